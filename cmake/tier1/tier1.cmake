@@ -110,6 +110,7 @@ set(
 	"${SRCDIR}/public/tier1/utlmultilist.h"
 	"${SRCDIR}/public/tier1/utlpriorityqueue.h"
 	"${SRCDIR}/public/tier1/utlqueue.h"
+	"${SRCDIR}/public/tier1/utlradixsort.h"
 	"${SRCDIR}/public/tier1/utlrbtree.h"
 	"${SRCDIR}/public/tier1/UtlSortVector.h"
 	"${SRCDIR}/public/tier1/utlstack.h"
@@ -6634,7 +6634,7 @@ END_MAPENTITY()
 
 void C_BaseEntity::SetClassname( const char *className )
 {
-	m_iClassname = AllocPooledString( className );
+	m_iClassname = AllocPooledString_Persistent( className );
 }
 
 //-----------------------------------------------------------------------------
@@ -746,7 +746,7 @@ void C_LocalTempEntity::OnRemoveTempEntity()
 // Purpose: 
 //-----------------------------------------------------------------------------
 CTempEnts::CTempEnts( void ) :
-	m_TempEntsPool( ( MAX_TEMP_ENTITIES / 20 ), CUtlMemoryPool::GROW_SLOW )
+	m_TempEntsPool( ( MAX_TEMP_ENTITIES / 20 ), UTLMEMORYPOOL_GROW_SLOW )
 {
 }
 
@@ -755,6 +755,12 @@ CTempEnts::CTempEnts( void ) :
 //-----------------------------------------------------------------------------
 CTempEnts::~CTempEnts( void )
 {
+	// The slab pool can't destruct what's still live, free it first
+	FOR_EACH_LL( m_TempEnts, i )
+	{
+		m_TempEntsPool.Free( m_TempEnts[ i ] );
+	}
+
 	m_TempEntsPool.Clear();
 	m_TempEnts.RemoveAll();
 }
@@ -138,7 +138,7 @@ class CTempEnts : public ITempEnts
 
 private:
 	// Global temp entity pool
-	CClassMemoryPool< C_LocalTempEntity >	m_TempEntsPool;
+	CClassMemoryPoolSlab< C_LocalTempEntity >	m_TempEntsPool;
 	CUtlLinkedList< C_LocalTempEntity *, unsigned short >	m_TempEnts;
 
 	// Muzzle flash sprites
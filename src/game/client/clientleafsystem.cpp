@@ -20,6 +20,7 @@
 #include "engine/ivdebugoverlay.h"
 #include "vstdlib/jobthread.h"
 #include "tier1/utllinkedlist.h"
+#include "tier1/utlradixsort.h"
 #include "datacache/imdlcache.h"
 #include "view.h"
 #include "iviewrender.h"
@@ -2872,31 +2873,61 @@ void CClientLeafSystem::SortEntities( const Vector &vecRenderOrigin, const Vecto
 		dists[i] = DotProduct( delta, vecRenderForward );
 	}
 
-	// H-sort.
-	int stepSize = 4;
-	while( stepSize )
+	// Radix sort on the distances, then apply the permutation.
+	CUtlRadixSort sorter;
+	const int *pOrder = sorter.SortFloats( dists, nEntities );
+
+	CUtlVectorFixedGrowable< CClientRenderablesList::CEntry, 256 > unsorted;
+	unsorted.CopyArray( pEntities, nEntities );
+	for( i=0; i < nEntities; i++ )
 	{
-		int end = nEntities - stepSize;
-		for( i=0; i < end; i += stepSize )
-		{
-			if( dists[i] > dists[i+stepSize] )
-			{
-				::V_swap( pEntities[i], pEntities[i+stepSize] );
-				::V_swap( dists[i], dists[i+stepSize] );
+		pEntities[i] = unsorted[ pOrder[i] ];
+	}
+}
 
-				if( i == 0 )
-				{
-					i = -stepSize;
-				}
-				else
-				{
-					i -= stepSize << 1;
-				}
-			}
-		}
+//-----------------------------------------------------------------------------
+// Measures CUtlRadixSort throughput against qsort on random depth keys
+//-----------------------------------------------------------------------------
+static int RadixSortBenchmarkCompare( const void *a, const void *b )
+{
+	float flA = *(const float *)a;
+	float flB = *(const float *)b;
+	return ( flA < flB ) ? -1 : ( ( flA > flB ) ? 1 : 0 );
+}
 
-		stepSize >>= 1;
+CON_COMMAND_F( cl_radixsort_benchmark, "Benchmark the depth radix sort. Usage: cl_radixsort_benchmark [elements] [iterations]", FCVAR_CHEAT )
+{
+	int nElements = ( args.ArgC() > 1 ) ? MAX( atoi( args[1] ), 1 ) : 10000;
+	int nIterations = ( args.ArgC() > 2 ) ? MAX( atoi( args[2] ), 1 ) : 100;
+
+	CUtlVector< float > keys;
+	CUtlVector< float > work;
+	keys.SetCount( nElements );
+	for ( int i = 0; i < nElements; ++i )
+	{
+		keys[i] = RandomFloat( -4096.0f, 4096.0f );
 	}
+
+	double flStart = Plat_FloatTime();
+	for ( int nIter = 0; nIter < nIterations; ++nIter )
+	{
+		work.CopyArray( keys.Base(), nElements );
+		qsort( work.Base(), nElements, sizeof( float ), RadixSortBenchmarkCompare );
+	}
+	double flQSortTime = Plat_FloatTime() - flStart;
+
+	CUtlRadixSort sorter;
+	flStart = Plat_FloatTime();
+	for ( int nIter = 0; nIter < nIterations; ++nIter )
+	{
+		sorter.SortFloats( keys.Base(), nElements );
+	}
+	double flRadixTime = Plat_FloatTime() - flStart;
+
+	double flTotal = (double)nElements * nIterations;
+	Msg( "%d elements x %d iterations\n", nElements, nIterations );
+	Msg( "  qsort: %8.3f ms (%.0f elements/ms)\n", flQSortTime * 1000.0, flTotal / MAX( flQSortTime * 1000.0, 1e-6 ) );
+	Msg( "  radix: %8.3f ms (%.0f elements/ms)\n", flRadixTime * 1000.0, flTotal / MAX( flRadixTime * 1000.0, 1e-6 ) );
 }
 
 int CClientLeafSystem::ExtractStaticProps( int nCount, RenderableInfoAndHandle_t *ppRenderables )
@@ -121,6 +121,17 @@ struct SpriteInfo_t
 	float16			m_flScale;
 };
 
+//-----------------------------------------------------------------------------
+// Geometry of a sprite that never sways, avoids players or turns towards the
+// view; built once per level so drawing it is just a copy plus color.
+//-----------------------------------------------------------------------------
+struct DetailSpriteStaticVerts_t
+{
+	Vector		m_Pos[4];
+	Vector2D	m_TexCoord[4];
+	Vector		m_Normal;
+};
+
 static void DrawMeshCallback( void *pMesh )
 {
 	((IMesh *)pMesh)->Draw();
@@ -230,6 +241,11 @@ class CDetailModel : public IDetailModel
 
 	// Draw functions for the different types of sprite
 	void DrawTypeSprite( CMeshBuilder &meshBuilder, uint8 nAlpha );
+	void DrawTypeSpriteStatic( CMeshBuilder &meshBuilder, uint8 nAlpha, const DetailSpriteStaticVerts_t &verts );
+
+	// Sprites whose quads don't change from frame to frame
+	bool HasStaticGeometry() const;
+	void BuildStaticSpriteVerts( DetailSpriteStaticVerts_t &verts );
 
 	void DrawTypeShapeCross( CMeshBuilder &meshBuilder, uint8 nAlpha );
 	void DrawTypeShapeTri( CMeshBuilder &meshBuilder, uint8 nAlpha );
@@ -509,6 +525,12 @@ class CDetailObjectSystem : public IDetailObjectSystem, public ISpatialLeafEnume
 
 	void FreeSortBuffers( void );
 
+	// Builds the per level SIMD origin arrays and static sprite geometry
+	void BuildStaticDetailData();
+
+	// Draws a sprite, using its static geometry if it has any
+	void DrawDetailSprite( int nIndex, CMeshBuilder &meshBuilder, uint8 nAlpha );
+
 	// Sorts sprites in back-to-front order
 	static bool SortLessFunc( const SortInfo_t &left, const SortInfo_t &right );
 	int SortSpritesBackToFront( int nLeaf, const Vector &viewOrigin, const Vector &viewForward, const DistanceFadeInfo_t &fadeInfo, SortInfo_t *pSortInfo );
@@ -523,6 +545,15 @@ class CDetailObjectSystem : public IDetailObjectSystem, public ISpatialLeafEnume
 	CUtlVector<DetailPropLightstylesLump_t>	m_DetailLighting;
 	FastSpriteX4_t *m_pFastSpriteData;
 
+	// Detail object origins split into components for the SIMD fade, padded to a multiple of 4
+	CUtlVector<float>						m_DetailOriginX;
+	CUtlVector<float>						m_DetailOriginY;
+	CUtlVector<float>						m_DetailOriginZ;
+
+	// Prebuilt sprite geometry, indexed through m_StaticSpriteVertsIndex (-1 = built every frame)
+	CUtlVector<DetailSpriteStaticVerts_t>	m_StaticSpriteVerts;
+	CUtlVector<int>							m_StaticSpriteVertsIndex;
+
 	// Necessary to get sprites to batch correctly
 	CMaterialReference m_DetailSpriteMaterial;
 	CMaterialReference m_DetailWireframeMaterial;
@@ -1129,6 +1160,89 @@ void CDetailModel::DrawTypeSprite( CMeshBuilder &meshBuilder, uint8 nAlpha  )
 	meshBuilder.AdvanceVertex();
 }
 
+//-----------------------------------------------------------------------------
+// Sprites without advanced info never sway or avoid players, so unless they
+// have to face the view their quads are fixed for the whole level
+//-----------------------------------------------------------------------------
+bool CDetailModel::HasStaticGeometry() const
+{
+	return ( m_Type == DETAIL_PROP_TYPE_SPRITE ) && ( m_Orientation == 0 ) && !m_pAdvInfo;
+}
+
+//-----------------------------------------------------------------------------
+// Same quad DrawTypeSprite emits, minus the sway
+//-----------------------------------------------------------------------------
+void CDetailModel::BuildStaticSpriteVerts( DetailSpriteStaticVerts_t &verts )
+{
+	Assert( HasStaticGeometry() );
+
+	DetailPropSpriteDict_t &dict = s_DetailObjectSystem.DetailSpriteDict( m_SpriteInfo.m_nSpriteIndex );
+
+	Vector vecOrigin, dx, dy, dz;
+	AngleVectors( m_Angles, &dz, &dx, &dy );
+
+	Vector2D ul, lr;
+	float scale = m_SpriteInfo.m_flScale.GetFloat();
+	Vector2DMultiply( dict.m_UL, scale, ul );
+	Vector2DMultiply( dict.m_LR, scale, lr );
+
+	VectorMA( m_Origin, ul.x, dx, vecOrigin );
+	VectorMA( vecOrigin, ul.y, dy, vecOrigin );
+	dx *= (lr.x - ul.x);
+	dy *= (lr.y - ul.y);
+
+	Vector2D texul, texlr;
+	texul = dict.m_TexUL;
+	texlr = dict.m_TexLR;
+
+	if ( !m_bFlipped )
+	{
+		texul.x = dict.m_TexLR.x;
+		texlr.x = dict.m_TexUL.x;
+	}
+
+	verts.m_Normal = dz;
+
+	verts.m_Pos[0] = vecOrigin;
+	verts.m_TexCoord[0] = texul;
+
+	vecOrigin += dy;
+	verts.m_Pos[1] = vecOrigin;
+	verts.m_TexCoord[1].Init( texul.x, texlr.y );
+
+	vecOrigin += dx;
+	verts.m_Pos[2] = vecOrigin;
+	verts.m_TexCoord[2] = texlr;
+
+	vecOrigin -= dy;
+	verts.m_Pos[3] = vecOrigin;
+	verts.m_TexCoord[3].Init( texlr.x, texul.y );
+}
+
+//-----------------------------------------------------------------------------
+// Draws a sprite from its prebuilt geometry, only the color is per frame
+//-----------------------------------------------------------------------------
+void CDetailModel::DrawTypeSpriteStatic( CMeshBuilder &meshBuilder, uint8 nAlpha, const DetailSpriteStaticVerts_t &verts )
+{
+	Vector vecColor;
+	GetColorModulation( vecColor.Base() );
+
+	unsigned char color[4];
+	color[0] = (unsigned char)(vecColor[0] * 255.0f);
+	color[1] = (unsigned char)(vecColor[1] * 255.0f);
+	color[2] = (unsigned char)(vecColor[2] * 255.0f);
+	color[3] = nAlpha;
+
+	for ( int i = 0; i < 4; ++i )
+	{
+		meshBuilder.Position3fv( verts.m_Pos[i].Base() );
+		meshBuilder.Color4ubv( color );
+		meshBuilder.TexCoord2fv( 0, verts.m_TexCoord[i].Base() );
+		meshBuilder.Normal3fv( verts.m_Normal.Base() );
+		meshBuilder.AdvanceVertex();
+	}
+}
+
 //-----------------------------------------------------------------------------
 // draws a procedural model, cross shape
 // two perpendicular sprites
@@ -1579,9 +1693,70 @@ void CDetailObjectSystem::LevelInitPostEntity()
 		}
 	}
 
+	BuildStaticDetailData();
+
 	UpdateDetailFadeValues();
 }
 
+//-----------------------------------------------------------------------------
+// Lays out the per level data the renderer reuses every frame: origins in
+// SIMD friendly arrays, and the quads of sprites that never move.
+// Objects are stored per leaf, so both end up contiguous per leaf as well.
+// Leaves start anywhere in the arrays and are read four at a time, so the
+// origins get three entries of slack past the last object.
+//-----------------------------------------------------------------------------
+void CDetailObjectSystem::BuildStaticDetailData()
+{
+	int nCount = m_DetailObjects.Count();
+	int nPaddedCount = nCount + 3;
+
+	m_DetailOriginX.SetCount( nPaddedCount );
+	m_DetailOriginY.SetCount( nPaddedCount );
+	m_DetailOriginZ.SetCount( nPaddedCount );
+	m_StaticSpriteVertsIndex.SetCount( nCount );
+	m_StaticSpriteVerts.RemoveAll();
+
+	for ( int i = 0; i < nCount; ++i )
+	{
+		CDetailModel &model = m_DetailObjects[i];
+
+		const Vector &vecOrigin = model.GetRenderOrigin();
+		m_DetailOriginX[i] = vecOrigin.x;
+		m_DetailOriginY[i] = vecOrigin.y;
+		m_DetailOriginZ[i] = vecOrigin.z;
+
+		m_StaticSpriteVertsIndex[i] = -1;
+		if ( model.HasStaticGeometry() )
+		{
+			m_StaticSpriteVertsIndex[i] = m_StaticSpriteVerts.AddToTail();
+			model.BuildStaticSpriteVerts( m_StaticSpriteVerts.Tail() );
+		}
+	}
+
+	// Park the slack far away so it always fades out, but keep it finite
+	for ( int i = nCount; i < nPaddedCount; ++i )
+	{
+		m_DetailOriginX[i] = m_DetailOriginY[i] = m_DetailOriginZ[i] = 1.0e15f;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Draws a sprite, using its static geometry if it has any
+//-----------------------------------------------------------------------------
+void CDetailObjectSystem::DrawDetailSprite( int nIndex, CMeshBuilder &meshBuilder, uint8 nAlpha )
+{
+	CDetailModel &model = m_DetailObjects[nIndex];
+	int nStaticIndex = m_StaticSpriteVertsIndex.IsValidIndex( nIndex ) ? m_StaticSpriteVertsIndex[nIndex] : -1;
+	if ( nStaticIndex >= 0 )
+	{
+		model.DrawTypeSpriteStatic( meshBuilder, nAlpha, m_StaticSpriteVerts[nStaticIndex] );
+	}
+	else
+	{
+		model.DrawSprite( meshBuilder, nAlpha );
+	}
+}
+
 void CDetailObjectSystem::LevelShutdownPreEntity()
 {
 	m_DetailObjects.Purge();
@@ -1589,6 +1764,11 @@ void CDetailObjectSystem::LevelShutdownPreEntity()
 	m_DetailSpriteDict.Purge();
 	m_DetailSpriteDictFlipped.Purge();
 	m_DetailLighting.Purge();
+	m_DetailOriginX.Purge();
+	m_DetailOriginY.Purge();
+	m_DetailOriginZ.Purge();
+	m_StaticSpriteVerts.Purge();
+	m_StaticSpriteVertsIndex.Purge();
 	m_DetailSpriteMaterial.Shutdown();
 	if ( m_pFastSpriteData )
 	{
@@ -2165,31 +2345,63 @@ int CDetailObjectSystem::SortSpritesBackToFront( int nLeaf, const Vector &viewOr
 	}
 	float flFalloffFactor = 255.0f / (flMaxSqDist - flFadeSqDist);
 
-	Vector vecDelta;
+	// Same math as ComputeDistanceFade, four objects at a time
+	fltx4 fl4ViewX = ReplicateX4( viewOrigin.x );
+	fltx4 fl4ViewY = ReplicateX4( viewOrigin.y );
+	fltx4 fl4ViewZ = ReplicateX4( viewOrigin.z );
+	fltx4 fl4MaxDistSqr = ReplicateX4( fadeInfo.m_flMaxDistSqr );
+	fltx4 fl4MinDistSqr = ReplicateX4( fadeInfo.m_flMinDistSqr );
+	fltx4 fl4Falloff = ReplicateX4( 255.0f * fadeInfo.m_flFalloffFactor );
+	fltx4 fl4Opaque = ReplicateX4( 255.0f );
+
+	ALIGN16 float flDistSqr[4] ALIGN16_POST;
+	ALIGN16 float flAlpha[4] ALIGN16_POST;
+
 	int nCount = 0;
 	nDetailObjectCount += nFirstDetailObject;
-	for ( int j = nFirstDetailObject; j < nDetailObjectCount; ++j )
+	Assert( nDetailObjectCount <= m_DetailOriginX.Count() );
+	for ( int j = nFirstDetailObject; j < nDetailObjectCount; j += 4 )
 	{
-		CDetailModel &model = m_DetailObjects[j];
+		Assert( j + 3 < m_DetailOriginX.Count() );
+		fltx4 fl4DeltaX = SubSIMD( LoadUnalignedSIMD( &m_DetailOriginX[j] ), fl4ViewX );
+		fltx4 fl4DeltaY = SubSIMD( LoadUnalignedSIMD( &m_DetailOriginY[j] ), fl4ViewY );
+		fltx4 fl4DeltaZ = SubSIMD( LoadUnalignedSIMD( &m_DetailOriginZ[j] ), fl4ViewZ );
+		fltx4 fl4DistSqr = AddSIMD( AddSIMD( MulSIMD( fl4DeltaX, fl4DeltaX ), MulSIMD( fl4DeltaY, fl4DeltaY ) ), MulSIMD( fl4DeltaZ, fl4DeltaZ ) );
 
-		if ( model.GetType() == DETAIL_PROP_TYPE_MODEL )
+		int nVisibleMask = TestSignSIMD( CmpLtSIMD( fl4DistSqr, fl4MaxDistSqr ) );
+		if ( !nVisibleMask )
 			continue;
 
-		float flSqDist;
-		uint8 nAlpha = ComputeDistanceFade( &flSqDist, fadeInfo, viewOrigin, model.GetRenderOrigin() );
-		if ( nAlpha == 0 )
-			continue;
+		fltx4 fl4Alpha = MulSIMD( fl4Falloff, SubSIMD( fl4MaxDistSqr, fl4DistSqr ) );
+		fl4Alpha = MaskedAssign( CmpGtSIMD( fl4DistSqr, fl4MinDistSqr ), fl4Alpha, fl4Opaque );
+		StoreAlignedSIMD( flDistSqr, fl4DistSqr );
+		StoreAlignedSIMD( flAlpha, fl4Alpha );
 
-		// Perform screen alignment if necessary.
-		model.ComputeAngles();
-		SortInfo_t *pSortInfoCurrent = &pSortInfo[nCount];
+		int nLanes = MIN( 4, nDetailObjectCount - j );
+		for ( int nLane = 0; nLane < nLanes; ++nLane )
+		{
+			if ( !( nVisibleMask & ( 1 << nLane ) ) )
+				continue;
 
-		pSortInfoCurrent->m_nIndex = j;
-		pSortInfoCurrent->m_nAlpha = nAlpha;
+			CDetailModel &model = m_DetailObjects[j + nLane];
+			if ( model.GetType() == DETAIL_PROP_TYPE_MODEL )
+				continue;
 
-		// Compute distance from the camera to each object
-		pSortInfoCurrent->m_flDistance = flSqDist;
-		++nCount;
+			uint8 nAlpha = flAlpha[nLane];
+			if ( nAlpha == 0 )
+				continue;
+
+			// Perform screen alignment if necessary.
+			model.ComputeAngles();
+			SortInfo_t *pSortInfoCurrent = &pSortInfo[nCount];
+
+			pSortInfoCurrent->m_nIndex = j + nLane;
+			pSortInfoCurrent->m_nAlpha = nAlpha;
+
+			// Compute distance from the camera to each object
+			pSortInfoCurrent->m_flDistance = flDistSqr[nLane];
+			++nCount;
+		}
 	}
 
 	if ( nCount )
@@ -2564,7 +2776,7 @@ void CDetailObjectSystem::RenderTranslucentDetailObjects( const DistanceFadeInfo
 				nQuadsDrawn = 0;
 			}
 
-			model.DrawSprite( meshBuilder, pSortInfo[j].m_nAlpha );
+			DrawDetailSprite( pSortInfo[j].m_nIndex, meshBuilder, pSortInfo[j].m_nAlpha );
 
 			nQuadsDrawn += nQuadsInModel;
 		}
@@ -2837,7 +3049,7 @@ void CDetailObjectSystem::RenderTranslucentDetailObjectsInLeaf( const DistanceFa
 			nQuadsDrawn = 0;
 		}
 
-		model.DrawSprite( meshBuilder, m_pSortInfo[m_nFirstSprite].m_nAlpha );
+		DrawDetailSprite( m_pSortInfo[m_nFirstSprite].m_nIndex, meshBuilder, m_pSortInfo[m_nFirstSprite].m_nAlpha );
 		++m_nFirstSprite;
 		nQuadsDrawn += nQuadsInModel;
 	}
@@ -21,6 +21,7 @@
 #include "KeyValues.h"
 #include "particles/particles.h"							// get new particle system access
 #include "tier1/utlintrusivelist.h"
+#include "tier1/utlradixsort.h"
 #include "particles_new.h"
 #include "vstdlib/jobthread.h"
 #include "filesystem.h"
@@ -77,6 +78,9 @@ static ConVar cl_particle_stats_trigger_count( "cl_particle_stats_trigger_count"
 
 #define PARTICLE_SIZE	96
 
+// Every particle is the same size, AddParticle clamps them
+static CMemoryPoolSlab g_ParticlePool( PARTICLE_SIZE, 1024, UTLMEMORYPOOL_GROW_FAST, "CParticleMgr particles", 16 );
+
 CParticleMgr *ParticleMgr()
 {
 	static CParticleMgr s_ParticleMgr;
@@ -871,55 +875,33 @@ void CParticleEffectBinding::RenderEnd( VMatrix &tempModel, VMatrix &tempView )
 
 void CParticleEffectBinding::DoBucketSort( CEffectMaterial *pMaterial, float *zCoords, int nZCoords, float minZ, float maxZ )
 {
-	// Do an O(N) bucket sort. This helps the sort when there are lots of particles.
-	#define NUM_BUCKETS	32
-	Particle buckets[NUM_BUCKETS];
-	for( int iBucket=0; iBucket < NUM_BUCKETS; iBucket++ )
-	{
-		buckets[iBucket].m_pPrev = buckets[iBucket].m_pNext = &buckets[iBucket];
-	}
-	
-	// Sort into buckets.
-	int iCurParticle = 0;
-	Particle *pNext, *pCur;
-	for( pCur=pMaterial->m_Particles.m_pNext; pCur != &pMaterial->m_Particles; pCur=pNext )
-	{
-		pNext = pCur->m_pNext;
-		if( iCurParticle >= nZCoords )
-			break;
-
-		// Remove it..
-		UnlinkParticle( pCur );
-
-		// Add it to the appropriate bucket.
-		float flPercent;
-		if (maxZ == minZ)
-			flPercent = 0;
-		else
-			flPercent = (zCoords[iCurParticle] - minZ) / (maxZ - minZ);
-
-		int iAddBucket = (int)( flPercent * (NUM_BUCKETS - 0.0001f) );
-		iAddBucket = NUM_BUCKETS - iAddBucket - 1;
-		Assert( iAddBucket >= 0 && iAddBucket < NUM_BUCKETS );
+	// Quantize the z range seen this frame to 16 bits and radix sort it. The sort is
+	// stable, so particles at the same depth keep their current order.
+	uint32 nKeys[MAX_TOTAL_PARTICLES];
+	Particle *pParticles[MAX_TOTAL_PARTICLES];
 
-		InsertParticleAfter( pCur, &buckets[iAddBucket] );
+	float flScale = ( maxZ > minZ ) ? ( 65535.0f / ( maxZ - minZ ) ) : 0.0f;
 
-		++iCurParticle;
+	int nSorted = 0;
+	for( Particle *pCur=pMaterial->m_Particles.m_pNext; pCur != &pMaterial->m_Particles && nSorted < nZCoords; pCur=pCur->m_pNext )
+	{
+		float flKey = clamp( ( zCoords[nSorted] - minZ ) * flScale, 0.0f, 65535.0f );
+		nKeys[nSorted] = (uint32)flKey;
+		pParticles[nSorted] = pCur;
+		++nSorted;
 	}
 
-	// Put the buckets back into the main list.
-	for( int iReAddBucket=0; iReAddBucket < NUM_BUCKETS; iReAddBucket++ )
+	CUtlRadixSort sorter;
+	const int *pOrder = sorter.SortKeys( nKeys, nSorted, 16 );
+
+	// Relink back to front so the smallest z ends up at the head of the list, same as the
+	// old bucket sort. Any particles past nZCoords stay at the end, unsorted.
+	for( int i = nSorted - 1; i >= 0; --i )
 	{
-		Particle *pListHead = &buckets[iReAddBucket];
-		for( pCur=pListHead->m_pNext; pCur != pListHead; pCur=pNext )
-		{
-			pNext = pCur->m_pNext;
-			InsertParticleAfter( pCur, &pMaterial->m_Particles );
-			--iCurParticle;
-		}
+		Particle *pCur = pParticles[ pOrder[i] ];
+		UnlinkParticle( pCur );
+		InsertParticleAfter( pCur, &pMaterial->m_Particles );
 	}
-
-	Assert(iCurParticle==0);
 }
 
 
@@ -1152,7 +1134,8 @@ Particle *CParticleMgr::AllocParticle( int size )
 	if ( m_nCurrentParticlesAllocated >= MAX_TOTAL_PARTICLES )
 		return NULL;
 		
-	Particle *pRet = (Particle *)malloc( size );
+	Assert( size <= PARTICLE_SIZE );
+	Particle *pRet = (Particle *)g_ParticlePool.Alloc( size );
 	if ( pRet )
 		++m_nCurrentParticlesAllocated;
 
@@ -1165,7 +1148,7 @@ void CParticleMgr::FreeParticle( Particle *pParticle )
 	if ( pParticle )
 		--m_nCurrentParticlesAllocated;
 	
-	free( pParticle );
+	g_ParticlePool.Free( pParticle );
 }
 
 
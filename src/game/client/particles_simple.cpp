@@ -11,11 +11,14 @@
 #include "toolframework_client.h"
 #include "toolframework/itoolframework.h"
 #include "vstdlib/IKeyValuesSystem.h"
+#include "mathlib/ssemath.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
 
+static ConVar cl_particle_batch_simulate( "cl_particle_batch_simulate", "1", FCVAR_NONE, "Simulate simple emitter particles in SIMD blocks instead of one at a time." );
+
 // Used for debugging to make sure all particle effects get freed when we exit.
 CUtlLinkedList<CParticleEffect*,int> g_ParticleEffects;
 class CEffectChecker
@@ -223,6 +226,7 @@ CSimpleEmitter::CSimpleEmitter( const char *pDebugName ) : CParticleEffect( pDeb
 {
 	m_flNearClipMin	= 16.0f;
 	m_flNearClipMax	= 64.0f;
+	m_bBatchSimulate = false;
 }
 
 
@@ -234,6 +238,7 @@ CSmartPtr<CSimpleEmitter> CSimpleEmitter::Create( const char *pDebugName )
 {
 	CSimpleEmitter *pRet = new CSimpleEmitter( pDebugName );
 	pRet->SetDynamicallyAllocated( true );
+	pRet->SetBatchSimulate( true );
 	return pRet;
 }
 
@@ -360,8 +365,142 @@ Vector CSimpleEmitter::UpdateColor( const SimpleParticle *pParticle )
 	return cColor;
 }
 
+//-----------------------------------------------------------------------------
+// Batched simulation. Particles are gathered from the material's list into a
+// structure-of-arrays block, integrated four at a time, and scattered back.
+// Dead particles are collected and removed once the block has been simulated.
+//-----------------------------------------------------------------------------
+#define SIMPLE_PARTICLE_BLOCK_SIZE	256
+
+struct SimpleParticleBlock_t
+{
+	fltx4	m_Pos[3][SIMPLE_PARTICLE_BLOCK_SIZE / 4];
+	fltx4	m_Vel[3][SIMPLE_PARTICLE_BLOCK_SIZE / 4];
+	fltx4	m_Roll[SIMPLE_PARTICLE_BLOCK_SIZE / 4];
+	fltx4	m_RollDelta[SIMPLE_PARTICLE_BLOCK_SIZE / 4];
+	fltx4	m_Lifetime[SIMPLE_PARTICLE_BLOCK_SIZE / 4];
+	fltx4	m_DieTime[SIMPLE_PARTICLE_BLOCK_SIZE / 4];
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Integrates position, roll and age of a block of particles, the same
+//			way the scalar loop in CSimpleEmitter::SimulateParticles does.
+// Output : Number of indices written to pDeadIndices (in ascending order).
+//-----------------------------------------------------------------------------
+static int SimulateSimpleParticleBlock( SimpleParticle **ppParticles, int nCount, float flTimeDelta, int *pDeadIndices )
+{
+	Assert( nCount <= SIMPLE_PARTICLE_BLOCK_SIZE );
+
+	SimpleParticleBlock_t block;
+	float *pPosX = (float *)block.m_Pos[0];
+	float *pPosY = (float *)block.m_Pos[1];
+	float *pPosZ = (float *)block.m_Pos[2];
+	float *pVelX = (float *)block.m_Vel[0];
+	float *pVelY = (float *)block.m_Vel[1];
+	float *pVelZ = (float *)block.m_Vel[2];
+	float *pRoll = (float *)block.m_Roll;
+	float *pRollDelta = (float *)block.m_RollDelta;
+	float *pLifetime = (float *)block.m_Lifetime;
+	float *pDieTime = (float *)block.m_DieTime;
+
+	int i;
+	for ( i = 0; i < nCount; ++i )
+	{
+		const SimpleParticle *pParticle = ppParticles[i];
+		pPosX[i] = pParticle->m_Pos.x;
+		pPosY[i] = pParticle->m_Pos.y;
+		pPosZ[i] = pParticle->m_Pos.z;
+		pVelX[i] = pParticle->m_vecVelocity.x;
+		pVelY[i] = pParticle->m_vecVelocity.y;
+		pVelZ[i] = pParticle->m_vecVelocity.z;
+		pRoll[i] = pParticle->m_flRoll;
+		pRollDelta[i] = pParticle->m_flRollDelta;
+		pLifetime[i] = pParticle->m_flLifetime;
+		pDieTime[i] = pParticle->m_flDieTime;
+	}
+
+	// Pad out the last group of four with particles that never die.
+	int nPadded = ( nCount + 3 ) & ~3;
+	for ( ; i < nPadded; ++i )
+	{
+		pPosX[i] = pPosY[i] = pPosZ[i] = 0.0f;
+		pVelX[i] = pVelY[i] = pVelZ[i] = 0.0f;
+		pRoll[i] = pRollDelta[i] = 0.0f;
+		pLifetime[i] = 0.0f;
+		pDieTime[i] = FLT_MAX;
+	}
+
+	fltx4 fl4TimeDelta = ReplicateX4( flTimeDelta );
+	int nDead = 0;
+	for ( int nGroup = 0; nGroup < nPadded / 4; ++nGroup )
+	{
+		block.m_Pos[0][nGroup] = AddSIMD( block.m_Pos[0][nGroup], MulSIMD( block.m_Vel[0][nGroup], fl4TimeDelta ) );
+		block.m_Pos[1][nGroup] = AddSIMD( block.m_Pos[1][nGroup], MulSIMD( block.m_Vel[1][nGroup], fl4TimeDelta ) );
+		block.m_Pos[2][nGroup] = AddSIMD( block.m_Pos[2][nGroup], MulSIMD( block.m_Vel[2][nGroup], fl4TimeDelta ) );
+		block.m_Lifetime[nGroup] = AddSIMD( block.m_Lifetime[nGroup], fl4TimeDelta );
+		block.m_Roll[nGroup] = AddSIMD( block.m_Roll[nGroup], MulSIMD( block.m_RollDelta[nGroup], fl4TimeDelta ) );
+
+		int nDeadMask = TestSignSIMD( CmpGeSIMD( block.m_Lifetime[nGroup], block.m_DieTime[nGroup] ) );
+		for ( int nLane = 0; nDeadMask; ++nLane, nDeadMask >>= 1 )
+		{
+			if ( nDeadMask & 1 )
+			{
+				pDeadIndices[nDead++] = nGroup * 4 + nLane;
+			}
+		}
+	}
+
+	for ( i = 0; i < nCount; ++i )
+	{
+		SimpleParticle *pParticle = ppParticles[i];
+		pParticle->m_Pos.Init( pPosX[i], pPosY[i], pPosZ[i] );
+		pParticle->m_flRoll = pRoll[i];
+		pParticle->m_flLifetime = pLifetime[i];
+	}
+
+	return nDead;
+}
+
+void CSimpleEmitter::SimulateParticlesBatched( CParticleSimulateIterator *pIterator )
+{
+	float timeDelta = pIterator->GetTimeDelta();
+
+	SimpleParticle *ppBlock[SIMPLE_PARTICLE_BLOCK_SIZE];
+	int pDeadIndices[SIMPLE_PARTICLE_BLOCK_SIZE];
+
+	SimpleParticle *pParticle = (SimpleParticle*)pIterator->GetFirst();
+	while ( pParticle )
+	{
+		int nCount = 0;
+		while ( pParticle && nCount < SIMPLE_PARTICLE_BLOCK_SIZE )
+		{
+			// Wind needs a per-particle lookup, do it before the velocity gets gathered
+			if ( pParticle->m_iFlags & SIMPLE_PARTICLE_FLAG_WINDBLOWN )
+			{
+				CSimpleEmitter::UpdateVelocity( pParticle, timeDelta );
+			}
+
+			ppBlock[nCount++] = pParticle;
+			pParticle = (SimpleParticle*)pIterator->GetNext();
+		}
+
+		// The iterator has already moved past every particle in the block, so they're safe to remove.
+		int nDead = SimulateSimpleParticleBlock( ppBlock, nCount, timeDelta, pDeadIndices );
+		for ( int i = 0; i < nDead; ++i )
+		{
+			pIterator->RemoveParticle( ppBlock[ pDeadIndices[i] ] );
+		}
+	}
+}
+
 void CSimpleEmitter::SimulateParticles( CParticleSimulateIterator *pIterator )
 {
+	if ( m_bBatchSimulate && cl_particle_batch_simulate.GetBool() )
+	{
+		SimulateParticlesBatched( pIterator );
+		return;
+	}
+
 	float timeDelta = pIterator->GetTimeDelta();
 
 	SimpleParticle *pParticle = (SimpleParticle*)pIterator->GetFirst();
@@ -416,6 +555,93 @@ void CSimpleEmitter::SetDrawBeforeViewModel( bool state )
 	m_ParticleEffect.SetDrawBeforeViewModel( state );
 }
 
+
+//-----------------------------------------------------------------------------
+// Compares the scalar linked-list simulation against the SIMD block path on a
+// synthetic set of particles linked in random order.
+//-----------------------------------------------------------------------------
+CON_COMMAND_F( cl_particle_simulate_benchmark, "Benchmark simple particle simulation. Usage: cl_particle_simulate_benchmark [particles] [iterations]", FCVAR_CHEAT )
+{
+	int nParticles = ( args.ArgC() > 1 ) ? MAX( atoi( args[1] ), 1 ) : 10000;
+	int nIterations = ( args.ArgC() > 2 ) ? MAX( atoi( args[2] ), 1 ) : 100;
+	const float flTimeDelta = 1.0f / 60.0f;
+
+	CUtlVector< SimpleParticle > particles;
+	particles.SetCount( nParticles );
+
+	CUtlVector< int > order;
+	order.SetCount( nParticles );
+	for ( int i = 0; i < nParticles; ++i )
+	{
+		order[i] = i;
+	}
+	for ( int i = nParticles - 1; i > 0; --i )
+	{
+		V_swap( order[i], order[ RandomInt( 0, i ) ] );
+	}
+
+	// Link in shuffled order, like particles allocated over time out of the particle pool.
+	Particle head;
+	head.m_pPrev = head.m_pNext = &head;
+	for ( int i = 0; i < nParticles; ++i )
+	{
+		SimpleParticle *pParticle = &particles[ order[i] ];
+		pParticle->m_Pos.Random( -1024.0f, 1024.0f );
+		pParticle->m_vecVelocity.Random( -64.0f, 64.0f );
+		pParticle->m_flRoll = RandomFloat( 0.0f, 360.0f );
+		pParticle->m_flRollDelta = RandomFloat( -4.0f, 4.0f );
+		pParticle->m_flLifetime = 0.0f;
+		pParticle->m_flDieTime = FLT_MAX;
+
+		pParticle->m_pPrev = head.m_pPrev;
+		pParticle->m_pNext = &head;
+		head.m_pPrev->m_pNext = pParticle;
+		head.m_pPrev = pParticle;
+	}
+
+	double flStart = Plat_FloatTime();
+	int nScalarDead = 0;
+	for ( int nIter = 0; nIter < nIterations; ++nIter )
+	{
+		for ( Particle *pCur = head.m_pNext; pCur != &head; pCur = pCur->m_pNext )
+		{
+			SimpleParticle *pParticle = (SimpleParticle *)pCur;
+			pParticle->m_Pos += pParticle->m_vecVelocity * flTimeDelta;
+			pParticle->m_flLifetime += flTimeDelta;
+			pParticle->m_flRoll += pParticle->m_flRollDelta * flTimeDelta;
+			if ( pParticle->m_flLifetime >= pParticle->m_flDieTime )
+				++nScalarDead;
+		}
+	}
+	double flScalarTime = Plat_FloatTime() - flStart;
+
+	SimpleParticle *ppBlock[SIMPLE_PARTICLE_BLOCK_SIZE];
+	int pDeadIndices[SIMPLE_PARTICLE_BLOCK_SIZE];
+
+	flStart = Plat_FloatTime();
+	int nBatchedDead = 0;
+	for ( int nIter = 0; nIter < nIterations; ++nIter )
+	{
+		Particle *pCur = head.m_pNext;
+		while ( pCur != &head )
+		{
+			int nCount = 0;
+			for ( ; pCur != &head && nCount < SIMPLE_PARTICLE_BLOCK_SIZE; pCur = pCur->m_pNext )
+			{
+				ppBlock[nCount++] = (SimpleParticle *)pCur;
+			}
+			nBatchedDead += SimulateSimpleParticleBlock( ppBlock, nCount, flTimeDelta, pDeadIndices );
+		}
+	}
+	double flBatchedTime = Plat_FloatTime() - flStart;
+
+	double flTotal = (double)nParticles * nIterations;
+	Msg( "%d particles x %d iterations\n", nParticles, nIterations );
+	Msg( "  scalar:  %8.3f ms (%.0f particles/ms)\n", flScalarTime * 1000.0, flTotal / MAX( flScalarTime * 1000.0, 1e-6 ) );
+	Msg( "  batched: %8.3f ms (%.0f particles/ms)\n", flBatchedTime * 1000.0, flTotal / MAX( flBatchedTime * 1000.0, 1e-6 ) );
+	Assert( nScalarDead == 0 && nBatchedDead == 0 );
+}
+
 //==================================================
 // Particle Library
 //==================================================
@@ -515,6 +741,7 @@ CSmartPtr<CFireParticle> CFireParticle::Create( const char *pDebugName )
 {
 	CFireParticle *pRet = new CFireParticle( pDebugName );
 	pRet->SetDynamicallyAllocated( true );
+	pRet->SetBatchSimulate( true );
 	return pRet;
 }
 
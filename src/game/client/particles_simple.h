@@ -188,10 +188,18 @@ class CSimpleEmitter : public CParticleEffect
 	virtual	void	UpdateVelocity( SimpleParticle *pParticle, float timeDelta );
 	virtual Vector	UpdateColor( const SimpleParticle *pParticle );
 
+	// Set by Create() functions whose class doesn't override the simulation overridables
+	// (UpdateVelocity, UpdateRoll), allowing SimulateParticles to run the SIMD block path.
+	void			SetBatchSimulate( bool bBatch )	{ m_bBatchSimulate = bBatch; }
+
 	float			m_flNearClipMin;
 	float			m_flNearClipMax;
 
 private:
+	void			SimulateParticlesBatched( CParticleSimulateIterator *pIterator );
+
+	bool			m_bBatchSimulate;
+
 	CSimpleEmitter( const CSimpleEmitter & ); // not defined, not accessible
 };
 
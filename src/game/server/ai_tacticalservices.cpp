@@ -11,6 +11,7 @@
 #include "ai_moveprobe.h"
 #include "ai_pathfinder.h"
 #include "ai_navigator.h"
+#include "recast/recast_mesh.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -45,6 +46,240 @@ ConVar ai_debug_tactical_los( "ai_debug_tactical_los", "0" );
 #define ShouldDebugLos() false
 #endif
 
+
+//-----------------------------------------------------------------------------
+// Tactical query cache
+//
+// Cover, line of fire and back away searches all start from the same data: the
+// navmesh polys around a position, and whether each one can be seen from the
+// threat. The polys come from the local neighbourhood (so they are reachable),
+// the precomputed poly visibility settles the clear cut cases, and only the
+// ambiguous ones are traced, in one batch. Results are kept for a short time
+// keyed on the mesh, a threat cluster and a search cluster, so squad members
+// fighting the same enemy share the work. The shared traces ignore NPCs; the
+// spot an NPC finally picks is still confirmed with its own checks.
+//-----------------------------------------------------------------------------
+ConVar ai_tactical_query_cache_time( "ai_tactical_query_cache_time", "1.0", FCVAR_CHEAT, "How long shared cover/LOS query results stay valid" );
+ConVar ai_tactical_query_cluster_size( "ai_tactical_query_cluster_size", "128", FCVAR_CHEAT, "Threat and search positions within this grid size share query results" );
+ConVar ai_tactical_query_radius( "ai_tactical_query_radius", "1024", FCVAR_CHEAT, "Max search radius for line of fire and back away queries" );
+
+#define MAX_TACTICAL_CANDIDATES		RECASTMESH_MAX_POLYS
+#define MAX_TACTICAL_QUERIES		32
+
+struct TacticalCandidate_t
+{
+	Vector m_vPos;
+	bool m_bVisible;			// threat eye can see this spot's eye position
+	bool m_bEyeTraced;			// m_bVisible comes from an eye level trace, not the ground level precomputed visibility
+	bool m_bHidingSpot;
+	float m_flClaimedUntil;		// another NPC is moving here
+	int m_iClaimedBy;
+};
+
+struct TacticalQuery_t
+{
+	NavMeshType_t m_MeshType;
+	int m_ThreatKey[3];
+	int m_SearchKey[3];
+	int m_nRadiusKey;
+	int m_nEyeHeightKey;
+	float m_flEyeHeight;
+	float m_flExpireTime;
+	int m_nPrecomputed;		// candidates settled from the precomputed visibility
+	int m_nTraced;			// candidates needing a trace
+	CUtlVector< TacticalCandidate_t > m_Candidates;
+};
+
+class CAI_TacticalQueryCache : public CAutoGameSystem
+{
+public:
+	CAI_TacticalQueryCache() : CAutoGameSystem( "CAI_TacticalQueryCache" ) {}
+
+	virtual void LevelShutdownPreEntity() { m_Queries.PurgeAndDeleteElements(); }
+
+	TacticalQuery_t *Query( CRecastMesh *pMesh, const Vector &vThreatPos, const Vector &vThreatEyePos, const Vector &vSearchPos, float flRadius, float flEyeHeight );
+
+	int m_nHits;
+	int m_nMisses;
+
+private:
+	static void Quantize( const Vector &vPos, int *pKey )
+	{
+		float flSize = MAX( ai_tactical_query_cluster_size.GetFloat(), 1.0f );
+		pKey[0] = Floor2Int( vPos.x / flSize );
+		pKey[1] = Floor2Int( vPos.y / flSize );
+		pKey[2] = Floor2Int( vPos.z / flSize );
+	}
+
+	void Compute( TacticalQuery_t *pQuery, CRecastMesh *pMesh, const Vector &vThreatPos, const Vector &vThreatEyePos, const Vector &vSearchPos, float flRadius, float flEyeHeight );
+
+	CUtlVector< TacticalQuery_t * > m_Queries;
+};
+
+static CAI_TacticalQueryCache g_AITacticalQueryCache;
+
+TacticalQuery_t *CAI_TacticalQueryCache::Query( CRecastMesh *pMesh, const Vector &vThreatPos, const Vector &vThreatEyePos, const Vector &vSearchPos, float flRadius, float flEyeHeight )
+{
+	int threatKey[3], searchKey[3];
+	Quantize( vThreatEyePos, threatKey );
+	Quantize( vSearchPos, searchKey );
+	int nRadiusKey = Ceil2Int( flRadius / 64.0f );
+	int nEyeHeightKey = Floor2Int( flEyeHeight / 16.0f );
+
+	TacticalQuery_t *pFree = NULL;
+	FOR_EACH_VEC( m_Queries, i )
+	{
+		TacticalQuery_t *pQuery = m_Queries[i];
+		if ( pQuery->m_flExpireTime <= gpGlobals->curtime )
+		{
+			if ( !pFree )
+				pFree = pQuery;
+			continue;
+		}
+
+		if ( pQuery->m_MeshType == pMesh->GetType() && pQuery->m_nRadiusKey == nRadiusKey && pQuery->m_nEyeHeightKey == nEyeHeightKey &&
+			 !V_memcmp( pQuery->m_ThreatKey, threatKey, sizeof( threatKey ) ) && !V_memcmp( pQuery->m_SearchKey, searchKey, sizeof( searchKey ) ) )
+		{
+			m_nHits++;
+			return pQuery;
+		}
+	}
+
+	if ( !pFree )
+	{
+		if ( m_Queries.Count() < MAX_TACTICAL_QUERIES )
+		{
+			pFree = new TacticalQuery_t;
+			m_Queries.AddToTail( pFree );
+		}
+		else
+		{
+			// Everything is live, recycle the one closest to expiring
+			pFree = m_Queries[0];
+			FOR_EACH_VEC( m_Queries, i )
+			{
+				if ( m_Queries[i]->m_flExpireTime < pFree->m_flExpireTime )
+					pFree = m_Queries[i];
+			}
+		}
+	}
+
+	m_nMisses++;
+	pFree->m_MeshType = pMesh->GetType();
+	V_memcpy( pFree->m_ThreatKey, threatKey, sizeof( threatKey ) );
+	V_memcpy( pFree->m_SearchKey, searchKey, sizeof( searchKey ) );
+	pFree->m_nRadiusKey = nRadiusKey;
+	pFree->m_nEyeHeightKey = nEyeHeightKey;
+	pFree->m_flExpireTime = gpGlobals->curtime + ai_tactical_query_cache_time.GetFloat();
+	Compute( pFree, pMesh, vThreatPos, vThreatEyePos, vSearchPos, nRadiusKey * 64.0f, nEyeHeightKey * 16.0f );
+	return pFree;
+}
+
+void CAI_TacticalQueryCache::Compute( TacticalQuery_t *pQuery, CRecastMesh *pMesh, const Vector &vThreatPos, const Vector &vThreatEyePos, const Vector &vSearchPos, float flRadius, float flEyeHeight )
+{
+	AI_PROFILE_SCOPE( CAI_TacticalQueryCache_Compute );
+
+	pQuery->m_Candidates.RemoveAll();
+	pQuery->m_flEyeHeight = flEyeHeight;
+	pQuery->m_nPrecomputed = 0;
+	pQuery->m_nTraced = 0;
+
+	CRecastMesh::TacticalPoly_t polys[MAX_TACTICAL_CANDIDATES];
+	int nPolys = pMesh->GetTacticalPolys( vSearchPos, flRadius, pMesh->GetPolyRef( vThreatPos ), polys, ARRAYSIZE( polys ) );
+
+	pQuery->m_Candidates.EnsureCapacity( nPolys );
+
+	// Polys the threat can see every vertex of, or none of, don't need a trace
+	CUtlVectorFixedGrowable< int, MAX_TACTICAL_CANDIDATES > toTrace;
+	for ( int i = 0; i < nPolys; i++ )
+	{
+		const CRecastMesh::TacticalPoly_t &poly = polys[i];
+
+		TacticalCandidate_t &candidate = pQuery->m_Candidates[ pQuery->m_Candidates.AddToTail() ];
+		candidate.m_vPos = poly.vPos;
+		candidate.m_bHidingSpot = poly.bHidingSpot;
+		candidate.m_flClaimedUntil = 0;
+		candidate.m_iClaimedBy = 0;
+		candidate.m_bVisible = false;
+		candidate.m_bEyeTraced = false;
+
+		if ( !poly.bHidingSpot && poly.nExposedVerts == 0 )
+		{
+			pQuery->m_nPrecomputed++;
+		}
+		else if ( !poly.bHidingSpot && poly.nExposedVerts == poly.nVerts )
+		{
+			candidate.m_bVisible = true;
+			pQuery->m_nPrecomputed++;
+		}
+		else
+		{
+			toTrace.AddToTail( pQuery->m_Candidates.Count() - 1 );
+		}
+	}
+
+	// Batch the rest against the static world
+	CTraceFilterNoNPCsOrPlayer traceFilter( NULL, COLLISION_GROUP_NONE );
+	FOR_EACH_VEC( toTrace, i )
+	{
+		TacticalCandidate_t &candidate = pQuery->m_Candidates[ toTrace[i] ];
+
+		trace_t tr;
+		AI_TraceLine( vThreatEyePos, candidate.m_vPos + Vector( 0, 0, flEyeHeight ), MASK_BLOCKLOS, &traceFilter, &tr );
+		candidate.m_bVisible = ( tr.fraction == 1.0f );
+		candidate.m_bEyeTraced = true;
+	}
+	pQuery->m_nTraced = toTrace.Count();
+}
+
+CON_COMMAND_F( ai_tactical_query_stats, "Prints how often cover/LOS queries were shared", FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nTotal = g_AITacticalQueryCache.m_nHits + g_AITacticalQueryCache.m_nMisses;
+	Msg( "Tactical queries: %d, computed %d, shared %d (%.1f%%)\n", nTotal, g_AITacticalQueryCache.m_nMisses, g_AITacticalQueryCache.m_nHits,
+		nTotal ? 100.0f * g_AITacticalQueryCache.m_nHits / nTotal : 0.0f );
+	g_AITacticalQueryCache.m_nHits = g_AITacticalQueryCache.m_nMisses = 0;
+}
+
+struct TacticalCandidateOrder_t
+{
+	int m_iCandidate;
+	float m_flDistSqr;
+};
+
+static int __cdecl CompareTacticalCandidates( const TacticalCandidateOrder_t *a, const TacticalCandidateOrder_t *b )
+{
+	if ( a->m_flDistSqr < b->m_flDistSqr )
+		return -1;
+	return ( a->m_flDistSqr > b->m_flDistSqr ) ? 1 : 0;
+}
+
+//-------------------------------------
+// Orders a query's usable candidates by distance from vFrom
+//-------------------------------------
+static void SortTacticalCandidates( TacticalQuery_t *pQuery, const Vector &vFrom, int iClaimer, CUtlVectorFixedGrowable< TacticalCandidateOrder_t, MAX_TACTICAL_CANDIDATES > &order )
+{
+	FOR_EACH_VEC( pQuery->m_Candidates, i )
+	{
+		const TacticalCandidate_t &candidate = pQuery->m_Candidates[i];
+		if ( candidate.m_flClaimedUntil > gpGlobals->curtime && candidate.m_iClaimedBy != iClaimer )
+			continue;
+
+		TacticalCandidateOrder_t &entry = order[ order.AddToTail() ];
+		entry.m_iCandidate = i;
+		entry.m_flDistSqr = candidate.m_vPos.DistToSqr( vFrom );
+	}
+	order.Sort( CompareTacticalCandidates );
+}
+
+static void ClaimTacticalCandidate( TacticalCandidate_t &candidate, int iClaimer, float flTime )
+{
+	candidate.m_iClaimedBy = iClaimer;
+	candidate.m_flClaimedUntil = gpGlobals->curtime + MAX( flTime, 1.0f );
+}
+
 //-------------------------------------
 
 void CAI_TacticalServices::Init()
@@ -255,9 +490,34 @@ Vector CAI_TacticalServices::FindBackAwayPos(const Vector &vecThreat )
 		return vec3_origin;
 	}
 
-	//TODO!!!! Arthurdead
-	//DebuggerBreak();
-	Assert(0);
+	CRecastMesh *pMesh = GetOuter()->GetNavMesh();
+	if ( !pMesh )
+		return vec3_origin;
+
+	// Get further than the weapon's min range, or at least further than we are now
+	float flMinDistSqr = ( GetLocalOrigin() - vecThreat ).LengthSqr();
+	CBaseCombatWeapon *pWeapon = GetOuter()->GetActiveWeapon();
+	if ( pWeapon && pWeapon->MinRange1() > 0 )
+	{
+		flMinDistSqr = MAX( flMinDistSqr, Square( pWeapon->MinRange1() ) );
+	}
+
+	TacticalQuery_t *pQuery = g_AITacticalQueryCache.Query( pMesh, vecThreat, vecThreat, GetLocalOrigin(), 
+		MIN( ai_tactical_query_radius.GetFloat(), 512.0f ), GetOuter()->GetViewOffset().z );
+
+	CUtlVectorFixedGrowable< TacticalCandidateOrder_t, MAX_TACTICAL_CANDIDATES > order;
+	SortTacticalCandidates( pQuery, GetLocalOrigin(), GetOuter()->entindex(), order );
+
+	FOR_EACH_VEC( order, i )
+	{
+		TacticalCandidate_t &candidate = pQuery->m_Candidates[ order[i].m_iCandidate ];
+		if ( ( candidate.m_vPos - vecThreat ).LengthSqr() <= flMinDistSqr )
+			continue;
+
+		ClaimTacticalCandidate( candidate, GetOuter()->entindex(), 0 );
+		return candidate.m_vPos;
+	}
+
 	return vec3_origin;
 }
 
@@ -299,9 +559,44 @@ Vector CAI_TacticalServices::FindCoverPos(const Vector &vNearPos, const Vector &
 		flMinDist = 0.5 * flMaxDist;
 	}
 
-	//TODO!!!! Arthurdead
-	//DebuggerBreak();
-	Assert(0);
+	CRecastMesh *pMesh = GetOuter()->GetNavMesh();
+	if ( !pMesh )
+		return vec3_origin;
+
+	const Vector &vViewOffset = GetOuter()->GetViewOffset();
+	TacticalQuery_t *pQuery = g_AITacticalQueryCache.Query( pMesh, vThreatPos, vThreatEyePos, vNearPos, flMaxDist, vViewOffset.z );
+
+	CUtlVectorFixedGrowable< TacticalCandidateOrder_t, MAX_TACTICAL_CANDIDATES > order;
+	SortTacticalCandidates( pQuery, vNearPos, GetOuter()->entindex(), order );
+
+	// Hiding spots in good cover first, then everything else by distance
+	for ( int iPass = 0; iPass < 2; iPass++ )
+	{
+		FOR_EACH_VEC( order, i )
+		{
+			TacticalCandidate_t &candidate = pQuery->m_Candidates[ order[i].m_iCandidate ];
+			if ( candidate.m_bVisible || candidate.m_bHidingSpot != ( iPass == 0 ) )
+				continue;
+
+			if ( ( candidate.m_vPos - vThreatPos ).LengthSqr() < Square( flMinDist ) )
+				continue;
+
+			// The shared traces ignore NPCs, confirm with our own test
+			if ( !GetOuter()->IsCoverPosition( vThreatEyePos, candidate.m_vPos + vViewOffset ) )
+			{
+				DebugFindCover( candidate.m_vPos + vViewOffset, vThreatEyePos, 255, 0, 0 );
+				continue;
+			}
+
+			if ( !GetOuter()->IsValidCover( candidate.m_vPos ) )
+				continue;
+
+			DebugFindCover( candidate.m_vPos + vViewOffset, vThreatEyePos, 0, 255, 0 );
+			ClaimTacticalCandidate( candidate, GetOuter()->entindex(), 0 );
+			return candidate.m_vPos;
+		}
+	}
+
 	return vec3_origin;
 }
 
@@ -328,10 +623,71 @@ Vector CAI_TacticalServices::FindLosPos(const Vector &vThreatPos, const Vector &
 
 	MARK_TASK_EXPENSIVE();
 
-	//TODO!!!! Arthurdead
-	//DebuggerBreak();
-	Assert(0);
-	return vec3_origin;
+	CRecastMesh *pMesh = GetOuter()->GetNavMesh();
+	if ( !pMesh )
+		return vec3_origin;
+
+	// Search around ourselves, no further than we could possibly need to go
+	float flSearchRadius = MIN( ai_tactical_query_radius.GetFloat(), ( GetLocalOrigin() - vThreatPos ).Length() + flMaxThreatDist );
+	const Vector &vViewOffset = GetOuter()->GetViewOffset();
+	TacticalQuery_t *pQuery = g_AITacticalQueryCache.Query( pMesh, vThreatPos, vThreatEyePos, GetLocalOrigin(), flSearchRadius, vViewOffset.z );
+
+	CUtlVectorFixedGrowable< TacticalCandidateOrder_t, MAX_TACTICAL_CANDIDATES > order;
+	SortTacticalCandidates( pQuery, GetLocalOrigin(), GetOuter()->entindex(), order );
+
+	Vector vFlankDir = vecFlankRefPos - vThreatPos;
+	vFlankDir.z = 0;
+	VectorNormalize( vFlankDir );
+	float flFlankCos = cos( DEG2RAD( flFlankParam ) );
+
+	FOR_EACH_VEC( order, i )
+	{
+		TacticalCandidate_t &candidate = pQuery->m_Candidates[ order[i].m_iCandidate ];
+		if ( !candidate.m_bVisible && candidate.m_bEyeTraced )
+			continue;
+
+		float flThreatDistSqr = ( candidate.m_vPos - vThreatPos ).LengthSqr();
+		if ( flThreatDistSqr < Square( flMinThreatDist ) || flThreatDistSqr > Square( flMaxThreatDist ) )
+			continue;
+
+		if ( eFlankType == FLANKTYPE_ARC )
+		{
+			// Must be at least flFlankParam degrees around the threat from the reference position
+			Vector vDir = candidate.m_vPos - vThreatPos;
+			vDir.z = 0;
+			VectorNormalize( vDir );
+			if ( DotProduct( vDir, vFlankDir ) > flFlankCos )
+				continue;
+		}
+		else if ( eFlankType == FLANKTYPE_RADIUS )
+		{
+			if ( ( candidate.m_vPos - vecFlankRefPos ).LengthSqr() < Square( flFlankParam ) )
+				continue;
+		}
+
+		if ( !candidate.m_bVisible )
+		{
+			// Hidden at ground level can still be in view at eye level. Trace it once,
+			// the answer is shared with everyone using this query.
+			trace_t tr;
+			CTraceFilterNoNPCsOrPlayer traceFilter( NULL, COLLISION_GROUP_NONE );
+			AI_TraceLine( vThreatEyePos, candidate.m_vPos + Vector( 0, 0, pQuery->m_flEyeHeight ), MASK_BLOCKLOS, &traceFilter, &tr );
+			candidate.m_bVisible = ( tr.fraction == 1.0f );
+			candidate.m_bEyeTraced = true;
+			pQuery->m_nTraced++;
+			if ( !candidate.m_bVisible )
+				continue;
+		}
+
+		if ( !GetOuter()->IsValidShootPosition( candidate.m_vPos ) )
+			continue;
+
+		if ( !GetOuter()->TestShootPosition( candidate.m_vPos, vThreatEyePos ) )
+			continue;
+
+		ClaimTacticalCandidate( candidate, GetOuter()->entindex(), flBlockTime );
+		return candidate.m_vPos;
+	}
 
 	// We failed.  No range attack node node was found
 	return vec3_origin;
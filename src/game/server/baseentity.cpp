@@ -634,6 +634,10 @@ CBaseEntity::CBaseEntity( uint64 iEFlags )
 	m_pPrevByClass = m_pNextByClass = NULL;
 	m_ListByClass = (UtlHashHandle_t)~0;
 
+	m_nEntityListOrder = 0;
+	memset( &m_NameIndexLink, 0, sizeof( m_NameIndexLink ) );
+	memset( &m_ClassnameIndexLink, 0, sizeof( m_ClassnameIndexLink ) );
+
 	// Possibly get an edict, and add self to global list of entites.
 	if ( !IsEFlagSet( EFL_NOT_NETWORKED ) )
 	{
@@ -839,7 +843,7 @@ void CBaseEntity::PostConstructor( const char *szClassname )
 {
 	if ( szClassname )
 	{
-		SetClassname(szClassname);
+		SetClassname( AllocPooledString_Persistent( szClassname ) );
 	}
 
 	Assert( m_iClassname != NULL_STRING && STRING(m_iClassname) != NULL );
@@ -981,6 +985,7 @@ void CBaseEntity::SetClassname( const char *className )
 void CBaseEntity::SetClassname( string_t className )
 {
 	m_iClassname = className;
+	gEntList.NotifyEntityClassnameChanged( this );
 }
 
 void CBaseEntity::SetModelIndex( modelindex_t index )
@@ -3987,6 +3992,24 @@ void CBaseEntity::ComputeWorldSpaceSurroundingBox( Vector *pMins, Vector *pMaxs
 }
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Renames the entity, letting the entity list relink it in its name index
+//-----------------------------------------------------------------------------
+void CBaseEntity::SetName( string_t newName )
+{
+	if ( m_iName.Get() == newName )
+		return;
+
+	m_iName = newName;
+	gEntList.NotifyEntityNameChanged( this );
+}
+
+void CBaseEntity::SetNameAsCStr( const char *newName )
+{
+	SetName( AllocPooledString( newName ) );
+}
+
+
 //------------------------------------------------------------------------------
 // Purpose : If name exists returns name, otherwise returns classname
 // Input   :
@@ -228,6 +228,16 @@ struct thinkfunc_t
 	int			m_nLastThinkTick;
 };
 
+//-----------------------------------------------------------------------------
+// Purpose: Intrusive link into one of the entity list's string indices
+//-----------------------------------------------------------------------------
+struct EntityIndexLink_t
+{
+	const char		*m_pszKey;	// NULL when not linked
+	CBaseEntity		*m_pPrev;
+	CBaseEntity		*m_pNext;
+};
+
 struct EmitSound_t;
 struct rotatingpushmove_t;
 
@@ -1893,6 +1903,11 @@ class CBaseEntity : public IServerEntity
 	CBaseEntity	*		m_pPrevByClass;
 	CBaseEntity	*		m_pNextByClass;
 
+	// Position in the entity list and links into its caseless name and classname indices
+	unsigned int		m_nEntityListOrder;
+	EntityIndexLink_t	m_NameIndexLink;
+	EntityIndexLink_t	m_ClassnameIndexLink;
+
 	// So it can get at the physics methods
 	friend class CCollisionEvent;
 
@@ -2130,15 +2145,6 @@ inline const char *CBaseEntity::GetPreTemplateName()
 	return szStrippedName;
 }
 
-inline void CBaseEntity::SetName( string_t newName )
-{
-	m_iName = newName;
-}
-
-inline void CBaseEntity::SetNameAsCStr( const char *newName )
-{
-	m_iName = AllocPooledString(newName);
-}
 
 inline bool CBaseEntity::NameMatches( const char *pszNameOrWildcard )
 {
@@ -24,6 +24,7 @@
 #include "env_debughistory.h"
 #include "recast/recast_mgr_ent.h"
 #include "collisionproperty.h"
+#include "utlhashtable.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -40,6 +41,149 @@ IServerEntityList *entitylist = &gEntList;
 // Expose list to engine
 EXPOSE_SINGLE_INTERFACE_GLOBALVAR( CGlobalEntityList, IServerEntityList, VSERVERENTITYLIST_INTERFACE_VERSION, gEntList );
 
+//-----------------------------------------------------------------------------
+// Purpose: Returns true if a name or classname query can only match entities
+//			whose string is the same ignoring case, i.e. it isn't procedural,
+//			a regex or a wildcard.
+//-----------------------------------------------------------------------------
+static bool IsPlainEntityName( const char *pszName )
+{
+	if ( !pszName || !pszName[0] || pszName[0] == '!' || pszName[0] == '@' )
+		return false;
+	return !strchr( pszName, '*' ) && !strchr( pszName, '?' );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Buckets entities by a caseless string through links embedded in
+//			each entity. Buckets are kept in entity list order, so walking one
+//			visits entities in the same order a scan of the list would.
+//-----------------------------------------------------------------------------
+class CEntityStringIndex
+{
+public:
+	CEntityStringIndex( EntityIndexLink_t CBaseEntity::*pLink ) : m_pLink( pLink ) {}
+
+	void Link( CBaseEntity *pEnt, const char *pszKey );
+	void Unlink( CBaseEntity *pEnt );
+
+	// Key the entity is linked under, NULL if it isn't
+	const char *GetKey( CBaseEntity *pEnt ) const	{ return ( pEnt->*m_pLink ).m_pszKey; }
+
+	CBaseEntity *First( const char *pszKey ) const;
+	CBaseEntity *Next( CBaseEntity *pEnt ) const	{ return ( pEnt->*m_pLink ).m_pNext; }
+
+	// First entity under pszKey that comes after pStartEntity in the entity list
+	CBaseEntity *FirstAfter( const char *pszKey, CBaseEntity *pStartEntity ) const;
+
+	void Purge()	{ m_Buckets.Purge(); }
+
+private:
+	struct Bucket_t
+	{
+		CBaseEntity *m_pHead;
+		CBaseEntity *m_pTail;
+	};
+
+	EntityIndexLink_t CBaseEntity::*m_pLink;
+	CUtlHashtable< const char *, Bucket_t, CaselessStringHashFunctor, CaselessStringEqualFunctor > m_Buckets;
+};
+
+void CEntityStringIndex::Link( CBaseEntity *pEnt, const char *pszKey )
+{
+	EntityIndexLink_t &link = pEnt->*m_pLink;
+	Assert( !link.m_pszKey );
+	if ( !pszKey || !pszKey[0] )
+		return;
+
+	UtlHashHandle_t hBucket = m_Buckets.Find( pszKey );
+	if ( hBucket == m_Buckets.InvalidHandle() )
+	{
+		Bucket_t empty = { NULL, NULL };
+		hBucket = m_Buckets.Insert( pszKey, empty );
+	}
+	Bucket_t &bucket = m_Buckets[hBucket];
+
+	// Entities are mostly linked in list order, so the search from the tail is usually immediate
+	CBaseEntity *pPrev = bucket.m_pTail;
+	while ( pPrev && pPrev->m_nEntityListOrder > pEnt->m_nEntityListOrder )
+	{
+		pPrev = ( pPrev->*m_pLink ).m_pPrev;
+	}
+
+	CBaseEntity *pNext = pPrev ? ( pPrev->*m_pLink ).m_pNext : bucket.m_pHead;
+
+	link.m_pszKey = pszKey;
+	link.m_pPrev = pPrev;
+	link.m_pNext = pNext;
+
+	if ( pPrev )
+		( pPrev->*m_pLink ).m_pNext = pEnt;
+	else
+		bucket.m_pHead = pEnt;
+
+	if ( pNext )
+		( pNext->*m_pLink ).m_pPrev = pEnt;
+	else
+		bucket.m_pTail = pEnt;
+}
+
+void CEntityStringIndex::Unlink( CBaseEntity *pEnt )
+{
+	EntityIndexLink_t &link = pEnt->*m_pLink;
+	if ( !link.m_pszKey )
+		return;
+
+	if ( !link.m_pPrev || !link.m_pNext )
+	{
+		UtlHashHandle_t hBucket = m_Buckets.Find( link.m_pszKey );
+		Assert( hBucket != m_Buckets.InvalidHandle() );
+		Bucket_t &bucket = m_Buckets[hBucket];
+		if ( !link.m_pPrev )
+			bucket.m_pHead = link.m_pNext;
+		if ( !link.m_pNext )
+			bucket.m_pTail = link.m_pPrev;
+
+		if ( !bucket.m_pHead )
+		{
+			m_Buckets.Remove( link.m_pszKey );
+		}
+	}
+
+	if ( link.m_pPrev )
+		( link.m_pPrev->*m_pLink ).m_pNext = link.m_pNext;
+	if ( link.m_pNext )
+		( link.m_pNext->*m_pLink ).m_pPrev = link.m_pPrev;
+
+	memset( &link, 0, sizeof( link ) );
+}
+
+CBaseEntity *CEntityStringIndex::First( const char *pszKey ) const
+{
+	UtlHashHandle_t hBucket = m_Buckets.Find( pszKey );
+	return ( hBucket != m_Buckets.InvalidHandle() ) ? m_Buckets[hBucket].m_pHead : NULL;
+}
+
+CBaseEntity *CEntityStringIndex::FirstAfter( const char *pszKey, CBaseEntity *pStartEntity ) const
+{
+	if ( !pStartEntity )
+		return First( pszKey );
+
+	// Continuing from an entity in this bucket is the common case
+	const char *pszStartKey = GetKey( pStartEntity );
+	if ( pszStartKey && !Q_strcasecmp( pszStartKey, pszKey ) )
+		return Next( pStartEntity );
+
+	CBaseEntity *pEnt = First( pszKey );
+	while ( pEnt && pEnt->m_nEntityListOrder <= pStartEntity->m_nEntityListOrder )
+	{
+		pEnt = Next( pEnt );
+	}
+	return pEnt;
+}
+
+static CEntityStringIndex g_EntsByName( &CBaseEntity::m_NameIndexLink );
+static CEntityStringIndex g_EntsByCaselessClassname( &CBaseEntity::m_ClassnameIndexLink );
+
 class CAimTargetManager : public IEntityListener
 {
 public:
@@ -350,6 +494,7 @@ CBaseEntityClassList::~CBaseEntityClassList()
 CGlobalEntityList::CGlobalEntityList()
 {
 	m_iHighestEnt = m_iNumEnts = m_iNumEdicts = 0;
+	m_nNextEntityListOrder = 0;
 	m_bClearingEntities = false;
 }
 
@@ -443,6 +588,9 @@ void CGlobalEntityList::Clear( void )
 #endif
 
 	g_EntsByClassname.RemoveAll();
+	g_EntsByCaselessClassname.Purge();
+	g_EntsByName.Purge();
+	m_nNextEntityListOrder = 0;
 
 	CBaseEntity::m_nDebugPlayer = -1;
 	CBaseEntity::m_bInDebugSelect = false; 
@@ -659,6 +807,19 @@ bool CGlobalEntityList::IsEntityPtr( void *pTest )
 //-----------------------------------------------------------------------------
 CBaseEntity *CGlobalEntityList::FindEntityByClassname( CBaseEntity *pStartEntity, const char *szName, IEntityFindFilter *pFilter )
 {
+	if ( IsPlainEntityName( szName ) )
+	{
+		for ( CBaseEntity *pEntity = g_EntsByCaselessClassname.FirstAfter( szName, pStartEntity ); pEntity; pEntity = g_EntsByCaselessClassname.Next( pEntity ) )
+		{
+			if ( pFilter && !pFilter->ShouldFindEntity(pEntity) )
+				continue;
+
+			return pEntity;
+		}
+
+		return NULL;
+	}
+
 	const CEntInfo *pInfo = pStartEntity ? GetEntInfoPtr( pStartEntity->GetRefEHandle() )->m_pNext : FirstEntInfo();
 
 	for ( ;pInfo; pInfo = pInfo->m_pNext )
@@ -825,6 +986,19 @@ CBaseEntity *CGlobalEntityList::FindEntityByName( CBaseEntity *pStartEntity, con
 
 		return NULL;
 	}
+
+	if ( IsPlainEntityName( szName ) )
+	{
+		for ( CBaseEntity *ent = g_EntsByName.FirstAfter( szName, pStartEntity ); ent; ent = g_EntsByName.Next( ent ) )
+		{
+			if ( pFilter && !pFilter->ShouldFindEntity(ent) )
+				continue;
+
+			return ent;
+		}
+
+		return NULL;
+	}
 	
 	const CEntInfo *pInfo = pStartEntity ? GetEntInfoPtr( pStartEntity->GetRefEHandle() )->m_pNext : FirstEntInfo();
 
@@ -857,20 +1031,9 @@ CBaseEntity *CGlobalEntityList::FindEntityByNameFast( CBaseEntity *pStartEntity,
 	if ( iszName == NULL_STRING || STRING(iszName)[0] == 0 )
 		return NULL;
 
-	const CEntInfo *pInfo = pStartEntity ? GetEntInfoPtr( pStartEntity->GetRefEHandle() )->m_pNext : FirstEntInfo();
-
-	for ( ;pInfo; pInfo = pInfo->m_pNext )
+	// The caseless bucket holds every spelling of the name, only return the exact string
+	for ( CBaseEntity *ent = g_EntsByName.FirstAfter( STRING(iszName), pStartEntity ); ent; ent = g_EntsByName.Next( ent ) )
 	{
-		CBaseEntity *ent = (CBaseEntity *)pInfo->m_pBaseEnt;
-		if ( !ent )
-		{
-			DevWarning( "NULL entity in global entity list!\n" );
-			continue;
-		}
-
-		if ( ent->m_iName.Get() == NULL_STRING )
-			continue;
-
 		if ( ent->m_iName.Get() == iszName )
 		{
 			return ent;
@@ -1416,6 +1579,10 @@ void CGlobalEntityList::OnAddEntity( CBaseEntity *pEnt, EHANDLE handle )
 
 	// record current list details
 	m_iNumEnts++;
+
+	pEnt->m_nEntityListOrder = ++m_nNextEntityListOrder;
+	g_EntsByCaselessClassname.Link( pEnt, STRING( pEnt->m_iClassname ) );
+	g_EntsByName.Link( pEnt, STRING( pEnt->m_iName.Get() ) );
 	if ( i > m_iHighestEnt )
 		m_iHighestEnt = i;
 
@@ -1455,6 +1622,32 @@ void CGlobalEntityList::OnRemoveEntity( CBaseEntity *pEnt, EHANDLE handle )
 		m_iNumEdicts--;
 
 	m_iNumEnts--;
+
+	g_EntsByCaselessClassname.Unlink( pEnt );
+	g_EntsByName.Unlink( pEnt );
+	pEnt->m_nEntityListOrder = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Relinks every entity into the name and classname indices, for when
+//			names were written without going through SetName()
+//-----------------------------------------------------------------------------
+void CGlobalEntityList::RebuildEntityIndices()
+{
+	g_EntsByCaselessClassname.Purge();
+	g_EntsByName.Purge();
+
+	for ( const CEntInfo *pInfo = FirstEntInfo(); pInfo; pInfo = pInfo->m_pNext )
+	{
+		CBaseEntity *pEnt = (CBaseEntity *)pInfo->m_pBaseEnt;
+		if ( !pEnt )
+			continue;
+
+		memset( &pEnt->m_ClassnameIndexLink, 0, sizeof( pEnt->m_ClassnameIndexLink ) );
+		memset( &pEnt->m_NameIndexLink, 0, sizeof( pEnt->m_NameIndexLink ) );
+		g_EntsByCaselessClassname.Link( pEnt, STRING( pEnt->m_iClassname ) );
+		g_EntsByName.Link( pEnt, STRING( pEnt->m_iName.Get() ) );
+	}
 }
 
 void CGlobalEntityList::NotifyCreateEntity( CBaseEntity *pEnt )
@@ -1663,6 +1856,25 @@ void CNotifyList::ReportSystemEvent( CBaseEntity *pEntity, notify_system_event_t
 static CNotifyList g_NotifyList;
 INotify *g_pNotify = &g_NotifyList;
 
+void CGlobalEntityList::NotifyEntityNameChanged( CBaseEntity *pEnt )
+{
+	// Not in the list yet, OnAddEntity() links it
+	if ( !pEnt->m_nEntityListOrder )
+		return;
+
+	g_EntsByName.Unlink( pEnt );
+	g_EntsByName.Link( pEnt, STRING( pEnt->m_iName.Get() ) );
+}
+
+void CGlobalEntityList::NotifyEntityClassnameChanged( CBaseEntity *pEnt )
+{
+	if ( !pEnt->m_nEntityListOrder )
+		return;
+
+	g_EntsByCaselessClassname.Unlink( pEnt );
+	g_EntsByCaselessClassname.Link( pEnt, STRING( pEnt->m_iClassname ) );
+}
+
 class CEntityTouchManager : public IEntityListener
 {
 public:
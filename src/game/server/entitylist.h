@@ -78,6 +78,7 @@ class CGlobalEntityList : public CBaseEntityList, public IServerEntityList
 	int m_iHighestEnt; // the topmost used array index
 	int m_iNumEnts;
 	int m_iNumEdicts;
+	unsigned int m_nNextEntityListOrder;
 
 	bool m_bClearingEntities;
 	CUtlVector<IEntityListener *>	m_entityListeners;
@@ -194,6 +195,11 @@ class CGlobalEntityList : public CBaseEntityList, public IServerEntityList
 	CBaseEntity *FindEntityByClassnameNearestFast( string_t iszClassname, const Vector &vecSrc, float flRadius );
 	CBaseEntity *FindEntityByNameFast( CBaseEntity *pStartEntity, string_t iszName );
 
+	// Must be called whenever an entity's name or classname changes
+	void NotifyEntityNameChanged( CBaseEntity *pEnt );
+	void NotifyEntityClassnameChanged( CBaseEntity *pEnt );
+	void RebuildEntityIndices();
+
 	CGlobalEntityList();
 
 // CBaseEntityList overrides.
@@ -33,12 +33,14 @@
 #include "textstatsmgr.h"
 #include "bitbuf.h"
 #include "tier0/vprof.h"
+#include "tier1/generichash.h"
 #include "effect_dispatch_data.h"
 #include "engine/IStaticPropMgr.h"
 #include "TemplateEntities.h"
 #include "ai_speech.h"
 #include "soundenvelope.h"
 #include "usermessages.h"
+#include "te_effect_dispatch.h"
 #include "physics.h"
 #include "igameevents.h"
 #include "EventLog.h"
@@ -1099,6 +1101,10 @@ void CServerGameDLL::ServerActivate( edict_t *pEdictList, int edictCount, int cl
 		Msg( "%s", "ERROR: Entity delete queue not empty on level start!\n" );
 	}
 
+	// Restored entities get their names written without SetName(), relink them
+	// before anything activates and starts looking entities up by name
+	gEntList.RebuildEntityIndices();
+
 	for ( CBaseEntity *pClass = gEntList.FirstEnt(); pClass != NULL; pClass = gEntList.NextEnt(pClass) )
 	{
 		if ( pClass && !pClass->IsDormant() )
@@ -1327,12 +1333,139 @@ void CServerGameDLL::GameFrame( bool simulating )
 	gpGlobals->frametime = oldframetime;
 }
 
+//-----------------------------------------------------------------------------
+// Network change tracking stats. Entities whose vars report their offset only
+// need those props re-encoded; anything flagged as a full change gets every prop
+// in its send table compared. This samples what the engine is about to pack.
+//-----------------------------------------------------------------------------
+static void FlushUserMessageBatches();
+static void ClearUserMessageBatches();
+
+struct NetChangeStats_t
+{
+	int m_nFrames;
+	int m_nChangedEdicts;
+	int m_nFullEdicts;
+	int m_nOffsetEdicts;
+	int64 m_nFullEntityProps;	// props compared if every changed edict were a full change
+	int64 m_nTrackedProps;		// props compared with per-var offsets
+};
+
+static int s_nNetChangeStatsFramesLeft = 0;
+static NetChangeStats_t s_NetChangeStats;
+static CUtlVector< int > s_NetChangePropCounts;
+
+static int CountSendTableProps( const SendTable *pTable )
+{
+	int nProps = 0;
+	for ( int i = 0; i < pTable->GetNumProps(); i++ )
+	{
+		const SendProp *pProp = pTable->GetProp( i );
+		if ( pProp->IsExcludeProp() )
+			continue;
+
+		if ( pProp->GetType() == DPT_DataTable )
+		{
+			if ( pProp->GetDataTable() )
+			{
+				nProps += CountSendTableProps( pProp->GetDataTable() );
+			}
+		}
+		else
+		{
+			++nProps;
+		}
+	}
+	return nProps;
+}
+
+static int GetServerClassPropCount( ServerClass *pClass )
+{
+	int nClassID = pClass->m_ClassID;
+	if ( nClassID < 0 )
+		return CountSendTableProps( pClass->m_pTable );
+
+	while ( s_NetChangePropCounts.Count() <= nClassID )
+	{
+		s_NetChangePropCounts.AddToTail( -1 );
+	}
+
+	if ( s_NetChangePropCounts[nClassID] < 0 )
+	{
+		s_NetChangePropCounts[nClassID] = CountSendTableProps( pClass->m_pTable );
+	}
+	return s_NetChangePropCounts[nClassID];
+}
+
+static void SampleNetChangeStats()
+{
+	if ( s_nNetChangeStatsFramesLeft <= 0 || !g_pSharedChangeInfo )
+		return;
+
+	NetChangeStats_t &stats = s_NetChangeStats;
+	++stats.m_nFrames;
+
+	for ( int i = 0; i < gpGlobals->maxEntities; i++ )
+	{
+		edict_t *pEdict = engine->PEntityOfEntIndex( i );
+		if ( !pEdict || pEdict->IsFree() || !( pEdict->m_fStateFlags & FL_EDICT_CHANGED ) )
+			continue;
+
+		ServerClass *pClass = pEdict->GetNetworkable() ? pEdict->GetNetworkable()->GetServerClass() : NULL;
+		if ( !pClass )
+			continue;
+
+		int nClassProps = GetServerClassPropCount( pClass );
+		++stats.m_nChangedEdicts;
+		stats.m_nFullEntityProps += nClassProps;
+
+		const IChangeInfoAccessor *pAccessor = pEdict->GetChangeAccessor();
+		if ( ( pEdict->m_fStateFlags & FL_FULL_EDICT_CHANGED ) || pAccessor->GetChangeInfoSerialNumber() != g_pSharedChangeInfo->m_iSerialNumber )
+		{
+			++stats.m_nFullEdicts;
+			stats.m_nTrackedProps += nClassProps;
+		}
+		else
+		{
+			// An offset can cover a few props (vectors split into components), but
+			// never more than the class has.
+			const CEdictChangeInfo &info = g_pSharedChangeInfo->m_ChangeInfos[ pAccessor->GetChangeInfo() ];
+			++stats.m_nOffsetEdicts;
+			stats.m_nTrackedProps += MIN( (int)info.m_nChangeOffsets, nClassProps );
+		}
+	}
+
+	if ( --s_nNetChangeStatsFramesLeft > 0 )
+		return;
+
+	int nFrames = MAX( stats.m_nFrames, 1 );
+	Msg( "Network change stats over %d frames:\n", stats.m_nFrames );
+	Msg( "  changed edicts/frame:   %.1f (%.1f full, %.1f with offsets)\n",
+		(float)stats.m_nChangedEdicts / nFrames, (float)stats.m_nFullEdicts / nFrames, (float)stats.m_nOffsetEdicts / nFrames );
+	Msg( "  props/frame full entity: %.1f\n", (double)stats.m_nFullEntityProps / nFrames );
+	Msg( "  props/frame tracked:     %.1f (%.1f%%)\n", (double)stats.m_nTrackedProps / nFrames,
+		stats.m_nFullEntityProps ? 100.0 * (double)stats.m_nTrackedProps / (double)stats.m_nFullEntityProps : 100.0 );
+}
+
+CON_COMMAND_F( sv_netchange_stats, "Samples how many send props per frame are dirty with per-var change tracking versus full entity compares. Usage: sv_netchange_stats [frames]", FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	V_memset( &s_NetChangeStats, 0, sizeof( s_NetChangeStats ) );
+	s_NetChangePropCounts.Purge();
+	s_nNetChangeStatsFramesLeft = ( args.ArgC() > 1 ) ? MAX( atoi( args[1] ), 1 ) : 300;
+	Msg( "Sampling network changes for %d frames...\n", s_nNetChangeStatsFramesLeft );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Called every frame even if not ticking
 // Input  : simulating - 
 //-----------------------------------------------------------------------------
 void CServerGameDLL::PreClientUpdate( bool simulating )
 {
+	FlushUserMessageBatches();
+
 	if ( !simulating )
 		return;
 
@@ -1352,6 +1485,8 @@ void CServerGameDLL::PreClientUpdate( bool simulating )
 
 	IGameSystem::PreClientUpdateAllSystems();
 
+	SampleNetChangeStats();
+
 #if defined _DEBUG && !defined SWDS
 	if( NDebugOverlay::IsEnabled() )
 	{
@@ -1423,6 +1558,9 @@ void CServerGameDLL::LevelShutdown( void )
 
 	ClearDebugHistory();
 
+	// Whatever was batched since the last update is for clients of the old level
+	ClearUserMessageBatches();
+
 	gEntList.Clear();
 
 	InvalidateQueryCache();
@@ -1958,6 +2096,112 @@ inline void CServerNetworkProperty::CheckTransmit( CCheckTransmitInfo *pInfo )
 	}
 } */
 
+static ConVar sv_transmit_groups( "sv_transmit_groups", "1", 0, "Share entity PVS results between clients that have the same PVS and areas during CheckTransmit." );
+
+//-----------------------------------------------------------------------------
+// Purpose: Clients standing in the same cluster with the same areas networked
+//  get the same IsInPVS() answer for every entity, so the answers are kept
+//  for the rest of the tick and shared by every client in the group.
+//  CheckTransmit is called for one client at a time, so this isn't locked.
+//-----------------------------------------------------------------------------
+class CTransmitVisGroup
+{
+public:
+	bool	Matches( unsigned int nHash, const CCheckTransmitInfo *pInfo ) const;
+	void	Init( unsigned int nHash, const CCheckTransmitInfo *pInfo );
+
+	// PVS data for the entity must already be up to date
+	bool	IsInPVS( int iEdict, CServerNetworkProperty *pNetProp, const CCheckTransmitInfo *pInfo, int &nTested );
+
+	static unsigned int HashVisibility( const CCheckTransmitInfo *pInfo );
+
+private:
+	unsigned int		m_nHash;
+	int					m_nPVSSize;
+	byte				m_PVS[ PAD_NUMBER( MAX_MAP_CLUSTERS, 8 ) / 8 ];
+	int					m_AreasNetworked;
+	int					m_Areas[ MAX_WORLD_AREAS ];
+
+	CBitVec<MAX_EDICTS>	m_Tested;
+	CBitVec<MAX_EDICTS>	m_InPVS;
+};
+
+unsigned int CTransmitVisGroup::HashVisibility( const CCheckTransmitInfo *pInfo )
+{
+	unsigned int nHash = HashBlock( pInfo->m_PVS, pInfo->m_nPVSSize );
+	return nHash ^ HashBlock( pInfo->m_Areas, pInfo->m_AreasNetworked * sizeof( int ) );
+}
+
+bool CTransmitVisGroup::Matches( unsigned int nHash, const CCheckTransmitInfo *pInfo ) const
+{
+	return m_nHash == nHash &&
+		m_nPVSSize == pInfo->m_nPVSSize &&
+		m_AreasNetworked == pInfo->m_AreasNetworked &&
+		!memcmp( m_Areas, pInfo->m_Areas, m_AreasNetworked * sizeof( int ) ) &&
+		!memcmp( m_PVS, pInfo->m_PVS, m_nPVSSize );
+}
+
+void CTransmitVisGroup::Init( unsigned int nHash, const CCheckTransmitInfo *pInfo )
+{
+	m_nHash = nHash;
+	m_nPVSSize = pInfo->m_nPVSSize;
+	memcpy( m_PVS, pInfo->m_PVS, m_nPVSSize );
+	m_AreasNetworked = pInfo->m_AreasNetworked;
+	memcpy( m_Areas, pInfo->m_Areas, m_AreasNetworked * sizeof( int ) );
+	m_Tested.ClearAll();
+	m_InPVS.ClearAll();
+}
+
+bool CTransmitVisGroup::IsInPVS( int iEdict, CServerNetworkProperty *pNetProp, const CCheckTransmitInfo *pInfo, int &nTested )
+{
+	if ( !m_Tested.IsBitSet( iEdict ) )
+	{
+		m_Tested.Set( iEdict );
+		if ( pNetProp->IsInPVS( pInfo ) )
+		{
+			m_InPVS.Set( iEdict );
+		}
+		++nTested;
+	}
+
+	return m_InPVS.IsBitSet( iEdict );
+}
+
+static CUtlVector< CTransmitVisGroup * > s_TransmitVisGroups;
+static int s_nTransmitVisGroupsUsed = 0;
+static int s_nTransmitVisGroupsTick = -1;
+
+//-----------------------------------------------------------------------------
+// Purpose: Finds the group this client's visibility belongs to this tick
+//-----------------------------------------------------------------------------
+static CTransmitVisGroup *FindOrCreateTransmitVisGroup( const CCheckTransmitInfo *pInfo )
+{
+	// Entities only move between ticks, everything gathered last tick is stale
+	if ( s_nTransmitVisGroupsTick != gpGlobals->tickcount )
+	{
+		s_nTransmitVisGroupsTick = gpGlobals->tickcount;
+		s_nTransmitVisGroupsUsed = 0;
+	}
+
+	unsigned int nHash = CTransmitVisGroup::HashVisibility( pInfo );
+	for ( int i = 0; i < s_nTransmitVisGroupsUsed; i++ )
+	{
+		if ( s_TransmitVisGroups[i]->Matches( nHash, pInfo ) )
+			return s_TransmitVisGroups[i];
+	}
+
+	if ( s_nTransmitVisGroupsUsed == s_TransmitVisGroups.Count() )
+	{
+		s_TransmitVisGroups.AddToTail( new CTransmitVisGroup );
+	}
+
+	CTransmitVisGroup *pGroup = s_TransmitVisGroups[ s_nTransmitVisGroupsUsed++ ];
+	pGroup->Init( nHash, pInfo );
+
+	VPROF_INCREMENT_COUNTER( "CheckTransmit vis groups", 1 );
+	return pGroup;
+}
+
 void CServerGameEnts::CheckTransmit( CCheckTransmitInfo *pInfo, const unsigned short *pEdictIndices, int nEdicts )
 {
 	// NOTE: for speed's sake, this assumes that all networkables are CBaseEntities and that the edict list
@@ -1986,6 +2230,15 @@ void CServerGameEnts::CheckTransmit( CCheckTransmitInfo *pInfo, const unsigned s
 	Assert( bIsHLTV == ( pInfo->m_pTransmitAlways != NULL) ||
 		    bIsReplay == ( pInfo->m_pTransmitAlways != NULL) );
 
+	// HLTV and replay don't cull against the PVS
+	CTransmitVisGroup *pVisGroup = NULL;
+	if ( !bIsHLTV && !bIsReplay && sv_transmit_groups.GetBool() )
+	{
+		pVisGroup = FindOrCreateTransmitVisGroup( pInfo );
+	}
+	int nPVSTested = 0;
+	int nPVSChecks = 0;
+
 	for ( int i=0; i < nEdicts; i++ )
 	{
 		int iEdict = pEdictIndices[i];
@@ -2097,7 +2350,8 @@ void CServerGameEnts::CheckTransmit( CCheckTransmitInfo *pInfo, const unsigned s
 			continue;
 		}
 
-		bool bInPVS = netProp->IsInPVS( pInfo );
+		++nPVSChecks;
+		bool bInPVS = pVisGroup ? pVisGroup->IsInPVS( iEdict, netProp, pInfo, nPVSTested ) : netProp->IsInPVS( pInfo );
 		if ( bInPVS || sv_force_transmit_ents.GetBool() )
 		{
 			// only send if entity is in PVS
@@ -2156,7 +2410,10 @@ void CServerGameEnts::CheckTransmit( CCheckTransmitInfo *pInfo, const unsigned s
 			{
 				// Check pvs
 				check->NetworkProp()->RecomputePVSInformation();
-				bool bMoveParentInPVS = check->NetworkProp()->IsInPVS( pInfo );
+				++nPVSChecks;
+				bool bMoveParentInPVS = pVisGroup ? 
+					pVisGroup->IsInPVS( checkIndex, check->NetworkProp(), pInfo, nPVSTested ) : 
+					check->NetworkProp()->IsInPVS( pInfo );
 				if ( bMoveParentInPVS )
 				{
 					orig->SetTransmit( pInfo, true );
@@ -2171,6 +2428,10 @@ void CServerGameEnts::CheckTransmit( CCheckTransmitInfo *pInfo, const unsigned s
 
 //	Msg("A:%i, N:%i, F: %i, P: %i\n", always, dontSend, fullCheck, PVS );
 
+	VPROF_INCREMENT_COUNTER( "CheckTransmit edicts", nEdicts );
+	VPROF_INCREMENT_COUNTER( "CheckTransmit PVS checks", nPVSChecks );
+	VPROF_INCREMENT_COUNTER( "CheckTransmit PVS tests", pVisGroup ? nPVSTested : nPVSChecks );
+
 	if( pRecipientPlayer->IsConnected() )
 	{
 		// GetEntityTransmitBitsForClient returns NULL if no previous frame exists for the client
@@ -2860,6 +3121,242 @@ void EntityMessageBegin( CBaseEntity * entity, bool reliable /*= false*/ )
 	g_pMsgBuffer = engine->EntityMessageBegin( entity->entindex(), entity->GetServerClass(), reliable );
 }
 
+//-----------------------------------------------------------------------------
+// Per tick usermessage batching. Messages registered as batchable are held
+// back until PreClientUpdate and packed into one compound message per set of
+// recipients, so a burst (an explosion's shakes, rumbles and damage
+// indicators) pays the message header once. Coalescing types also drop exact
+// duplicates sent to the same recipients within the tick.
+//-----------------------------------------------------------------------------
+ConVar sv_usermessage_batching( "sv_usermessage_batching", "1", 0, "Pack batchable usermessages sent to the same recipients into one message per tick." );
+ConVar sv_usermessage_batch_report( "sv_usermessage_batch_report", "0", 0, "Print the bytes saved by usermessage batching each tick it saves any." );
+
+// Approximate engine cost of a user message on the wire: the net message
+// type, the usermessage type byte and an 11 bit length.
+#define USERMSG_WIRE_HEADER_BITS	( 6 + 8 + USERMSG_BATCH_LENGTH_BITS )
+
+struct BatchedUserMessage_t
+{
+	int m_nType;
+	int m_nBits;
+	int m_nDataOffset;
+};
+
+struct UserMessageBatch_s
+{
+	CEnginePlayerBitVec m_Recipients;
+	bool m_bReliable;
+	CUtlVector< BatchedUserMessage_t > m_Messages;
+};
+
+static CUtlVector< UserMessageBatch_s * > g_UserMessageBatches;
+static int g_nUserMessageBatchesUsed = 0;
+static CUtlVector< byte > g_UserMessageBatchData;
+static int g_nUserMessageBatchType = -1;
+
+// Message currently being written into the scratch buffer
+static byte g_UserMessageScratch[ MAX_USER_MSG_DATA ];
+static bf_write g_UserMessageScratchBuf;
+static int g_nScratchMsgType = -1;
+static CEnginePlayerBitVec g_ScratchRecipients;
+static bool g_bScratchReliable = false;
+
+// Counters for the current tick
+static int g_nUserMessagesBatched = 0;
+static int g_nUserMessagesCoalesced = 0;
+static int g_nUserMessageBitsSaved = 0;
+
+static UserMessageBatch_s *FindOrAddUserMessageBatch( const CEnginePlayerBitVec &recipients, bool bReliable )
+{
+	for ( int i = 0; i < g_nUserMessageBatchesUsed; ++i )
+	{
+		UserMessageBatch_s *pBatch = g_UserMessageBatches[i];
+		if ( pBatch->m_bReliable == bReliable && pBatch->m_Recipients == recipients )
+			return pBatch;
+	}
+
+	if ( g_nUserMessageBatchesUsed == g_UserMessageBatches.Count() )
+	{
+		g_UserMessageBatches.AddToTail( new UserMessageBatch_s );
+	}
+
+	UserMessageBatch_s *pBatch = g_UserMessageBatches[ g_nUserMessageBatchesUsed++ ];
+	pBatch->m_Recipients = recipients;
+	pBatch->m_bReliable = bReliable;
+	pBatch->m_Messages.RemoveAll();
+	return pBatch;
+}
+
+static void QueueBatchedUserMessage()
+{
+	int nBits = g_UserMessageScratchBuf.GetNumBitsWritten();
+	if ( g_UserMessageScratchBuf.IsOverflowed() )
+	{
+		Log_Error( LOG_USERMSG, "MessageEnd:  '%s' overflowed\n", usermessages->GetUserMessageName( g_nScratchMsgType ) );
+		return;
+	}
+
+	UserMessageBatch_s *pBatch = FindOrAddUserMessageBatch( g_ScratchRecipients, g_bScratchReliable );
+
+	if ( usermessages->GetUserMessageBatch( g_nScratchMsgType ) == USERMSG_BATCH_COALESCE )
+	{
+		int nBytes = BitByte( nBits );
+		FOR_EACH_VEC( pBatch->m_Messages, i )
+		{
+			const BatchedUserMessage_t &other = pBatch->m_Messages[i];
+			if ( other.m_nType == g_nScratchMsgType && other.m_nBits == nBits &&
+				!V_memcmp( &g_UserMessageBatchData[ other.m_nDataOffset ], g_UserMessageScratch, nBytes ) )
+			{
+				++g_nUserMessagesCoalesced;
+				g_nUserMessageBitsSaved += USERMSG_WIRE_HEADER_BITS + nBits;
+				return;
+			}
+		}
+	}
+
+	BatchedUserMessage_t &msg = pBatch->m_Messages[ pBatch->m_Messages.AddToTail() ];
+	msg.m_nType = g_nScratchMsgType;
+	msg.m_nBits = nBits;
+	msg.m_nDataOffset = g_UserMessageBatchData.AddMultipleToTail( BitByte( nBits ), g_UserMessageScratch );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Sends and empties the pending batches
+//-----------------------------------------------------------------------------
+static void SendUserMessageBatches()
+{
+	if ( g_nUserMessageBatchType == -1 )
+	{
+		g_nUserMessageBatchType = usermessages->LookupUserMessage( USERMSG_BATCH_NAME );
+	}
+
+	for ( int i = 0; i < g_nUserMessageBatchesUsed; ++i )
+	{
+		UserMessageBatch_s *pBatch = g_UserMessageBatches[i];
+
+		CRecipientFilter filter;
+		for ( int nPlayer = 0; nPlayer < ABSOLUTE_PLAYER_LIMIT; ++nPlayer )
+		{
+			if ( pBatch->m_Recipients.IsBitSet( nPlayer ) )
+			{
+				filter.AddRecipient( nPlayer + 1 );
+			}
+		}
+		if ( pBatch->m_bReliable )
+		{
+			filter.MakeReliable();
+		}
+
+		int nMessage = 0;
+		while ( nMessage < pBatch->m_Messages.Count() )
+		{
+			// Take as many as fit in one compound message
+			int nBatchBits = 8;
+			int nEnd = nMessage;
+			while ( nEnd < pBatch->m_Messages.Count() && nEnd - nMessage < 255 )
+			{
+				int nSize = 8 + USERMSG_BATCH_LENGTH_BITS + pBatch->m_Messages[nEnd].m_nBits;
+				if ( nBatchBits + nSize > MAX_USER_MSG_DATA * 8 )
+					break;
+				nBatchBits += nSize;
+				++nEnd;
+			}
+
+			if ( nEnd - nMessage <= 1 )
+			{
+				// Lone message (or one too big to wrap), send it as is
+				const BatchedUserMessage_t &msg = pBatch->m_Messages[nMessage];
+				bf_write *pBuf = engine->UserMessageBegin( &filter, msg.m_nType );
+				if ( pBuf )
+				{
+					pBuf->WriteBits( &g_UserMessageBatchData[ msg.m_nDataOffset ], msg.m_nBits );
+					engine->MessageEnd();
+				}
+				++nMessage;
+				continue;
+			}
+
+			bf_write *pBuf = engine->UserMessageBegin( &filter, g_nUserMessageBatchType );
+			if ( pBuf )
+			{
+				int nDirectBits = 0;
+				pBuf->WriteByte( nEnd - nMessage );
+				for ( int j = nMessage; j < nEnd; ++j )
+				{
+					const BatchedUserMessage_t &msg = pBatch->m_Messages[j];
+					pBuf->WriteByte( msg.m_nType );
+					pBuf->WriteUBitLong( msg.m_nBits, USERMSG_BATCH_LENGTH_BITS );
+					pBuf->WriteBits( &g_UserMessageBatchData[ msg.m_nDataOffset ], msg.m_nBits );
+					nDirectBits += USERMSG_WIRE_HEADER_BITS + msg.m_nBits;
+				}
+				engine->MessageEnd();
+
+				g_nUserMessagesBatched += nEnd - nMessage;
+				g_nUserMessageBitsSaved += nDirectBits - ( USERMSG_WIRE_HEADER_BITS + nBatchBits );
+			}
+			nMessage = nEnd;
+		}
+	}
+
+	g_nUserMessageBatchesUsed = 0;
+	g_UserMessageBatchData.RemoveAll();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: A message sent directly must not overtake batched ones already
+//  queued for any of its recipients, send those first.
+//-----------------------------------------------------------------------------
+static void SendUserMessageBatchesBefore( IRecipientFilter &filter )
+{
+	for ( int i = 0; i < g_nUserMessageBatchesUsed; ++i )
+	{
+		const UserMessageBatch_s *pBatch = g_UserMessageBatches[i];
+		for ( int j = 0; j < filter.GetRecipientCount(); ++j )
+		{
+			int nPlayer = filter.GetRecipientIndex( j );
+			if ( nPlayer >= 1 && nPlayer <= ABSOLUTE_PLAYER_LIMIT && pBatch->m_Recipients.IsBitSet( nPlayer - 1 ) )
+			{
+				SendUserMessageBatches();
+				return;
+			}
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Sends everything batched this tick. Called before the engine
+//  builds client snapshots so batched messages still go out on their tick.
+//-----------------------------------------------------------------------------
+static void FlushUserMessageBatches()
+{
+	SendUserMessageBatches();
+
+	g_nUserMessagesCoalesced += TE_GetCoalescedEffectCount();
+
+	if ( sv_usermessage_batch_report.GetBool() && ( g_nUserMessagesBatched || g_nUserMessagesCoalesced ) )
+	{
+		Msg( "Usermessage batching tick %d: %d batched, %d coalesced, %d bytes saved\n",
+			gpGlobals->tickcount, g_nUserMessagesBatched, g_nUserMessagesCoalesced, g_nUserMessageBitsSaved / 8 );
+	}
+
+	g_nUserMessagesBatched = 0;
+	g_nUserMessagesCoalesced = 0;
+	g_nUserMessageBitsSaved = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Drops the pending batches without sending them
+//-----------------------------------------------------------------------------
+static void ClearUserMessageBatches()
+{
+	g_nUserMessageBatchesUsed = 0;
+	g_UserMessageBatchData.RemoveAll();
+	g_nUserMessagesBatched = 0;
+	g_nUserMessagesCoalesced = 0;
+	g_nUserMessageBitsSaved = 0;
+	TE_GetCoalescedEffectCount();
+}
+
 void UserMessageBegin( IRecipientFilter& filter, const char *messagename )
 {
 	Assert( !g_pMsgBuffer );
@@ -2873,8 +3370,28 @@ void UserMessageBegin( IRecipientFilter& filter, const char *messagename )
 		Log_Error( LOG_USERMSG,"UserMessageBegin:  Unregistered message '%s'\n", messagename );
 		g_pMsgBuffer = NULL;
 	}
+	else if ( sv_usermessage_batching.GetBool() && !filter.IsInitMessage() &&
+		usermessages->GetUserMessageBatch( msg_type ) != USERMSG_BATCH_NONE )
+	{
+		g_nScratchMsgType = msg_type;
+		g_bScratchReliable = filter.IsReliable();
+		g_ScratchRecipients.ClearAll();
+		for ( int i = 0; i < filter.GetRecipientCount(); ++i )
+		{
+			int nPlayer = filter.GetRecipientIndex( i );
+			if ( nPlayer >= 1 && nPlayer <= ABSOLUTE_PLAYER_LIMIT )
+			{
+				g_ScratchRecipients.Set( nPlayer - 1 );
+			}
+		}
+
+		g_UserMessageScratchBuf.StartWriting( g_UserMessageScratch, sizeof( g_UserMessageScratch ) );
+		g_UserMessageScratchBuf.SetDebugName( messagename );
+		g_pMsgBuffer = &g_UserMessageScratchBuf;
+	}
 	else
 	{
+		SendUserMessageBatchesBefore( filter );
 		g_pMsgBuffer = engine->UserMessageBegin( &filter, msg_type );
 	}
 }
@@ -2888,7 +3405,14 @@ void MessageEnd( void )
 		return;
 	}
 
-	engine->MessageEnd();
+	if ( g_pMsgBuffer == &g_UserMessageScratchBuf )
+	{
+		QueueBatchedUserMessage();
+	}
+	else
+	{
+		engine->MessageEnd();
+	}
 
 	g_pMsgBuffer = NULL;
 }
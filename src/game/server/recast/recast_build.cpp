@@ -409,6 +409,300 @@ bool CRecastMesh::RemoveUnreachablePoly( CMapMesh *pMapMesh )
 
 ConVar recast_max_view_distance( "recast_max_view_distance", "6000", FCVAR_CHEAT, "Maximum range for precomputed nav mesh visibility" );
 
+static ConVar recast_build_vis_threaded( "recast_build_vis_threaded", "1", FCVAR_ARCHIVE, "Trace precomputed nav mesh visibility on the thread pool" );
+
+#define RECAST_VIS_BATCH_SIZE 64
+
+// One source/target poly pair to trace. Bit ( srcVert * tgtVerts + tgtVert )
+// of m_nVisibleBits is set for each clear vertex to vertex trace.
+struct RecastVisPair_t
+{
+	dtPolyRef m_srcRef;
+	dtPolyRef m_tgtRef;
+	uint64 m_nVisibleBits;
+};
+
+struct RecastVisBatch_t
+{
+	const dtNavMesh *m_pNavMesh;
+	RecastVisPair_t *m_pPairs;
+	int m_nPairs;
+};
+
+// Neighbourhood of one source poly, a run in the shared neighbour array
+struct RecastVisSource_t
+{
+	dtPolyRef m_ref;
+	int m_nFirst;
+	int m_nCount;
+};
+
+static int CompareVisPolyRefs( const void *a, const void *b )
+{
+	dtPolyRef refA = *(const dtPolyRef *)a;
+	dtPolyRef refB = *(const dtPolyRef *)b;
+	return ( refA < refB ) ? -1 : ( refA > refB ) ? 1 : 0;
+}
+
+static int CompareVisSources( const RecastVisSource_t *a, const RecastVisSource_t *b )
+{
+	return ( a->m_ref < b->m_ref ) ? -1 : ( a->m_ref > b->m_ref ) ? 1 : 0;
+}
+
+static int FindVisPolyRef( const dtPolyRef *pRefs, int nCount, dtPolyRef ref )
+{
+	int lo = 0, hi = nCount - 1;
+	while ( lo <= hi )
+	{
+		int mid = ( lo + hi ) >> 1;
+		if ( pRefs[mid] < ref )
+			lo = mid + 1;
+		else if ( pRefs[mid] > ref )
+			hi = mid - 1;
+		else
+			return mid;
+	}
+	return -1;
+}
+
+static int FindVisSource( const CUtlVector< RecastVisSource_t > &sources, dtPolyRef ref )
+{
+	int lo = 0, hi = sources.Count() - 1;
+	while ( lo <= hi )
+	{
+		int mid = ( lo + hi ) >> 1;
+		if ( sources[mid].m_ref < ref )
+			lo = mid + 1;
+		else if ( sources[mid].m_ref > ref )
+			hi = mid - 1;
+		else
+			return mid;
+	}
+	return -1;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Traces the vertex pairs of a batch of poly pairs. Runs on the
+//			thread pool; only reads the nav mesh and traces against the world.
+//			Entity filters touch the entity list, which isn't safe off the
+//			main thread, so only the world is traced.
+//-----------------------------------------------------------------------------
+static void TraceRecastVisBatch( RecastVisBatch_t &batch )
+{
+	const float stepsize = 1.0f;
+	CTraceFilterWorldOnly traceFilter;
+
+	for( int i = 0; i < batch.m_nPairs; ++i )
+	{
+		RecastVisPair_t &pair = batch.m_pPairs[i];
+		pair.m_nVisibleBits = 0;
+
+		const dtMeshTile *src_tile, *tgt_tile;
+		const dtPoly *src_poly, *tgt_poly;
+		batch.m_pNavMesh->getTileAndPolyByRefUnsafe( pair.m_srcRef, &src_tile, &src_poly );
+		batch.m_pNavMesh->getTileAndPolyByRefUnsafe( pair.m_tgtRef, &tgt_tile, &tgt_poly );
+
+		// Detour verts are y-up, three floats per vertex
+		for( int l = 0; l < src_poly->vertCount; ++l ) {
+			const float *src_pos_ptr = &src_tile->verts[src_poly->verts[l] * 3];
+			Vector src_pos( src_pos_ptr[0], src_pos_ptr[2], src_pos_ptr[1] + stepsize );
+
+			for( int n = 0; n < tgt_poly->vertCount; ++n ) {
+				const float *tgt_pos_ptr = &tgt_tile->verts[tgt_poly->verts[n] * 3];
+				Vector tgt_pos( tgt_pos_ptr[0], tgt_pos_ptr[2], tgt_pos_ptr[1] + stepsize );
+
+				// Straight to the engine, UTIL_TraceLine may debug draw
+				Ray_t ray;
+				ray.Init( src_pos, tgt_pos );
+				trace_t result;
+				enginetrace->TraceRay( ray, MASK_AI_VISION, &traceFilter, &result );
+
+				if( result.fraction >= 1.0f )
+				{
+					pair.m_nVisibleBits |= 1ull << ( l * tgt_poly->vertCount + n );
+				}
+			}
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Precomputes which vertices of every poly can see the vertices of
+//			the polys in its local neighbourhood.
+//			Gathering neighbourhoods uses the (single threaded) nav query, the
+//			traces are spread over the thread pool. When two polys are in each
+//			other's neighbourhood only one direction is traced and the other
+//			is filled in by transposing the result.
+//-----------------------------------------------------------------------------
+static void BuildPolyVisibility( const dtNavMesh *pNavMesh, dtNavMeshQuery *pNavQuery, CRecastPolyVisibility &vis, int &nTraces, int &nMirrored )
+{
+	vis.Purge();
+	nTraces = 0;
+	nMirrored = 0;
+
+	// Gather the sorted neighbourhood of every poly
+	CUtlVector< RecastVisSource_t > sources;
+	CUtlVector< dtPolyRef > neighbours;
+
+	for( int i = 0; i < pNavMesh->getMaxTiles(); ++i ) {
+		const dtMeshTile *src_tile = pNavMesh->getTile(i);
+		if( !src_tile->header ) {
+			continue;
+		}
+
+		for( int j = 0; j < src_tile->header->polyCount; ++j ) {
+			dtPolyRef src_polyRef = pNavMesh->encodePolyId(src_tile->salt, i, j);
+
+			// Search around the poly's center
+			const dtPoly &src_poly = src_tile->polys[j];
+			float center[3] = { 0.0f, 0.0f, 0.0f };
+			for( int l = 0; l < src_poly.vertCount; ++l ) {
+				dtVadd( center, center, &src_tile->verts[src_poly.verts[l] * 3] );
+			}
+			if( src_poly.vertCount > 0 ) {
+				dtVscale( center, center, 1.0f / src_poly.vertCount );
+			}
+
+			int numPolys = 0;
+			dtPolyRef polys[RECASTMESH_MAX_POLYS];
+			if( !dtStatusSucceed(pNavQuery->findLocalNeighbourhood(src_polyRef, center, recast_max_view_distance.GetFloat(), &defaultQueryFilter, polys, NULL, &numPolys, ARRAYSIZE(polys))) || numPolys == 0 )
+				continue;
+
+			qsort( polys, numPolys, sizeof( dtPolyRef ), CompareVisPolyRefs );
+
+			RecastVisSource_t &source = sources[ sources.AddToTail() ];
+			source.m_ref = src_polyRef;
+			source.m_nFirst = neighbours.AddMultipleToTail( numPolys, polys );
+			source.m_nCount = numPolys;
+		}
+	}
+
+	sources.Sort( CompareVisSources );
+
+	// Create a trace job per pair, except for the mirror image of a pair that is already traced.
+	// Sources are sorted, so the lower ref of a mutual pair is always seen first.
+	CUtlVector< int > neighbourPair;
+	neighbourPair.SetCount( neighbours.Count() );
+	CUtlVector< RecastVisPair_t > pairs;
+
+	FOR_EACH_VEC( sources, i )
+	{
+		const RecastVisSource_t &source = sources[i];
+		for( int k = 0; k < source.m_nCount; ++k ) {
+			dtPolyRef tgt_polyRef = neighbours[ source.m_nFirst + k ];
+
+			if( tgt_polyRef < source.m_ref )
+			{
+				int tgtSource = FindVisSource( sources, tgt_polyRef );
+				if( tgtSource != -1 && FindVisPolyRef( &neighbours[ sources[tgtSource].m_nFirst ], sources[tgtSource].m_nCount, source.m_ref ) != -1 )
+				{
+					neighbourPair[ source.m_nFirst + k ] = -1;
+					nMirrored++;
+					continue;
+				}
+			}
+
+			neighbourPair[ source.m_nFirst + k ] = pairs.Count();
+			RecastVisPair_t &pair = pairs[ pairs.AddToTail() ];
+			pair.m_srcRef = source.m_ref;
+			pair.m_tgtRef = tgt_polyRef;
+			pair.m_nVisibleBits = 0;
+		}
+	}
+
+	// Trace
+	CUtlVector< RecastVisBatch_t > batches;
+	for( int i = 0; i < pairs.Count(); i += RECAST_VIS_BATCH_SIZE ) {
+		RecastVisBatch_t &batch = batches[ batches.AddToTail() ];
+		batch.m_pNavMesh = pNavMesh;
+		batch.m_pPairs = pairs.Base() + i;
+		batch.m_nPairs = MIN( RECAST_VIS_BATCH_SIZE, pairs.Count() - i );
+	}
+
+	if( recast_build_vis_threaded.GetBool() )
+	{
+		ParallelProcess( "RecastPolyVisibility", batches.Base(), batches.Count(), &TraceRecastVisBatch, NULL, NULL, recast_build_numthreads.GetInt() );
+	}
+	else
+	{
+		FOR_EACH_VEC( batches, i )
+		{
+			TraceRecastVisBatch( batches[i] );
+		}
+	}
+
+	// Pack into the compressed rows
+	vis.m_SrcPolys.EnsureCapacity( sources.Count() );
+	vis.m_SrcVertCount.EnsureCapacity( sources.Count() );
+	vis.m_SrcFirstTarget.EnsureCapacity( sources.Count() + 1 );
+	vis.m_TgtPolys.EnsureCapacity( neighbours.Count() );
+	vis.m_TgtFirstBit.EnsureCapacity( neighbours.Count() + 1 );
+
+	uint32 nBit = 0;
+	FOR_EACH_VEC( sources, i )
+	{
+		const RecastVisSource_t &source = sources[i];
+
+		const dtMeshTile *src_tile;
+		const dtPoly *src_poly;
+		pNavMesh->getTileAndPolyByRefUnsafe( source.m_ref, &src_tile, &src_poly );
+		int nSrcVerts = src_poly->vertCount;
+
+		vis.m_SrcPolys.AddToTail( source.m_ref );
+		vis.m_SrcVertCount.AddToTail( (uint8)nSrcVerts );
+		vis.m_SrcFirstTarget.AddToTail( vis.m_TgtPolys.Count() );
+
+		for( int k = 0; k < source.m_nCount; ++k ) {
+			dtPolyRef tgt_polyRef = neighbours[ source.m_nFirst + k ];
+
+			const dtMeshTile *tgt_tile;
+			const dtPoly *tgt_poly;
+			pNavMesh->getTileAndPolyByRefUnsafe( tgt_polyRef, &tgt_tile, &tgt_poly );
+			int nTgtVerts = tgt_poly->vertCount;
+
+			uint64 nVisibleBits;
+			int pairIndex = neighbourPair[ source.m_nFirst + k ];
+			if( pairIndex != -1 )
+			{
+				nVisibleBits = pairs[ pairIndex ].m_nVisibleBits;
+				nTraces += nSrcVerts * nTgtVerts;
+			}
+			else
+			{
+				// Transpose the traced target to source pair
+				const RecastVisSource_t &tgtSource = sources[ FindVisSource( sources, tgt_polyRef ) ];
+				int tgtIndex = FindVisPolyRef( &neighbours[ tgtSource.m_nFirst ], tgtSource.m_nCount, source.m_ref );
+				uint64 nMirrorBits = pairs[ neighbourPair[ tgtSource.m_nFirst + tgtIndex ] ].m_nVisibleBits;
+
+				nVisibleBits = 0;
+				for( int l = 0; l < nSrcVerts; ++l ) {
+					for( int n = 0; n < nTgtVerts; ++n ) {
+						if( nMirrorBits & ( 1ull << ( n * nSrcVerts + l ) ) )
+							nVisibleBits |= 1ull << ( l * nTgtVerts + n );
+					}
+				}
+			}
+
+			vis.m_TgtPolys.AddToTail( tgt_polyRef );
+			vis.m_TgtFirstBit.AddToTail( nBit );
+
+			int nPairBits = nSrcVerts * nTgtVerts;
+			vis.m_Bits.SetCount( ( nBit + nPairBits + 31 ) >> 5 );
+			for( int b = 0; b < nPairBits; ++b, ++nBit ) {
+				uint32 &word = vis.m_Bits[ nBit >> 5 ];
+				if( ( nBit & 31 ) == 0 )
+					word = 0;
+				if( nVisibleBits & ( 1ull << b ) )
+					word |= 1u << ( nBit & 31 );
+			}
+		}
+	}
+
+	vis.m_SrcFirstTarget.AddToTail( vis.m_TgtPolys.Count() );
+	vis.m_TgtFirstBit.AddToTail( nBit );
+	vis.m_Bits.Compact();
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
@@ -593,72 +887,12 @@ bool CRecastMesh::Build( CMapMesh *pMapMesh )
 
 	fStartTime = Plat_FloatTime();
 
-	for(int i = 0; i < m_navMesh->getMaxTiles(); ++i) {
-		const dtMeshTile *src_tile = static_cast<const dtNavMesh *>(m_navMesh)->getTile(i);
-		if(!src_tile->header) {
-			continue;
-		}
-
-		for(int j = 0; j < src_tile->header->polyCount; ++j) {
-			const dtPoly &src_poly = src_tile->polys[j];
-			dtPolyRef src_polyRef = m_navMesh->encodePolyId(src_tile->salt, i, j);
-
-			int numPolys;
-			dtPolyRef polys[RECASTMESH_MAX_POLYS];
-			if(dtStatusSucceed(m_navQuery->findLocalNeighbourhood(src_polyRef, NULL, recast_max_view_distance.GetFloat(), &defaultQueryFilter, polys, NULL, &numPolys, ARRAYSIZE(polys))))
-			{
-				float stepsize = 1.0f;
-
-				PolyVisibilityInfo &info = m_polyVisibility[ m_polyVisibility.Insert( src_polyRef ) ];
-
-				for(int k = 0; k < numPolys; ++k) {
-					dtPolyRef tgt_polyRef = polys[k];
-
-					const dtMeshTile *tgt_tile;
-					const dtPoly *tgt_poly;
-					m_navMesh->getTileAndPolyByRefUnsafe(tgt_polyRef, &tgt_tile, &tgt_poly);
-
-					auto vis_hndl = info.visible.Insert( tgt_polyRef );
-					auto not_vis_hndl = info.not_visible.Insert( tgt_polyRef );
-
-					for(int l = 0; l < src_poly.vertCount; ++l) {
-						const float *src_pos_ptr = &src_tile->verts[src_poly.verts[l]];
-						Vector src_pos( src_pos_ptr[0], src_pos_ptr[1], src_pos_ptr[2] + stepsize );
-
-						for(int n = 0; n < tgt_poly->vertCount; ++n) {
-							const float *tgt_pos_ptr = &tgt_tile->verts[tgt_poly->verts[n]];
-							Vector tgt_pos( tgt_pos_ptr[0], tgt_pos_ptr[1], tgt_pos_ptr[2] + stepsize );
-
-							CTraceFilterNoNPCsOrPlayer traceFilter( NULL, COLLISION_GROUP_NONE );
-
-							trace_t result;
-							UTIL_TraceLine( src_pos, tgt_pos, MASK_AI_VISION, &traceFilter, &result );
-
-							if (result.fraction >= 1.0f)
-							{
-								info.visible[ vis_hndl ].verts.AddToTail( PolyVisibilityInfo::VisibilityConnectionInfo::vertPair{l, n} );
-							}
-							else
-							{
-								info.not_visible[ not_vis_hndl ].verts.AddToTail( PolyVisibilityInfo::VisibilityConnectionInfo::vertPair{l, n} );
-							}
-						}
-					}
-
-					if(info.visible[ vis_hndl ].verts.IsEmpty())
-						info.visible.Remove( tgt_polyRef );
-
-					if(info.not_visible[ not_vis_hndl ].verts.IsEmpty())
-						info.not_visible.Remove( tgt_polyRef );
-				}
-
-				if(info.visible.Count() == 0 && info.not_visible.Count() == 0)
-					m_polyVisibility.Remove( src_polyRef );
-			}
-		}
-	}
+	int nTraces = 0, nMirrored = 0;
+	BuildPolyVisibility( m_navMesh, m_navQuery, m_polyVisibility, nTraces, nMirrored );
 
-	Log_Msg( LOG_RECAST, "CRecastMesh: Calculated navigation mesh %s visibility in %f seconds\n", GetName(), Plat_FloatTime() - fStartTime );
+	Log_Msg( LOG_RECAST, "CRecastMesh: Calculated navigation mesh %s visibility in %f seconds (%d polys, %d targets, %d traces, %d mirrored pairs, %.1f KB)\n", 
+		GetName(), Plat_FloatTime() - fStartTime, m_polyVisibility.GetNumSourcePolys(), m_polyVisibility.GetNumTargets(), 
+		nTraces, nMirrored, m_polyVisibility.GetMemoryUsage() / 1024.0f );
 
 	PostLoad();
 
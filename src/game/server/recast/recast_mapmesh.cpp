@@ -11,6 +11,7 @@
 #include "recast/recast_mesh.h"
 #include "builddisp.h"
 #include "gamebspfile.h"
+#include "bspreader.h"
 #include <filesystem.h>
 #include "SkyCamera.h"
 #include "player.h"
@@ -203,20 +204,21 @@ bool CMapMesh::IsTriangleInValidArea( const Vector *vTriangle, bool bCheckNoArea
 //-----------------------------------------------------------------------------
 // Purpose: Load displacment verts and triangles
 //-----------------------------------------------------------------------------
-bool CMapMesh::GenerateDispVertsAndTris( void *fileContent, CUtlVector<float> &verts, CUtlVector<int> &triangles )
+bool CMapMesh::GenerateDispVertsAndTris( CBSPReader &bsp, CUtlVector<float> &verts, CUtlVector<int> &triangles )
 {
-	BSPHeader_t *header = (BSPHeader_t *)fileContent;
+	CBSPLumpSpan< ddispinfo_t > dispInfoArray = bsp.GetLumpSpan< ddispinfo_t >( LUMP_DISPINFO );
+	int nDispInfo = dispInfoArray.Count();
+	if( nDispInfo == 0 )
+		return true;
 
-	dvertex_t *vertices = (dvertex_t *)((char *)fileContent + header->lumps[LUMP_VERTEXES].fileofs);
-	dedge_t *edges = (dedge_t *)((char *)fileContent + header->lumps[LUMP_EDGES].fileofs);
-	int *surfedge = (int *)((char *)fileContent + header->lumps[LUMP_SURFEDGES].fileofs);
-	dface_t *faces = (dface_t *)((char *)fileContent + header->lumps[LUMP_FACES].fileofs);
-	int nFaces = (header->lumps[LUMP_FACES].filelen) / sizeof(dface_t);
+	CBSPLumpSpan< dvertex_t > vertices = bsp.GetLumpSpan< dvertex_t >( LUMP_VERTEXES );
+	CBSPLumpSpan< dedge_t > edges = bsp.GetLumpSpan< dedge_t >( LUMP_EDGES );
+	CBSPLumpSpan< int > surfedge = bsp.GetLumpSpan< int >( LUMP_SURFEDGES );
+	CBSPLumpSpan< dface_t > faces = bsp.GetLumpSpan< dface_t >( LUMP_FACES );
+	int nFaces = faces.Count();
 
-	ddispinfo_t *dispInfoArray = (ddispinfo_t *)((char *)fileContent + header->lumps[LUMP_DISPINFO].fileofs);
-	int nDispInfo = (header->lumps[LUMP_DISPINFO].filelen) / sizeof(ddispinfo_t);
-	CDispVert *dispVerts = (CDispVert *)((char *)fileContent + header->lumps[LUMP_DISP_VERTS].fileofs);
-	CDispTri *dispTri = (CDispTri *)((char *)fileContent + header->lumps[LUMP_DISP_TRIS].fileofs);
+	const CDispVert *dispVerts = bsp.GetLumpSpan< CDispVert >( LUMP_DISP_VERTS ).Base();
+	const CDispTri *dispTri = bsp.GetLumpSpan< CDispTri >( LUMP_DISP_TRIS ).Base();
 
 	// Build mapping from index to face
 	int nMemSize = nFaces * sizeof(unsigned short);
@@ -238,7 +240,7 @@ bool CMapMesh::GenerateDispVertsAndTris( void *fileContent, CUtlVector<float> &v
 	int i;
 	for( int dispInfoIdx = 0; dispInfoIdx < nDispInfo; dispInfoIdx++ )
 	{
-		ddispinfo_t &dispInfo = dispInfoArray[dispInfoIdx];
+		const ddispinfo_t &dispInfo = dispInfoArray[dispInfoIdx];
 		int nVerts = NUM_DISP_POWER_VERTS( dispInfo.power );
 		int nTris = NUM_DISP_POWER_TRIS( dispInfo.power );
 
@@ -254,7 +256,7 @@ bool CMapMesh::GenerateDispVertsAndTris( void *fileContent, CUtlVector<float> &v
 	
 		coreDisp.InitDispInfo( dispInfo.power, dispInfo.minTess, dispInfo.smoothingAngle, dispVerts + iCurVert, dispTri + iCurTri, 0, NULL );
 
-		dface_t *pFaces = &faces[ nFaceIndex ];
+		const dface_t *pFaces = &faces[ nFaceIndex ];
 		pDispSurf->SetHandle( nFaceIndex );
 
 		if( pFaces->numedges > 4 )
@@ -445,34 +447,21 @@ void CMapMesh::AddCollisionModelToMesh( const matrix3x4_t &transform, CPhysColli
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
-bool CMapMesh::GenerateStaticPropData( void *fileContent, CUtlVector<float> &verts, CUtlVector<int> &triangles )
+bool CMapMesh::GenerateStaticPropData( CBSPReader &bsp, CUtlVector<float> &verts, CUtlVector<int> &triangles )
 {
-	BSPHeader_t *header = (BSPHeader_t *)fileContent;
-
-	// Find the static prop game lump
-	dgamelump_t *staticPropLumpHeader = NULL;
-	dgamelumpheader_t *gamelumpheader = (dgamelumpheader_t *)((char *)fileContent + header->lumps[LUMP_GAME_LUMP].fileofs);
-	for( int i = 0; i < gamelumpheader->lumpCount; i++ )
+	// Find the static prop game lump, decompressed if need be
+	int staticPropLumpSize, staticPropLumpVersion;
+	const void *staticPropLump = bsp.GetGameLump( GAMELUMP_STATIC_PROPS, &staticPropLumpSize, &staticPropLumpVersion );
+	if( staticPropLump && ( staticPropLumpVersion < GAMELUMP_STATIC_PROPS_MIN_VERSION || staticPropLumpVersion > GAMELUMP_STATIC_PROPS_VERSION || staticPropLumpVersion == 9 ) )
 	{
-		dgamelump_t *gamelump = (dgamelump_t *)((char *)gamelumpheader + sizeof( dgamelumpheader_t ) + (i * sizeof( dgamelump_t )));
-		if( gamelump->id == GAMELUMP_STATIC_PROPS )
-		{
-			if( (gamelump->version >= GAMELUMP_STATIC_PROPS_MIN_VERSION && gamelump->version <= GAMELUMP_STATIC_PROPS_VERSION) && gamelump->version != 9 )
-			{
-				staticPropLumpHeader = gamelump;
-			}
-			else
-			{
-				Warning("CRecastMesh::GenerateStaticPropData: Found static prop lump with version %d, but expected 4, 5, 6, 7, 8 or %d!\n", gamelump->version, GAMELUMP_STATIC_PROPS_VERSION );
-			}
-			break;
-		}
+		Warning("CRecastMesh::GenerateStaticPropData: Found static prop lump with version %d, but expected 4, 5, 6, 7, 8 or %d!\n", staticPropLumpVersion, GAMELUMP_STATIC_PROPS_VERSION );
+		staticPropLump = NULL;
 	}
 
-	if( staticPropLumpHeader )
+	if( staticPropLump )
 	{
 		// Read models
-		CUtlBuffer staticPropData( (void *)((char *)fileContent + staticPropLumpHeader->fileofs), staticPropLumpHeader->filelen, CUtlBuffer::READ_ONLY );
+		CUtlBuffer staticPropData( staticPropLump, staticPropLumpSize, CUtlBuffer::READ_ONLY );
 		int dictEntries = staticPropData.GetInt();
 		if( m_bLog )
 			Log_Msg(LOG_RECAST, "Listening %d static prop dict entries\n", dictEntries);
@@ -551,7 +540,7 @@ bool CMapMesh::GenerateStaticPropData( void *fileContent, CUtlVector<float> &ver
 
 		for( int i = 0; i < staticPropEntries; i++ )
 		{
-			switch(staticPropLumpHeader->version) {
+			switch(staticPropLumpVersion) {
 			case 4: {
 				StaticPropLumpV4_t staticProp;
 				readLump(staticProp);
@@ -634,15 +623,14 @@ bool CMapMesh::GenerateDynamicPropData( CUtlVector<float> &verts, CUtlVector<int
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
-static int CalcBrushContents( void *fileContent, int nodeidx )
+static int CalcBrushContents( CBSPReader &bsp, int nodeidx )
 {
 	int contents = 0;
 
-	BSPHeader_t *header = (BSPHeader_t *)fileContent;
-	dleaf_t *leafs = (dleaf_t *)((char *)fileContent + header->lumps[LUMP_LEAFS].fileofs);
-	unsigned short *leafbrushes = (unsigned short *)((char *)fileContent + header->lumps[LUMP_LEAFBRUSHES].fileofs);
-	dnode_t *nodes = (dnode_t *)((char *)fileContent + header->lumps[LUMP_NODES].fileofs);
-	dbrush_t *brushes = (dbrush_t *)((char *)fileContent + header->lumps[LUMP_BRUSHES].fileofs);
+	CBSPLumpSpan< dleaf_t > leafs = bsp.GetLumpSpan< dleaf_t >( LUMP_LEAFS );
+	CBSPLumpSpan< unsigned short > leafbrushes = bsp.GetLumpSpan< unsigned short >( LUMP_LEAFBRUSHES );
+	CBSPLumpSpan< dnode_t > nodes = bsp.GetLumpSpan< dnode_t >( LUMP_NODES );
+	CBSPLumpSpan< dbrush_t > brushes = bsp.GetLumpSpan< dbrush_t >( LUMP_BRUSHES );
 
 	// Keep going until terminated by leafs.
 	// Each node has exactly two children, which can be either another node or a leaf. 
@@ -654,7 +642,7 @@ static int CalcBrushContents( void *fileContent, int nodeidx )
 		{
 			// negative numbers are -(leafs+1), not nodes
 			int leafidx = -(nodeidx+1);
-			dleaf_t &leaf = leafs[leafidx];
+			const dleaf_t &leaf = leafs[leafidx];
 			
 			for( int i = 0; i < leaf.numleafbrushes; i++ )
 			{
@@ -664,8 +652,8 @@ static int CalcBrushContents( void *fileContent, int nodeidx )
 			return contents;
 		}
 
-		dnode_t &node = nodes[nodeidx];
-		contents |= CalcBrushContents( fileContent, node.children[0] );
+		const dnode_t &node = nodes[nodeidx];
+		contents |= CalcBrushContents( bsp, node.children[0] );
 		nodeidx = node.children[1];
 	}
 
@@ -675,26 +663,27 @@ static int CalcBrushContents( void *fileContent, int nodeidx )
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
-bool CMapMesh::GenerateBrushData( void *fileContent, CUtlVector<float> &verts, CUtlVector<int> &triangles )
+bool CMapMesh::GenerateBrushData( CBSPReader &bsp, CUtlVector<float> &verts, CUtlVector<int> &triangles )
 {
-	BSPHeader_t *header = (BSPHeader_t *)fileContent;
-
 	// Load Brush Models
 	CUtlVector< vcollide_t > parsedphysmodels;
 
-	dmodel_t *brushmodels = (dmodel_t *)((char *)fileContent + header->lumps[LUMP_MODELS].fileofs);
-	int nbrushmodels = (header->lumps[LUMP_MODELS].filelen) / sizeof(dmodel_t);
+	CBSPLumpSpan< dmodel_t > brushmodels = bsp.GetLumpSpan< dmodel_t >( LUMP_MODELS );
+	int nbrushmodels = brushmodels.Count();
 	parsedphysmodels.EnsureCount( nbrushmodels );
 
 	// Load PhysModel data
-	byte *physmodels = (byte *)((char *)fileContent + header->lumps[LUMP_PHYSCOLLIDE].fileofs);
-	byte *basephysmodels = physmodels;
-	int nphysmodelsize = header->lumps[LUMP_PHYSCOLLIDE].filelen;
+	int nphysmodelsize;
+	const byte *physmodels = (const byte *)bsp.GetLump( LUMP_PHYSCOLLIDE, &nphysmodelsize );
+	const byte *basephysmodels = physmodels;
 
 	dphysmodel_t physModel;
 	// Variable length, etc. Last is null.
 	do
 	{
+		if( (int)(physmodels - basephysmodels) + (int)sizeof(physModel) > nphysmodelsize )
+			break;
+
 		V_memcpy( &physModel, physmodels, sizeof(physModel) );
 		physmodels += sizeof(physModel);
 
@@ -712,9 +701,9 @@ bool CMapMesh::GenerateBrushData( void *fileContent, CUtlVector<float> &verts, C
 
 	for( int i = 0; i < nbrushmodels; i++ )
 	{
-		dmodel_t *pModel = &brushmodels[ i ];
+		const dmodel_t *pModel = &brushmodels[ i ];
 
-		//int contents = CalcBrushContents( fileContent, pModel->headnode );
+		//int contents = CalcBrushContents( bsp, pModel->headnode );
 
 		// Only parse the first brush (world) and clips
 		// TODO: Should probably parse certain brush entities too
@@ -761,30 +750,36 @@ bool CMapMesh::Load( bool bDynamicOnly )
 		char filename[256];
 		V_snprintf( filename, sizeof( filename ), "maps" CORRECT_PATH_SEPARATOR_S "%s.bsp", STRING( gpGlobals->mapname ) );
 
-		CUtlBuffer fileBuffer( 4096, 1024*1024, CUtlBuffer::READ_ONLY );
-		if ( !g_pFullFileSystem->ReadFile( filename, "GAME", fileBuffer ) )	// this ignores .nav files embedded in the .bsp ...
+		// Maps the bsp, only the lumps read below get paged in
+		CBSPReader bsp;
+		if ( !bsp.Open( g_pFullFileSystem, filename, "GAME" ) )	// this ignores .nav files embedded in the .bsp ...
 		{
 			Warning("Recast LoadMapData: unable to read bsp \"%s\"", filename);
 			return false;
 		}
 
-		int length = fileBuffer.TellMaxPut();
-		void *fileContent = fileBuffer.Base();
+		BSPHeader_t *header = bsp.GetHeader();
+		if ( header->ident != IDBSPHEADER )
+		{
+			Warning("Recast LoadMapData: \"%s\" is not a bsp", filename);
+			return false;
+		}
+
+		int length = bsp.FileSize();
 
 		// Static world geometry
 		if( recast_mapmesh_loaddisplacements.GetBool() )
-			GenerateDispVertsAndTris( fileContent, m_Vertices, m_Triangles );
+			GenerateDispVertsAndTris( bsp, m_Vertices, m_Triangles );
 		if( recast_mapmesh_loadstaticprops.GetBool() )
-			GenerateStaticPropData( fileContent, m_Vertices, m_Triangles );
+			GenerateStaticPropData( bsp, m_Vertices, m_Triangles );
 		if( recast_mapmesh_loadbrushes.GetBool() )
-			GenerateBrushData( fileContent, m_Vertices, m_Triangles );
+			GenerateBrushData( bsp, m_Vertices, m_Triangles );
 
 		m_iStaticVertCountEnd = m_Vertices.Count();
 		m_iStaticTrisCountEnd = m_Triangles.Count();
 
 		if( m_bLog )
 		{
-			BSPHeader_t *header = (BSPHeader_t *)fileContent;
 			Log_Msg( LOG_RECAST, "Recast Load static map data for %s: %d verts and %d tris (bsp size: %d, version: %d)\n", filename, GetNumVerts(), GetNumTris(), length, header->version );
 		}
 	}
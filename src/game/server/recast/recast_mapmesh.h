@@ -18,6 +18,7 @@
 #include "recast/recast_imgr.h"
 
 class CBaseEntity;
+class CBSPReader;
 
 class CMapMesh : public IMapMesh
 {
@@ -50,10 +51,10 @@ class CMapMesh : public IMapMesh
 	void AddCollisionModelToMesh( const matrix3x4_t &transform, CPhysCollide const *pCollisionModel, 
 			CUtlVector<float> &verts, CUtlVector<int> &triangles, int filterContents = CONTENTS_EMPTY );
 
-	virtual bool GenerateDispVertsAndTris( void *fileContent, CUtlVector<float> &verts, CUtlVector<int> &triangles );
-	virtual bool GenerateStaticPropData( void *fileContent, CUtlVector<float> &verts, CUtlVector<int> &triangles );
+	virtual bool GenerateDispVertsAndTris( CBSPReader &bsp, CUtlVector<float> &verts, CUtlVector<int> &triangles );
+	virtual bool GenerateStaticPropData( CBSPReader &bsp, CUtlVector<float> &verts, CUtlVector<int> &triangles );
 	virtual bool GenerateDynamicPropData( CUtlVector<float> &verts, CUtlVector<int> &triangles );
-	virtual bool GenerateBrushData( void *fileContent, CUtlVector<float> &verts, CUtlVector<int> &triangles );
+	virtual bool GenerateBrushData( CBSPReader &bsp, CUtlVector<float> &verts, CUtlVector<int> &triangles );
 
 private:
 	MapMeshType_t m_Type;
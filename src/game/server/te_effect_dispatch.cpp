@@ -63,6 +63,102 @@ END_SEND_TABLE()
 // Singleton to fire TEEffectDispatch objects
 static CTEEffectDispatch g_TEEffectDispatch( "EffectDispatch" );
 
+ConVar sv_coalesce_effects( "sv_coalesce_effects", "1", 0, "Drop effects identical to one already dispatched to the same recipients this tick." );
+
+//-----------------------------------------------------------------------------
+// Effects dispatched this tick. Bursts (shotgun impacts, explosions hitting
+// the same surface) often repeat the exact same effect to the same players;
+// only the first copy is sent.
+//-----------------------------------------------------------------------------
+#define MAX_COALESCED_EFFECTS	64
+
+struct DispatchedEffect_t
+{
+	CEffectData m_Data;
+	float m_flDelay;
+	CEnginePlayerBitVec m_Recipients;
+};
+
+static DispatchedEffect_t s_DispatchedEffects[ MAX_COALESCED_EFFECTS ];
+static int s_nDispatchedEffects = 0;
+static int s_nDispatchedEffectsTick = -1;
+static int s_nCoalescedEffects = 0;
+
+static bool EffectDataEqual( const CEffectData &a, const CEffectData &b )
+{
+	return a.m_vOrigin == b.m_vOrigin &&
+		a.m_vStart == b.m_vStart &&
+		a.m_vNormal == b.m_vNormal &&
+		a.m_vAngles == b.m_vAngles &&
+		a.m_fFlags == b.m_fFlags &&
+		a.m_nEntIndex == b.m_nEntIndex &&
+		a.m_flScale == b.m_flScale &&
+		a.m_flMagnitude == b.m_flMagnitude &&
+		a.m_flRadius == b.m_flRadius &&
+		a.m_nAttachmentIndex == b.m_nAttachmentIndex &&
+		a.m_nSurfaceProp == b.m_nSurfaceProp &&
+		a.m_nMaterial == b.m_nMaterial &&
+		a.m_nDamageType == b.m_nDamageType &&
+		a.m_nHitBox == b.m_nHitBox &&
+		a.m_nOtherEntIndex == b.m_nOtherEntIndex &&
+		a.m_nColor == b.m_nColor &&
+		a.m_bCustomColors == b.m_bCustomColors &&
+		( !a.m_bCustomColors || ( a.m_CustomColors.m_vecColor1 == b.m_CustomColors.m_vecColor1 && a.m_CustomColors.m_vecColor2 == b.m_CustomColors.m_vecColor2 ) ) &&
+		a.m_bControlPoint1 == b.m_bControlPoint1 &&
+		( !a.m_bControlPoint1 || ( a.m_ControlPoint1.m_eParticleAttachment == b.m_ControlPoint1.m_eParticleAttachment && a.m_ControlPoint1.m_vecOffset == b.m_ControlPoint1.m_vecOffset ) ) &&
+		a.m_iEffectName == b.m_iEffectName;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns true if an identical effect already went to these recipients
+//  this tick, otherwise remembers this one.
+//-----------------------------------------------------------------------------
+static bool CoalesceEffect( IRecipientFilter &filter, float delay, const CEffectData &data )
+{
+	if ( s_nDispatchedEffectsTick != gpGlobals->tickcount )
+	{
+		s_nDispatchedEffectsTick = gpGlobals->tickcount;
+		s_nDispatchedEffects = 0;
+	}
+
+	CEnginePlayerBitVec recipients;
+	recipients.ClearAll();
+	for ( int i = 0; i < filter.GetRecipientCount(); ++i )
+	{
+		int nPlayer = filter.GetRecipientIndex( i );
+		if ( nPlayer >= 1 && nPlayer <= ABSOLUTE_PLAYER_LIMIT )
+		{
+			recipients.Set( nPlayer - 1 );
+		}
+	}
+
+	for ( int i = 0; i < s_nDispatchedEffects; ++i )
+	{
+		DispatchedEffect_t &other = s_DispatchedEffects[i];
+		if ( other.m_flDelay == delay && EffectDataEqual( other.m_Data, data ) && other.m_Recipients == recipients )
+		{
+			++s_nCoalescedEffects;
+			return true;
+		}
+	}
+
+	if ( s_nDispatchedEffects < MAX_COALESCED_EFFECTS )
+	{
+		DispatchedEffect_t &effect = s_DispatchedEffects[ s_nDispatchedEffects++ ];
+		effect.m_Data = data;
+		effect.m_flDelay = delay;
+		effect.m_Recipients = recipients;
+	}
+	return false;
+}
+
+int TE_GetCoalescedEffectCount()
+{
+	int nCount = s_nCoalescedEffects;
+	s_nCoalescedEffects = 0;
+	return nCount;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
@@ -74,6 +170,9 @@ void TE_DispatchEffect( IRecipientFilter& filter, float delay, const Vector &pos
 	// Get the entry index in the string table.
 	g_TEEffectDispatch.m_EffectData.m_iEffectName = GetEffectIndex( pName );
 
+	if ( sv_coalesce_effects.GetBool() && CoalesceEffect( filter, delay, g_TEEffectDispatch.m_EffectData ) )
+		return;
+
 	// Send it to anyone who can see the effect's origin.
 	g_TEEffectDispatch.Create( filter, 0 );
 }
@@ -18,4 +18,7 @@ void DispatchEffect( const char *pName, const CEffectData &data );
 void DispatchEffect( const char *pName, const CEffectData &data, IRecipientFilter &filter );
 void DispatchEffect( IRecipientFilter& filter, float flDelay, const char *pName, const CEffectData &data );
 
+// Returns how many duplicate effects were dropped since the last call
+int TE_GetCoalescedEffectCount();
+
 #endif // TE_EFFECT_DISPATCH_H
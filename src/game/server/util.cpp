@@ -1525,7 +1525,7 @@ void UTIL_SetModel( CBaseEntity *pEntity, const char *pModelName )
 		pAnimating->m_nForceBone = 0;
 	}
 
-	pEntity->SetModelName( AllocPooledString( pModelName ) );
+	pEntity->SetModelName( AllocPooledString_Persistent( pModelName ) );
 	pEntity->SetModelIndex( i ) ;
 	SetMinMaxSize(pEntity, vec3_origin, vec3_origin);
 	pEntity->SetCollisionBoundsFromModel();
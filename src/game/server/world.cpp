@@ -37,7 +37,7 @@ extern CBaseEntity				*g_pLastSpawn;
 void InitBodyQue(void);
 extern void W_Precache(void);
 extern void ActivityList_Free( void );
-extern CUtlMemoryPool g_EntityListPool;
+extern CMemoryPoolSlabAllocator g_EntityListPool;
 
 #if !defined( CLIENT_DLL )
 #define SF_GAME_EVENT_PROXY_AUTO_VISIBILITY		1
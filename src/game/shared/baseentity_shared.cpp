@@ -640,7 +640,11 @@ bool CSharedBaseEntity::KeyValue( const char *szKeyName, const char *szValue )
 
 	if ( FStrEq( szKeyName, "targetname" ) )
 	{
+#ifdef GAME_DLL
+		SetNameAsCStr( szValue );
+#else
 		m_iName = AllocPooledString( szValue );
+#endif
 		return true;
 	}
 
@@ -33,7 +33,8 @@ DEFINE_LOGGING_CHANNEL_NO_TAGS( LOG_ENTITYIO, "Entity I/O Client" );
 
 // this memory pool stores blocks around the size of CEventAction/inputitem_t structs
 // can be used for other blocks; will error if to big a block is tried to be allocated
-CUtlMemoryPool g_EntityListPool( MAX(sizeof(CEventAction),sizeof(CMultiInputVar::inputitem_t)), 512, CUtlMemoryPool::GROW_FAST, "g_EntityListPool" );
+// Actions and input items each get their own size class
+CMemoryPoolSlabAllocator g_EntityListPool( "g_EntityListPool", 512 );
 
 // ID Stamp used to uniquely identify every output
 int CEventAction::s_iNextIDStamp = 0;
@@ -80,7 +81,7 @@ CEventAction::CEventAction( const char *ActionData )
 	psz = nexttoken(szToken, psz, chDelim, sizeof(szToken));
 	if (szToken[0] != '\0')
 	{
-		m_iTargetInput = AllocPooledString(szToken);
+		m_iTargetInput = AllocPooledString_Persistent(szToken);
 	}
 	else
 	{
@@ -479,7 +480,7 @@ void CMultiInputVar::AddValue( variant_t newVal, int outputID )
 //
 // Purpose: holds and executes a global prioritized queue of entity actions
 //-----------------------------------------------------------------------------
-DEFINE_FIXEDSIZE_ALLOCATOR( EventQueuePrioritizedEvent_t, 128, CUtlMemoryPool::GROW_SLOW );
+DEFINE_FIXEDSIZE_ALLOCATOR_MT( EventQueuePrioritizedEvent_t, 128, UTLMEMORYPOOL_GROW_SLOW );
 
 CEventQueue g_EventQueue;
 
@@ -953,7 +954,7 @@ void *CMultiInputVar::inputitem_t::operator new( size_t stAllocateBlock, int nBl
 //-----------------------------------------------------------------------------
 void CMultiInputVar::inputitem_t::operator delete( void *pMem )
 {
-	g_EntityListPool.Free( pMem );
+	g_EntityListPool.Free( pMem, sizeof( CMultiInputVar::inputitem_t ) );
 }
 
 void *CEventAction::operator new( size_t stAllocateBlock )
@@ -968,7 +969,7 @@ void *CEventAction::operator new( size_t stAllocateBlock, int nBlockUse, const c
 
 void CEventAction::operator delete( void *pMem )
 {
-	g_EntityListPool.Free( pMem );
+	g_EntityListPool.Free( pMem, sizeof( CEventAction ) );
 }
 
 #pragma pop_macro("delete")
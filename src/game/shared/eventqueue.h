@@ -31,7 +31,7 @@ struct EventQueuePrioritizedEvent_t
 	EventQueuePrioritizedEvent_t *m_pNext;
 	EventQueuePrioritizedEvent_t *m_pPrev;
 
-	DECLARE_FIXEDSIZE_ALLOCATOR( PrioritizedEvent_t );
+	DECLARE_FIXEDSIZE_ALLOCATOR_MT( PrioritizedEvent_t );
 };
 
 class CEventQueue
@@ -8,6 +8,8 @@
 #include "cbase.h"
 
 #include "utlhashtable.h"
+#include "tier1/memstack.h"
+#include "tier1/generichash.h"
 #ifndef GC
 #include "igamesystem.h"
 #endif
@@ -16,8 +18,16 @@
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
+// Reserved address space for strings that outlive a level, committed as it fills
+#define PERSISTENT_STRING_ARENA_SIZE	( 4 * 1024 * 1024 )
+
 //-----------------------------------------------------------------------------
 // Purpose: The actual storage for pooled per-level strings
+//
+// Strings that are known to come back every level (classnames, model names,
+// input names) or that showed up in two levels in a row live in an append
+// only arena that is never purged. A string is only ever in one of the two
+// tables, so string_t comparison stays pointer equality.
 //-----------------------------------------------------------------------------
 #ifdef GC
 class CGameStringPool
@@ -29,6 +39,7 @@ class CGameStringPool : public CBaseGameSystem
 	virtual void LevelInitPreEntity() { InitGlobalStrings(); }
 	virtual void LevelShutdownPostEntity()
 	{
+		PromoteRecurringStrings();
 		FreeAll();
 		CGameString::IncrementSerialNumber();
 	}
@@ -40,25 +51,104 @@ class CGameStringPool : public CBaseGameSystem
 		m_KeyLookupCache.DbgCheckIntegrity();
 #endif
 		m_Strings.Purge();
-		m_KeyLookupCache.Purge();
+		m_PromoteHashes.Purge();
+
+		// Keys that resolved to persistent strings stay valid
+		for ( UtlHashHandle_t i = m_KeyLookupCache.FirstHandle(); i != m_KeyLookupCache.InvalidHandle(); )
+		{
+			if ( IsPersistent( m_KeyLookupCache[i] ) )
+			{
+				i = m_KeyLookupCache.NextHandle( i );
+			}
+			else
+			{
+				i = m_KeyLookupCache.RemoveAndAdvance( i );
+			}
+		}
+	}
+
+	bool IsPersistent( const char *pString )
+	{
+		const char *pBase = (const char *)m_PersistentArena.GetBase();
+		return pBase && pString >= pBase && pString < pBase + m_PersistentArena.GetUsed();
+	}
+
+	const char *FindPersistent( const char *string )
+	{
+		UtlHashHandle_t i = m_PersistentStrings.Find( string );
+		return i == m_PersistentStrings.InvalidHandle() ? NULL : m_PersistentStrings[ i ];
+	}
+
+	// Copies the string into the arena, NULL once the arena is full
+	const char *AddPersistent( const char *string )
+	{
+		int nLen = V_strlen( string ) + 1;
+		if ( m_PersistentArena.GetUsed() + nLen > m_PersistentArena.GetMaxSize() )
+			return NULL;
+
+		char *pCopy = (char *)m_PersistentArena.Alloc( nLen );
+		if ( !pCopy )
+			return NULL;
+
+		V_memcpy( pCopy, string, nLen );
+		m_PersistentStrings.Insert( pCopy );
+		return pCopy;
+	}
+
+	// Strings seen in the previous level as well as this one, or asked for as
+	// persistent while a level copy already existed, move to the arena
+	void PromoteRecurringStrings()
+	{
+		CUtlVector<uint32> levelHashes( 0, m_Strings.Count() );
+		FOR_EACH_HASHTABLE( m_Strings, i )
+		{
+			const char *pString = m_Strings[i].Get();
+			uint32 nHash = HashString( pString );
+			if ( m_PreviousLevelHashes.HasElement( nHash ) || m_PromoteHashes.HasElement( nHash ) )
+			{
+				AddPersistent( pString );
+			}
+			else
+			{
+				levelHashes.AddToTail( nHash );
+			}
+		}
+
+		m_PreviousLevelHashes.Purge();
+		for ( int i = 0; i < levelHashes.Count(); ++i )
+		{
+			m_PreviousLevelHashes.Insert( levelHashes[i] );
+		}
 	}
 
 	CUtlHashtable<CUtlConstString> m_Strings;
 	CUtlHashtable<const void*, const char*> m_KeyLookupCache;
 
+	CMemoryStack m_PersistentArena;
+	CUtlHashtable<const char *> m_PersistentStrings;
+	CUtlHashtable<uint32> m_PreviousLevelHashes;
+	CUtlHashtable<uint32> m_PromoteHashes;
+
 public:
 
-	CGameStringPool() : m_Strings(256) { }
+	CGameStringPool() : m_Strings(256), m_PersistentStrings(1024)
+	{
+		m_PersistentArena.Init( PERSISTENT_STRING_ARENA_SIZE, 64 * 1024, 0, 1 );
+	}
 
 	~CGameStringPool() { FreeAll(); }
 
 	void Dump( void )
 	{
-		CUtlVector<const char*> strings( 0, m_Strings.Count() );
+		CUtlVector<const char*> strings( 0, m_Strings.Count() + m_PersistentStrings.Count() );
 		for (UtlHashHandle_t i = m_Strings.FirstHandle(); i != m_Strings.InvalidHandle(); i = m_Strings.NextHandle(i))
 		{
 			strings.AddToTail( m_Strings[i] );
 		}
+		FOR_EACH_HASHTABLE( m_PersistentStrings, i )
+		{
+			strings.AddToTail( m_PersistentStrings[i] );
+		}
 		struct _Local {
 			static int __cdecl F(const char * const *a, const char * const *b) { return strcmp(*a, *b); }
 		};
@@ -66,29 +156,57 @@ class CGameStringPool : public CBaseGameSystem
 		
 		for ( int i = 0; i < strings.Count(); ++i )
 		{
-			DevMsg( "  %d (0x%p) : %s\n", i, strings[i], strings[i] );
+			DevMsg( "  %d (0x%p)%s : %s\n", i, strings[i], IsPersistent( strings[i] ) ? " [persistent]" : "", strings[i] );
 		}
 		DevMsg( "\n" );
-		DevMsg( "Size:  %d items\n", strings.Count() );
+		DevMsg( "Size:  %d items, %d persistent (%d / %d bytes)\n", strings.Count(), m_PersistentStrings.Count(),
+			m_PersistentArena.GetUsed(), m_PersistentArena.GetMaxSize() );
 	}
 
 	const char *Find(const char *string)
 	{
+		const char *pPersistent = FindPersistent( string );
+		if ( pPersistent )
+			return pPersistent;
+
 		UtlHashHandle_t i = m_Strings.Find( string );
 		return i == m_Strings.InvalidHandle() ? NULL : m_Strings[ i ].Get();
 	}
 
 	const char *Allocate(const char *string)
 	{
+		const char *pPersistent = FindPersistent( string );
+		if ( pPersistent )
+			return pPersistent;
+
 		return m_Strings[ m_Strings.Insert( string ) ].Get();
 	}
 
+	const char *AllocatePersistent(const char *string)
+	{
+		const char *pPersistent = FindPersistent( string );
+		if ( pPersistent )
+			return pPersistent;
+
+		// Already handed out from this level's table, keep using that copy
+		// until the level ends so existing string_ts still compare equal
+		UtlHashHandle_t i = m_Strings.Find( string );
+		if ( i != m_Strings.InvalidHandle() )
+		{
+			m_PromoteHashes.Insert( HashString( string ) );
+			return m_Strings[ i ].Get();
+		}
+
+		pPersistent = AddPersistent( string );
+		return pPersistent ? pPersistent : Allocate( string );
+	}
+
 	const char *AllocateWithKey(const char *string, const void* key)
 	{
 		const char * &cached = m_KeyLookupCache[ m_KeyLookupCache.Insert( key, NULL ) ];
 		if (cached == NULL)
 		{
-			cached = Allocate( string );
+			cached = AllocatePersistent( string );
 		}
 		return cached;
 	}
@@ -117,6 +235,13 @@ string_t AllocPooledString( const char * pszValue )
 	return NULL_STRING;
 }
 
+string_t AllocPooledString_Persistent( const char * pszValue )
+{
+	if (pszValue && *pszValue)
+		return MAKE_STRING( g_GameStringPool.AllocatePersistent( pszValue ) );
+	return NULL_STRING;
+}
+
 string_t AllocPooledString_StaticConstantStringPointer( const char * pszGlobalConstValue )
 {
 	Assert(pszGlobalConstValue && *pszGlobalConstValue);
@@ -2,7 +2,8 @@
 //
 // Purpose: Pool of all per-level strings. Allocates memory for strings, 
 //			consolodating duplicates. The memory is freed on behalf of clients
-//			at level transition. Strings are of type string_t.
+//			at level transition, except for persistent strings which are kept
+//			for the life of the dll. Strings are of type string_t.
 //
 // $NoKeywords: $
 //=============================================================================//
@@ -19,6 +20,8 @@
 // String allocation
 //-----------------------------------------------------------------------------
 string_t AllocPooledString( const char *pszValue );
+// For strings that come back every level (classnames, model names, inputs), kept across level changes
+string_t AllocPooledString_Persistent( const char *pszValue );
 string_t AllocPooledString_StaticConstantStringPointer( const char *pszGlobalConstValue );
 string_t FindPooledString( const char *pszValue );
 
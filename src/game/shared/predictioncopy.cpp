@@ -19,6 +19,7 @@
 #include "predictioncopy.h"
 #include "engine/ivmodelinfo.h"
 #include "tier1/fmtstr.h"
+#include "tier1/utlmap.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -1476,6 +1477,364 @@ void CPredictionCopy::DetermineWatchField( const char *operation, int entindex,
 	m_pWatchField = FindFieldByName( pwatchvar.GetString(), dmap );
 }
 
+static ConVar cl_pred_copyplans( "cl_pred_copyplans", "1", 0, "Use precompiled copy plans for prediction copies that don't check for errors." );
+
+//-----------------------------------------------------------------------------
+// Purpose: A datamap flattened into what a plain copy ( no error checking,
+//  describing or watching ) ends up doing. Every copied field becomes a byte
+//  range and adjacent ranges are merged, only strings and embedded pointers
+//  still need to be handled one at a time.
+//-----------------------------------------------------------------------------
+class CPredictionCopyPlan
+{
+public:
+	CPredictionCopyPlan( int nType, int nDestOffsetIndex, int nSrcOffsetIndex );
+	~CPredictionCopyPlan();
+
+	void	Compile( datamap_t *pMap );
+	void	Execute( void *pDest, void const *pSrc ) const;
+
+	int		GetFieldCount() const { return m_nFieldCount; }
+	int		GetRunCount() const { return m_Runs.Count(); }
+	int		GetRunBytes() const;
+
+private:
+	struct PlanOp_t
+	{
+		int		m_nDestOffset;
+		int		m_nSrcOffset;
+		int		m_nSize;		// Byte count for runs, sub plan index for embedded pointers
+		bool	m_bDerefDest;
+		bool	m_bDerefSrc;
+	};
+
+	void	AddFields_R( typedescription_t *pFields, int nFieldCount, int nDestBase, int nSrcBase, CUtlVector< typedescription_t * > &overridden );
+	void	AddRun( int nDestOffset, int nSrcOffset, int nSize );
+	void	MergeRuns();
+
+	static int __cdecl RunLessFunc( const PlanOp_t *pLeft, const PlanOp_t *pRight );
+
+	int		m_nType;
+	int		m_nDestOffsetIndex;
+	int		m_nSrcOffsetIndex;
+	int		m_nFieldCount;
+
+	CUtlVector< PlanOp_t >	m_Runs;
+	CUtlVector< PlanOp_t >	m_Strings;
+	CUtlVector< PlanOp_t >	m_EmbeddedPtrs;
+	CUtlVector< CPredictionCopyPlan * >	m_SubPlans;
+};
+
+CPredictionCopyPlan::CPredictionCopyPlan( int nType, int nDestOffsetIndex, int nSrcOffsetIndex )
+{
+	m_nType = nType;
+	m_nDestOffsetIndex = nDestOffsetIndex;
+	m_nSrcOffsetIndex = nSrcOffsetIndex;
+	m_nFieldCount = 0;
+}
+
+CPredictionCopyPlan::~CPredictionCopyPlan()
+{
+	m_SubPlans.PurgeAndDeleteElements();
+}
+
+int CPredictionCopyPlan::GetRunBytes() const
+{
+	int nBytes = 0;
+	for ( int i = 0; i < m_Runs.Count(); ++i )
+	{
+		nBytes += m_Runs[i].m_nSize;
+	}
+	return nBytes;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Walks the map and its base classes in the same order as TransferData_R
+//-----------------------------------------------------------------------------
+void CPredictionCopyPlan::Compile( datamap_t *pMap )
+{
+	Assert( pMap->chains_validated );
+
+	CUtlVector< typedescription_t * > overridden;
+	for ( datamap_t *pChain = pMap; pChain; pChain = pChain->baseMap )
+	{
+		AddFields_R( pChain->dataDesc, pChain->dataNumFields, 0, 0, overridden );
+	}
+
+	MergeRuns();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Mirrors the skipping rules and type handling in CPredictionCopy::CopyFields
+//-----------------------------------------------------------------------------
+void CPredictionCopyPlan::AddFields_R( typedescription_t *pFields, int nFieldCount, int nDestBase, int nSrcBase, CUtlVector< typedescription_t * > &overridden )
+{
+	for ( int i = 0; i < nFieldCount; i++ )
+	{
+		typedescription_t *pField = &pFields[ i ];
+		int flags = pField->flags;
+
+		// Overridden baseclass fields are skipped when we get to them
+		if ( pField->override_field != NULL )
+		{
+			overridden.AddToTail( pField->override_field );
+		}
+
+		if ( overridden.Find( pField ) != overridden.InvalidIndex() )
+			continue;
+
+		if ( pField->fieldType != FIELD_EMBEDDED )
+		{
+			if ( flags & FTYPEDESC_PRIVATE )
+				continue;
+
+			if ( m_nType == PC_NON_NETWORKED_ONLY && ( flags & FTYPEDESC_INSENDTABLE ) )
+				continue;
+
+			if ( m_nType == PC_NETWORKED_ONLY && !( flags & FTYPEDESC_INSENDTABLE ) )
+				continue;
+		}
+
+		int nDestOffset = nDestBase + pField->fieldOffset[ m_nDestOffsetIndex ];
+		int nSrcOffset = nSrcBase + pField->fieldOffset[ m_nSrcOffsetIndex ];
+		int nCount = pField->fieldSize;
+
+		++m_nFieldCount;
+
+		switch ( pField->fieldType )
+		{
+		case FIELD_EMBEDDED:
+			{
+				// Pointers are only followed in unpacked data
+				bool bDerefDest = ( flags & FTYPEDESC_PTR ) && ( m_nDestOffsetIndex == TD_OFFSET_NORMAL );
+				bool bDerefSrc = ( flags & FTYPEDESC_PTR ) && ( m_nSrcOffsetIndex == TD_OFFSET_NORMAL );
+				if ( !bDerefDest && !bDerefSrc )
+				{
+					AddFields_R( pField->td->dataDesc, pField->td->dataNumFields, nDestOffset, nSrcOffset, overridden );
+					break;
+				}
+
+				CPredictionCopyPlan *pSubPlan = new CPredictionCopyPlan( m_nType, m_nDestOffsetIndex, m_nSrcOffsetIndex );
+				pSubPlan->AddFields_R( pField->td->dataDesc, pField->td->dataNumFields, 0, 0, overridden );
+				pSubPlan->MergeRuns();
+
+				PlanOp_t &op = m_EmbeddedPtrs[ m_EmbeddedPtrs.AddToTail() ];
+				op.m_nDestOffset = nDestOffset;
+				op.m_nSrcOffset = nSrcOffset;
+				op.m_nSize = m_SubPlans.AddToTail( pSubPlan );
+				op.m_bDerefDest = bDerefDest;
+				op.m_bDerefSrc = bDerefSrc;
+			}
+			break;
+
+		case FIELD_STRING:
+			{
+				PlanOp_t &op = m_Strings[ m_Strings.AddToTail() ];
+				op.m_nDestOffset = nDestOffset;
+				op.m_nSrcOffset = nSrcOffset;
+				op.m_nSize = 0;
+				op.m_bDerefDest = op.m_bDerefSrc = false;
+			}
+			break;
+
+		case FIELD_FLOAT:		AddRun( nDestOffset, nSrcOffset, sizeof( float ) * nCount );			break;
+		case FIELD_VECTOR:		AddRun( nDestOffset, nSrcOffset, sizeof( Vector ) * nCount );			break;
+		case FIELD_QUATERNION:	AddRun( nDestOffset, nSrcOffset, sizeof( Quaternion ) * nCount );		break;
+		case FIELD_COLOR32:		AddRun( nDestOffset, nSrcOffset, 4 * nCount );							break;
+		case FIELD_BOOLEAN:		AddRun( nDestOffset, nSrcOffset, sizeof( bool ) * nCount );				break;
+		case FIELD_INTEGER64:	AddRun( nDestOffset, nSrcOffset, sizeof( int64 ) * nCount );			break;
+		case FIELD_MODELINDEX:	AddRun( nDestOffset, nSrcOffset, sizeof( modelindex_t ) * nCount );		break;
+		case FIELD_INTEGER:		AddRun( nDestOffset, nSrcOffset, sizeof( int ) * nCount );				break;
+		case FIELD_SHORT:		AddRun( nDestOffset, nSrcOffset, sizeof( short ) * nCount );			break;
+		case FIELD_CHARACTER:	AddRun( nDestOffset, nSrcOffset, nCount );								break;
+
+		// Handles are just a serial number + index, assigning them is a plain copy
+		case FIELD_EHANDLE:		AddRun( nDestOffset, nSrcOffset, sizeof( EHANDLE ) * nCount );			break;
+
+		default:
+			// Types CopyFields doesn't copy either ( it asserts or ignores them )
+			--m_nFieldCount;
+			break;
+		}
+	}
+}
+
+void CPredictionCopyPlan::AddRun( int nDestOffset, int nSrcOffset, int nSize )
+{
+	if ( nSize <= 0 )
+		return;
+
+	PlanOp_t &op = m_Runs[ m_Runs.AddToTail() ];
+	op.m_nDestOffset = nDestOffset;
+	op.m_nSrcOffset = nSrcOffset;
+	op.m_nSize = nSize;
+	op.m_bDerefDest = op.m_bDerefSrc = false;
+}
+
+int __cdecl CPredictionCopyPlan::RunLessFunc( const PlanOp_t *pLeft, const PlanOp_t *pRight )
+{
+	return pLeft->m_nDestOffset - pRight->m_nDestOffset;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: The runs never overlap, so they can be reordered by destination and
+//  any run that continues both the previous destination and source range is
+//  folded into it.
+//-----------------------------------------------------------------------------
+void CPredictionCopyPlan::MergeRuns()
+{
+	if ( m_Runs.Count() < 2 )
+		return;
+
+	m_Runs.Sort( RunLessFunc );
+
+	int nMerged = 0;
+	for ( int i = 1; i < m_Runs.Count(); ++i )
+	{
+		PlanOp_t &prev = m_Runs[ nMerged ];
+		const PlanOp_t &cur = m_Runs[ i ];
+		if ( prev.m_nDestOffset + prev.m_nSize == cur.m_nDestOffset &&
+			 prev.m_nSrcOffset + prev.m_nSize == cur.m_nSrcOffset )
+		{
+			prev.m_nSize += cur.m_nSize;
+			continue;
+		}
+
+		m_Runs[ ++nMerged ] = cur;
+	}
+
+	m_Runs.SetCountNonDestructively( nMerged + 1 );
+}
+
+void CPredictionCopyPlan::Execute( void *pDest, void const *pSrc ) const
+{
+	char *pDestBytes = (char *)pDest;
+	const char *pSrcBytes = (const char *)pSrc;
+
+	for ( int i = 0; i < m_Runs.Count(); ++i )
+	{
+		const PlanOp_t &op = m_Runs[ i ];
+		memcpy( pDestBytes + op.m_nDestOffset, pSrcBytes + op.m_nSrcOffset, op.m_nSize );
+	}
+
+	for ( int i = 0; i < m_Strings.Count(); ++i )
+	{
+		const PlanOp_t &op = m_Strings[ i ];
+		const char *pInString = pSrcBytes + op.m_nSrcOffset;
+		memcpy( pDestBytes + op.m_nDestOffset, pInString, Q_strlen( pInString ) + 1 );
+	}
+
+	for ( int i = 0; i < m_EmbeddedPtrs.Count(); ++i )
+	{
+		const PlanOp_t &op = m_EmbeddedPtrs[ i ];
+
+		void *pSubDest = pDestBytes + op.m_nDestOffset;
+		if ( op.m_bDerefDest )
+		{
+			pSubDest = *( (void **)pSubDest );
+		}
+
+		void const *pSubSrc = pSrcBytes + op.m_nSrcOffset;
+		if ( op.m_bDerefSrc )
+		{
+			pSubSrc = *( (void * const *)pSubSrc );
+		}
+
+		if ( !pSubDest || !pSubSrc )
+			continue;
+
+		m_SubPlans[ op.m_nSize ]->Execute( pSubDest, pSubSrc );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Plans are compiled the first time a map is copied with a given
+//  type and packing, and live until the dll unloads
+//-----------------------------------------------------------------------------
+class CPredictionCopyPlanCache
+{
+public:
+	CPredictionCopyPlanCache() : m_Plans( 0, 0, KeyLessFunc ) {}
+	~CPredictionCopyPlanCache() { Purge(); }
+
+	const CPredictionCopyPlan *GetPlan( datamap_t *pMap, int nType, int nDestOffsetIndex, int nSrcOffsetIndex );
+	void Purge();
+	void Dump();
+
+private:
+	struct PlanKey_t
+	{
+		datamap_t	*m_pMap;
+		int			m_nType;
+		int			m_nDestOffsetIndex;
+		int			m_nSrcOffsetIndex;
+	};
+
+	static bool KeyLessFunc( const PlanKey_t &left, const PlanKey_t &right )
+	{
+		if ( left.m_pMap != right.m_pMap )
+			return left.m_pMap < right.m_pMap;
+		if ( left.m_nType != right.m_nType )
+			return left.m_nType < right.m_nType;
+		if ( left.m_nDestOffsetIndex != right.m_nDestOffsetIndex )
+			return left.m_nDestOffsetIndex < right.m_nDestOffsetIndex;
+		return left.m_nSrcOffsetIndex < right.m_nSrcOffsetIndex;
+	}
+
+	CUtlMap< PlanKey_t, CPredictionCopyPlan * >	m_Plans;
+};
+
+static CPredictionCopyPlanCache g_PredictionCopyPlans;
+
+const CPredictionCopyPlan *CPredictionCopyPlanCache::GetPlan( datamap_t *pMap, int nType, int nDestOffsetIndex, int nSrcOffsetIndex )
+{
+	PlanKey_t key;
+	key.m_pMap = pMap;
+	key.m_nType = nType;
+	key.m_nDestOffsetIndex = nDestOffsetIndex;
+	key.m_nSrcOffsetIndex = nSrcOffsetIndex;
+
+	unsigned short i = m_Plans.Find( key );
+	if ( i != m_Plans.InvalidIndex() )
+		return m_Plans[ i ];
+
+	CPredictionCopyPlan *pPlan = new CPredictionCopyPlan( nType, nDestOffsetIndex, nSrcOffsetIndex );
+	pPlan->Compile( pMap );
+	m_Plans.Insert( key, pPlan );
+	return pPlan;
+}
+
+void CPredictionCopyPlanCache::Purge()
+{
+	for ( unsigned short i = m_Plans.FirstInorder(); i != m_Plans.InvalidIndex(); i = m_Plans.NextInorder( i ) )
+	{
+		delete m_Plans[ i ];
+	}
+	m_Plans.RemoveAll();
+}
+
+void CPredictionCopyPlanCache::Dump()
+{
+	static const char *s_pTypeNames[] = { "everything", "non-networked", "networked" };
+
+	for ( unsigned short i = m_Plans.FirstInorder(); i != m_Plans.InvalidIndex(); i = m_Plans.NextInorder( i ) )
+	{
+		const PlanKey_t &key = m_Plans.Key( i );
+		const CPredictionCopyPlan *pPlan = m_Plans[ i ];
+		Msg( "%-32s %-14s %s->%s : %4d fields -> %4d runs ( %d bytes )\n", 
+			key.m_pMap->dataClassName, 
+			s_pTypeNames[ clamp( key.m_nType, 0, (int)ARRAYSIZE( s_pTypeNames ) - 1 ) ],
+			key.m_nSrcOffsetIndex == TD_OFFSET_PACKED ? "packed" : "normal",
+			key.m_nDestOffsetIndex == TD_OFFSET_PACKED ? "packed" : "normal",
+			pPlan->GetFieldCount(), pPlan->GetRunCount(), pPlan->GetRunBytes() );
+	}
+}
+
+CON_COMMAND_F( cl_pred_copyplans_dump, "Lists the compiled prediction copy plans.", FCVAR_CHEAT )
+{
+	g_PredictionCopyPlans.Dump();
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 // Input  : *operation - 
@@ -1494,6 +1853,14 @@ int CPredictionCopy::TransferData( const char *operation, int entindex, datamap_
 	
 	DetermineWatchField( operation, entindex, dmap );
 
+	// Plain copies don't need the per field compare/describe/watch work, use the compiled plan
+	if ( m_bPerformCopy && !m_bErrorCheck && !m_pWatchField && cl_pred_copyplans.GetBool() )
+	{
+		const CPredictionCopyPlan *pPlan = g_PredictionCopyPlans.GetPlan( dmap, m_nType, m_nDestOffsetIndex, m_nSrcOffsetIndex );
+		pPlan->Execute( m_pDest, m_pSrc );
+		return m_nErrorCount;
+	}
+
 	TransferData_R( g_nChainCount, dmap );
 
 	return m_nErrorCount;
@@ -31,7 +31,7 @@
 #define EXT_NAVFILE "recast"
 
 static const int NAVMESHSET_MAGIC = 'M'<<24 | 'S'<<16 | 'E'<<8 | 'T'; //'MSET';
-static const int NAVMESHSET_VERSION = 3;
+static const int NAVMESHSET_VERSION = 5;
 
 struct NavMgrHeader
 {
@@ -172,57 +172,9 @@ bool CRecastMesh::Load( CUtlBuffer &fileBuffer, CMapMesh *pMapMesh )
 		return false;
 	}
 
-	uint infoCount;
-	fileBuffer.Get( &infoCount, sizeof(uint) );
-
-	for(int i = 0; i < infoCount; ++i) {
-		dtPolyRef src_ref;
-		fileBuffer.Get( &src_ref, sizeof(dtPolyRef) );
-
-		PolyVisibilityInfo &info = m_polyVisibility[ m_polyVisibility.Insert( src_ref ) ];
-
-		uint visCount;
-		fileBuffer.Get( &visCount, sizeof(uint) );
-
-		for(int j = 0; j < visCount; ++j) {
-			dtPolyRef tgt_ref;
-			fileBuffer.Get( &tgt_ref, sizeof(dtPolyRef) );
-
-			uint vertCount;
-			fileBuffer.Get( &vertCount, sizeof(uint) );
-
-			auto vis_hndl = info.visible.Insert( tgt_ref );
-
-			for(int k = 0; k < vertCount; ++k) {
-				uint32 src_vert;
-				fileBuffer.Get( &src_vert, sizeof(uint32) );
-				uint32 dst_vert;
-				fileBuffer.Get( &dst_vert, sizeof(uint32) );
-
-				info.visible[ vis_hndl ].verts.AddToTail( PolyVisibilityInfo::VisibilityConnectionInfo::vertPair{src_vert, dst_vert} );
-			}
-		}
-
-		fileBuffer.Get( &visCount, sizeof(uint) );
-
-		for(int j = 0; j < visCount; ++j) {
-			dtPolyRef tgt_ref;
-			fileBuffer.Get( &tgt_ref, sizeof(dtPolyRef) );
-
-			uint vertCount;
-			fileBuffer.Get( &vertCount, sizeof(uint) );
-
-			auto not_vis_hndl = info.not_visible.Insert( tgt_ref );
-
-			for(int k = 0; k < vertCount; ++k) {
-				uint32 src_vert;
-				fileBuffer.Get( &src_vert, sizeof(uint32) );
-				uint32 dst_vert;
-				fileBuffer.Get( &dst_vert, sizeof(uint32) );
-
-				info.not_visible[ not_vis_hndl ].verts.AddToTail( PolyVisibilityInfo::VisibilityConnectionInfo::vertPair{src_vert, dst_vert} );
-			}
-		}
+	if( !m_polyVisibility.Load( fileBuffer ) )
+	{
+		Log_Warning( LOG_RECAST, "CRecastMesh: Invalid visibility data for mesh %s\n", GetName() );
 	}
 
 	PostLoad();
@@ -400,55 +352,7 @@ bool CRecastMesh::Save( CUtlBuffer &fileBuffer )
 		}
 	}
 
-	uint visCount = m_polyVisibility.Count();
-	fileBuffer.Put( &visCount, sizeof(uint) );
-
-	FOR_EACH_HASHTABLE( m_polyVisibility, it )
-	{
-		dtPolyRef src_ref = m_polyVisibility.Key( it );
-		fileBuffer.Put( &src_ref, sizeof(dtPolyRef) );
-
-		const PolyVisibilityInfo &info = m_polyVisibility.Element( it );
-
-		visCount = info.visible.Count();
-		fileBuffer.Put( &visCount, sizeof(uint) );
-
-		FOR_EACH_HASHTABLE( info.visible, it2 )
-		{
-			dtPolyRef tgt_ref = info.visible.Key( it2 );
-
-			const PolyVisibilityInfo::VisibilityConnectionInfo &conn_info = info.visible.Element(it2);
-
-			fileBuffer.Put( &tgt_ref, sizeof(dtPolyRef) );
-
-			visCount = conn_info.verts.Count();
-			fileBuffer.Put( &visCount, sizeof(uint) );
-
-			for(int k = 0; k < visCount; ++k) {
-				const PolyVisibilityInfo::VisibilityConnectionInfo::vertPair &vert = conn_info.verts[k];
-				fileBuffer.Put( &vert.src_vert, sizeof(uint32) );
-				fileBuffer.Put( &vert.dst_vert, sizeof(uint32) );
-			}
-		}
-
-		FOR_EACH_HASHTABLE( info.not_visible, it2 )
-		{
-			dtPolyRef tgt_ref = info.not_visible.Key( it2 );
-
-			const PolyVisibilityInfo::VisibilityConnectionInfo &conn_info = info.not_visible.Element(it2);
-
-			fileBuffer.Put( &tgt_ref, sizeof(dtPolyRef) );
-
-			visCount = conn_info.verts.Count();
-			fileBuffer.Put( &visCount, sizeof(uint) );
-
-			for(int k = 0; k < visCount; ++k) {
-				const PolyVisibilityInfo::VisibilityConnectionInfo::vertPair &vert = conn_info.verts[k];
-				fileBuffer.Put( &vert.src_vert, sizeof(uint32) );
-				fileBuffer.Put( &vert.dst_vert, sizeof(uint32) );
-			}
-		}
-	}
+	m_polyVisibility.Save( fileBuffer );
 
 	return true;
 }
@@ -466,11 +466,151 @@ void CRecastMesh::Update( float dt )
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CRecastPolyVisibility::Purge()
+{
+	m_SrcPolys.Purge();
+	m_SrcVertCount.Purge();
+	m_SrcFirstTarget.Purge();
+	m_TgtPolys.Purge();
+	m_TgtFirstBit.Purge();
+	m_Bits.Purge();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+int CRecastPolyVisibility::GetMemoryUsage() const
+{
+	return m_SrcPolys.NumAllocated() * sizeof( dtPolyRef ) +
+		m_SrcVertCount.NumAllocated() * sizeof( uint8 ) +
+		m_SrcFirstTarget.NumAllocated() * sizeof( uint32 ) +
+		m_TgtPolys.NumAllocated() * sizeof( dtPolyRef ) +
+		m_TgtFirstBit.NumAllocated() * sizeof( uint32 ) +
+		m_Bits.NumAllocated() * sizeof( uint32 );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Binary searches source and target, then tests the vertex pair bit
+//-----------------------------------------------------------------------------
+int CRecastPolyVisibility::IsVertVisible( dtPolyRef srcRef, int srcVert, dtPolyRef tgtRef, int tgtVert ) const
+{
+	int lo = 0, hi = m_SrcPolys.Count() - 1;
+	while ( lo <= hi )
+	{
+		int mid = ( lo + hi ) >> 1;
+		if ( m_SrcPolys[mid] < srcRef )
+			lo = mid + 1;
+		else if ( m_SrcPolys[mid] > srcRef )
+			hi = mid - 1;
+		else
+		{
+			int nSrcVerts = m_SrcVertCount[mid];
+			int tlo = m_SrcFirstTarget[mid], thi = m_SrcFirstTarget[mid + 1] - 1;
+			while ( tlo <= thi )
+			{
+				int tmid = ( tlo + thi ) >> 1;
+				if ( m_TgtPolys[tmid] < tgtRef )
+					tlo = tmid + 1;
+				else if ( m_TgtPolys[tmid] > tgtRef )
+					thi = tmid - 1;
+				else
+				{
+					uint32 nFirstBit = m_TgtFirstBit[tmid];
+					int nTgtVerts = nSrcVerts ? ( m_TgtFirstBit[tmid + 1] - nFirstBit ) / nSrcVerts : 0;
+					if ( srcVert < 0 || srcVert >= nSrcVerts || tgtVert < 0 || tgtVert >= nTgtVerts )
+						return VIS_UNKNOWN;
+
+					uint32 nBit = nFirstBit + srcVert * nTgtVerts + tgtVert;
+					return ( m_Bits[ nBit >> 5 ] & ( 1u << ( nBit & 31 ) ) ) ? VIS_VISIBLE : VIS_BLOCKED;
+				}
+			}
+			return VIS_UNKNOWN;
+		}
+	}
+	return VIS_UNKNOWN;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+template< class T >
+static void PutVisibilityArray( CUtlBuffer &fileBuffer, const CUtlVector< T > &vec )
+{
+	uint nCount = vec.Count();
+	fileBuffer.Put( &nCount, sizeof( uint ) );
+	if ( nCount )
+		fileBuffer.Put( vec.Base(), nCount * sizeof( T ) );
+}
+
+template< class T >
+static bool GetVisibilityArray( CUtlBuffer &fileBuffer, CUtlVector< T > &vec )
+{
+	uint nCount = 0;
+	fileBuffer.Get( &nCount, sizeof( uint ) );
+	if ( !fileBuffer.IsValid() || nCount > (uint)fileBuffer.GetBytesRemaining() / sizeof( T ) )
+		return false;
+
+	vec.SetCount( nCount );
+	if ( nCount )
+		fileBuffer.Get( vec.Base(), nCount * sizeof( T ) );
+	return fileBuffer.IsValid();
+}
+
+void CRecastPolyVisibility::Save( CUtlBuffer &fileBuffer ) const
+{
+	PutVisibilityArray( fileBuffer, m_SrcPolys );
+	PutVisibilityArray( fileBuffer, m_SrcVertCount );
+	PutVisibilityArray( fileBuffer, m_SrcFirstTarget );
+	PutVisibilityArray( fileBuffer, m_TgtPolys );
+	PutVisibilityArray( fileBuffer, m_TgtFirstBit );
+	PutVisibilityArray( fileBuffer, m_Bits );
+}
+
+bool CRecastPolyVisibility::Load( CUtlBuffer &fileBuffer )
+{
+	Purge();
+
+	bool bValid = GetVisibilityArray( fileBuffer, m_SrcPolys ) &&
+		GetVisibilityArray( fileBuffer, m_SrcVertCount ) &&
+		GetVisibilityArray( fileBuffer, m_SrcFirstTarget ) &&
+		GetVisibilityArray( fileBuffer, m_TgtPolys ) &&
+		GetVisibilityArray( fileBuffer, m_TgtFirstBit ) &&
+		GetVisibilityArray( fileBuffer, m_Bits );
+
+	// Make sure the offsets can't index out of the arrays
+	bValid = bValid &&
+		m_SrcVertCount.Count() == m_SrcPolys.Count() &&
+		m_SrcFirstTarget.Count() == m_SrcPolys.Count() + 1 &&
+		m_SrcFirstTarget.Tail() == (uint32)m_TgtPolys.Count() &&
+		m_TgtFirstBit.Count() == m_TgtPolys.Count() + 1 &&
+		m_TgtFirstBit.Tail() <= (uint32)m_Bits.Count() * 32;
+
+	for ( int i = 1; bValid && i < m_SrcFirstTarget.Count(); ++i )
+	{
+		bValid = m_SrcFirstTarget[i - 1] <= m_SrcFirstTarget[i];
+	}
+	for ( int i = 1; bValid && i < m_TgtFirstBit.Count(); ++i )
+	{
+		bValid = m_TgtFirstBit[i - 1] <= m_TgtFirstBit[i];
+	}
+
+	if ( !bValid )
+	{
+		Purge();
+	}
+	return bValid;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
 bool CRecastMesh::Reset()
 {
+	m_polyVisibility.Purge();
+
 	// Cleanup Nav mesh data
 	if( m_navMesh )
 	{
@@ -1055,6 +1195,110 @@ bool CRecastMesh::CanUseCachedPath( dtPolyRef startRef, dtPolyRef endRef, pathfi
 }
 
 #ifndef CLIENT_DLL
+//-----------------------------------------------------------------------------
+// Purpose: Collects the tactical candidates around vCenter. Polys come from the
+//			local neighbourhood so every candidate is connected to vCenter's
+//			poly; threat exposure is read from the precomputed visibility.
+//-----------------------------------------------------------------------------
+int CRecastMesh::GetTacticalPolys( const Vector &vCenter, float fRadius, dtPolyRef threatRef, TacticalPoly_t *pPolys, int nMaxPolys )
+{
+	if( !IsLoaded() )
+		return 0;
+
+	dtPolyRef centerRef = GetPolyRef( vCenter );
+	if( !centerRef )
+		return 0;
+
+	float centerPos[3];
+	centerPos[0] = vCenter.x;
+	centerPos[1] = vCenter.z;
+	centerPos[2] = vCenter.y;
+
+	int numPolys = 0;
+	dtPolyRef polys[RECASTMESH_MAX_POLYS];
+	if( !dtStatusSucceed( m_navQuery->findLocalNeighbourhood( centerRef, centerPos, fRadius, &defaultQueryFilter, polys, NULL, &numPolys, ARRAYSIZE(polys) ) ) )
+		return 0;
+
+	int nThreatVerts = 0;
+	if( threatRef && IsValidPolyRef( threatRef ) )
+	{
+		const dtMeshTile *threatTile;
+		const dtPoly *threatPoly;
+		m_navMesh->getTileAndPolyByRefUnsafe( threatRef, &threatTile, &threatPoly );
+		nThreatVerts = threatPoly->vertCount;
+	}
+
+	int nCount = 0;
+	for( int i = 0; i < numPolys && nCount < nMaxPolys; ++i )
+	{
+		const dtMeshTile *tile;
+		const dtPoly *poly;
+		m_navMesh->getTileAndPolyByRefUnsafe( polys[i], &tile, &poly );
+		if( poly->getType() != DT_POLYTYPE_GROUND || poly->vertCount == 0 )
+			continue;
+
+		TacticalPoly_t &result = pPolys[nCount++];
+		result.polyRef = polys[i];
+		result.nVerts = poly->vertCount;
+		result.nExposedVerts = nThreatVerts ? 0 : -1;
+		result.bHidingSpot = false;
+
+		Vector vSum( 0, 0, 0 );
+		for( int n = 0; n < poly->vertCount; ++n )
+		{
+			const float *v = &tile->verts[ poly->verts[n] * 3 ];
+			vSum += Vector( v[0], v[2], v[1] );
+
+			if( result.nExposedVerts == -1 )
+				continue;
+
+			bool bExposed = false;
+			for( int l = 0; l < nThreatVerts; ++l )
+			{
+				int vis = m_polyVisibility.IsVertVisible( threatRef, l, polys[i], n );
+				if( vis == CRecastPolyVisibility::VIS_UNKNOWN )
+				{
+					result.nExposedVerts = -1;
+					break;
+				}
+				if( vis == CRecastPolyVisibility::VIS_VISIBLE )
+				{
+					bExposed = true;
+					break;
+				}
+			}
+			if( bExposed && result.nExposedVerts != -1 )
+				result.nExposedVerts++;
+		}
+		result.vPos = vSum / poly->vertCount;
+	}
+
+	// Prefer hiding spots that are in cover over the bare poly center
+	const HidingSpotVector &spots = TheHidingSpots[ m_Type ];
+	if( spots.Count() )
+	{
+		float flRadiusSqr = Square( fRadius );
+		FOR_EACH_VEC( spots, i )
+		{
+			const HidingSpot *pSpot = spots[i];
+			if( !pSpot->HasGoodCover() || pSpot->GetPosition().DistToSqr( vCenter ) > flRadiusSqr )
+				continue;
+
+			for( int j = 0; j < nCount; ++j )
+			{
+				if( pPolys[j].polyRef == pSpot->GetPoly() )
+				{
+					pPolys[j].vPos = pSpot->GetPosition();
+					pPolys[j].bHidingSpot = true;
+					break;
+				}
+			}
+		}
+	}
+
+	return nCount;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Builds a waypoint list from the path finding results.
 //-----------------------------------------------------------------------------
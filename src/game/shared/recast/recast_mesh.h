@@ -219,21 +219,43 @@ struct SpotOrder
 };
 typedef CUtlVector< SpotOrder > SpotOrderVector;
 
-struct PolyVisibilityInfo
+//-----------------------------------------------------------------------------
+// Precomputed vertex to vertex visibility between nearby polygons, stored in
+// compressed sparse row form. Each source poly owns a run of target polys
+// (sorted by ref) and each target a run of srcVerts * tgtVerts bits, where bit
+// ( srcVert * tgtVerts + tgtVert ) is set when the trace between those two
+// vertices is clear.
+//-----------------------------------------------------------------------------
+class CRecastPolyVisibility
 {
-	struct VisibilityConnectionInfo
+public:
+	enum
 	{
-		struct vertPair
-		{
-			uint32 src_vert;
-			uint32 dst_vert;
-		};
-
-		CUtlVectorConservative<vertPair> verts;
+		VIS_UNKNOWN = -1,	// target isn't in the source's neighbourhood
+		VIS_BLOCKED = 0,
+		VIS_VISIBLE = 1,
 	};
 
-	CUtlHashtable<dtPolyRef, VisibilityConnectionInfo> visible;
-	CUtlHashtable<dtPolyRef, VisibilityConnectionInfo> not_visible;
+	void Purge();
+	int GetNumSourcePolys() const { return m_SrcPolys.Count(); }
+	int GetNumTargets() const { return m_TgtPolys.Count(); }
+	int GetMemoryUsage() const;
+
+	// Returns a VIS_ value
+	int IsVertVisible( dtPolyRef srcRef, int srcVert, dtPolyRef tgtRef, int tgtVert ) const;
+
+	void Save( CUtlBuffer &fileBuffer ) const;
+	bool Load( CUtlBuffer &fileBuffer );
+
+	// Source polys, sorted by ref
+	CUtlVector< dtPolyRef > m_SrcPolys;
+	CUtlVector< uint8 > m_SrcVertCount;
+	// Targets of source i are m_TgtPolys[ m_SrcFirstTarget[i] ] up to m_SrcFirstTarget[i+1]
+	CUtlVector< uint32 > m_SrcFirstTarget;
+	CUtlVector< dtPolyRef > m_TgtPolys;
+	// Visibility bits of target j start at m_TgtFirstBit[j], up to m_TgtFirstBit[j+1]
+	CUtlVector< uint32 > m_TgtFirstBit;
+	CUtlVector< uint32 > m_Bits;
 };
 
 class CRecastMesh
@@ -314,6 +336,19 @@ class CRecastMesh
 	}
 
 #ifndef CLIENT_DLL
+	// Tactical queries. Gathers the polys connected to vCenter within fRadius and, when
+	// threatRef is given, how many of each poly's vertices the threat poly can see
+	// according to the precomputed visibility (-1 when that pair wasn't precomputed).
+	struct TacticalPoly_t
+	{
+		dtPolyRef polyRef;
+		Vector vPos;			// poly center, or the hiding spot inside it
+		int nVerts;
+		int nExposedVerts;
+		bool bHidingSpot;		// vPos is a hiding spot with good cover
+	};
+	int GetTacticalPolys( const Vector &vCenter, float fRadius, dtPolyRef threatRef, TacticalPoly_t *pPolys, int nMaxPolys );
+
 	// Path find functions
 	AI_Waypoint_t *FindPath( const Vector &vStart, const Vector &vEnd, float fBeneathLimit = 120.0f, CBaseEntity *pTarget = NULL, 
 		bool *bIsPartial = NULL, const Vector *pStartTestPos = NULL );
@@ -439,7 +474,7 @@ class CRecastMesh
 
 	HidingSpotVector m_HidingSpots;
 
-	CUtlHashtable<dtPolyRef, PolyVisibilityInfo> m_polyVisibility;
+	CRecastPolyVisibility m_polyVisibility;
 };
 
 //--------------------------------------------------------------------------------------------------------------
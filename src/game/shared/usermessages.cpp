@@ -20,6 +20,10 @@ DEFINE_LOGGING_CHANNEL_NO_TAGS( LOG_USERMSG, "UserMessages Client" );
 
 void RegisterUserMessages( void );
 
+#if defined( CLIENT_DLL )
+static void __MsgFunc_Batch( bf_read &msg );
+#endif
+
 //-----------------------------------------------------------------------------
 // Purpose: Force registration on .dll load
 // FIXME:  Should this be a client/server system?
@@ -47,13 +51,13 @@ CUserMessages::CUserMessages()
 	Register( "SendAudio", -1 );	// play radion command
 	Register( "ShowMenu", -1 );	// show hud menu
 
-	Register( "Shake", 13 );		// shake view
+	Register( "Shake", 13, USERMSG_BATCH_COALESCE );		// shake view
 	Register( "Fade", 10 );	// fade HUD in/out
-	Register( "ShakeDir", -1 ); // directional shake
-	Register( "Tilt", 22 );
+	Register( "ShakeDir", -1, USERMSG_BATCH_COALESCE ); // directional shake
+	Register( "Tilt", 22, USERMSG_BATCH_COALESCE );
 
 	Register( "VGUIMenu", -1 );	// Show VGUI menu
-	Register( "Rumble", 3 );	// Send a rumble to a controller
+	Register( "Rumble", 3, USERMSG_BATCH_COALESCE );	// Send a rumble to a controller
 
 	Register( "CloseCaption", -1 ); // Show a caption (by string id number)(duration in 10th of a second)
 	Register( "CloseCaptionDirect", -1 ); // Show a forced caption (by string id number)(duration in 10th of a second)
@@ -78,10 +82,16 @@ CUserMessages::CUserMessages()
 	Register( "LogoTimeMsg", 4 );
 	Register( "AchievementEvent", -1 );
 
-	Register( "Damage", -1 );
+	Register( "Damage", -1, USERMSG_BATCH_GROUP );
+
+	Register( USERMSG_BATCH_NAME, -1 );
 
 	// Game specific registration function;
 	RegisterUserMessages();
+
+#if defined( CLIENT_DLL )
+	HookMessage( USERMSG_BATCH_NAME, __MsgFunc_Batch );
+#endif
 }
 
 CUserMessages::~CUserMessages()
@@ -126,6 +136,19 @@ int CUserMessages::GetUserMessageSize( int index )
 	return e->size;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: 
+// Input  : index - 
+// Output : UserMessageBatch_t
+//-----------------------------------------------------------------------------
+int CUserMessages::GetUserMessageBatch( int index )
+{
+	if ( !IsValidIndex( index ) )
+		return USERMSG_BATCH_NONE;
+
+	return m_UserMessages[ index ]->batch;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 // Input  : index - 
@@ -155,8 +178,9 @@ bool CUserMessages::IsValidIndex( int index )
 // Purpose: 
 // Input  : *name - 
 //			size - -1 for variable size
+//			batch - UserMessageBatch_t
 //-----------------------------------------------------------------------------
-void CUserMessages::Register( const char *name, int size )
+void CUserMessages::Register( const char *name, int size, int batch )
 {
 	Assert( name );
 	int idx = m_UserMessages.Find( name );
@@ -168,6 +192,7 @@ void CUserMessages::Register( const char *name, int size )
 	CUserMessage * entry = new CUserMessage;
 	entry->size = size;
 	entry->name = name;
+	entry->batch = batch;
 
 	m_UserMessages.Insert( name, entry );
 }
@@ -236,6 +261,38 @@ bool CUserMessages::DispatchUserMessage( int msg_type, bf_read &msg_data )
 	}
 	return true;
 }
+
+//-----------------------------------------------------------------------------
+// Purpose: Unpacks a compound message from the server's per tick batching.
+//  Layout is a count byte, then for each message its type byte, its length
+//  in bits and the message bits themselves.
+//-----------------------------------------------------------------------------
+static void __MsgFunc_Batch( bf_read &msg )
+{
+	static int s_nBatchType = -1;
+	if ( s_nBatchType == -1 )
+	{
+		s_nBatchType = usermessages->LookupUserMessage( USERMSG_BATCH_NAME );
+	}
+
+	int nMessages = msg.ReadByte();
+	for ( int i = 0; i < nMessages; ++i )
+	{
+		int msg_type = msg.ReadByte();
+		int nBits = msg.ReadUBitLong( USERMSG_BATCH_LENGTH_BITS );
+		if ( msg.IsOverflowed() || nBits > msg.GetNumBitsLeft() || nBits > MAX_USER_MSG_DATA * 8 || msg_type == s_nBatchType )
+		{
+			Log_Error( LOG_USERMSG, "__MsgFunc_Batch:  Malformed batch (message %i of %i)\n", i, nMessages );
+			return;
+		}
+
+		ALIGN4 byte data[ PAD_NUMBER( MAX_USER_MSG_DATA, 4 ) ];
+		msg.ReadBits( data, nBits );
+
+		bf_read msg_data( "Batch", data, BitByte( nBits ), nBits );
+		usermessages->DispatchUserMessage( msg_type, msg_data );
+	}
+}
 #endif
 
 // Singleton
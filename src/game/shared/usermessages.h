@@ -17,6 +17,18 @@ DECLARE_LOGGING_CHANNEL( LOG_USERMSG );
 // Client dispatch function for usermessages
 typedef void (*pfnUserMsgHook)(bf_read &msg);
 
+// How the server may hold back a message until the end of the tick
+enum UserMessageBatch_t
+{
+	USERMSG_BATCH_NONE = 0,		// sent immediately
+	USERMSG_BATCH_GROUP,		// packed with other messages to the same recipients
+	USERMSG_BATCH_COALESCE,		// packed, and identical copies in the same tick are dropped
+};
+
+// Compound message the server packs batched messages into
+#define USERMSG_BATCH_NAME			"Batch"
+#define USERMSG_BATCH_LENGTH_BITS	11	// enough for MAX_USER_MSG_DATA bytes
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
@@ -26,6 +38,8 @@ class CUserMessage
 		// byte size of message, or -1 for variable sized
 		int				size;	
 		const char		*name;
+		// UserMessageBatch_t
+		int				batch;
 		// Client only dispatch function for message
 		CUtlVector<pfnUserMsgHook>	clienthooks;
 };
@@ -46,9 +60,10 @@ class CUserMessages
 	int		GetUserMessageSize( int index );
 	const char *GetUserMessageName( int index );
 	bool	IsValidIndex( int index );
+	int		GetUserMessageBatch( int index );
 
 	// Server only
-	void	Register( const char *name, int size );
+	void	Register( const char *name, int size, int batch = USERMSG_BATCH_NONE );
 
 #if defined( CLIENT_DLL )
 	// Client only
@@ -2810,4 +2810,27 @@ bool FindInList( const char **pStrings, const char *pToFind, int size )
 	}
 
 	return false;
-}
\ No newline at end of file
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Lists the thread caching slab pools owned by this dll
+//-----------------------------------------------------------------------------
+static void SlabPoolReport( const char *pMsg, ... )
+{
+	char szBuf[512];
+	va_list marker;
+	va_start( marker, pMsg );
+	V_vsnprintf( szBuf, sizeof( szBuf ), pMsg, marker );
+	va_end( marker );
+
+	Msg( "%s", szBuf );
+}
+
+#ifdef CLIENT_DLL
+CON_COMMAND( cl_mem_slab_dump, "Prints live, peak, cached and fragmentation stats for the client's slab memory pools." )
+#else
+CON_COMMAND( mem_slab_dump, "Prints live, peak, cached and fragmentation stats for the server's slab memory pools." )
+#endif
+{
+	CMemoryPoolSlab::DumpStats( SlabPoolReport );
+}
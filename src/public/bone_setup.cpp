@@ -212,35 +212,47 @@ short *CBoneCache::CachedToStudio()
 	return (short *)( (char *)(this+1) + m_cachedToStudioOffset );
 }
 
-// Construct a singleton
-static CDataManager<CBoneCache, bonecacheparams_t, CBoneCache *, CThreadFastMutex> g_StudioBoneCache( 128 * 1024L );
+// Construct a singleton. Threaded bone setup hits this from every worker, so
+// it's sharded to spread the lock traffic.
+static CDataManagerSharded<CBoneCache, bonecacheparams_t, CBoneCache *, CThreadFastMutex, 4> g_StudioBoneCache( 128 * 1024L );
 
 CBoneCache *Studio_GetBoneCache( memhandle_t cacheHandle )
 {
-	AUTO_LOCK( g_StudioBoneCache.AccessMutex() );
 	return g_StudioBoneCache.GetResource_NoLock( cacheHandle );
 }
 
 memhandle_t Studio_CreateBoneCache( bonecacheparams_t &params )
 {
-	AUTO_LOCK( g_StudioBoneCache.AccessMutex() );
 	return g_StudioBoneCache.CreateResource( params );
 }
 
 void Studio_DestroyBoneCache( memhandle_t cacheHandle )
 {
-	AUTO_LOCK( g_StudioBoneCache.AccessMutex() );
 	g_StudioBoneCache.DestroyResource( cacheHandle );
 }
 
 void Studio_InvalidateBoneCache( memhandle_t cacheHandle )
 {
-	AUTO_LOCK( g_StudioBoneCache.AccessMutex() );
+	g_StudioBoneCache.Lock( cacheHandle );
 	CBoneCache *pCache = g_StudioBoneCache.GetResource_NoLock( cacheHandle );
 	if ( pCache )
 	{
 		pCache->m_timeValid = -1.0f;
 	}
+	g_StudioBoneCache.Unlock( cacheHandle );
+}
+
+#ifdef CLIENT_DLL
+CON_COMMAND( cl_bonecache_stats, "Prints the client bone cache size and lock contention." )
+#else
+CON_COMMAND( bonecache_stats, "Prints the server bone cache size and lock contention." )
+#endif
+{
+	unsigned int nLocks, nContended;
+	g_StudioBoneCache.GetLockStats( &nLocks, &nContended );
+	Msg( "Bone cache: %u / %u bytes, %u locks, %u contended (%.2f%%)\n",
+		g_StudioBoneCache.UsedSize(), g_StudioBoneCache.TargetSize(), nLocks, nContended,
+		nLocks ? 100.0f * nContended / nLocks : 0.0f );
 }
 
 //-----------------------------------------------------------------------------
@@ -0,0 +1,319 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Memory mapped .bsp reader
+//
+//=============================================================================//
+
+#if defined( _WIN32 )
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#elif defined( POSIX )
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "bspreader.h"
+#include "filesystem.h"
+#include "tier1/lzmaDecoder.h"
+#include "tier1/strtools.h"
+
+// NOTE: This has to be the last file included!
+#include "tier0/memdbgon.h"
+
+
+CBSPReader::CBSPReader()
+{
+	m_pFile = NULL;
+	m_nFileSize = 0;
+	m_pMapping = NULL;
+	m_nMappingSize = 0;
+}
+
+CBSPReader::~CBSPReader()
+{
+	Close();
+}
+
+//-----------------------------------------------------------------------------
+// Maps the file copy on write, pages are only read in as they're touched
+//-----------------------------------------------------------------------------
+bool CBSPReader::Map( const char *pPath )
+{
+#if defined( _WIN32 )
+	HANDLE hFile = CreateFileA( pPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if ( hFile == INVALID_HANDLE_VALUE )
+		return false;
+
+	LARGE_INTEGER nSize;
+	if ( !GetFileSizeEx( hFile, &nSize ) || nSize.QuadPart <= 0 || nSize.QuadPart > INT_MAX )
+	{
+		CloseHandle( hFile );
+		return false;
+	}
+
+	HANDLE hMapping = CreateFileMapping( hFile, NULL, PAGE_WRITECOPY, 0, 0, NULL );
+	CloseHandle( hFile );
+	if ( !hMapping )
+		return false;
+
+	// the view keeps the mapping alive
+	void *pView = MapViewOfFile( hMapping, FILE_MAP_COPY, 0, 0, 0 );
+	CloseHandle( hMapping );
+	if ( !pView )
+		return false;
+
+	m_pMapping = pView;
+	m_nMappingSize = (size_t)nSize.QuadPart;
+#elif defined( POSIX )
+	int fd = open( pPath, O_RDONLY );
+	if ( fd < 0 )
+		return false;
+
+	struct stat st;
+	if ( fstat( fd, &st ) != 0 || st.st_size <= 0 || st.st_size > INT_MAX )
+	{
+		close( fd );
+		return false;
+	}
+
+	void *pView = mmap( NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 );
+	close( fd );
+	if ( pView == MAP_FAILED )
+		return false;
+
+	m_pMapping = pView;
+	m_nMappingSize = st.st_size;
+#else
+	return false;
+#endif
+
+	m_pFile = (byte *)m_pMapping;
+	m_nFileSize = (int)m_nMappingSize;
+	return true;
+}
+
+bool CBSPReader::Validate( const char *pFilename )
+{
+	if ( m_nFileSize < (int)sizeof( BSPHeader_t ) )
+	{
+		Warning( "CBSPReader: %s is too small to be a bsp\n", pFilename );
+		Close();
+		return false;
+	}
+	return true;
+}
+
+bool CBSPReader::OpenFile( const char *pPath )
+{
+	Close();
+
+	if ( !Map( pPath ) )
+		return false;
+
+	return Validate( pPath );
+}
+
+bool CBSPReader::Open( IFileSystem *pFileSystem, const char *pFilename, const char *pPathID )
+{
+	// only loose files can be mapped
+	char szPath[MAX_PATH];
+	if ( pFileSystem->RelativePathToFullPath( pFilename, pPathID, szPath, sizeof( szPath ), FILTER_CULLPACK ) && OpenFile( szPath ) )
+		return true;
+
+	return OpenFromFileSystem( pFileSystem, pFilename, pPathID );
+}
+
+bool CBSPReader::OpenFromFileSystem( IBaseFileSystem *pFileSystem, const char *pFilename, const char *pPathID )
+{
+	Close();
+
+	if ( !pFileSystem->ReadFile( pFilename, pPathID, m_FileBuffer ) )
+		return false;
+
+	m_pFile = (byte *)m_FileBuffer.Base();
+	m_nFileSize = m_FileBuffer.TellMaxPut();
+	return Validate( pFilename );
+}
+
+void CBSPReader::Close()
+{
+	for ( int i = 0; i < HEADER_LUMPS; i++ )
+	{
+		m_Lumps[i].Purge();
+	}
+	m_GameLumps.PurgeAndDeleteElements();
+
+	if ( m_pMapping )
+	{
+#if defined( _WIN32 )
+		UnmapViewOfFile( m_pMapping );
+#elif defined( POSIX )
+		munmap( m_pMapping, m_nMappingSize );
+#endif
+		m_pMapping = NULL;
+		m_nMappingSize = 0;
+	}
+	m_FileBuffer.Purge();
+
+	m_pFile = NULL;
+	m_nFileSize = 0;
+}
+
+bool CBSPReader::IsInFile( int nOffset, int nSize ) const
+{
+	return nOffset >= 0 && nSize >= 0 && nOffset <= m_nFileSize - nSize;
+}
+
+bool CBSPReader::HasLump( int nLump ) const
+{
+	Assert( nLump >= 0 && nLump < HEADER_LUMPS );
+	return GetHeader()->lumps[nLump].filelen > 0;
+}
+
+int CBSPReader::LumpVersion( int nLump ) const
+{
+	Assert( nLump >= 0 && nLump < HEADER_LUMPS );
+	return GetHeader()->lumps[nLump].version;
+}
+
+//-----------------------------------------------------------------------------
+// Decompresses the LZMA stream at nOffset into buf, unless that's been done
+//-----------------------------------------------------------------------------
+const void *CBSPReader::Decompress( CUtlBuffer &buf, int nOffset, int *pSize )
+{
+	AUTO_LOCK( m_Mutex );
+
+	if ( !buf.TellMaxPut() )
+	{
+		if ( !IsInFile( nOffset, sizeof( lzma_header_t ) ) )
+			return NULL;
+
+		unsigned char *pCompressed = m_pFile + nOffset;
+		lzma_header_t *pHeader = (lzma_header_t *)pCompressed;
+		if ( !CLZMA::IsCompressed( pCompressed ) || !IsInFile( nOffset, sizeof( lzma_header_t ) + LittleLong( pHeader->lzmaSize ) ) )
+		{
+			Warning( "CBSPReader: Unrecognized compressed lump\n" );
+			return NULL;
+		}
+
+		unsigned int nActualSize = CLZMA::GetActualSize( pCompressed );
+		buf.EnsureCapacity( nActualSize );
+		unsigned int nOutSize = CLZMA::Uncompress( pCompressed, (unsigned char *)buf.Base() );
+		if ( nOutSize != nActualSize )
+		{
+			Warning( "CBSPReader: Decompressed size differs from header, BSP may be corrupt\n" );
+			buf.Purge();
+			return NULL;
+		}
+		buf.SeekPut( CUtlBuffer::SEEK_HEAD, nOutSize );
+	}
+
+	*pSize = buf.TellMaxPut();
+	return buf.Base();
+}
+
+const void *CBSPReader::GetLump( int nLump, int *pSize )
+{
+	Assert( IsOpen() && nLump >= 0 && nLump < HEADER_LUMPS );
+	*pSize = 0;
+
+	const lump_t &lump = GetHeader()->lumps[nLump];
+	if ( lump.filelen <= 0 )
+		return NULL;
+
+	if ( !IsInFile( lump.fileofs, lump.filelen ) )
+	{
+		Warning( "CBSPReader: lump %d runs off the end of the file\n", nLump );
+		return NULL;
+	}
+
+	if ( lump.uncompressedSize )
+		return Decompress( m_Lumps[nLump], lump.fileofs, pSize );
+
+	*pSize = lump.filelen;
+	return m_pFile + lump.fileofs;
+}
+
+void CBSPReader::ReleaseLump( int nLump )
+{
+	AUTO_LOCK( m_Mutex );
+	m_Lumps[nLump].Purge();
+}
+
+int CBSPReader::FindGameLump( int nId ) const
+{
+	const lump_t &lump = GetHeader()->lumps[LUMP_GAME_LUMP];
+	if ( lump.uncompressedSize || !IsInFile( lump.fileofs, lump.filelen ) || lump.filelen < (int)sizeof( dgamelumpheader_t ) )
+		return -1;
+
+	const dgamelumpheader_t *pGameLumpHeader = (const dgamelumpheader_t *)( m_pFile + lump.fileofs );
+	if ( pGameLumpHeader->lumpCount < 0 || (int)( sizeof( dgamelumpheader_t ) + pGameLumpHeader->lumpCount * sizeof( dgamelump_t ) ) > lump.filelen )
+		return -1;
+
+	const dgamelump_t *pGameLumps = (const dgamelump_t *)( pGameLumpHeader + 1 );
+	for ( int i = 0; i < pGameLumpHeader->lumpCount; i++ )
+	{
+		if ( pGameLumps[i].id == nId )
+			return i;
+	}
+	return -1;
+}
+
+const void *CBSPReader::GetGameLump( int nId, int *pSize, int *pVersion )
+{
+	Assert( IsOpen() );
+	*pSize = 0;
+
+	int iGameLump = FindGameLump( nId );
+	if ( iGameLump < 0 )
+		return NULL;
+
+	const dgamelumpheader_t *pGameLumpHeader = (const dgamelumpheader_t *)( m_pFile + GetHeader()->lumps[LUMP_GAME_LUMP].fileofs );
+	const dgamelump_t &gameLump = ( (const dgamelump_t *)( pGameLumpHeader + 1 ) )[iGameLump];
+	if ( pVersion )
+	{
+		*pVersion = gameLump.version;
+	}
+
+	if ( gameLump.filelen <= 0 )
+		return NULL;
+
+	if ( gameLump.flags & GAMELUMPFLAG_COMPRESSED )
+	{
+		{
+			AUTO_LOCK( m_Mutex );
+			if ( m_GameLumps.Count() < pGameLumpHeader->lumpCount )
+			{
+				int nOldCount = m_GameLumps.Count();
+				m_GameLumps.SetCount( pGameLumpHeader->lumpCount );
+				for ( int i = nOldCount; i < m_GameLumps.Count(); i++ )
+				{
+					m_GameLumps[i] = new CUtlBuffer;
+				}
+			}
+		}
+		return Decompress( *m_GameLumps[iGameLump], gameLump.fileofs, pSize );
+	}
+
+	if ( !IsInFile( gameLump.fileofs, gameLump.filelen ) )
+	{
+		Warning( "CBSPReader: game lump %d runs off the end of the file\n", nId );
+		return NULL;
+	}
+
+	*pSize = gameLump.filelen;
+	return m_pFile + gameLump.fileofs;
+}
+
+void CBSPReader::ReleaseGameLump( int nId )
+{
+	int iGameLump = FindGameLump( nId );
+
+	AUTO_LOCK( m_Mutex );
+	if ( m_GameLumps.IsValidIndex( iGameLump ) )
+	{
+		m_GameLumps[iGameLump]->Purge();
+	}
+}
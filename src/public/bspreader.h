@@ -0,0 +1,139 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Memory mapped .bsp reader. Lumps are handed out as typed spans
+//			that point straight into the mapped file, LZMA compressed lumps
+//			are decompressed the first time they're asked for.
+//
+//=============================================================================//
+
+#ifndef BSPREADER_H
+#define BSPREADER_H
+#pragma once
+
+#include "bspfile.h"
+#include "tier0/threadtools.h"
+#include "tier1/utlbuffer.h"
+
+class IBaseFileSystem;
+class IFileSystem;
+
+
+//-----------------------------------------------------------------------------
+// A read only view of a lump as an array of T
+//-----------------------------------------------------------------------------
+template< class T >
+class CBSPLumpSpan
+{
+public:
+	CBSPLumpSpan() : m_pBase( NULL ), m_nCount( 0 ) {}
+	CBSPLumpSpan( const T *pBase, int nCount ) : m_pBase( pBase ), m_nCount( nCount ) {}
+
+	const T		*Base() const			{ return m_pBase; }
+	int			Count() const			{ return m_nCount; }
+	bool		IsEmpty() const			{ return m_nCount == 0; }
+	bool		IsValidIndex( int i ) const	{ return i >= 0 && i < m_nCount; }
+
+	const T &operator[]( int i ) const
+	{
+		Assert( IsValidIndex( i ) );
+		return m_pBase[i];
+	}
+
+private:
+	const T		*m_pBase;
+	int			m_nCount;
+};
+
+
+//-----------------------------------------------------------------------------
+// Usage:
+//		CBSPReader reader;
+//		if ( reader.Open( g_pFullFileSystem, "maps/foo.bsp", "GAME" ) )
+//		{
+//			CBSPLumpSpan< dface_t > faces = reader.GetLumpSpan< dface_t >( LUMP_FACES );
+//			...
+//		}
+//
+// Only the pages of the lumps that get touched are read from disk. Files that
+// aren't loose on disk (in a vpk, etc.) are read whole through the filesystem.
+// The view is copy on write, so the tools can byte swap it in place.
+//-----------------------------------------------------------------------------
+class CBSPReader
+{
+public:
+	CBSPReader();
+	~CBSPReader();
+
+	// Maps a file by its OS path
+	bool		OpenFile( const char *pPath );
+
+	// Maps the file if the filesystem finds it loose on disk, reads it otherwise
+	bool		Open( IFileSystem *pFileSystem, const char *pFilename, const char *pPathID );
+
+	// Reads the whole file through the filesystem
+	bool		OpenFromFileSystem( IBaseFileSystem *pFileSystem, const char *pFilename, const char *pPathID );
+
+	void		Close();
+
+	bool		IsOpen() const		{ return m_pFile != NULL; }
+	bool		IsMapped() const	{ return m_pMapping != NULL; }
+	int			FileSize() const	{ return m_nFileSize; }
+
+	BSPHeader_t	*GetHeader() const	{ return (BSPHeader_t *)m_pFile; }
+
+	bool		HasLump( int nLump ) const;
+	int			LumpVersion( int nLump ) const;
+
+	// Returns the (decompressed) lump, NULL if it's empty or damaged. The
+	// data stays valid until the lump is released or the file closed.
+	const void	*GetLump( int nLump, int *pSize );
+	void		ReleaseLump( int nLump );
+
+	template< class T > CBSPLumpSpan< T > GetLumpSpan( int nLump );
+
+	// Finds a game lump by id and returns it decompressed, NULL if it isn't there
+	const void	*GetGameLump( int nId, int *pSize, int *pVersion = NULL );
+	void		ReleaseGameLump( int nId );
+
+private:
+	bool		Map( const char *pPath );
+	bool		Validate( const char *pFilename );
+	bool		IsInFile( int nOffset, int nSize ) const;
+	const void	*Decompress( CUtlBuffer &buf, int nOffset, int *pSize );
+	int			FindGameLump( int nId ) const;
+
+	byte		*m_pFile;
+	int			m_nFileSize;
+
+	// mmap view, or the file read into memory when it couldn't be mapped
+	void		*m_pMapping;
+	size_t		m_nMappingSize;
+	CUtlBuffer	m_FileBuffer;
+
+	// decompressed copies of LZMA lumps, built on first access
+	CUtlBuffer	m_Lumps[HEADER_LUMPS];
+	CUtlVector< CUtlBuffer * >	m_GameLumps;
+	CThreadFastMutex	m_Mutex;
+};
+
+
+//-----------------------------------------------------------------------------
+// Inline methods
+//-----------------------------------------------------------------------------
+template< class T >
+inline CBSPLumpSpan< T > CBSPReader::GetLumpSpan( int nLump )
+{
+	int nSize;
+	const void *pData = GetLump( nLump, &nSize );
+	if ( !pData )
+		return CBSPLumpSpan< T >();
+
+	if ( nSize % sizeof( T ) )
+	{
+		Warning( "CBSPReader: odd size for lump %d\n", nLump );
+	}
+	return CBSPLumpSpan< T >( (const T *)pData, nSize / sizeof( T ) );
+}
+
+
+#endif // BSPREADER_H
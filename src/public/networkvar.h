@@ -182,21 +182,37 @@ class CAutoInitEntPtr
 	CAutoInitEntPtr()
 	{
 		m_pEnt = NULL;
+		m_bEmbedded = false;
 	}
 	CGameBaseEntity *m_pEnt;
+
+	// True when the chained object lives inside m_pEnt's own memory. Only then do its
+	// vars have a fixed offset from the entity that the engine can map back to send props;
+	// heap allocated chains (like the collision property) still dirty the whole entity.
+	bool m_bEmbedded;
 };
 
-//TODO: Currently, these don't get the benefit of tracking changes to individual vars.
-// Would be nice if they did.
 #define DECLARE_NETWORKVAR_CHAIN() \
 	template <typename T> friend int ServerClassInit(T *);	\
 	template <typename T> friend int ClientClassInit(T *); \
 	CAutoInitEntPtr __m_pChainEntity; \
 	virtual void NetworkStateChanged() { CHECK_USENETWORKVARS { if(__m_pChainEntity.m_pEnt) { __m_pChainEntity.m_pEnt->NetworkStateChanged(); } } } \
-	virtual void NetworkStateChanged( void *pVar ) { CHECK_USENETWORKVARS { if(__m_pChainEntity.m_pEnt) { __m_pChainEntity.m_pEnt->NetworkStateChanged(); } } }
+	virtual void NetworkStateChanged( void *pVar ) \
+	{ \
+		CHECK_USENETWORKVARS \
+		{ \
+			if ( !__m_pChainEntity.m_pEnt ) \
+				return; \
+			if ( __m_pChainEntity.m_bEmbedded ) \
+				__m_pChainEntity.m_pEnt->NetworkStateChanged( pVar ); \
+			else \
+				__m_pChainEntity.m_pEnt->NetworkStateChanged(); \
+		} \
+	}
 
 #define IMPLEMENT_NETWORKVAR_CHAIN( varName ) \
-	(varName)->__m_pChainEntity.m_pEnt = this;
+	(varName)->__m_pChainEntity.m_pEnt = this; \
+	(varName)->__m_pChainEntity.m_bEmbedded = ( (const char*)(varName) >= (const char*)this && (const char*)(varName) < (const char*)this + sizeof( *this ) );
 
 
 
@@ -1482,7 +1498,7 @@ class CNetworkVarBase<ColorRGBExp32, Changer> final
 	protected: \
 		inline void NetworkStateChanged() \
 		{ \
-		CHECK_USENETWORKVARS ((ThisClass*)(((char*)this) - MyOffsetOf(ThisClass,name)))->NetworkStateChanged(); \
+		CHECK_USENETWORKVARS ((ThisClass*)(((char*)this) - MyOffsetOf(ThisClass,name)))->NetworkStateChanged( m_Value ); \
 		} \
 	private: \
 		char m_Value[length]; \
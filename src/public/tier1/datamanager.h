@@ -47,6 +47,18 @@ class CDataManagerBase
 
 	void					SetTargetSize( unsigned int targetSize );
 
+	// Clock style recency: touches only set a reference bit, without locking, and
+	// eviction gives referenced items a second lap through the LRU instead of
+	// relinking on every access. Set before creating any resources.
+	void					SetApproximateLRU( bool bApproximate );
+
+	// Reserves the top nTagBits of every handle's serial for nTag, used to tell
+	// the shards of a CDataManagerSharded apart. Set before creating any resources.
+	void					SetHandleTag( unsigned short nTag, int nTagBits );
+
+	// Lock acquisitions, and how many of them had to wait for another thread
+	void					GetLockStats( unsigned int *pLocks, unsigned int *pContended );
+
 	// NOTE: flush is equivalent to Destroy
 	unsigned int			FlushAllUnlocked();
 	unsigned int			FlushToTargetSize();
@@ -97,6 +109,20 @@ class CDataManagerBase
 	void					TouchByIndex( unsigned short memoryIndex );
 	void *					GetForFreeByIndex( unsigned short memoryIndex );
 
+	// Called by the derived class with the lock held
+	void					CountLock( bool bContended ) { m_nLocks++; if ( bContended ) m_nContendedLocks++; }
+
+	// Reference bits for approximate LRU, in pages that are never freed so
+	// touches can write them without the lock
+	enum
+	{
+		REF_PAGE_BITS = 8,
+		REF_PAGE_SIZE = 1 << REF_PAGE_BITS,
+		REF_PAGE_COUNT = 65536 / REF_PAGE_SIZE,
+	};
+	void					SetReferenced( unsigned short memoryIndex, unsigned char bReferenced );
+	bool					IsReferenced( unsigned short memoryIndex );
+
 	// One of these is stored per active allocation
 	struct resource_lru_element_t
 	{
@@ -121,8 +147,15 @@ class CDataManagerBase
 	unsigned short m_lockList;
 	unsigned short m_freeList;
 	unsigned short m_listsAreFreed : 1;
-	unsigned short m_unused : 15;
+	unsigned short m_approximateLRU : 1;
+	unsigned short m_unused : 14;
+
+	unsigned short m_serialMask;
+	unsigned short m_handleTag;
+	unsigned char **m_ppRefPages;
 
+	unsigned int m_nLocks;
+	unsigned int m_nContendedLocks;
 };
 
 template< class STORAGE_TYPE, class CREATE_PARAMS, class LOCK_TYPE = STORAGE_TYPE *, class MUTEX_TYPE = CThreadNullMutex>
@@ -222,7 +255,15 @@ class CDataManager : public CDataManagerBase
 	}
 
 	MUTEX_TYPE &AccessMutex()	{ return m_mutex; }
-	virtual void Lock() { m_mutex.Lock(); }
+	virtual void Lock()
+	{
+		bool bContended = !m_mutex.TryLock();
+		if ( bContended )
+		{
+			m_mutex.Lock();
+		}
+		CountLock( bContended );
+	}
 	virtual bool TryLock() { return m_mutex.TryLock(); }
 	virtual void Unlock() { m_mutex.Unlock(); }
 
@@ -245,12 +286,172 @@ class CDataManager : public CDataManagerBase
 	MUTEX_TYPE m_mutex;
 };
 
+//-----------------------------------------------------------------------------
+// Purpose: NUM_SHARDS data managers sharing one memory budget, for caches that
+// many threads hit at once. A resource lives in the shard picked round robin
+// when it's created and the shard is encoded in its handle, so every call only
+// takes that shard's lock. Shards use approximate LRU, so TouchResource never
+// locks at all. Eviction takes one entry from each shard in turn: the total
+// stays under the target size, but the order only approximates a global LRU.
+//-----------------------------------------------------------------------------
+template< class STORAGE_TYPE, class CREATE_PARAMS, class LOCK_TYPE = STORAGE_TYPE *, class MUTEX_TYPE = CThreadFastMutex, int NUM_SHARDS = 4 >
+class CDataManagerSharded
+{
+public:
+	typedef CDataManager< STORAGE_TYPE, CREATE_PARAMS, LOCK_TYPE, MUTEX_TYPE > Shard_t;
+
+	enum
+	{
+		SHARD_BITS = ( NUM_SHARDS <= 2 ) ? 1 : ( NUM_SHARDS <= 4 ) ? 2 : ( NUM_SHARDS <= 8 ) ? 3 : 4
+	};
+
+	CDataManagerSharded( unsigned int size = (unsigned)-1 ) : m_targetMemorySize( size )
+	{
+		COMPILE_TIME_ASSERT( NUM_SHARDS >= 2 && NUM_SHARDS <= 16 && ( NUM_SHARDS & ( NUM_SHARDS - 1 ) ) == 0 );
+
+		m_nNextShard = 0;
+		m_nEvictShard = 0;
+		for ( int i = 0; i < NUM_SHARDS; i++ )
+		{
+			m_Shards[i].SetHandleTag( i, SHARD_BITS );
+			m_Shards[i].SetApproximateLRU( true );
+		}
+	}
+
+	memhandle_t CreateResource( const CREATE_PARAMS &createParams, bool bCreateLocked = false )
+	{
+		EnsureCapacity( STORAGE_TYPE::EstimatedSize( createParams ) );
+
+		// Hold the shard across creating the handle and storing the resource,
+		// so eviction never sees the empty handle
+		Shard_t &shard = m_Shards[ (unsigned)( ++m_nNextShard ) % NUM_SHARDS ];
+		shard.Lock();
+		memhandle_t hMem = shard.CreateResource( createParams, bCreateLocked );
+		shard.Unlock();
+		return hMem;
+	}
+
+	void DestroyResource( memhandle_t hMem )					{ ShardForHandle( hMem ).DestroyResource( hMem ); }
+	LOCK_TYPE LockResource( memhandle_t hMem )					{ return ShardForHandle( hMem ).LockResource( hMem ); }
+	int UnlockResource( memhandle_t hMem )						{ return ShardForHandle( hMem ).UnlockResource( hMem ); }
+	LOCK_TYPE GetResource_NoLock( memhandle_t hMem )			{ return ShardForHandle( hMem ).GetResource_NoLock( hMem ); }
+	LOCK_TYPE GetResource_NoLockNoLRUTouch( memhandle_t hMem )	{ return ShardForHandle( hMem ).GetResource_NoLockNoLRUTouch( hMem ); }
+	void TouchResource( memhandle_t hMem )						{ ShardForHandle( hMem ).TouchResource( hMem ); }
+	void MarkAsStale( memhandle_t hMem )						{ ShardForHandle( hMem ).MarkAsStale( hMem ); }
+	int LockCount( memhandle_t hMem )							{ return ShardForHandle( hMem ).LockCount( hMem ); }
+	int BreakLock( memhandle_t hMem )							{ return ShardForHandle( hMem ).BreakLock( hMem ); }
+
+	// Locks the shard that owns hMem, to keep a resource alive while using it
+	void Lock( memhandle_t hMem )								{ ShardForHandle( hMem ).Lock(); }
+	void Unlock( memhandle_t hMem )								{ ShardForHandle( hMem ).Unlock(); }
+
+	int BreakAllLocks()
+	{
+		int nBroken = 0;
+		for ( int i = 0; i < NUM_SHARDS; i++ )
+		{
+			nBroken += m_Shards[i].BreakAllLocks();
+		}
+		return nBroken;
+	}
+
+	unsigned int TargetSize()				{ return m_targetMemorySize; }
+	unsigned int AvailableSize()			{ return m_targetMemorySize - UsedSize(); }
+	void SetTargetSize( unsigned int size )	{ m_targetMemorySize = size; }
+
+	unsigned int UsedSize()
+	{
+		unsigned int nUsed = 0;
+		for ( int i = 0; i < NUM_SHARDS; i++ )
+		{
+			nUsed += m_Shards[i].UsedSize();
+		}
+		return nUsed;
+	}
+
+	// NOTE: flush is equivalent to Destroy
+	unsigned int FlushAllUnlocked()
+	{
+		unsigned int nFlushed = 0;
+		for ( int i = 0; i < NUM_SHARDS; i++ )
+		{
+			nFlushed += m_Shards[i].FlushAllUnlocked();
+		}
+		return nFlushed;
+	}
+
+	unsigned int FlushAll()
+	{
+		unsigned int nFlushed = 0;
+		for ( int i = 0; i < NUM_SHARDS; i++ )
+		{
+			nFlushed += m_Shards[i].FlushAll();
+		}
+		return nFlushed;
+	}
+
+	unsigned int FlushToTargetSize()
+	{
+		return EnsureCapacity( 0 );
+	}
+
+	unsigned int Purge( unsigned int nBytesToPurge )
+	{
+		unsigned int nUsed = UsedSize();
+		return EvictToSize( ( nUsed > nBytesToPurge ) ? nUsed - nBytesToPurge : 0 );
+	}
+
+	// free resources until there is enough space to hold "size"
+	unsigned int EnsureCapacity( unsigned int size )
+	{
+		return EvictToSize( ( size < m_targetMemorySize ) ? m_targetMemorySize - size : 0 );
+	}
+
+	void GetLockStats( unsigned int *pLocks, unsigned int *pContended )
+	{
+		*pLocks = *pContended = 0;
+		for ( int i = 0; i < NUM_SHARDS; i++ )
+		{
+			unsigned int nLocks, nContended;
+			m_Shards[i].GetLockStats( &nLocks, &nContended );
+			*pLocks += nLocks;
+			*pContended += nContended;
+		}
+	}
+
+private:
+	Shard_t &ShardForHandle( memhandle_t hMem )
+	{
+		return m_Shards[ ( (unsigned int)(uintp)hMem >> ( 32 - SHARD_BITS ) ) & ( NUM_SHARDS - 1 ) ];
+	}
+
+	unsigned int EvictToSize( unsigned int nTargetSize )
+	{
+		unsigned int nBytesInitial = UsedSize();
+		unsigned int nUsed = nBytesInitial;
+		int nEmptyShards = 0;
+		while ( nUsed > nTargetSize && nEmptyShards < NUM_SHARDS )
+		{
+			// Purging a single byte evicts the shard's oldest unlocked entry
+			Shard_t &shard = m_Shards[ (unsigned)( ++m_nEvictShard ) % NUM_SHARDS ];
+			nEmptyShards = shard.Purge( 1 ) ? 0 : nEmptyShards + 1;
+			nUsed = UsedSize();
+		}
+		return ( nBytesInitial > nUsed ) ? nBytesInitial - nUsed : 0;
+	}
+
+	Shard_t m_Shards[NUM_SHARDS];
+	unsigned int m_targetMemorySize;
+	CInterlockedInt m_nNextShard;
+	CInterlockedInt m_nEvictShard;
+};
+
 //-----------------------------------------------------------------------------
 
 inline unsigned short CDataManagerBase::FromHandle( memhandle_t handle )
 {
 	unsigned int fullWord = (unsigned int)handle;
-	unsigned short serial = fullWord>>16;
+	unsigned short serial = ( fullWord>>16 ) & m_serialMask;
 	unsigned short index = fullWord & 0xFFFF;
 	index--;
 	if ( m_memoryLists.IsValidIndex(index) && m_memoryLists[index].serial == serial )
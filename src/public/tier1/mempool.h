@@ -125,6 +125,165 @@ class CMemoryPoolMT : public CUtlMemoryPool
 };
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Fixed size pool for blocks allocated and freed from many threads.
+// Each thread keeps a magazine of free blocks per pool, so most allocs and
+// frees never touch shared state; magazines are refilled from and flushed to
+// the shared slabs in batches under the pool lock.
+//
+// Clear() and the destructor must not race with Alloc/Free on other threads,
+// same as CMemoryPoolMT. Blocks sitting in another thread's magazine at that
+// point are simply dropped the next time that thread touches the pool.
+// A thread that exits hands its cached blocks back to the shared free list.
+// No slab is carved until the first Alloc.
+//-----------------------------------------------------------------------------
+enum MemoryPoolSlabFlags_t
+{
+	MEMORYPOOL_SLAB_HUGE_PAGES = 0x1,	// Try to back slabs with large pages, falls back to regular pages
+};
+
+struct MemoryPoolSlabStats_t
+{
+	const char *m_pszName;
+	int		m_nBlockSize;
+	int		m_nLive;			// Blocks handed out to callers
+	int		m_nPeakOutstanding;	// Peak blocks outside the shared free list (live + cached in magazines)
+	int		m_nCached;			// Free blocks sitting in thread magazines
+	int		m_nTotal;			// Blocks carved out of slabs
+	int		m_nSlabs;
+	int		m_nHugePageSlabs;
+	int64	m_nSlabBytes;
+	int		m_nRefills;
+	int		m_nFlushes;
+	int		m_nThreads;			// Threads that have a magazine for this pool
+};
+
+class CMemoryPoolSlab
+{
+public:
+	enum
+	{
+		MAGAZINE_SIZE = 64,		// Blocks a thread may hold, half of it moves per refill or flush
+		MAX_SLAB_POOLS = 256,	// Pools that can be alive at once, sizes the per-thread magazine table
+	};
+
+				CMemoryPoolSlab( int blockSize, int numElements, int growMode = UTLMEMORYPOOL_GROW_FAST, const char *pszAllocOwner = NULL, int nAlignment = 0, int nFlags = 0 );
+				~CMemoryPoolSlab();
+
+	void*		Alloc();
+	void*		Alloc( size_t amount );
+	void*		AllocZero();
+	void*		AllocZero( size_t amount );
+	void		Free( void *pMem );
+
+	// Frees everything
+	void		Clear();
+
+	// Returns the calling thread's cached blocks to the shared free list
+	void		FlushThreadCache();
+
+	// Number of blocks handed out, exact only while no other thread is allocating
+	int			Count() const;
+	int			PeakCount() const { return m_nPeakOutstanding; }
+	bool		IsAllocationWithinPool( void *pMem ) const;
+
+	const char *GetName() const { return m_pszAllocOwner; }
+	void		GetStats( MemoryPoolSlabStats_t *pStats ) const;
+
+	// Prints stats for every live slab pool in this module
+	static void DumpStats( MemoryPoolReportFunc_t pfnReport );
+
+	// Called as a thread exits with its magazine table
+	static void ReleaseThreadMagazines( void **ppMagazines );
+
+private:
+	struct Magazine_t
+	{
+		unsigned int	m_nSerial;		// Pool instance this magazine holds blocks for
+		int				m_nCount;
+		unsigned int	m_nAllocs;		// Only written by the owning thread
+		unsigned int	m_nFrees;
+		Magazine_t		*m_pNextInPool;
+		void			*m_pBlocks[MAGAZINE_SIZE];
+	};
+
+	struct Slab_t
+	{
+		void	*m_pBase;
+		size_t	m_nBytes;
+		bool	m_bMapped;
+		bool	m_bHugePages;
+	};
+
+	Magazine_t	*GetMagazine();
+	void		*AllocFromMagazine( Magazine_t *pMagazine );
+	void		FreeToMagazine( Magazine_t *pMagazine, void *pMem );
+	void		ResetMagazine( Magazine_t *pMagazine );
+	void		Refill( Magazine_t *pMagazine );
+	void		Flush( Magazine_t *pMagazine, int nCount );
+	void		RetireMagazine( Magazine_t *pMagazine );
+	bool		AddNewSlab();
+	void		FreeSlabs();
+
+	int			m_nBlockSize;
+	int			m_nBlocksPerSlab;
+	int			m_nGrowMode;
+	int			m_nAlignment;
+	int			m_nFlags;
+	int			m_nPoolIndex;
+	unsigned int volatile m_nSerial;
+	const char	*m_pszAllocOwner;
+
+	// Everything below is guarded by m_mutex
+	mutable CThreadFastMutex m_mutex;
+	void		*m_pHeadOfFreeList;
+	Magazine_t	*m_pMagazines;
+	Magazine_t	m_SharedMagazine;		// Used by threads without a magazine slot
+	CUtlVector<Slab_t> m_Slabs;
+	int			m_nTotal;
+	int			m_nOutstanding;
+	int			m_nPeakOutstanding;
+	int			m_nRetiredLive;			// Allocs minus frees of magazines whose thread exited
+	int			m_nRefills;
+	int			m_nFlushes;
+	int64		m_nSlabBytes;
+};
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Small allocations of any size from a set of slab pools, one per size
+// class. Sizes round up to the next class: 16 byte steps up to 128, then half
+// powers of two up to MAX_SLAB_SIZE. Anything larger goes to the heap.
+// Free must be given the size that was asked for.
+//-----------------------------------------------------------------------------
+class CMemoryPoolSlabAllocator
+{
+public:
+	enum
+	{
+		MAX_SLAB_SIZE = 1024,
+		NUM_SIZE_CLASSES = 14,
+	};
+
+				CMemoryPoolSlabAllocator( const char *pszAllocOwner, int nBlocksPerSlab = 256, int nFlags = 0 );
+				~CMemoryPoolSlabAllocator();
+
+	void*		Alloc( size_t nSize );
+	void*		AllocZero( size_t nSize );
+	void		Free( void *pMem, size_t nSize );
+
+	// Returns the calling thread's cached blocks of every size class
+	void		FlushThreadCache();
+
+	// -1 for sizes that go to the heap
+	static int	SizeClass( size_t nSize );
+	static int	SizeOfClass( int nClass );
+
+private:
+	CMemoryPoolSlab *m_pPools[NUM_SIZE_CLASSES];
+};
+
+
 //-----------------------------------------------------------------------------
 // Wrapper macro to make an allocator that returns particular typed allocations
 // and construction and destruction of objects.
@@ -150,6 +309,23 @@ class CClassMemoryPool : public CUtlMemoryPool
 };
 
 
+//-----------------------------------------------------------------------------
+// CClassMemoryPool on top of a CMemoryPoolSlab. Clear() can't find the live
+// objects in a slab pool, free them before clearing.
+//-----------------------------------------------------------------------------
+template< class T >
+class CClassMemoryPoolSlab : public CMemoryPoolSlab
+{
+public:
+	CClassMemoryPoolSlab( int numElements, int growMode = UTLMEMORYPOOL_GROW_FAST, int nAlignment = 0 ) :
+		CMemoryPoolSlab( sizeof(T), numElements, growMode, MEM_ALLOC_CLASSNAME(T), nAlignment ) {}
+
+	T*		Alloc();
+	T*		AllocZero();
+	void	Free( T *pMem );
+};
+
+
 //-----------------------------------------------------------------------------
 // Specialized pool for aligned data management (e.g., Xbox cubemaps)
 //-----------------------------------------------------------------------------
@@ -298,6 +474,51 @@ inline void CClassMemoryPool<T>::Free(T *pMem)
 	CUtlMemoryPool::Free( pMem );
 }
 
+template< class T >
+inline T* CClassMemoryPoolSlab<T>::Alloc()
+{
+	T *pRet;
+
+	{
+	MEM_ALLOC_CREDIT_(MEM_ALLOC_CLASSNAME(T));
+	pRet = (T*)CMemoryPoolSlab::Alloc();
+	}
+
+	if ( pRet )
+	{
+		Construct( pRet );
+	}
+	return pRet;
+}
+
+template< class T >
+inline T* CClassMemoryPoolSlab<T>::AllocZero()
+{
+	T *pRet;
+
+	{
+	MEM_ALLOC_CREDIT_(MEM_ALLOC_CLASSNAME(T));
+	pRet = (T*)CMemoryPoolSlab::AllocZero();
+	}
+
+	if ( pRet )
+	{
+		Construct( pRet );
+	}
+	return pRet;
+}
+
+template< class T >
+inline void CClassMemoryPoolSlab<T>::Free(T *pMem)
+{
+	if ( pMem )
+	{
+		Destruct( pMem );
+	}
+
+	CMemoryPoolSlab::Free( pMem );
+}
+
 template< class T >
 inline void CClassMemoryPool<T>::Clear()
 {
@@ -356,10 +577,10 @@ inline void CClassMemoryPool<T>::Clear()
 	   inline void  operator delete( void* p ) { s_Allocator.Free(p); }		\
 	   inline void  operator delete( void* p, int nBlockUse, const char *pFileName, int nLine ) { s_Allocator.Free(p); }   \
 	private:																		\
-		static   CMemoryPoolMT   s_Allocator
+		static   CMemoryPoolSlab   s_Allocator
 
 #define DEFINE_FIXEDSIZE_ALLOCATOR_MT( _class, _initsize, _grow )					\
-	CMemoryPoolMT   _class::s_Allocator(sizeof(_class), _initsize, _grow, #_class " pool")
+	CMemoryPoolSlab   _class::s_Allocator(sizeof(_class), _initsize, _grow, #_class " pool")
 
 //-----------------------------------------------------------------------------
 // Macros that make it simple to make a class use a fixed-size allocator
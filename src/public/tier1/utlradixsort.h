@@ -0,0 +1,179 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Stable LSD radix sort for depth style sort keys
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#ifndef UTLRADIXSORT_H
+#define UTLRADIXSORT_H
+#pragma once
+
+#include "tier0/platform.h"
+#include "utlvector.h"
+
+//-----------------------------------------------------------------------------
+// Maps a float onto an unsigned key that sorts in the same order as the float
+// (negative values get all their bits flipped, positive values their sign bit)
+//-----------------------------------------------------------------------------
+FORCEINLINE uint32 RadixSortFloatKey( float flValue )
+{
+	uint32 nBits;
+	memcpy( &nBits, &flValue, sizeof( nBits ) );
+	uint32 nMask = (uint32)( -(int32)( nBits >> 31 ) ) | 0x80000000;
+	return nBits ^ nMask;
+}
+
+//-----------------------------------------------------------------------------
+// Sorts keys 8 bits at a time and returns the resulting permutation.
+// Sorting is ascending and stable; elements with equal keys keep their order.
+// Keys quantized to less than 32 bits skip the unused high digit passes, and
+// passes where every key shares the same digit are skipped altogether.
+//
+// Usage:
+//		CUtlRadixSort sorter;
+//		const int *pOrder = sorter.SortFloats( pDepths, nCount );
+//		for ( int i = 0; i < nCount; ++i )
+//			Draw( pItems[ pOrder[i] ] );
+//-----------------------------------------------------------------------------
+class CUtlRadixSort
+{
+public:
+	// Lists shorter than this are insertion sorted, the histograms aren't worth it
+	enum { INSERTION_SORT_THRESHOLD = 32 };
+
+	// The returned permutation is valid until the next call to a sort function
+	const int *SortFloats( const float *pKeys, int nCount );
+	const int *SortKeys( const uint32 *pKeys, int nCount, int nKeyBits = 32 );
+
+private:
+	void Init( int nCount );
+	const int *Sort( int nCount, int nKeyBits );
+
+	CUtlVectorFixedGrowable< uint32, 256 > m_Keys[2];
+	CUtlVectorFixedGrowable< int, 256 > m_Indices[2];
+};
+
+
+//-----------------------------------------------------------------------------
+// Inline methods
+//-----------------------------------------------------------------------------
+inline void CUtlRadixSort::Init( int nCount )
+{
+	m_Keys[0].SetCount( nCount );
+	m_Keys[1].SetCount( nCount );
+	m_Indices[0].SetCount( nCount );
+	m_Indices[1].SetCount( nCount );
+
+	int *pIndices = m_Indices[0].Base();
+	for ( int i = 0; i < nCount; ++i )
+	{
+		pIndices[i] = i;
+	}
+}
+
+inline const int *CUtlRadixSort::SortFloats( const float *pKeys, int nCount )
+{
+	Init( nCount );
+
+	uint32 *pDest = m_Keys[0].Base();
+	for ( int i = 0; i < nCount; ++i )
+	{
+		pDest[i] = RadixSortFloatKey( pKeys[i] );
+	}
+
+	return Sort( nCount, 32 );
+}
+
+inline const int *CUtlRadixSort::SortKeys( const uint32 *pKeys, int nCount, int nKeyBits )
+{
+	Assert( nKeyBits > 0 && nKeyBits <= 32 );
+	Init( nCount );
+
+	if ( nCount > 0 )
+	{
+		memcpy( m_Keys[0].Base(), pKeys, nCount * sizeof( uint32 ) );
+	}
+
+	return Sort( nCount, nKeyBits );
+}
+
+inline const int *CUtlRadixSort::Sort( int nCount, int nKeyBits )
+{
+	uint32 *pKeys = m_Keys[0].Base();
+	uint32 *pKeysTemp = m_Keys[1].Base();
+	int *pIndices = m_Indices[0].Base();
+	int *pIndicesTemp = m_Indices[1].Base();
+
+	if ( nCount < INSERTION_SORT_THRESHOLD )
+	{
+		for ( int i = 1; i < nCount; ++i )
+		{
+			uint32 nKey = pKeys[i];
+			int nIndex = pIndices[i];
+
+			int j = i - 1;
+			for ( ; j >= 0 && pKeys[j] > nKey; --j )
+			{
+				pKeys[j+1] = pKeys[j];
+				pIndices[j+1] = pIndices[j];
+			}
+
+			pKeys[j+1] = nKey;
+			pIndices[j+1] = nIndex;
+		}
+		return pIndices;
+	}
+
+	// Build the histograms for every pass in one sweep over the keys
+	int nPasses = ( nKeyBits + 7 ) >> 3;
+	uint32 nHistogram[4][256];
+	memset( nHistogram, 0, nPasses * sizeof( nHistogram[0] ) );
+
+	for ( int i = 0; i < nCount; ++i )
+	{
+		uint32 nKey = pKeys[i];
+		for ( int nPass = 0; nPass < nPasses; ++nPass )
+		{
+			++nHistogram[nPass][ ( nKey >> ( nPass << 3 ) ) & 0xff ];
+		}
+	}
+
+	for ( int nPass = 0; nPass < nPasses; ++nPass )
+	{
+		uint32 *pCounts = nHistogram[nPass];
+		int nShift = nPass << 3;
+
+		// Every key has the same digit, this pass wouldn't move anything
+		if ( pCounts[ ( pKeys[0] >> nShift ) & 0xff ] == (uint32)nCount )
+			continue;
+
+		uint32 nOffset = 0;
+		for ( int nDigit = 0; nDigit < 256; ++nDigit )
+		{
+			uint32 nDigitCount = pCounts[nDigit];
+			pCounts[nDigit] = nOffset;
+			nOffset += nDigitCount;
+		}
+
+		for ( int i = 0; i < nCount; ++i )
+		{
+			uint32 nKey = pKeys[i];
+			uint32 nDest = pCounts[ ( nKey >> nShift ) & 0xff ]++;
+			pKeysTemp[nDest] = nKey;
+			pIndicesTemp[nDest] = pIndices[i];
+		}
+
+		uint32 *pSwapKeys = pKeys;
+		pKeys = pKeysTemp;
+		pKeysTemp = pSwapKeys;
+
+		int *pSwapIndices = pIndices;
+		pIndices = pIndicesTemp;
+		pIndicesTemp = pSwapIndices;
+	}
+
+	return pIndices;
+}
+
+#endif // UTLRADIXSORT_H
@@ -87,6 +87,10 @@ class CUtlSymbol
 //    of strings to symbols and back. The symbol class itself contains
 //    a static version of this class for creating global strings, but this
 //    class can also be instanced to create local symbol tables.
+//
+//    Strings are looked up through an open addressing hash index holding
+//    each string's hash. Strings, symbols and index tables are only ever
+//    appended and never move, which lets CUtlSymbolTableMT read without locking.
 //-----------------------------------------------------------------------------
 
 class CUtlSymbolTable
@@ -110,46 +114,41 @@ class CUtlSymbolTable
 
 	int GetNumStrings( void ) const
 	{
-		return m_Lookup.Count();
+		return m_nStrings;
 	}
 
 protected:
-	class CStringPoolIndex
+	enum
 	{
-	public:
-		inline CStringPoolIndex()
-		{
-		}
-
-		inline CStringPoolIndex( unsigned short iPool, unsigned short iOffset )
-		{
-			m_iPool = iPool;
-			m_iOffset = iOffset;
-		}
+		// Symbols are stored in fixed size blocks so they never move once added
+		SYMBOL_BLOCK_BITS = 8,
+		SYMBOL_BLOCK_SIZE = 1 << SYMBOL_BLOCK_BITS,
+		SYMBOL_BLOCK_MASK = SYMBOL_BLOCK_SIZE - 1,
+		SYMBOL_BLOCK_COUNT = ( UTL_INVAL_SYMBOL + 1 ) / SYMBOL_BLOCK_SIZE,
 
-		inline bool operator==( const CStringPoolIndex &other )	const
-		{
-			return m_iPool == other.m_iPool && m_iOffset == other.m_iOffset;
-		}
+		MIN_HASH_INDEX_SIZE = 64,
+	};
 
-		unsigned short m_iPool;		// Index into m_StringPools.
-		unsigned short m_iOffset;	// Index into the string pool.
+	struct Symbol_t
+	{
+		const char		*m_pString;
+		unsigned int	m_nHash;
 	};
 
-	class CLess
+	// A hash of 0 marks an empty slot, HashSymbolString never returns it
+	struct HashSlot_t
 	{
-	public:
-		CLess( int ignored = 0 ) {} // permits default initialization to NULL in CUtlRBTree
-		bool operator!() const { return false; }
-		bool operator()( const CStringPoolIndex &left, const CStringPoolIndex &right ) const;
+		unsigned int volatile	m_nHash;
+		UtlSymId_t				m_Id;
 	};
 
-	// Stores the symbol lookup
-	class CTree : public CUtlRBTree<CStringPoolIndex, unsigned short, CLess>
+	// Grown tables are kept on the m_pRetired list until RemoveAll, a reader
+	// may still be probing one.
+	struct HashIndex_t
 	{
-	public:
-		CTree(  int growSize, int initSize ) : CUtlRBTree<CStringPoolIndex, unsigned short, CLess>( growSize, initSize ) {}
-		friend class CUtlSymbolTable::CLess; // Needed to allow CLess to calculate pointer to symbol table
+		unsigned int	m_nMask;
+		HashIndex_t		*m_pRetired;
+		HashSlot_t		m_Slots[1];
 	};
 
 	struct StringPool_t
@@ -159,20 +158,34 @@ class CUtlSymbolTable
 		char m_Data[1];
 	};
 
-	CTree m_Lookup;
+	unsigned int HashSymbolString( const char *pString ) const;
+
+	// Lock free, returns UTL_INVAL_SYMBOL if the string isn't in the table
+	UtlSymId_t FindSymbol( const char *pString, unsigned int nHash ) const;
+
+	// Adds a string that isn't in the table yet, writers must be serialized
+	UtlSymId_t InsertSymbol( const char *pString, unsigned int nHash );
+
+	Symbol_t *m_pSymbolBlocks[ SYMBOL_BLOCK_COUNT ];
+	HashIndex_t * volatile m_pIndex;
+	int volatile m_nStrings;
+	int m_nInitSize;
 	bool m_bInsensitive;
-	mutable const char* m_pUserSearchString;
 
 	// stores the string data
 	CUtlVector<StringPool_t*> m_StringPools;
 
 private:
 	int FindPoolWithSpace( int len ) const;
-	const char* StringFromIndex( const CStringPoolIndex &index ) const;
-
-	friend class CLess;
+	const char *StoreString( const char *pString, int len );
+	void InsertIntoIndex( HashIndex_t *pIndex, unsigned int nHash, UtlSymId_t id );
+	void GrowIndex();
 };
 
+//-----------------------------------------------------------------------------
+// Find and String never lock, only adding a new string takes the lock.
+// RemoveAll isn't exposed because it can't be made safe for readers.
+//-----------------------------------------------------------------------------
 class CUtlSymbolTableMT : private CUtlSymbolTable
 {
 public:
@@ -183,34 +196,41 @@ class CUtlSymbolTableMT : private CUtlSymbolTable
 
 	CUtlSymbol AddString( const char* pString )
 	{
-		m_lock.LockForWrite();
-		CUtlSymbol result = CUtlSymbolTable::AddString( pString );
-		m_lock.UnlockWrite();
-		return result;
+		if ( !pString )
+			return CUtlSymbol( UTL_INVAL_SYMBOL );
+
+		unsigned int nHash = HashSymbolString( pString );
+		UtlSymId_t id = FindSymbol( pString, nHash );
+		if ( id != UTL_INVAL_SYMBOL )
+			return CUtlSymbol( id );
+
+		// Someone else may have added it while we weren't holding the lock
+		AUTO_LOCK( m_lock );
+		id = FindSymbol( pString, nHash );
+		if ( id == UTL_INVAL_SYMBOL )
+		{
+			id = InsertSymbol( pString, nHash );
+		}
+		return CUtlSymbol( id );
 	}
 
 	CUtlSymbol Find( const char* pString ) const
 	{
-		m_lock.LockForRead();
-		CUtlSymbol result = CUtlSymbolTable::Find( pString );
-		m_lock.UnlockRead();
-		return result;
+		return CUtlSymbolTable::Find( pString );
 	}
 
 	const char* String( CUtlSymbol id ) const
 	{
-		m_lock.LockForRead();
-		const char *pszResult = CUtlSymbolTable::String( id );
-		m_lock.UnlockRead();
-		return pszResult;
+		return CUtlSymbolTable::String( id );
+	}
+
+	int GetNumStrings( void ) const
+	{
+		return CUtlSymbolTable::GetNumStrings();
 	}
 	
 private:
-#if defined(WIN32) || defined(_WIN32)
-	mutable CThreadSpinRWLock m_lock;
-#else
-	mutable CThreadRWLock m_lock;
-#endif
+	CThreadFastMutex m_lock;
 };
 
 
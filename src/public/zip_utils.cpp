@@ -237,14 +237,10 @@ class CWin32File
 
 //-----------------------------------------------------------------------------
 // Purpose: Interface to allow abstraction of zip file output methods, and
-// avoid duplication of code. Files may be written to a CUtlBuffer or a filestream
+// avoid duplication of code. Files may be written to a CUtlBuffer, a filestream
+// or a caller's IZipWriteStream
 //-----------------------------------------------------------------------------
-abstract_class IWriteStream
-{
-public:
-	virtual void Put( const void* pMem, int size ) = 0;
-	virtual unsigned int Tell( void ) = 0;
-};
+typedef IZipWriteStream IWriteStream;
 
 //-----------------------------------------------------------------------------
 // Purpose: Wrapper for CUtlBuffer methods
@@ -362,6 +358,8 @@ class CZipFile
 	// Write the zip to a filestream
 	void			SaveToDisk( FILE *fout );
 	void			SaveToDisk( HANDLE hOutFile );
+	// Write the zip to a caller's stream
+	void			SaveToStream( IWriteStream& stream );
 
 	unsigned int	CalculateSize( void );
 
@@ -1443,6 +1441,11 @@ void CZipFile::SaveToDisk( HANDLE hOutFile )
 	SaveDirectory( stream );
 }
 
+void CZipFile::SaveToStream( IWriteStream& stream )
+{
+	SaveDirectory( stream );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Store data out to a CUtlBuffer
 //-----------------------------------------------------------------------------
@@ -1692,6 +1695,9 @@ class CZip : public IZip
 	virtual void			SaveToDisk( FILE *fout ) OVERRIDE;
 	virtual void			SaveToDisk( HANDLE hOutFile ) OVERRIDE;
 
+	// Writes out zip file to a stream - uses current alignment size
+	virtual void			SaveToStream( IZipWriteStream &stream ) OVERRIDE;
+
 	// Reads a zip file from a buffer into memory - sets current alignment size to
 	// the file's alignment size, unless overridden by a ForceAlignment call)
 	virtual void			ParseFromBuffer( void *buffer, int bufferlength ) OVERRIDE;
@@ -1813,6 +1819,11 @@ void CZip::SaveToDisk( HANDLE hOutFile )
 	m_ZipFile.SaveToDisk( hOutFile );
 }
 
+void CZip::SaveToStream( IZipWriteStream &stream )
+{
+	m_ZipFile.SaveToStream( stream );
+}
+
 void CZip::ParseFromBuffer( void *buffer, int bufferlength )
 {
 	m_ZipFile.Reset();
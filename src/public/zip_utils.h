@@ -13,6 +13,17 @@
 class CUtlBuffer;
 #include "tier0/dbg.h"
 
+//-----------------------------------------------------------------------------
+// Purpose: Somewhere to write a zip to, lets a zip be streamed into a larger
+// file without building it in memory first
+//-----------------------------------------------------------------------------
+abstract_class IZipWriteStream
+{
+public:
+	virtual void Put( const void* pMem, int size ) = 0;
+	virtual unsigned int Tell( void ) = 0;
+};
+
 abstract_class IZip
 {
 public:
@@ -59,6 +70,10 @@ abstract_class IZip
 	virtual void			SaveToDisk			( FILE *fout ) = 0;
 	virtual void			SaveToDisk			( HANDLE hFileOut ) = 0;
 
+	// Writes out zip file to a stream - uses current alignment size
+	// (set by file's previous alignment, or a call to ForceAlignment)
+	virtual void			SaveToStream		( IZipWriteStream &stream ) = 0;
+
 	// Reads a zip file from a buffer into memory - sets current alignment size to
 	// the file's alignment size, unless overridden by a ForceAlignment call)
 	virtual void			ParseFromBuffer		( void *buffer, int bufferlength ) = 0;
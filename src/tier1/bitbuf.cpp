@@ -447,16 +447,7 @@ bool bf_write::WriteBits(const void *pInData, int nBits)
 		return false;
 	}
 
-	// Align output to dword boundary
-	while (((unsigned long)pOut & 3) != 0 && nBitsLeft >= 8)
-	{
-
-		WriteUBitLong( *pOut, 8, false );
-		++pOut;
-		nBitsLeft -= 8;
-	}
-	
-	if ( (nBitsLeft >= 32) && (m_iCurBit & 7) == 0 )
+	if ( (nBitsLeft >= 8) && (m_iCurBit & 7) == 0 )
 	{
 		// current bit is byte aligned, do block copy
 		int numbytes = nBitsLeft >> 3; 
@@ -467,38 +458,32 @@ bool bf_write::WriteBits(const void *pInData, int nBits)
 		nBitsLeft -= numbits;
 		m_iCurBit += numbits;
 	}
-
-	// X360TBD: Can't write dwords in WriteBits because they'll get swapped
-	if ( nBitsLeft >= 32 )
+	else if ( nBitsLeft >= 32 )
 	{
-		unsigned long iBitsRight = (m_iCurBit & 31);
-		unsigned long iBitsLeft = 32 - iBitsRight;
-		unsigned long bitMaskLeft = g_BitWriteMasks[iBitsRight][32];
-		unsigned long bitMaskRight = g_BitWriteMasks[0][iBitsRight];
-
+		// Stream the input through a 64 bit accumulator seeded with the bits already
+		// written to the current dword, so each output dword is stored exactly once.
 		unsigned long *pData = &m_pData[m_iCurBit>>5];
+		int nAccumBits = m_iCurBit & 31;
+		uint64 nAccum = LoadLittleDWord( pData, 0 ) & g_ExtraMasks[nAccumBits];
 
-		// Read dwords.
-		while(nBitsLeft >= 32)
+		while ( nBitsLeft >= 32 )
 		{
-			unsigned long curData = *(unsigned long*)pOut;
-			pOut += sizeof(unsigned long);
+			uint32 nIn;
+			memcpy( &nIn, pOut, sizeof( nIn ) );
+			pOut += sizeof( nIn );
 
-			*pData &= bitMaskLeft;
-			*pData |= curData << iBitsRight;
-
-			pData++; 
-
-			if ( iBitsLeft < 32 )
-			{
-				curData >>= iBitsLeft;
-				*pData &= bitMaskRight;
-				*pData |= curData;
-			}
+			nAccum |= (uint64)LittleDWord( nIn ) << nAccumBits;
+			StoreLittleDWord( pData, 0, (unsigned long)nAccum );
+			++pData;
+			nAccum >>= 32;
 
 			nBitsLeft -= 32;
 			m_iCurBit += 32;
 		}
+
+		// The leftover bits go under whatever follows them in the last dword
+		unsigned long nKeep = LoadLittleDWord( pData, 0 ) & ~g_ExtraMasks[nAccumBits];
+		StoreLittleDWord( pData, 0, nKeep | (unsigned long)nAccum );
 	}
 
 
@@ -522,7 +507,14 @@ bool bf_write::WriteBits(const void *pInData, int nBits)
 
 bool bf_write::WriteBitsFromBuffer( bf_read *pIn, int nBits )
 {
-	// This could be optimized a little by
+	// A byte aligned reader can feed WriteBits straight from its buffer
+	if ( ( pIn->m_iCurBit & 7 ) == 0 && nBits <= pIn->GetNumBitsLeft() )
+	{
+		WriteBits( pIn->m_pData + ( pIn->m_iCurBit >> 3 ), nBits );
+		pIn->m_iCurBit += nBits;
+		return !IsOverflowed();
+	}
+
 	while ( nBits > 32 )
 	{
 		WriteUBitLong( pIn->ReadUBitLong( 32 ), 32 );
@@ -923,23 +915,50 @@ void bf_read::ReadBits(void *pOutData, int nBits)
 	unsigned char *pOut = (unsigned char*)pOutData;
 	int nBitsLeft = nBits;
 
-	
-	// align output to dword boundary
-	while( ((size_t)pOut & 3) != 0 && nBitsLeft >= 8 )
+	// Reads that fit are bounds checked once here. Overflowing reads fall through
+	// to ReadUBitLong below, which zero fills whatever is past the end.
+	if ( nBitsLeft <= GetNumBitsLeft() )
 	{
-		*pOut = (unsigned char)ReadUBitLong(8);
-		++pOut;
-		nBitsLeft -= 8;
-	}
+		if ( (m_iCurBit & 7) == 0 )
+		{
+			// current bit is byte aligned, do block copy
+			int numbytes = nBitsLeft >> 3;
+			int numbits = numbytes << 3;
+
+			Q_memcpy( pOut, m_pData + (m_iCurBit>>3), numbytes );
+			pOut += numbytes;
+			nBitsLeft -= numbits;
+			m_iCurBit += numbits;
+		}
+		else if ( nBitsLeft >= 32 )
+		{
+			// Pull input dwords through a 64 bit accumulator, a dword is only
+			// loaded once the read needs at least one of its bits
+			const unsigned long *pData = (const unsigned long *)m_pData + (m_iCurBit>>5);
+			int nShift = m_iCurBit & 31;
+			uint64 nAccum = LoadLittleDWord( pData, 0 ) >> nShift;
+			int nAccumBits = 32 - nShift;
+			++pData;
+
+			while ( nBitsLeft >= 32 )
+			{
+				if ( nAccumBits < 32 )
+				{
+					nAccum |= (uint64)LoadLittleDWord( pData, 0 ) << nAccumBits;
+					++pData;
+					nAccumBits += 32;
+				}
 
-	// X360TBD: Can't read dwords in ReadBits because they'll get swapped
+				uint32 nOut = LittleDWord( (uint32)nAccum );
+				memcpy( pOut, &nOut, sizeof( nOut ) );
+				pOut += sizeof( nOut );
+				nAccum >>= 32;
+				nAccumBits -= 32;
 
-	// read dwords
-	while ( nBitsLeft >= 32 )
-	{
-		*((unsigned long*)pOut) = ReadUBitLong(32);
-		pOut += sizeof(unsigned long);
-		nBitsLeft -= 32;
+				nBitsLeft -= 32;
+				m_iCurBit += 32;
+			}
+		}
 	}
 
 	// read remaining bytes
@@ -1062,6 +1081,21 @@ uint32 bf_read::ReadVarInt32()
 	int count = 0;
 	uint32 b;
 
+	// Byte aligned with room for the longest encoding, decode straight from the buffer
+	if ( (m_iCurBit & 7) == 0 && (m_iCurBit + bitbuf::kMaxVarint32Bytes * 8) <= m_nDataBits )
+	{
+		const uint8 *pIn = m_pData + (m_iCurBit>>3);
+		do
+		{
+			b = pIn[count];
+			result |= (b & 0x7F) << (7 * count);
+			++count;
+		} while ( (b & 0x80) && count < bitbuf::kMaxVarint32Bytes );
+
+		m_iCurBit += count * 8;
+		return result;
+	}
+
 	do 
 	{
 		if ( count == bitbuf::kMaxVarint32Bytes ) 
@@ -1082,6 +1116,20 @@ uint64 bf_read::ReadVarInt64()
 	int count = 0;
 	uint64 b;
 
+	if ( (m_iCurBit & 7) == 0 && (m_iCurBit + bitbuf::kMaxVarintBytes * 8) <= m_nDataBits )
+	{
+		const uint8 *pIn = m_pData + (m_iCurBit>>3);
+		do
+		{
+			b = pIn[count];
+			result |= static_cast<uint64>(b & 0x7F) << (7 * count);
+			++count;
+		} while ( (b & 0x80) && count < bitbuf::kMaxVarintBytes );
+
+		m_iCurBit += count * 8;
+		return result;
+	}
+
 	do 
 	{
 		if ( count == bitbuf::kMaxVarintBytes ) 
@@ -1104,7 +1152,7 @@ int32 bf_read::ReadSignedVarInt32()
 
 int64 bf_read::ReadSignedVarInt64()
 {
-	uint32 value = ReadVarInt64();
+	uint64 value = ReadVarInt64();
 	return bitbuf::ZigZagDecode64( value );
 }
 
@@ -21,11 +21,67 @@ CDataManagerBase::CDataManagerBase( unsigned int maxSize )
 	m_lockList = m_memoryLists.CreateList();
 	m_freeList = m_memoryLists.CreateList();
 	m_listsAreFreed = 0;
+	m_approximateLRU = 0;
+	m_serialMask = 0xFFFF;
+	m_handleTag = 0;
+	m_ppRefPages = NULL;
+	m_nLocks = 0;
+	m_nContendedLocks = 0;
 }
 
 CDataManagerBase::~CDataManagerBase() 
 {
 	Assert( m_listsAreFreed );
+
+	if ( m_ppRefPages )
+	{
+		for ( int i = 0; i < REF_PAGE_COUNT; i++ )
+		{
+			free( m_ppRefPages[i] );
+		}
+		free( m_ppRefPages );
+	}
+}
+
+void CDataManagerBase::SetApproximateLRU( bool bApproximate )
+{
+	AUTO_LOCK_DM();
+	Assert( m_memoryLists.Count( m_lruList ) + m_memoryLists.Count( m_lockList ) == 0 );
+	if ( bApproximate && !m_ppRefPages )
+	{
+		m_ppRefPages = (unsigned char **)calloc( REF_PAGE_COUNT, sizeof( unsigned char * ) );
+	}
+	m_approximateLRU = bApproximate;
+}
+
+void CDataManagerBase::SetHandleTag( unsigned short nTag, int nTagBits )
+{
+	AUTO_LOCK_DM();
+	Assert( nTagBits > 0 && nTagBits < 16 && nTag < ( 1 << nTagBits ) );
+	Assert( m_memoryLists.Count( m_lruList ) + m_memoryLists.Count( m_lockList ) == 0 );
+	m_serialMask = 0xFFFF >> nTagBits;
+	m_handleTag = nTag << ( 16 - nTagBits );
+}
+
+void CDataManagerBase::GetLockStats( unsigned int *pLocks, unsigned int *pContended )
+{
+	*pLocks = m_nLocks;
+	*pContended = m_nContendedLocks;
+}
+
+void CDataManagerBase::SetReferenced( unsigned short memoryIndex, unsigned char bReferenced )
+{
+	unsigned char *pPage = m_ppRefPages[ memoryIndex >> REF_PAGE_BITS ];
+	if ( pPage )
+	{
+		pPage[ memoryIndex & ( REF_PAGE_SIZE - 1 ) ] = bReferenced;
+	}
+}
+
+bool CDataManagerBase::IsReferenced( unsigned short memoryIndex )
+{
+	unsigned char *pPage = m_ppRefPages[ memoryIndex >> REF_PAGE_BITS ];
+	return pPage && pPage[ memoryIndex & ( REF_PAGE_SIZE - 1 ) ];
 }
 
 void CDataManagerBase::NotifySizeChanged( memhandle_t handle, unsigned int oldSize, unsigned int newSize )
@@ -218,6 +274,18 @@ void *CDataManagerBase::GetResource_NoLock( memhandle_t handle )
 
 void CDataManagerBase::TouchResource( memhandle_t handle )
 {
+	if ( m_approximateLRU )
+	{
+		// No lock and no serial check, a stale handle just marks whichever
+		// entry reused its slot as recently used
+		unsigned short index = (unsigned short)( (uintp)handle & 0xFFFF );
+		if ( index != 0 )
+		{
+			SetReferenced( index - 1, 1 );
+		}
+		return;
+	}
+
 	AUTO_LOCK_DM();
 	TouchByIndex( FromHandle(handle) );
 }
@@ -232,6 +300,10 @@ void CDataManagerBase::MarkAsStale( memhandle_t handle )
 		{
 			m_memoryLists.Unlink( m_lruList, memoryIndex );
 			m_memoryLists.LinkToHead( m_lruList, memoryIndex );
+			if ( m_approximateLRU )
+			{
+				SetReferenced( memoryIndex, 0 );
+			}
 		}
 	}
 }
@@ -294,6 +366,16 @@ unsigned short CDataManagerBase::CreateHandle( bool bCreateLocked )
 		m_memoryLists[memoryIndex].lockCount++;
 	}
 
+	if ( m_approximateLRU )
+	{
+		unsigned char *&pPage = m_ppRefPages[ memoryIndex >> REF_PAGE_BITS ];
+		if ( !pPage )
+		{
+			pPage = (unsigned char *)calloc( REF_PAGE_SIZE, 1 );
+		}
+		SetReferenced( memoryIndex, 0 );
+	}
+
 	return memoryIndex;
 }
 
@@ -310,6 +392,12 @@ void CDataManagerBase::TouchByIndex( unsigned short memoryIndex )
 {
 	if ( memoryIndex != m_memoryLists.InvalidIndex() )
 	{
+		if ( m_approximateLRU )
+		{
+			SetReferenced( memoryIndex, 1 );
+			return;
+		}
+
 		if ( m_memoryLists[memoryIndex].lockCount == 0 )
 		{
 			m_memoryLists.Unlink( m_lruList, memoryIndex );
@@ -320,7 +408,7 @@ void CDataManagerBase::TouchByIndex( unsigned short memoryIndex )
 
 memhandle_t CDataManagerBase::ToHandle( unsigned short index )
 {
-	unsigned int hiword = m_memoryLists.Element(index).serial;
+	unsigned int hiword = m_memoryLists.Element(index).serial | m_handleTag;
 	hiword <<= 16;
 	index++;
 	return (memhandle_t)( hiword|index );
@@ -350,6 +438,19 @@ unsigned int CDataManagerBase::EnsureCapacity( unsigned int size )
 	{
 		Lock();
 		int lruIndex = m_memoryLists.Head( m_lruList );
+		if ( m_approximateLRU )
+		{
+			// Second chance: entries touched since they were last at the head go
+			// back to the tail with their bit cleared, bounded by one lap
+			int nCount = m_memoryLists.Count( m_lruList );
+			for ( int i = 0; i < nCount && IsReferenced( lruIndex ); i++ )
+			{
+				SetReferenced( lruIndex, 0 );
+				m_memoryLists.Unlink( m_lruList, lruIndex );
+				m_memoryLists.LinkToTail( m_lruList, lruIndex );
+				lruIndex = m_memoryLists.Head( m_lruList );
+			}
+		}
 		if ( lruIndex == m_memoryLists.InvalidIndex() )
 		{
 			Unlock();
@@ -381,7 +482,11 @@ void *CDataManagerBase::GetForFreeByIndex( unsigned short memoryIndex )
 		m_memUsed -= size;
 		p = mem.pStore;
 		mem.pStore = NULL;
-		mem.serial++;
+		mem.serial = ( mem.serial + 1 ) & m_serialMask;
+		if ( m_approximateLRU )
+		{
+			SetReferenced( memoryIndex, 0 );
+		}
 		m_memoryLists.LinkToTail( m_freeList, memoryIndex );
 	}
 	return p;
@@ -4,6 +4,13 @@
 //
 //===========================================================================//
 
+#if defined( _WIN32 )
+#define WIN_32_LEAN_AND_MEAN
+#include <windows.h>
+#elif defined( POSIX )
+#include <sys/mman.h>
+#endif
+
 #include "mempool.h"
 #include <stdio.h>
 #include <malloc.h>
@@ -303,3 +310,681 @@ void CUtlMemoryPool::Free( void *memBlock )
 }
 
 
+//-----------------------------------------------------------------------------
+// CMemoryPoolSlab
+//-----------------------------------------------------------------------------
+
+// Every live slab pool in this module, a pool's index is its slot in the
+// per-thread magazine table
+static CMemoryPoolSlab *g_pSlabPools[CMemoryPoolSlab::MAX_SLAB_POOLS];
+static unsigned int g_nSlabPoolSerial;
+
+static CThreadFastMutex &SlabPoolRegistryMutex()
+{
+	static CThreadFastMutex s_mutex;
+	return s_mutex;
+}
+
+#ifdef CTHREADLOCALPTR
+// MAX_SLAB_POOLS magazine pointers per thread, allocated on first use
+static CTHREADLOCALPTR( void * ) g_ppSlabMagazines;
+
+// Its destructor runs as the thread exits and gives the cached blocks back.
+// Only touched when a thread's table is allocated, a thread_local with a
+// destructor costs a guard check on every access.
+struct SlabThreadExit_t
+{
+	~SlabThreadExit_t()
+	{
+		CMemoryPoolSlab::ReleaseThreadMagazines( m_ppMagazines );
+		g_ppSlabMagazines = NULL;
+	}
+
+	void **m_ppMagazines;
+};
+static thread_local SlabThreadExit_t g_SlabThreadExit;
+#endif
+
+
+//-----------------------------------------------------------------------------
+// Large page backed slab memory. Returns NULL when the OS won't hand out large
+// pages, the caller falls back to malloc.
+//-----------------------------------------------------------------------------
+static void *AllocHugePageSlab( size_t nBytes, size_t *pMappedBytes, bool *pHugePages )
+{
+#if defined( _WIN32 )
+	SIZE_T nLargePageSize = GetLargePageMinimum();
+	if ( nLargePageSize == 0 )
+		return NULL;
+
+	// Needs SeLockMemoryPrivilege, fails without it
+	size_t nMapBytes = ( nBytes + nLargePageSize - 1 ) & ~( nLargePageSize - 1 );
+	void *pMem = VirtualAlloc( NULL, nMapBytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE );
+	if ( !pMem )
+		return NULL;
+
+	*pMappedBytes = nMapBytes;
+	*pHugePages = true;
+	return pMem;
+#elif defined( POSIX )
+	const size_t nHugePageSize = 2 * 1024 * 1024;
+	size_t nMapBytes = ( nBytes + nHugePageSize - 1 ) & ~( nHugePageSize - 1 );
+	void *pMem = MAP_FAILED;
+	bool bHugePages = false;
+
+#ifdef MAP_HUGETLB
+	pMem = mmap( NULL, nMapBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+	bHugePages = ( pMem != MAP_FAILED );
+#endif
+	if ( pMem == MAP_FAILED )
+	{
+		// No reserved huge pages, ask for transparent ones instead
+		pMem = mmap( NULL, nMapBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+		if ( pMem == MAP_FAILED )
+			return NULL;
+#ifdef MADV_HUGEPAGE
+		madvise( pMem, nMapBytes, MADV_HUGEPAGE );
+#endif
+	}
+
+	*pMappedBytes = nMapBytes;
+	*pHugePages = bHugePages;
+	return pMem;
+#else
+	return NULL;
+#endif
+}
+
+static void FreeHugePageSlab( void *pMem, size_t nBytes )
+{
+#if defined( _WIN32 )
+	VirtualFree( pMem, 0, MEM_RELEASE );
+#elif defined( POSIX )
+	munmap( pMem, nBytes );
+#endif
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Constructor
+//-----------------------------------------------------------------------------
+CMemoryPoolSlab::CMemoryPoolSlab( int blockSize, int numElements, int growMode, const char *pszAllocOwner, int nAlignment, int nFlags ) :
+	m_pHeadOfFreeList( NULL ),
+	m_pMagazines( NULL ),
+	m_nTotal( 0 ),
+	m_nOutstanding( 0 ),
+	m_nPeakOutstanding( 0 ),
+	m_nRetiredLive( 0 ),
+	m_nRefills( 0 ),
+	m_nFlushes( 0 ),
+	m_nSlabBytes( 0 )
+{
+	m_nAlignment = ( nAlignment != 0 ) ? nAlignment : 1;
+	Assert( IsPowerOfTwo( m_nAlignment ) );
+	m_nBlockSize = blockSize < (int)sizeof(void*) ? (int)sizeof(void*) : blockSize;
+	m_nBlockSize = AlignValue( m_nBlockSize, m_nAlignment );
+	m_nBlocksPerSlab = max( numElements, 1 );
+	m_nGrowMode = growMode;
+	m_nFlags = nFlags;
+	m_pszAllocOwner = pszAllocOwner ? pszAllocOwner : __FILE__;
+
+	{
+		AUTO_LOCK( SlabPoolRegistryMutex() );
+		m_nSerial = ++g_nSlabPoolSerial;
+		m_nPoolIndex = -1;
+		for ( int i = 0; i < MAX_SLAB_POOLS; ++i )
+		{
+			if ( !g_pSlabPools[i] )
+			{
+				g_pSlabPools[i] = this;
+				m_nPoolIndex = i;
+				break;
+			}
+		}
+	}
+	AssertMsg( m_nPoolIndex >= 0, "Too many slab pools, %s won't use thread caches\n", m_pszAllocOwner );
+
+	memset( &m_SharedMagazine, 0, sizeof( m_SharedMagazine ) );
+	ResetMagazine( &m_SharedMagazine );
+
+	// The first slab is carved by the first Refill, pools that never get used cost nothing
+}
+
+CMemoryPoolSlab::~CMemoryPoolSlab()
+{
+	{
+		AUTO_LOCK( SlabPoolRegistryMutex() );
+		if ( m_nPoolIndex >= 0 )
+		{
+			g_pSlabPools[m_nPoolIndex] = NULL;
+		}
+	}
+
+	Clear();
+}
+
+
+//-----------------------------------------------------------------------------
+// Frees everything. Magazines of other threads still carry the old serial and
+// drop their blocks the next time they're used.
+//-----------------------------------------------------------------------------
+void CMemoryPoolSlab::Clear()
+{
+	// Not nested in m_mutex, thread exit takes the registry lock first
+	unsigned int nSerial;
+	{
+		AUTO_LOCK( SlabPoolRegistryMutex() );
+		nSerial = ++g_nSlabPoolSerial;
+	}
+
+	AUTO_LOCK( m_mutex );
+	FreeSlabs();
+	m_nSerial = nSerial;
+
+	m_pMagazines = NULL;
+	ResetMagazine( &m_SharedMagazine );
+	m_nOutstanding = 0;
+	m_nRetiredLive = 0;
+}
+
+void CMemoryPoolSlab::FreeSlabs()
+{
+	for ( int i = 0; i < m_Slabs.Count(); ++i )
+	{
+		if ( m_Slabs[i].m_bMapped )
+		{
+			FreeHugePageSlab( m_Slabs[i].m_pBase, m_Slabs[i].m_nBytes );
+		}
+		else
+		{
+			free( m_Slabs[i].m_pBase );
+		}
+	}
+	m_Slabs.Purge();
+	m_pHeadOfFreeList = NULL;
+	m_nTotal = 0;
+	m_nSlabBytes = 0;
+}
+
+
+//-----------------------------------------------------------------------------
+// Carves a new slab into blocks. Called with m_mutex held.
+//-----------------------------------------------------------------------------
+bool CMemoryPoolSlab::AddNewSlab()
+{
+	MEM_ALLOC_CREDIT_(m_pszAllocOwner);
+
+	int sizeMultiplier = 1;
+	if ( m_nGrowMode == UTLMEMORYPOOL_GROW_NONE )
+	{
+		// Can only have one allocation when we're in this mode
+		if ( m_Slabs.Count() != 0 )
+			return false;
+	}
+	else if ( m_nGrowMode == UTLMEMORYPOOL_GROW_FAST )
+	{
+		sizeMultiplier = m_Slabs.Count() + 1;
+	}
+
+	size_t nBytes = (size_t)m_nBlockSize * m_nBlocksPerSlab * sizeMultiplier + ( m_nAlignment - 1 );
+
+	Slab_t slab;
+	slab.m_pBase = NULL;
+	slab.m_nBytes = nBytes;
+	slab.m_bMapped = false;
+	slab.m_bHugePages = false;
+
+	if ( m_nFlags & MEMORYPOOL_SLAB_HUGE_PAGES )
+	{
+		slab.m_pBase = AllocHugePageSlab( nBytes, &slab.m_nBytes, &slab.m_bHugePages );
+		slab.m_bMapped = ( slab.m_pBase != NULL );
+	}
+
+	if ( !slab.m_pBase )
+	{
+		slab.m_pBase = malloc( nBytes );
+		slab.m_nBytes = nBytes;
+		if ( !slab.m_pBase )
+		{
+			Assert( !"CMemoryPoolSlab::AddNewSlab: ran out of memory" );
+			return false;
+		}
+	}
+
+	// Large pages round the slab up, use all of it
+	char *pFirst = AlignValue( (char *)slab.m_pBase, m_nAlignment );
+	int nBlocks = (int)( ( (char *)slab.m_pBase + slab.m_nBytes - pFirst ) / m_nBlockSize );
+
+	void **pBlock = (void **)pFirst;
+	for ( int j = 0; j < nBlocks - 1; j++ )
+	{
+		pBlock[0] = (char *)pBlock + m_nBlockSize;
+		pBlock = (void **)pBlock[0];
+	}
+	pBlock[0] = m_pHeadOfFreeList;
+	m_pHeadOfFreeList = pFirst;
+
+	m_Slabs.AddToTail( slab );
+	m_nTotal += nBlocks;
+	m_nSlabBytes += slab.m_nBytes;
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Magazines
+//-----------------------------------------------------------------------------
+void CMemoryPoolSlab::ResetMagazine( Magazine_t *pMagazine )
+{
+	// Its blocks belonged to a pool that has since been cleared or destroyed
+	pMagazine->m_nSerial = m_nSerial;
+	pMagazine->m_nCount = 0;
+	pMagazine->m_nAllocs = 0;
+	pMagazine->m_nFrees = 0;
+
+	AUTO_LOCK( m_mutex );
+	pMagazine->m_pNextInPool = m_pMagazines;
+	m_pMagazines = pMagazine;
+}
+
+CMemoryPoolSlab::Magazine_t *CMemoryPoolSlab::GetMagazine()
+{
+#ifdef CTHREADLOCALPTR
+	if ( m_nPoolIndex < 0 )
+		return NULL;
+
+	void **ppMagazines = g_ppSlabMagazines;
+	if ( !ppMagazines )
+	{
+		ppMagazines = (void **)calloc( MAX_SLAB_POOLS, sizeof( void * ) );
+		g_ppSlabMagazines = ppMagazines;
+		g_SlabThreadExit.m_ppMagazines = ppMagazines;
+	}
+
+	Magazine_t *pMagazine = (Magazine_t *)ppMagazines[m_nPoolIndex];
+	if ( !pMagazine )
+	{
+		pMagazine = (Magazine_t *)calloc( 1, sizeof( Magazine_t ) );
+		ppMagazines[m_nPoolIndex] = pMagazine;
+		ResetMagazine( pMagazine );
+	}
+	else if ( pMagazine->m_nSerial != m_nSerial )
+	{
+		ResetMagazine( pMagazine );
+	}
+	return pMagazine;
+#else
+	return NULL;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Moves half a magazine worth of blocks out of the shared free list
+//-----------------------------------------------------------------------------
+void CMemoryPoolSlab::Refill( Magazine_t *pMagazine )
+{
+	AUTO_LOCK( m_mutex );
+	m_nRefills++;
+
+	int nStart = pMagazine->m_nCount;
+	while ( pMagazine->m_nCount < MAGAZINE_SIZE / 2 )
+	{
+		if ( !m_pHeadOfFreeList && !AddNewSlab() )
+			break;
+
+		void *pBlock = m_pHeadOfFreeList;
+		m_pHeadOfFreeList = *((void**)pBlock);
+		pMagazine->m_pBlocks[pMagazine->m_nCount++] = pBlock;
+	}
+
+	m_nOutstanding += pMagazine->m_nCount - nStart;
+	m_nPeakOutstanding = max( m_nPeakOutstanding, m_nOutstanding );
+}
+
+//-----------------------------------------------------------------------------
+// Returns the top nCount blocks of a magazine to the shared free list
+//-----------------------------------------------------------------------------
+void CMemoryPoolSlab::Flush( Magazine_t *pMagazine, int nCount )
+{
+	Assert( nCount <= pMagazine->m_nCount );
+
+	AUTO_LOCK( m_mutex );
+	m_nFlushes++;
+
+	for ( int i = 0; i < nCount; ++i )
+	{
+		void *pBlock = pMagazine->m_pBlocks[--pMagazine->m_nCount];
+		*((void**)pBlock) = m_pHeadOfFreeList;
+		m_pHeadOfFreeList = pBlock;
+	}
+	m_nOutstanding -= nCount;
+}
+
+//-----------------------------------------------------------------------------
+// Takes an exiting thread's magazine out of the pool: its blocks go back to
+// the shared free list and its counts are kept for Count()
+//-----------------------------------------------------------------------------
+void CMemoryPoolSlab::RetireMagazine( Magazine_t *pMagazine )
+{
+	AUTO_LOCK( m_mutex );
+
+	// From before the last Clear(), it holds nothing of ours and isn't linked
+	if ( pMagazine->m_nSerial != m_nSerial )
+		return;
+
+	for ( Magazine_t **ppLink = &m_pMagazines; *ppLink; ppLink = &(*ppLink)->m_pNextInPool )
+	{
+		if ( *ppLink == pMagazine )
+		{
+			*ppLink = pMagazine->m_pNextInPool;
+			break;
+		}
+	}
+
+	m_nRetiredLive += (int)( pMagazine->m_nAllocs - pMagazine->m_nFrees );
+	m_nFlushes++;
+
+	while ( pMagazine->m_nCount )
+	{
+		void *pBlock = pMagazine->m_pBlocks[--pMagazine->m_nCount];
+		*((void**)pBlock) = m_pHeadOfFreeList;
+		m_pHeadOfFreeList = pBlock;
+		m_nOutstanding--;
+	}
+}
+
+void CMemoryPoolSlab::ReleaseThreadMagazines( void **ppMagazines )
+{
+	if ( !ppMagazines )
+		return;
+
+	// Holding the registry keeps the pools from being destroyed under us
+	AUTO_LOCK( SlabPoolRegistryMutex() );
+	for ( int i = 0; i < MAX_SLAB_POOLS; ++i )
+	{
+		Magazine_t *pMagazine = (Magazine_t *)ppMagazines[i];
+		if ( !pMagazine )
+			continue;
+
+		// A pool that reused the slot has a different serial and ignores it
+		if ( g_pSlabPools[i] )
+		{
+			g_pSlabPools[i]->RetireMagazine( pMagazine );
+		}
+		free( pMagazine );
+	}
+	free( ppMagazines );
+}
+
+inline void *CMemoryPoolSlab::AllocFromMagazine( Magazine_t *pMagazine )
+{
+	if ( pMagazine->m_nCount == 0 )
+	{
+		Refill( pMagazine );
+		if ( pMagazine->m_nCount == 0 )
+			return NULL;
+	}
+
+	pMagazine->m_nAllocs++;
+	return pMagazine->m_pBlocks[--pMagazine->m_nCount];
+}
+
+inline void CMemoryPoolSlab::FreeToMagazine( Magazine_t *pMagazine, void *pMem )
+{
+	if ( pMagazine->m_nCount == MAGAZINE_SIZE )
+	{
+		Flush( pMagazine, MAGAZINE_SIZE / 2 );
+	}
+
+	pMagazine->m_nFrees++;
+	pMagazine->m_pBlocks[pMagazine->m_nCount++] = pMem;
+}
+
+
+//-----------------------------------------------------------------------------
+// Alloc/free
+//-----------------------------------------------------------------------------
+void *CMemoryPoolSlab::Alloc()
+{
+	return Alloc( m_nBlockSize );
+}
+
+void *CMemoryPoolSlab::AllocZero()
+{
+	return AllocZero( m_nBlockSize );
+}
+
+void *CMemoryPoolSlab::Alloc( size_t amount )
+{
+	if ( amount > (size_t)m_nBlockSize )
+		return NULL;
+
+	Magazine_t *pMagazine = GetMagazine();
+	if ( pMagazine )
+		return AllocFromMagazine( pMagazine );
+
+	AUTO_LOCK( m_mutex );
+	return AllocFromMagazine( &m_SharedMagazine );
+}
+
+void *CMemoryPoolSlab::AllocZero( size_t amount )
+{
+	void *mem = Alloc( amount );
+	if ( mem )
+	{
+		V_memset( mem, 0x00, amount );
+	}
+	return mem;
+}
+
+void CMemoryPoolSlab::Free( void *pMem )
+{
+	if ( !pMem )
+		return;  // trying to delete NULL pointer, ignore
+
+#ifdef _DEBUG
+	Assert( IsAllocationWithinPool( pMem ) );
+
+	// invalidate the memory
+	memset( pMem, 0xDD, m_nBlockSize );
+#endif
+
+	Magazine_t *pMagazine = GetMagazine();
+	if ( pMagazine )
+	{
+		FreeToMagazine( pMagazine, pMem );
+		return;
+	}
+
+	AUTO_LOCK( m_mutex );
+	FreeToMagazine( &m_SharedMagazine, pMem );
+}
+
+void CMemoryPoolSlab::FlushThreadCache()
+{
+	Magazine_t *pMagazine = GetMagazine();
+	if ( pMagazine && pMagazine->m_nCount )
+	{
+		Flush( pMagazine, pMagazine->m_nCount );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Stats
+//-----------------------------------------------------------------------------
+int CMemoryPoolSlab::Count() const
+{
+	AUTO_LOCK( m_mutex );
+
+	unsigned int nLive = m_nRetiredLive;
+	for ( const Magazine_t *pMagazine = m_pMagazines; pMagazine; pMagazine = pMagazine->m_pNextInPool )
+	{
+		nLive += pMagazine->m_nAllocs - pMagazine->m_nFrees;
+	}
+	return (int)nLive;
+}
+
+bool CMemoryPoolSlab::IsAllocationWithinPool( void *pMem ) const
+{
+	AUTO_LOCK( m_mutex );
+
+	for ( int i = 0; i < m_Slabs.Count(); ++i )
+	{
+		const Slab_t &slab = m_Slabs[i];
+		if ( pMem >= slab.m_pBase && (char *)pMem < (char *)slab.m_pBase + slab.m_nBytes )
+			return true;
+	}
+	return false;
+}
+
+void CMemoryPoolSlab::GetStats( MemoryPoolSlabStats_t *pStats ) const
+{
+	AUTO_LOCK( m_mutex );
+
+	memset( pStats, 0, sizeof( *pStats ) );
+	pStats->m_pszName = m_pszAllocOwner;
+	pStats->m_nBlockSize = m_nBlockSize;
+	pStats->m_nPeakOutstanding = m_nPeakOutstanding;
+	pStats->m_nTotal = m_nTotal;
+	pStats->m_nSlabs = m_Slabs.Count();
+	pStats->m_nSlabBytes = m_nSlabBytes;
+	pStats->m_nRefills = m_nRefills;
+	pStats->m_nFlushes = m_nFlushes;
+
+	for ( int i = 0; i < m_Slabs.Count(); ++i )
+	{
+		pStats->m_nHugePageSlabs += m_Slabs[i].m_bHugePages ? 1 : 0;
+	}
+
+	// Magazine counts are read racily, other threads may be in the middle of an alloc
+	unsigned int nLive = m_nRetiredLive;
+	for ( const Magazine_t *pMagazine = m_pMagazines; pMagazine; pMagazine = pMagazine->m_pNextInPool )
+	{
+		nLive += pMagazine->m_nAllocs - pMagazine->m_nFrees;
+		pStats->m_nCached += pMagazine->m_nCount;
+		pStats->m_nThreads += ( pMagazine != &m_SharedMagazine ) ? 1 : 0;
+	}
+	pStats->m_nLive = (int)nLive;
+}
+
+void CMemoryPoolSlab::DumpStats( MemoryPoolReportFunc_t pfnReport )
+{
+	AUTO_LOCK( SlabPoolRegistryMutex() );
+
+	pfnReport( "%-40s %6s %8s %8s %8s %8s %6s %10s %6s %8s %8s %4s\n",
+		"pool", "size", "live", "peak", "cached", "total", "slabs", "KB", "frag", "refills", "flushes", "thr" );
+
+	int nPools = 0;
+	int64 nTotalBytes = 0;
+	for ( int i = 0; i < MAX_SLAB_POOLS; ++i )
+	{
+		if ( !g_pSlabPools[i] )
+			continue;
+
+		MemoryPoolSlabStats_t stats;
+		g_pSlabPools[i]->GetStats( &stats );
+
+		// Fraction of carved blocks not in use by anybody
+		float flFragmentation = stats.m_nTotal ? 100.0f * ( stats.m_nTotal - stats.m_nLive ) / stats.m_nTotal : 0.0f;
+		pfnReport( "%-40s %6d %8d %8d %8d %8d %3d/%-2d %10.1f %5.1f%% %8d %8d %4d\n",
+			stats.m_pszName, stats.m_nBlockSize, stats.m_nLive, stats.m_nPeakOutstanding, stats.m_nCached, stats.m_nTotal,
+			stats.m_nSlabs, stats.m_nHugePageSlabs, stats.m_nSlabBytes / 1024.0f, flFragmentation,
+			stats.m_nRefills, stats.m_nFlushes, stats.m_nThreads );
+
+		nPools++;
+		nTotalBytes += stats.m_nSlabBytes;
+	}
+
+	pfnReport( "%d slab pools, %.1f KB in slabs\n", nPools, nTotalBytes / 1024.0f );
+}
+
+
+//-----------------------------------------------------------------------------
+// CMemoryPoolSlabAllocator
+//-----------------------------------------------------------------------------
+static const int g_nSlabClassSizes[CMemoryPoolSlabAllocator::NUM_SIZE_CLASSES] =
+{
+	16, 32, 48, 64, 80, 96, 112, 128, 192, 256, 384, 512, 768, 1024
+};
+
+CMemoryPoolSlabAllocator::CMemoryPoolSlabAllocator( const char *pszAllocOwner, int nBlocksPerSlab, int nFlags )
+{
+	COMPILE_TIME_ASSERT( MAX_SLAB_SIZE == 1024 );
+
+	// Slabs are carved lazily, so unused classes only cost their pool object
+	for ( int i = 0; i < NUM_SIZE_CLASSES; ++i )
+	{
+		int nBlocks = max( nBlocksPerSlab * g_nSlabClassSizes[0] / g_nSlabClassSizes[i], 16 );
+		m_pPools[i] = new CMemoryPoolSlab( g_nSlabClassSizes[i], nBlocks, UTLMEMORYPOOL_GROW_FAST, pszAllocOwner, 16, nFlags );
+	}
+}
+
+CMemoryPoolSlabAllocator::~CMemoryPoolSlabAllocator()
+{
+	for ( int i = 0; i < NUM_SIZE_CLASSES; ++i )
+	{
+		delete m_pPools[i];
+	}
+}
+
+int CMemoryPoolSlabAllocator::SizeClass( size_t nSize )
+{
+	if ( nSize > MAX_SLAB_SIZE )
+		return -1;
+
+	if ( nSize <= 128 )
+		return nSize ? (int)( nSize - 1 ) / 16 : 0;
+
+	int nClass = 8;
+	while ( (size_t)g_nSlabClassSizes[nClass] < nSize )
+	{
+		++nClass;
+	}
+	return nClass;
+}
+
+int CMemoryPoolSlabAllocator::SizeOfClass( int nClass )
+{
+	Assert( nClass >= 0 && nClass < NUM_SIZE_CLASSES );
+	return g_nSlabClassSizes[nClass];
+}
+
+void *CMemoryPoolSlabAllocator::Alloc( size_t nSize )
+{
+	int nClass = SizeClass( nSize );
+	if ( nClass < 0 )
+		return malloc( nSize );
+
+	return m_pPools[nClass]->Alloc();
+}
+
+void *CMemoryPoolSlabAllocator::AllocZero( size_t nSize )
+{
+	void *mem = Alloc( nSize );
+	if ( mem )
+	{
+		V_memset( mem, 0x00, nSize );
+	}
+	return mem;
+}
+
+void CMemoryPoolSlabAllocator::Free( void *pMem, size_t nSize )
+{
+	int nClass = SizeClass( nSize );
+	if ( nClass < 0 )
+	{
+		free( pMem );
+		return;
+	}
+
+	m_pPools[nClass]->Free( pMem );
+}
+
+void CMemoryPoolSlabAllocator::FlushThreadCache()
+{
+	for ( int i = 0; i < NUM_SIZE_CLASSES; ++i )
+	{
+		m_pPools[i]->FlushThreadCache();
+	}
+}
@@ -11,6 +11,7 @@
 #include "utlsymbol.h"
 #include "KeyValues.h"
 #include "tier0/threadtools.h"
+#include "generichash.h"
 #include "tier0/memdbgon.h"
 #include "stringpool.h"
 #include "utlhashtable.h"
@@ -36,8 +37,6 @@
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
-#define INVALID_STRING_INDEX CStringPoolIndex( 0xFFFF, 0xFFFF )
-
 #define MIN_STRING_POOL_SIZE	2048
 
 //-----------------------------------------------------------------------------
@@ -131,37 +130,10 @@ bool CUtlSymbol::operator!=(const char* pStr) const
 // symbol table stuff
 //-----------------------------------------------------------------------------
 
-inline const char* CUtlSymbolTable::StringFromIndex( const CStringPoolIndex &index ) const
-{
-	Assert( index.m_iPool < m_StringPools.Count() );
-	Assert( index.m_iOffset < m_StringPools[index.m_iPool]->m_TotalLen );
-
-	return &m_StringPools[index.m_iPool]->m_Data[index.m_iOffset];
-}
-
-
-bool CUtlSymbolTable::CLess::operator()( const CStringPoolIndex &i1, const CStringPoolIndex &i2 ) const
+inline unsigned int CUtlSymbolTable::HashSymbolString( const char *pString ) const
 {
-	// Need to do pointer math because CUtlSymbolTable is used in CUtlVectors, and hence
-	// can be arbitrarily moved in memory on a realloc. Yes, this is portable. In reality,
-	// right now at least, because m_LessFunc is the first member of CUtlRBTree, and m_Lookup
-	// is the first member of CUtlSymbolTabke, this == pTable
-	CUtlSymbolTable *pTable = (CUtlSymbolTable *)( (byte *)this - offsetof(CUtlSymbolTable::CTree, m_LessFunc) ) - offsetof(CUtlSymbolTable, m_Lookup );
-	const char* str1 = (i1 == INVALID_STRING_INDEX) ? pTable->m_pUserSearchString :
-													  pTable->StringFromIndex( i1 );
-	const char* str2 = (i2 == INVALID_STRING_INDEX) ? pTable->m_pUserSearchString :
-													  pTable->StringFromIndex( i2 );
-
-	if ( !str1 && str2 )
-		return false;
-	if ( !str2 && str1 )
-		return true;
-	if ( !str1 && !str2 )
-		return false;
-	if ( !pTable->m_bInsensitive )
-		return V_strcmp( str1, str2 ) < 0;
-	else
-		return V_stricmp( str1, str2 ) < 0;
+	unsigned int nHash = m_bInsensitive ? HashStringCaseless( pString ) : HashString( pString );
+	return nHash ? nHash : 1;
 }
 
 
@@ -169,8 +141,9 @@ bool CUtlSymbolTable::CLess::operator()( const CStringPoolIndex &i1, const CStri
 // constructor, destructor
 //-----------------------------------------------------------------------------
 CUtlSymbolTable::CUtlSymbolTable( int growSize, int initSize, bool caseInsensitive ) : 
-	m_Lookup( growSize, initSize ), m_bInsensitive( caseInsensitive ), m_StringPools( 8 )
+	m_pIndex( NULL ), m_nStrings( 0 ), m_nInitSize( initSize ), m_bInsensitive( caseInsensitive ), m_StringPools( 8 )
 {
+	memset( m_pSymbolBlocks, 0, sizeof( m_pSymbolBlocks ) );
 }
 
 CUtlSymbolTable::~CUtlSymbolTable()
@@ -180,23 +153,43 @@ CUtlSymbolTable::~CUtlSymbolTable()
 }
 
 
+//-----------------------------------------------------------------------------
+// Walks the probe sequence until the string or an empty slot shows up. The
+// index is never more than half full, so there always is an empty slot.
+//-----------------------------------------------------------------------------
+UtlSymId_t CUtlSymbolTable::FindSymbol( const char *pString, unsigned int nHash ) const
+{
+	const HashIndex_t *pIndex = m_pIndex;
+	if ( !pIndex )
+		return UTL_INVAL_SYMBOL;
+
+	unsigned int nMask = pIndex->m_nMask;
+	for ( unsigned int i = nHash & nMask; ; i = ( i + 1 ) & nMask )
+	{
+		const HashSlot_t &slot = pIndex->m_Slots[i];
+		unsigned int nSlotHash = slot.m_nHash;
+		if ( nSlotHash == 0 )
+			return UTL_INVAL_SYMBOL;
+
+		if ( nSlotHash != nHash )
+			continue;
+
+		// The hash is written after the id, so the id is valid once we've seen the hash
+		ThreadMemoryBarrier();
+		UtlSymId_t id = slot.m_Id;
+		const char *pSymbolString = m_pSymbolBlocks[ id >> SYMBOL_BLOCK_BITS ][ id & SYMBOL_BLOCK_MASK ].m_pString;
+		if ( m_bInsensitive ? !V_stricmp( pSymbolString, pString ) : !V_strcmp( pSymbolString, pString ) )
+			return id;
+	}
+}
+
+
 CUtlSymbol CUtlSymbolTable::Find( const char* pString ) const
 {	
 	if (!pString)
 		return CUtlSymbol();
 	
-	// Store a special context used to help with insertion
-	m_pUserSearchString = pString;
-	
-	// Passing this special invalid symbol makes the comparison function
-	// use the string passed in the context
-	UtlSymId_t idx = m_Lookup.Find( INVALID_STRING_INDEX );
-
-#ifdef _DEBUG
-	m_pUserSearchString = NULL;
-#endif
-
-	return CUtlSymbol( idx );
+	return CUtlSymbol( FindSymbol( pString, HashSymbolString( pString ) ) );
 }
 
 
@@ -217,21 +210,10 @@ int CUtlSymbolTable::FindPoolWithSpace( int len )	const
 
 
 //-----------------------------------------------------------------------------
-// Finds and/or creates a symbol based on the string
+// Copies the string into a pool, pools are never reallocated
 //-----------------------------------------------------------------------------
-
-CUtlSymbol CUtlSymbolTable::AddString( const char* pString )
+const char *CUtlSymbolTable::StoreString( const char *pString, int len )
 {
-	if (!pString) 
-		return CUtlSymbol( UTL_INVAL_SYMBOL );
-
-	CUtlSymbol id = Find( pString );
-	
-	if (id.IsValid())
-		return id;
-
-	int len = V_strlen(pString) + 1;
-
 	// Find a pool with space for this string, or allocate a new one.
 	int iPool = FindPoolWithSpace( len );
 	if ( iPool == -1 )
@@ -246,21 +228,115 @@ CUtlSymbol CUtlSymbolTable::AddString( const char* pString )
 
 	// Copy the string in.
 	StringPool_t *pPool = m_StringPools[iPool];
-	Assert( pPool->m_SpaceUsed < 0xFFFF );	// This should never happen, because if we had a string > 64k, it
-											// would have been given its entire own pool.
-	
-	unsigned short iStringOffset = pPool->m_SpaceUsed;
-
-	memcpy( &pPool->m_Data[pPool->m_SpaceUsed], pString, len );
+	char *pDest = &pPool->m_Data[pPool->m_SpaceUsed];
+	memcpy( pDest, pString, len );
 	pPool->m_SpaceUsed += len;
+	return pDest;
+}
 
-	// didn't find, insert the string into the vector.
-	CStringPoolIndex index;
-	index.m_iPool = iPool;
-	index.m_iOffset = iStringOffset;
 
-	UtlSymId_t idx = m_Lookup.Insert( index );
-	return CUtlSymbol( idx );
+//-----------------------------------------------------------------------------
+// Writes the id before the hash so readers never match a half written slot
+//-----------------------------------------------------------------------------
+void CUtlSymbolTable::InsertIntoIndex( HashIndex_t *pIndex, unsigned int nHash, UtlSymId_t id )
+{
+	unsigned int nMask = pIndex->m_nMask;
+	unsigned int i = nHash & nMask;
+	while ( pIndex->m_Slots[i].m_nHash != 0 )
+	{
+		i = ( i + 1 ) & nMask;
+	}
+
+	pIndex->m_Slots[i].m_Id = id;
+	ThreadMemoryBarrier();
+	pIndex->m_Slots[i].m_nHash = nHash;
+}
+
+
+//-----------------------------------------------------------------------------
+// Builds a table twice the size off to the side and then publishes it,
+// readers see either the old complete table or the new complete one.
+//-----------------------------------------------------------------------------
+void CUtlSymbolTable::GrowIndex()
+{
+	int nSlots = m_pIndex ? ( m_pIndex->m_nMask + 1 ) * 2 : MIN_HASH_INDEX_SIZE;
+	while ( nSlots < m_nStrings * 2 || nSlots < m_nInitSize * 2 )
+	{
+		nSlots *= 2;
+	}
+
+	HashIndex_t *pIndex = (HashIndex_t*)calloc( 1, sizeof( HashIndex_t ) + ( nSlots - 1 ) * sizeof( HashSlot_t ) );
+	pIndex->m_nMask = nSlots - 1;
+	pIndex->m_pRetired = m_pIndex;
+
+	for ( int i = 0; i < m_nStrings; i++ )
+	{
+		const Symbol_t &symbol = m_pSymbolBlocks[ i >> SYMBOL_BLOCK_BITS ][ i & SYMBOL_BLOCK_MASK ];
+		InsertIntoIndex( pIndex, symbol.m_nHash, (UtlSymId_t)i );
+	}
+
+	ThreadMemoryBarrier();
+	m_pIndex = pIndex;
+}
+
+
+UtlSymId_t CUtlSymbolTable::InsertSymbol( const char *pString, unsigned int nHash )
+{
+	if ( m_nStrings >= UTL_INVAL_SYMBOL )
+	{
+		Assert( !"CUtlSymbolTable is full" );
+		return UTL_INVAL_SYMBOL;
+	}
+
+	int len = V_strlen(pString) + 1;
+	const char *pStored = StoreString( pString, len );
+
+	UtlSymId_t id = (UtlSymId_t)m_nStrings;
+	Symbol_t *pBlock = m_pSymbolBlocks[ id >> SYMBOL_BLOCK_BITS ];
+	if ( !pBlock )
+	{
+		pBlock = (Symbol_t*)malloc( SYMBOL_BLOCK_SIZE * sizeof( Symbol_t ) );
+	}
+
+	pBlock[ id & SYMBOL_BLOCK_MASK ].m_pString = pStored;
+	pBlock[ id & SYMBOL_BLOCK_MASK ].m_nHash = nHash;
+
+	// The symbol has to be complete before anything can hand out its id
+	ThreadMemoryBarrier();
+	m_pSymbolBlocks[ id >> SYMBOL_BLOCK_BITS ] = pBlock;
+	m_nStrings = id + 1;
+
+	// Keep the index at most half full
+	if ( !m_pIndex || m_nStrings * 2 > (int)( m_pIndex->m_nMask + 1 ) )
+	{
+		GrowIndex();
+	}
+	else
+	{
+		InsertIntoIndex( m_pIndex, nHash, id );
+	}
+
+	return id;
+}
+
+
+//-----------------------------------------------------------------------------
+// Finds and/or creates a symbol based on the string
+//-----------------------------------------------------------------------------
+
+CUtlSymbol CUtlSymbolTable::AddString( const char* pString )
+{
+	if (!pString) 
+		return CUtlSymbol( UTL_INVAL_SYMBOL );
+
+	unsigned int nHash = HashSymbolString( pString );
+	UtlSymId_t id = FindSymbol( pString, nHash );
+	if ( id == UTL_INVAL_SYMBOL )
+	{
+		id = InsertSymbol( pString, nHash );
+	}
+
+	return CUtlSymbol( id );
 }
 
 
@@ -273,8 +349,8 @@ const char* CUtlSymbolTable::String( CUtlSymbol id ) const
 	if (!id.IsValid()) 
 		return "";
 	
-	Assert( m_Lookup.IsValidIndex((UtlSymId_t)id) );
-	return StringFromIndex( m_Lookup[id] );
+	Assert( (UtlSymId_t)id < m_nStrings );
+	return m_pSymbolBlocks[ (UtlSymId_t)id >> SYMBOL_BLOCK_BITS ][ (UtlSymId_t)id & SYMBOL_BLOCK_MASK ].m_pString;
 }
 
 
@@ -284,7 +360,21 @@ const char* CUtlSymbolTable::String( CUtlSymbol id ) const
 
 void CUtlSymbolTable::RemoveAll()
 {
-	m_Lookup.Purge();
+	HashIndex_t *pIndex = m_pIndex;
+	while ( pIndex )
+	{
+		HashIndex_t *pRetired = pIndex->m_pRetired;
+		free( pIndex );
+		pIndex = pRetired;
+	}
+	m_pIndex = NULL;
+
+	for ( int i = 0; i < SYMBOL_BLOCK_COUNT; i++ )
+	{
+		free( m_pSymbolBlocks[i] );
+		m_pSymbolBlocks[i] = NULL;
+	}
+	m_nStrings = 0;
 	
 	for ( int i=0; i < m_StringPools.Count(); i++ )
 		free( m_StringPools[i] );
@@ -28,6 +28,8 @@
 #include "vtf/vtf.h"
 #include "lzma/lzma.h"
 #include "tier1/lzmaDecoder.h"
+#include "tier0/threadtools.h"
+#include "bspreader.h"
 
 //=============================================================================
 
@@ -705,6 +707,33 @@ template< class T > static void AddLump( int lumpnum, CUtlVector<T> &data, int v
 dheader_t		*g_pBSPHeader;
 FileHandle_t	g_hBSPFile;
 
+// The bsp being read, g_pBSPHeader points at the start of its mapped file
+static CBSPReader s_BSPReader;
+
+static void OpenBSPReader( const char *filename )
+{
+	// maps the file, only reads it when it isn't a plain file on disk
+	if ( !s_BSPReader.OpenFile( filename ) && !s_BSPReader.OpenFromFileSystem( g_pFileSystem, filename, NULL ) )
+	{
+		Error( "Error opening %s", filename );
+	}
+	g_pBSPHeader = s_BSPReader.GetHeader();
+}
+
+// LZMA compressed lumps come back decompressed, these are what the Copy functions read
+static byte *GetLumpBase( int lump )
+{
+	int length;
+	return (byte *)s_BSPReader.GetLump( lump, &length );
+}
+
+static int GetLumpSize( int lump )
+{
+	int length;
+	s_BSPReader.GetLump( lump, &length );
+	return length;
+}
+
 struct Lump_t
 {
 	void	*pLumps[HEADER_LUMPS];
@@ -787,21 +816,47 @@ void ForceAlignment( IZip *pak, bool bAlign, bool bCompatibleFormat, unsigned in
 	pak->ForceAlignment( bAlign, bCompatibleFormat, alignmentSize );
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Lets the pak file write itself straight into the .bsp file
+//-----------------------------------------------------------------------------
+class CBSPFileZipStream : public IZipWriteStream
+{
+public:
+	CBSPFileZipStream( FileHandle_t hFile ) : m_hFile( hFile ) {}
+
+	virtual void Put( const void* pMem, int size ) { SafeWrite( m_hFile, (void *)pMem, size ); }
+	virtual unsigned int Tell( void ) { return g_pFileSystem->Tell( m_hFile ); }
+
+private:
+	FileHandle_t	m_hFile;
+};
+
 //-----------------------------------------------------------------------------
 // Purpose: Store data back out to .bsp file
 //-----------------------------------------------------------------------------
 static void WritePakFileLump( void )
 {
-	CUtlBuffer buf( 0, 0 );
 	GetPakFile()->ActivateByteSwapping( IsX360() );
-	GetPakFile()->SaveToBuffer( buf );
 
 	// must respect pak file alignment
 	// pad up and ensure lump starts on same aligned boundary
 	AlignFilePosition( g_hBSPFile, GetPakFile()->GetAlignment() );
-	
-	// Now store final buffers out to file
-	AddLump( LUMP_PAKFILE, (byte*)buf.Base(), buf.TellPut() );
+
+	// stream the zip into the file rather than building a copy of it in memory
+	g_Lumps.size[LUMP_PAKFILE] = 0;	// mark it written
+
+	lump_t *lump = &g_pBSPHeader->lumps[LUMP_PAKFILE];
+	lump->fileofs = g_pFileSystem->Tell( g_hBSPFile );
+	lump->version = 0;
+	lump->uncompressedSize = 0;
+
+	CBSPFileZipStream stream( g_hBSPFile );
+	GetPakFile()->SaveToStream( stream );
+
+	lump->filelen = g_pFileSystem->Tell( g_hBSPFile ) - lump->fileofs;
+
+	// pad out to the next dword
+	AlignFilePosition( g_hBSPFile, 4 );
 }
 
 //-----------------------------------------------------------------------------
@@ -1403,14 +1458,9 @@ static void LoadOcclusionLump()
 	g_OccluderPolyData.RemoveAll();
 	g_OccluderVertexIndices.RemoveAll();
 
-	int		length, ofs;
-
 	g_Lumps.bLumpParsed[LUMP_OCCLUSION] = true;
 
-	length = g_pBSPHeader->lumps[LUMP_OCCLUSION].filelen;
-	ofs = g_pBSPHeader->lumps[LUMP_OCCLUSION].fileofs;
-	
-	CUtlBuffer buf( (byte *)g_pBSPHeader + ofs, length, CUtlBuffer::READ_ONLY );
+	CUtlBuffer buf( GetLumpBase( LUMP_OCCLUSION ), GetLumpSize( LUMP_OCCLUSION ), CUtlBuffer::READ_ONLY );
 	buf.ActivateByteSwapping( g_bSwapOnLoad );
 	switch ( g_pBSPHeader->lumps[LUMP_OCCLUSION].version )
 	{
@@ -1852,8 +1902,8 @@ int CopyLumpInternal( int fieldType, int lump, T *dest, int forceVersion )
 
 	// Vectors are passed in as floats
 	int fieldSize = ( fieldType == FIELD_VECTOR ) ? sizeof(Vector) : sizeof(T);
-	unsigned int length = g_pBSPHeader->lumps[lump].filelen;
-	unsigned int ofs = g_pBSPHeader->lumps[lump].fileofs;
+	unsigned int length = GetLumpSize( lump );
+	byte *pSrc = GetLumpBase( lump );
 
 	// count must be of the integral type
 	unsigned int count = length / sizeof(T);
@@ -1865,27 +1915,27 @@ int CopyLumpInternal( int fieldType, int lump, T *dest, int forceVersion )
 		switch( lump )
 		{
 		case LUMP_VISIBILITY:
-			SwapVisibilityLump( (byte*)dest, ((byte*)g_pBSPHeader + ofs), count );
+			SwapVisibilityLump( (byte*)dest, pSrc, count );
 			break;
 		
 		case LUMP_PHYSCOLLIDE:
 			// SwapPhyscollideLump may change size
-			SwapPhyscollideLump( (byte*)dest, ((byte*)g_pBSPHeader + ofs), count );
+			SwapPhyscollideLump( (byte*)dest, pSrc, count );
 			length = count;
 			break;
 
 		case LUMP_PHYSDISP:
-			SwapPhysdispLump( (byte*)dest, ((byte*)g_pBSPHeader + ofs), count );
+			SwapPhysdispLump( (byte*)dest, pSrc, count );
 			break;
 
 		default:
-			g_Swap.SwapBufferToTargetEndian( dest, (T*)((byte*)g_pBSPHeader + ofs), count );
+			g_Swap.SwapBufferToTargetEndian( dest, (T*)pSrc, count );
 			break;
 		}
 	}
 	else
 	{
-		memcpy( dest, (byte*)g_pBSPHeader + ofs, length );
+		memcpy( dest, pSrc, length );
 	}
 
 	// Return actual count of elements
@@ -1902,7 +1952,7 @@ template< class T >
 void CopyLump( int fieldType, int lump, CUtlVector<T> &dest, int forceVersion = -1 )
 {
 	Assert( fieldType != FIELD_VECTOR ); // TODO: Support this if necessary
-	dest.SetSize( g_pBSPHeader->lumps[lump].filelen / sizeof(T) );
+	dest.SetSize( GetLumpSize( lump ) / sizeof(T) );
 	CopyLumpInternal( fieldType, lump, dest.Base(), forceVersion );
 }
 
@@ -1913,14 +1963,14 @@ void CopyOptionalLump( int fieldType, int lump, CUtlVector<T> &dest, int forceVe
 	if ( !HasLump( lump ) )
 		return;
 
-	dest.SetSize( g_pBSPHeader->lumps[lump].filelen / sizeof(T) );
+	dest.SetSize( GetLumpSize( lump ) / sizeof(T) );
 	CopyLumpInternal( fieldType, lump, dest.Base(), forceVersion );
 }
 
 template< class T >
 int CopyVariableLump( int fieldType, int lump, void **dest, int forceVersion = -1 )
 {
-	int length = g_pBSPHeader->lumps[lump].filelen;
+	int length = GetLumpSize( lump );
 	*dest = malloc( length );
 
 	return CopyLumpInternal<T>( fieldType, lump, (T*)*dest, forceVersion );
@@ -1934,19 +1984,19 @@ int CopyLumpInternal( int lump, T *dest, int forceVersion )
 {
 	g_Lumps.bLumpParsed[lump] = true;
 
-	unsigned int length = g_pBSPHeader->lumps[lump].filelen;
-	unsigned int ofs = g_pBSPHeader->lumps[lump].fileofs;
+	unsigned int length = GetLumpSize( lump );
+	byte *pSrc = GetLumpBase( lump );
 	unsigned int count = length / sizeof(T);
 	
 	ValidateLump( lump, length, sizeof(T), forceVersion );
 
 	if ( g_bSwapOnLoad )
 	{
-		g_Swap.SwapFieldsToTargetEndian( dest, (T*)((byte*)g_pBSPHeader + ofs), count );
+		g_Swap.SwapFieldsToTargetEndian( dest, (T*)pSrc, count );
 	}
 	else
 	{
-		memcpy( dest, (byte*)g_pBSPHeader + ofs, length );
+		memcpy( dest, pSrc, length );
 	}
 
 	return count;
@@ -1961,7 +2011,7 @@ int CopyLump( int lump, T *dest, int forceVersion = -1 )
 template< class T >
 void CopyLump( int lump, CUtlVector<T> &dest, int forceVersion = -1 )
 {
-	dest.SetSize( g_pBSPHeader->lumps[lump].filelen / sizeof(T) );
+	dest.SetSize( GetLumpSize( lump ) / sizeof(T) );
 	CopyLumpInternal( lump, dest.Base(), forceVersion );
 }
 
@@ -1972,14 +2022,14 @@ void CopyOptionalLump( int lump, CUtlVector<T> &dest, int forceVersion = -1 )
 	if ( !HasLump( lump ) )
 		return;
 
-	dest.SetSize( g_pBSPHeader->lumps[lump].filelen / sizeof(T) );
+	dest.SetSize( GetLumpSize( lump ) / sizeof(T) );
 	CopyLumpInternal( lump, dest.Base(), forceVersion );
 }
 
 template< class T >
 int CopyVariableLump( int lump, void **dest, int forceVersion = -1 )
 {
-	int length = g_pBSPHeader->lumps[lump].filelen;
+	int length = GetLumpSize( lump );
 	*dest = malloc( length );
 
 	return CopyLumpInternal<T>( lump, (T*)*dest, forceVersion );
@@ -2024,7 +2074,7 @@ void Lumps_Write( void )
 int LoadLeafs( void )
 {
 #if defined( BSP_USE_LESS_MEMORY )
-	dleafs = (dleaf_t*)malloc( g_pBSPHeader->lumps[LUMP_LEAFS].filelen );
+	dleafs = (dleaf_t*)malloc( GetLumpSize( LUMP_LEAFS ) );
 #endif
 
 	switch ( LumpVersion( LUMP_LEAFS ) )
@@ -2032,7 +2082,7 @@ int LoadLeafs( void )
 	case 0:
 		{
 			g_Lumps.bLumpParsed[LUMP_LEAFS] = true;
-			int length = g_pBSPHeader->lumps[LUMP_LEAFS].filelen;
+			int length = GetLumpSize( LUMP_LEAFS );
 			int size = sizeof( dleaf_version_0_t );
 			if ( length % size )
 			{
@@ -2040,7 +2090,7 @@ int LoadLeafs( void )
 			}
 			int count = length / size;
 
-			void *pSrcBase = ( ( byte * )g_pBSPHeader + g_pBSPHeader->lumps[LUMP_LEAFS].fileofs );
+			void *pSrcBase = GetLumpBase( LUMP_LEAFS );
 			dleaf_version_0_t *pSrc = (dleaf_version_0_t *)pSrcBase;
 			dleaf_t *pDst = dleafs;
 
@@ -2101,7 +2151,7 @@ void LoadLeafAmbientLighting( int numLeafs )
 			Assert( LumpVersion( LUMP_LEAF_AMBIENT_LIGHTING_HDR ) != LUMP_LEAF_AMBIENT_LIGHTING_VERSION );
 		}
 
-		void *pSrcBase = ( ( byte * )g_pBSPHeader + g_pBSPHeader->lumps[LUMP_LEAF_AMBIENT_LIGHTING].fileofs );
+		void *pSrcBase = GetLumpBase( LUMP_LEAF_AMBIENT_LIGHTING );
 		CompressedLightCube *pSrc = NULL;
 		if ( HasLump( LUMP_LEAF_AMBIENT_LIGHTING ) )
 		{
@@ -2110,7 +2160,7 @@ void LoadLeafAmbientLighting( int numLeafs )
 		g_LeafAmbientIndexLDR.SetCount( numLeafs );
 		g_LeafAmbientLightingLDR.SetCount( numLeafs );
 
-		void *pSrcBaseHDR = ( ( byte * )g_pBSPHeader + g_pBSPHeader->lumps[LUMP_LEAF_AMBIENT_LIGHTING_HDR].fileofs );
+		void *pSrcBaseHDR = GetLumpBase( LUMP_LEAF_AMBIENT_LIGHTING_HDR );
 		CompressedLightCube *pSrcHDR = NULL;
 		if ( HasLump( LUMP_LEAF_AMBIENT_LIGHTING_HDR ) )
 		{
@@ -2181,8 +2231,8 @@ void OpenBSPFile( const char *filename )
 {
 	Lumps_Init();
 
-	// load the file header
-	LoadFile( filename, (void **)&g_pBSPHeader );
+	// map the file, lumps are only read in as they're copied out
+	OpenBSPReader( filename );
 
 	if ( g_bSwapOnLoad )
 	{
@@ -2200,7 +2250,7 @@ void OpenBSPFile( const char *filename )
 //-----------------------------------------------------------------------------
 void CloseBSPFile( void )
 {
-	free( g_pBSPHeader );
+	s_BSPReader.Close();
 	g_pBSPHeader = NULL;
 }
 
@@ -2297,21 +2347,20 @@ void LoadBSPFile( const char *filename )
 	}
 	*/
 		
-	// Load PAK file lump into appropriate data structure
-	byte *pakbuffer = NULL;
-	int paksize = CopyVariableLump<byte>( FIELD_CHARACTER, LUMP_PAKFILE, ( void ** )&pakbuffer );
+	// Load PAK file lump into appropriate data structure, the zip copies
+	// what it needs so parse it straight out of the file
+	g_Lumps.bLumpParsed[LUMP_PAKFILE] = true;
+	int paksize = GetLumpSize( LUMP_PAKFILE );
 	if ( paksize > 0 )
 	{
 		GetPakFile()->ActivateByteSwapping( IsX360() );
-		GetPakFile()->ParseFromBuffer( pakbuffer, paksize );
+		GetPakFile()->ParseFromBuffer( GetLumpBase( LUMP_PAKFILE ), paksize );
 	}
 	else
 	{
 		GetPakFile()->Reset();
 	}
 
-	free( pakbuffer );
-
 	g_GameLumps.ParseGameLump( g_pBSPHeader );
 
 	// NOTE: Do NOT call CopyLump after Lumps_Parse() it parses all un-Copied lumps
@@ -2440,9 +2489,9 @@ void LoadBSPFile_FileSystemOnly( const char *filename )
 	Lumps_Init();
 
 	//
-	// load the file header
+	// map the file, only the pak lump gets read
 	//
-	LoadFile( filename, (void **)&g_pBSPHeader );
+	OpenBSPReader( filename );
 
 	ValidateHeader( filename, g_pBSPHeader );
 
@@ -2461,8 +2510,7 @@ void LoadBSPFile_FileSystemOnly( const char *filename )
 	free( pakbuffer );
 
 	// everything has been copied out
-	free( g_pBSPHeader );
-	g_pBSPHeader = NULL;
+	CloseBSPFile();
 }
 
 void ExtractZipFileFromBSP( char *pBSPFileName, char *pZipFileName )
@@ -2470,9 +2518,9 @@ void ExtractZipFileFromBSP( char *pBSPFileName, char *pZipFileName )
 	Lumps_Init();
 
 	//
-	// load the file header
+	// map the file, only the pak lump gets read
 	//
-	LoadFile( pBSPFileName, (void **)&g_pBSPHeader);
+	OpenBSPReader( pBSPFileName );
 
 	ValidateHeader( pBSPFileName, g_pBSPHeader );
 
@@ -2482,19 +2530,23 @@ void ExtractZipFileFromBSP( char *pBSPFileName, char *pZipFileName )
 	{
 		FILE *fp;
 		fp = fopen( pZipFileName, "wb" );
-		if( !fp )
+		if( fp )
+		{
+			fwrite( pakbuffer, paksize, 1, fp );
+			fclose( fp );
+		}
+		else
 		{
 			fprintf( stderr, "can't open %s\n", pZipFileName );
-			return;
 		}
-
-		fwrite( pakbuffer, paksize, 1, fp );
-		fclose( fp );
 	}
 	else
 	{		
 		fprintf( stderr, "zip file is zero length!\n" );
 	}
+
+	free( pakbuffer );
+	CloseBSPFile();
 }
 
 /*
@@ -4080,12 +4132,13 @@ int SwapLumpToDisk( int fieldType, int lumpnum )
 	DevMsg( "Swapping %s\n", GetLumpName( lumpnum ) );
 
 	// lump swap may expand, allocate enough expansion room
-	void *pBuffer = malloc( 2*g_pBSPHeader->lumps[lumpnum].filelen );
+	void *pBuffer = malloc( 2*GetLumpSize( lumpnum ) );
 
-	// CopyLumpInternal will handle the swap on load case
+	// CopyLumpInternal will handle the swap on load case, and decompression
 	unsigned int fieldSize = ( fieldType == FIELD_VECTOR ) ? sizeof(Vector) : sizeof(T);
 	unsigned int count = CopyLumpInternal<T>( fieldType, lumpnum, (T*)pBuffer, g_pBSPHeader->lumps[lumpnum].version );
 	g_pBSPHeader->lumps[lumpnum].filelen = count * fieldSize;
+	g_pBSPHeader->lumps[lumpnum].uncompressedSize = 0;
 
 	if ( g_bSwapOnWrite )
 	{
@@ -4129,11 +4182,12 @@ int SwapLumpToDisk( int lumpnum )
 	DevMsg( "Swapping %s\n", GetLumpName( lumpnum ) );
 
 	// lump swap may expand, allocate enough room
-	void *pBuffer = malloc( 2*g_pBSPHeader->lumps[lumpnum].filelen );
+	void *pBuffer = malloc( 2*GetLumpSize( lumpnum ) );
 
-	// CopyLumpInternal will handle the swap on load case
+	// CopyLumpInternal will handle the swap on load case, and decompression
 	int count = CopyLumpInternal<T>( lumpnum, (T*)pBuffer, g_pBSPHeader->lumps[lumpnum].version );
 	g_pBSPHeader->lumps[lumpnum].filelen = count * sizeof(T);
+	g_pBSPHeader->lumps[lumpnum].uncompressedSize = 0;
 
 	if ( g_bSwapOnWrite )
 	{
@@ -4440,6 +4494,207 @@ int SortLumpsByOffset( const SortedLump_t *pSortedLumpA, const SortedLump_t *pSo
 	return 0;
 }
 
+//-----------------------------------------------------------------------------
+// Compresses a list of lumps on a few threads while the caller writes out the
+// finished ones in order.  Workers only run a few lumps ahead of the writer,
+// so only that many compressed copies exist at once.  Every lump is still a
+// single LZMA stream since that's what the loaders expect, so the parallelism
+// is across lumps.  pCompressFunc has to be safe to call from several threads.
+//-----------------------------------------------------------------------------
+#define MAX_LUMP_COMPRESS_THREADS	4
+
+class CLumpCompressor
+{
+public:
+	CLumpCompressor( CompressFunc_t pCompressFunc );
+	~CLumpCompressor();
+
+	// Queues a lump, call before Start().  If bLZMA is set the data is LZMA
+	// compressed and gets decompressed first, nUncompressedSize (if not 0)
+	// has to match the size in its header.
+	int			AddJob( void *pData, int nSize, bool bLZMA, unsigned int nUncompressedSize = 0 );
+	void		Start();
+
+	// Waits for a lump and returns what to write for it, which is the
+	// decompressed input if it didn't compress.  Finish and Release the
+	// jobs in order.
+	CUtlBuffer	&Finish( int iJob, bool *pbCompressed, unsigned int *pnInputSize = NULL );
+	void		Release( int iJob );
+
+private:
+	struct Job_t
+	{
+		Job_t() : m_Done( true ) {}
+
+		void			*m_pData;
+		int				m_nSize;
+		bool			m_bLZMA;
+		unsigned int	m_nUncompressedSize;
+
+		CUtlBuffer		m_Input;
+		CUtlBuffer		m_Output;
+		unsigned int	m_nInputSize;
+		bool			m_bCompressed;
+		bool			m_bFinished;
+		CThreadEvent	m_Done;
+	};
+
+	static unsigned WorkerThread( void *pParam );
+	void		Compress( Job_t *pJob );
+
+	CompressFunc_t				m_pCompressFunc;
+	CUtlVector< Job_t * >		m_Jobs;
+	CUtlVector< ThreadHandle_t >	m_Threads;
+	CInterlockedInt				m_nNextJob;
+	CInterlockedInt				m_nReleased;
+	int							m_nWindow;
+	CThreadEvent				m_JobReleased;
+};
+
+CLumpCompressor::CLumpCompressor( CompressFunc_t pCompressFunc )
+{
+	m_pCompressFunc = pCompressFunc;
+	m_nNextJob = 0;
+	m_nReleased = 0;
+	m_nWindow = 0;
+}
+
+CLumpCompressor::~CLumpCompressor()
+{
+	// let any worker that's waiting on the writer run out
+	m_nReleased = m_Jobs.Count();
+	m_JobReleased.Set();
+
+	for ( int i = 0; i < m_Threads.Count(); i++ )
+	{
+		ThreadJoin( m_Threads[i] );
+		ReleaseThreadHandle( m_Threads[i] );
+	}
+	m_Jobs.PurgeAndDeleteElements();
+}
+
+int CLumpCompressor::AddJob( void *pData, int nSize, bool bLZMA, unsigned int nUncompressedSize )
+{
+	Job_t *pJob = new Job_t;
+	pJob->m_pData = pData;
+	pJob->m_nSize = nSize;
+	pJob->m_bLZMA = bLZMA;
+	pJob->m_nUncompressedSize = nUncompressedSize;
+	pJob->m_nInputSize = 0;
+	pJob->m_bCompressed = false;
+	pJob->m_bFinished = false;
+	return m_Jobs.AddToTail( pJob );
+}
+
+void CLumpCompressor::Start()
+{
+	int nThreads = MIN( GetCPUInformation()->m_nLogicalProcessors, MAX_LUMP_COMPRESS_THREADS );
+	nThreads = MIN( nThreads, m_Jobs.Count() );
+	if ( !m_pCompressFunc || nThreads <= 1 )
+	{
+		// Finish does them as they're asked for
+		return;
+	}
+
+	m_nWindow = nThreads * 2;
+	for ( int i = 0; i < nThreads; i++ )
+	{
+		m_Threads.AddToTail( CreateSimpleThread( WorkerThread, this ) );
+	}
+}
+
+unsigned CLumpCompressor::WorkerThread( void *pParam )
+{
+	CLumpCompressor *pCompressor = (CLumpCompressor *)pParam;
+
+	while ( 1 )
+	{
+		int iJob = pCompressor->m_nNextJob++;
+		if ( iJob >= pCompressor->m_Jobs.Count() )
+			break;
+
+		// don't get too far ahead of the writer
+		while ( iJob >= pCompressor->m_nReleased + pCompressor->m_nWindow )
+		{
+			pCompressor->m_JobReleased.Wait( 10 );
+		}
+
+		Job_t *pJob = pCompressor->m_Jobs[iJob];
+		pCompressor->Compress( pJob );
+		pJob->m_Done.Set();
+	}
+
+	return 0;
+}
+
+void CLumpCompressor::Compress( Job_t *pJob )
+{
+	if ( pJob->m_bLZMA )
+	{
+		unsigned char *pCompressedLump = (unsigned char *)pJob->m_pData;
+		if ( CLZMA::IsCompressed( pCompressedLump ) && ( !pJob->m_nUncompressedSize || pJob->m_nUncompressedSize == CLZMA::GetActualSize( pCompressedLump ) ) )
+		{
+			unsigned int nActualSize = CLZMA::GetActualSize( pCompressedLump );
+			pJob->m_Input.EnsureCapacity( nActualSize );
+			unsigned int outSize = CLZMA::Uncompress( pCompressedLump, (unsigned char *)pJob->m_Input.Base() );
+			pJob->m_Input.SeekPut( CUtlBuffer::SEEK_CURRENT, outSize );
+			if ( outSize != nActualSize )
+			{
+				Warning( "Decompressed size differs from header, BSP may be corrupt\n" );
+			}
+		}
+		else
+		{
+			Warning( "Unsupported BSP: Unrecognized compressed lump\n" );
+		}
+	}
+	else
+	{
+		pJob->m_Input.SetExternalBuffer( pJob->m_pData, pJob->m_nSize, pJob->m_nSize );
+	}
+
+	pJob->m_nInputSize = pJob->m_Input.TellPut();
+	pJob->m_bCompressed = m_pCompressFunc ? m_pCompressFunc( pJob->m_Input, pJob->m_Output ) : false;
+	if ( pJob->m_bCompressed )
+	{
+		pJob->m_Input.Purge();
+	}
+}
+
+CUtlBuffer &CLumpCompressor::Finish( int iJob, bool *pbCompressed, unsigned int *pnInputSize )
+{
+	Job_t *pJob = m_Jobs[iJob];
+	if ( !pJob->m_bFinished )
+	{
+		if ( m_Threads.Count() )
+		{
+			pJob->m_Done.Wait();
+		}
+		else
+		{
+			Compress( pJob );
+		}
+		pJob->m_bFinished = true;
+	}
+
+	*pbCompressed = pJob->m_bCompressed;
+	if ( pnInputSize )
+	{
+		*pnInputSize = pJob->m_nInputSize;
+	}
+	return pJob->m_bCompressed ? pJob->m_Output : pJob->m_Input;
+}
+
+void CLumpCompressor::Release( int iJob )
+{
+	Job_t *pJob = m_Jobs[iJob];
+	pJob->m_Input.Purge();
+	pJob->m_Output.Purge();
+
+	m_nReleased++;
+	m_JobReleased.Set();
+}
+
 bool CompressGameLump( dheader_t *pInBSPHeader, dheader_t *pOutBSPHeader, CUtlBuffer &outputBuffer, CompressFunc_t pCompressFunc )
 {
 	CByteswap	byteSwap;
@@ -4472,55 +4727,38 @@ bool CompressGameLump( dheader_t *pInBSPHeader, dheader_t *pOutBSPHeader, CUtlBu
 	dgamelump_t dummyLump = { 0 };
 	outputBuffer.Put( &dummyLump, sizeof( dgamelump_t ) );
 
+	// compress the game lumps on the side, they're written in order below
+	CLumpCompressor compressor( pCompressFunc );
 	for ( int i = 0; i < pInGameLumpHeader->lumpCount; i++ )
 	{
-		CUtlBuffer inputBuffer;
-		CUtlBuffer compressedBuffer;
+		if ( pInGameLump[i].filelen )
+		{
+			compressor.AddJob( ((byte *)pInBSPHeader) + pInGameLump[i].fileofs, pInGameLump[i].filelen,
+			                   ( pInGameLump[i].flags & GAMELUMPFLAG_COMPRESSED ) != 0 );
+		}
+	}
+	compressor.Start();
 
+	int iJob = 0;
+	for ( int i = 0; i < pInGameLumpHeader->lumpCount; i++ )
+	{
 		sOutGameLump[i].fileofs = AlignBuffer( outputBuffer, 4 );
 
 		if ( pInGameLump[i].filelen )
 		{
-			if ( pInGameLump[i].flags & GAMELUMPFLAG_COMPRESSED )
-			{
-				byte *pCompressedLump = ((byte *)pInBSPHeader) + pInGameLump[i].fileofs;
-				if ( CLZMA::IsCompressed( pCompressedLump ) )
-				{
-					inputBuffer.EnsureCapacity( CLZMA::GetActualSize( pCompressedLump ) );
-					unsigned int outSize = CLZMA::Uncompress( pCompressedLump, (unsigned char *)inputBuffer.Base() );
-					inputBuffer.SeekPut( CUtlBuffer::SEEK_CURRENT, outSize );
-					if ( outSize != CLZMA::GetActualSize( pCompressedLump ) )
-					{
-						Warning( "Decompressed size differs from header, BSP may be corrupt\n" );
-					}
-				}
-				else
-				{
-					Assert( CLZMA::IsCompressed( pCompressedLump ) );
-					Warning( "Unsupported BSP: Unrecognized compressed game lump\n" );
-				}
-
-			}
-			else
-			{
-				inputBuffer.SetExternalBuffer( ((byte *)pInBSPHeader) + pInGameLump[i].fileofs,
-				                               pInGameLump[i].filelen, pInGameLump[i].filelen );
-			}
-
-			bool bCompressed = pCompressFunc ? pCompressFunc( inputBuffer, compressedBuffer ) : false;
+			bool bCompressed;
+			CUtlBuffer &lumpBuffer = compressor.Finish( iJob, &bCompressed );
 			if ( bCompressed )
 			{
 				sOutGameLump[i].flags |= GAMELUMPFLAG_COMPRESSED;
-
-				outputBuffer.Put( compressedBuffer.Base(), compressedBuffer.TellPut() );
-				compressedBuffer.Purge();
 			}
 			else
 			{
 				// as is, clear compression flag from input lump
 				sOutGameLump[i].flags &= ~GAMELUMPFLAG_COMPRESSED;
-				outputBuffer.Put( inputBuffer.Base(), inputBuffer.TellPut() );
 			}
+			outputBuffer.Put( lumpBuffer.Base(), lumpBuffer.TellPut() );
+			compressor.Release( iJob++ );
 		}
 	}
 
@@ -4613,6 +4851,21 @@ bool RepackBSP( CUtlBuffer &inputBuffer, CUtlBuffer &outputBuffer, CompressFunc_
 	}
 	sortedLumps.Sort( SortLumpsByOffset );
 
+	// everything but the game lump and the pakfile is compressed on the side
+	// and written out below in sorted order
+	CLumpCompressor compressor( pCompressFunc );
+	for ( int i = 0; i < HEADER_LUMPS; ++i )
+	{
+		SortedLump_t *pSortedLump = &sortedLumps[i];
+		if ( pSortedLump->pLump->filelen && pSortedLump->lumpNum != LUMP_GAME_LUMP && pSortedLump->lumpNum != LUMP_PAKFILE )
+		{
+			compressor.AddJob( ((byte *)pInBSPHeader) + pSortedLump->pLump->fileofs, pSortedLump->pLump->filelen,
+			                   pSortedLump->pLump->uncompressedSize != 0, pSortedLump->pLump->uncompressedSize );
+		}
+	}
+	compressor.Start();
+	int iJob = 0;
+
 	// iterate in sorted order
 	for ( int i = 0; i < HEADER_LUMPS; ++i )
 	{
@@ -4634,6 +4887,22 @@ bool RepackBSP( CUtlBuffer &inputBuffer, CUtlBuffer &outputBuffer, CompressFunc_
 			}
 			unsigned int newOffset = AlignBuffer( outputBuffer, alignment );
 
+			if ( lumpNum != LUMP_GAME_LUMP && lumpNum != LUMP_PAKFILE )
+			{
+				bool bCompressed;
+				unsigned int nInputSize;
+				CUtlBuffer &lumpBuffer = compressor.Finish( iJob, &bCompressed, &nInputSize );
+				if ( bCompressed )
+				{
+					sOutBSPHeader.lumps[lumpNum].uncompressedSize = nInputSize;
+				}
+				sOutBSPHeader.lumps[lumpNum].fileofs = newOffset;
+				sOutBSPHeader.lumps[lumpNum].filelen = lumpBuffer.TellPut();
+				outputBuffer.Put( lumpBuffer.Base(), lumpBuffer.TellPut() );
+				compressor.Release( iJob++ );
+				continue;
+			}
+
 			CUtlBuffer inputBuffer;
 			if ( pSortedLump->pLump->uncompressedSize )
 			{
@@ -4707,26 +4976,6 @@ bool RepackBSP( CUtlBuffer &inputBuffer, CUtlBuffer &outputBuffer, CompressFunc_
 				IZip::ReleaseZip( oldPakFile );
 				IZip::ReleaseZip( newPakFile );
 			}
-			else
-			{
-				CUtlBuffer compressedBuffer;
-				bool bCompressed = pCompressFunc ? pCompressFunc( inputBuffer, compressedBuffer ) : false;
-				if ( bCompressed )
-				{
-					sOutBSPHeader.lumps[lumpNum].uncompressedSize = inputBuffer.TellPut();
-					sOutBSPHeader.lumps[lumpNum].filelen = compressedBuffer.TellPut();
-					sOutBSPHeader.lumps[lumpNum].fileofs = newOffset;
-					outputBuffer.Put( compressedBuffer.Base(), compressedBuffer.TellPut() );
-					compressedBuffer.Purge();
-				}
-				else
-				{
-					// add as is
-					sOutBSPHeader.lumps[lumpNum].fileofs = newOffset;
-					sOutBSPHeader.lumps[lumpNum].filelen = inputBuffer.TellPut();
-					outputBuffer.Put( inputBuffer.Base(), inputBuffer.TellPut() );
-				}
-			}
 		}
 	}
 
@@ -4983,11 +5232,10 @@ bool GetPakFileLump( const char *pBSPFilename, void **pPakData, int *pPakSize )
 		return false;
 	}
 
-	// determine endian nature
-	dheader_t *pHeader;
-	LoadFile( pBSPFilename, (void **)&pHeader );
-	bool bSwap = ( pHeader->ident == BigLong( IDBSPHEADER ) );
-	free( pHeader );
+	// determine endian nature, only the header gets read
+	OpenBSPReader( pBSPFilename );
+	bool bSwap = ( g_pBSPHeader->ident == BigLong( IDBSPHEADER ) );
+	CloseBSPFile();
 
 	g_bSwapOnLoad = bSwap;
 	g_bSwapOnWrite = !bSwap;
@@ -5070,11 +5318,10 @@ bool SetPakFileLump( const char *pBSPFilename, const char *pNewFilename, void *p
 		return false;
 	}
 
-	// determine endian nature
-	dheader_t *pHeader;
-	LoadFile( pBSPFilename, (void **)&pHeader );
-	bool bSwap = ( pHeader->ident == BigLong( IDBSPHEADER ) );
-	free( pHeader );
+	// determine endian nature, only the header gets read
+	OpenBSPReader( pBSPFilename );
+	bool bSwap = ( g_pBSPHeader->ident == BigLong( IDBSPHEADER ) );
+	CloseBSPFile();
 
 	g_bSwapOnLoad = bSwap;
 	g_bSwapOnWrite = bSwap;
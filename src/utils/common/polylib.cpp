@@ -12,7 +12,9 @@
 #include "polylib.h"
 #include "worldsize.h"
 #include "threads.h"
+#include "toolpool.h"
 #include "tier0/dbg.h"
+#include "tier0/threadtools.h"
 
 // doesn't seem to need to be here? -- in threads.h
 //extern int numthreads;
@@ -31,7 +33,44 @@ void pw(winding_t *w)
 		printf ("(%5.1f, %5.1f, %5.1f)\n",w->p[i][0], w->p[i][1],w->p[i][2]);
 }
 
-winding_t *winding_pool[MAX_POINTS_ON_WINDING+4];
+// windings are pooled by maxpoints, bigger ones go straight to the heap
+#define	WINDING_POOL_CLASSES	(MAX_POINTS_ON_WINDING+4)
+
+typedef CToolPool< winding_t, WINDING_POOL_CLASSES > CWindingPool;
+static CWindingPool s_WindingPool;
+static CTHREADLOCALPTR( CWindingPool::ThreadCache_t ) s_pWindingCache;
+
+static CWindingPool::ThreadCache_t *GetWindingCache()
+{
+	CWindingPool::ThreadCache_t *pCache = s_pWindingCache;
+	if ( !pCache )
+	{
+		pCache = (CWindingPool::ThreadCache_t *)calloc( 1, sizeof( *pCache ) );
+		s_pWindingCache = pCache;
+	}
+	return pCache;
+}
+
+static void FlushWindingCache()
+{
+	CWindingPool::ThreadCache_t *pCache = s_pWindingCache;
+	if ( pCache )
+	{
+		s_WindingPool.Flush( pCache );
+	}
+}
+
+static class CWindingPoolInit
+{
+public:
+	CWindingPoolInit() { RunThreads_AddExitFn( FlushWindingCache ); }
+} s_WindingPoolInit;
+
+void PrintWindingPoolStats()
+{
+	FlushWindingCache();
+	s_WindingPool.PrintStats( "Winding" );
+}
 
 /*
 =============
@@ -40,7 +79,7 @@ AllocWinding
 */
 winding_t *AllocWinding (int points)
 {
-	winding_t	*w;
+	winding_t	*w = NULL;
 
 	if (numthreads == 1)
 	{
@@ -50,18 +89,17 @@ winding_t *AllocWinding (int points)
 		if (c_active_windings > c_peak_windings)
 			c_peak_windings = c_active_windings;
 	}
-	ThreadLock();
-	if (winding_pool[points])
+	if (points < WINDING_POOL_CLASSES)
 	{
-		w = winding_pool[points];
-		winding_pool[points] = w->next;
+		w = s_WindingPool.Alloc (GetWindingCache(), points);
 	}
-	else
+	if (!w)
 	{
 		w = (winding_t *)malloc(sizeof(*w));
 		w->p = (Vector *)calloc( points, sizeof(Vector) );
+		if (points < WINDING_POOL_CLASSES)
+			s_WindingPool.AddBlock (sizeof(*w) + points * sizeof(Vector));
 	}
-	ThreadUnlock();
 	w->numpoints = 0; // None are occupied yet even though allocated.
 	w->maxpoints = points;
 	w->next = NULL;
@@ -73,11 +111,14 @@ void FreeWinding (winding_t *w)
 	if (w->numpoints == 0xdeaddead)
 		Error ("FreeWinding: freed a freed winding");
 	
-	ThreadLock();
 	w->numpoints = 0xdeaddead; // flag as freed
-	w->next = winding_pool[w->maxpoints];
-	winding_pool[w->maxpoints] = w;
-	ThreadUnlock();
+	if (w->maxpoints >= WINDING_POOL_CLASSES)
+	{
+		free (w->p);
+		free (w);
+		return;
+	}
+	s_WindingPool.Free (GetWindingCache(), w, w->maxpoints);
 }
 
 /*
@@ -39,6 +39,7 @@ struct winding_t
 
 
 winding_t	*AllocWinding (int points);
+void	PrintWindingPoolStats();
 vec_t	WindingArea (winding_t *w);
 void	WindingCenter (winding_t *w, Vector &center);
 vec_t	WindingAreaAndBalancePoint( winding_t *w, Vector &center );
@@ -165,11 +165,31 @@ void ThreadUnlock (void)
 }
 
 
+#define MAX_THREAD_EXIT_FNS	8
+
+static ThreadExitFn g_ThreadExitFns[MAX_THREAD_EXIT_FNS];
+static int g_nThreadExitFns;
+
+void RunThreads_AddExitFn( ThreadExitFn fn )
+{
+	if ( g_nThreadExitFns == MAX_THREAD_EXIT_FNS )
+		Error( "RunThreads_AddExitFn: too many exit functions\n" );
+	g_ThreadExitFns[g_nThreadExitFns++] = fn;
+}
+
+static void CallThreadExitFns()
+{
+	for ( int i=0; i < g_nThreadExitFns; i++ )
+		g_ThreadExitFns[i]();
+}
+
+
 // This runs in the thread and dispatches a RunThreadsFn call.
 DWORD WINAPI InternalRunThreadsFn( LPVOID pParameter )
 {
 	CRunThreadsData *pData = (CRunThreadsData*)pParameter;
 	pData->m_Fn( pData->m_iThread, pData->m_pUserData );
+	CallThreadExitFns();
 	return 0;
 }
 
@@ -255,3 +275,84 @@ void RunThreadsOn( int workcnt, qboolean showpacifier, RunThreadsFn fn, void *pU
 }
 
 
+/*
+=============
+RunThreadsOnPool
+=============
+*/
+struct PoolThreadData_t
+{
+	int m_iThread;
+	int m_nWorkCount;
+	long volatile *m_pNextWork;
+	PoolWorkerFn m_Fn;
+	void *m_pUserData;
+};
+
+static void PoolWorkerLoop( PoolThreadData_t *pData )
+{
+	while ( 1 )
+	{
+		int work = InterlockedIncrement( pData->m_pNextWork ) - 1;
+		if ( work >= pData->m_nWorkCount )
+			break;
+
+		pData->m_Fn( pData->m_iThread, work, pData->m_pUserData );
+	}
+}
+
+static DWORD WINAPI InternalPoolThreadFn( LPVOID pParameter )
+{
+	PoolWorkerLoop( (PoolThreadData_t*)pParameter );
+	CallThreadExitFns();
+	return 0;
+}
+
+void RunThreadsOnPool( int workcnt, int nThreads, PoolWorkerFn fn, void *pUserData )
+{
+	if ( nThreads > MAX_TOOL_THREADS )
+		nThreads = MAX_TOOL_THREADS;
+	if ( nThreads > workcnt )
+		nThreads = workcnt;
+
+	long volatile nNextWork = 0;
+	PoolThreadData_t data[MAX_TOOL_THREADS];
+	for ( int i=0; i < nThreads; i++ )
+	{
+		data[i].m_iThread = i;
+		data[i].m_nWorkCount = workcnt;
+		data[i].m_pNextWork = &nNextWork;
+		data[i].m_Fn = fn;
+		data[i].m_pUserData = pUserData;
+	}
+
+	if ( nThreads <= 1 )
+	{
+		if ( workcnt > 0 )
+			PoolWorkerLoop( &data[0] );
+		return;
+	}
+
+	qboolean bWasThreaded = threaded;
+	int nOldNumThreads = numthreads;
+	threaded = true;
+	numthreads = nThreads;
+
+	HANDLE hThreads[MAX_TOOL_THREADS];
+	for ( int i=1; i < nThreads; i++ )
+	{
+		DWORD dwDummy;
+		hThreads[i] = CreateThread( NULL, 0, InternalPoolThreadFn, &data[i], 0, &dwDummy );
+		if ( g_bLowPriorityThreads )
+			SetThreadPriority( hThreads[i], THREAD_PRIORITY_LOWEST );
+	}
+
+	PoolWorkerLoop( &data[0] );
+
+	WaitForMultipleObjects( nThreads - 1, &hThreads[1], TRUE, INFINITE );
+	for ( int i=1; i < nThreads; i++ )
+		CloseHandle( hThreads[i] );
+
+	numthreads = nOldNumThreads;
+	threaded = bWasThreaded;
+}
@@ -29,6 +29,8 @@ extern bool	g_bLowPriorityThreads;
 
 typedef void (*ThreadWorkerFn)( int iThread, int iWorkItem );
 typedef void (*RunThreadsFn)( int iThread, void *pUserData );
+typedef void (*PoolWorkerFn)( int iThread, int iWorkItem, void *pUserData );
+typedef void (*ThreadExitFn)( void );
 
 
 enum ERunThreadsPriority
@@ -53,6 +55,15 @@ void RunThreadsOn ( int workcnt, qboolean showpacifier, RunThreadsFn fn, void *p
 void RunThreads_Start( RunThreadsFn fn, void *pUserData, ERunThreadsPriority ePriority=k_eRunThreadsPriority_UseGlobalState );
 void RunThreads_End();
 
+// Runs fn on each work item with its own threads and work counter, so unlike
+// RunThreadsOnIndividual it can be called from inside a RunThreadsOn worker.
+// The calling thread takes work too (as iThread 0). numthreads is set to
+// nThreads while it runs so single-thread-only bookkeeping stays off.
+void RunThreadsOnPool( int workcnt, int nThreads, PoolWorkerFn fn, void *pUserData );
+
+// Every thread RunThreads_Start or RunThreadsOnPool makes calls these right before it exits.
+void RunThreads_AddExitFn( ThreadExitFn fn );
+
 void ThreadLock (void);
 void ThreadUnlock (void);
 
@@ -0,0 +1,130 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Size classed free lists for the map tools' hot allocations
+//			(windings by point count, brushes by side count).
+//
+// Each thread keeps its own free lists so allocating and freeing don't go
+// through ThreadLock. A thread only touches the shared lists when its own
+// run dry or get long, and hands everything back when it exits (the pool
+// owner registers a flush with RunThreads_AddExitFn). Blocks are never
+// returned to the heap, so the number of blocks made is the peak footprint.
+//
+// T needs a 'T *next' member, it's used to link the free lists.
+//
+//=============================================================================//
+
+#ifndef TOOLPOOL_H
+#define TOOLPOOL_H
+#pragma once
+
+#include "threads.h"
+
+
+// a thread's free list for one size class is trimmed back to this many
+#define TOOLPOOL_THREAD_CACHE_SIZE		32
+
+
+template< class T, int NUM_CLASSES >
+class CToolPool
+{
+public:
+	struct ThreadCache_t
+	{
+		T		*m_pFree[NUM_CLASSES];
+		int		m_nFree[NUM_CLASSES];
+		int		m_nAllocs;
+	};
+
+	CToolPool()
+	{
+		memset( m_pFree, 0, sizeof( m_pFree ) );
+		m_nAllocs = 0;
+		m_nBlocks = 0;
+		m_nBytes = 0;
+	}
+
+	// Returns a free block from the class, or NULL if the caller has to make one
+	T *Alloc( ThreadCache_t *pCache, int nClass )
+	{
+		pCache->m_nAllocs++;
+		if ( !pCache->m_pFree[nClass] )
+		{
+			Move( &m_pFree[nClass], &pCache->m_pFree[nClass], &pCache->m_nFree[nClass], TOOLPOOL_THREAD_CACHE_SIZE );
+		}
+
+		T *p = pCache->m_pFree[nClass];
+		if ( p )
+		{
+			pCache->m_pFree[nClass] = p->next;
+			pCache->m_nFree[nClass]--;
+		}
+		return p;
+	}
+
+	void Free( ThreadCache_t *pCache, T *p, int nClass )
+	{
+		p->next = pCache->m_pFree[nClass];
+		pCache->m_pFree[nClass] = p;
+		if ( ++pCache->m_nFree[nClass] > 2 * TOOLPOOL_THREAD_CACHE_SIZE )
+		{
+			int nCount = 0;
+			Move( &pCache->m_pFree[nClass], &m_pFree[nClass], &nCount, TOOLPOOL_THREAD_CACHE_SIZE );
+			pCache->m_nFree[nClass] -= nCount;
+		}
+	}
+
+	// Call when the caller had to make a new block
+	void AddBlock( int nBytes )
+	{
+		ThreadLock();
+		m_nBlocks++;
+		m_nBytes += nBytes;
+		ThreadUnlock();
+	}
+
+	// Gives everything the thread has cached back to the shared lists
+	void Flush( ThreadCache_t *pCache )
+	{
+		for ( int i = 0; i < NUM_CLASSES; i++ )
+		{
+			int nCount = 0;
+			Move( &pCache->m_pFree[i], &m_pFree[i], &nCount, pCache->m_nFree[i] );
+			pCache->m_nFree[i] = 0;
+		}
+
+		ThreadLock();
+		m_nAllocs += pCache->m_nAllocs;
+		ThreadUnlock();
+		pCache->m_nAllocs = 0;
+	}
+
+	// Call after flushing the calling thread
+	void PrintStats( const char *pName ) const
+	{
+		Msg( "%s pool: %.0f allocs, peak %d blocks (%.1f MB)\n", pName, (double)m_nAllocs, m_nBlocks, m_nBytes / ( 1024.0 * 1024.0 ) );
+	}
+
+private:
+	// Moves up to nMax blocks from one list to the other
+	static void Move( T **ppFrom, T **ppTo, int *pMoved, int nMax )
+	{
+		ThreadLock();
+		while ( *ppFrom && *pMoved < nMax )
+		{
+			T *p = *ppFrom;
+			*ppFrom = p->next;
+			p->next = *ppTo;
+			*ppTo = p;
+			(*pMoved)++;
+		}
+		ThreadUnlock();
+	}
+
+	T		*m_pFree[NUM_CLASSES];		// shared, under ThreadLock
+	int64	m_nAllocs;
+	int		m_nBlocks;
+	int64	m_nBytes;
+};
+
+
+#endif // TOOLPOOL_H
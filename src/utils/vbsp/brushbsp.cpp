@@ -7,6 +7,9 @@
 //=============================================================================//
 
 #include "vbsp.h"
+#include "tier0/threadtools.h"
+#include "mathlib/ssemath.h"
+#include "toolpool.h"
 
 
 int		c_nodes;
@@ -18,6 +21,13 @@ int		c_active_brushes;
 #define	PLANESIDE_EPSILON	0.001
 //0.1
 
+// BrushBSP hands subtrees to threads once they're down to about this many per thread
+#define	BRUSHBSP_TASKS_PER_THREAD	8
+// subtrees with fewer brushes than this are never split up further
+#define	BRUSHBSP_MIN_TASK_BRUSHES	32
+
+static int s_NodeCount = 0;
+
 
 void FindBrushInTree (node_t *node, int brushnum)
 {
@@ -310,21 +320,67 @@ AllocNode
 */
 node_t *AllocNode (void)
 {
-	static int s_NodeCount = 0;
-
 	node_t	*node;
 
 	node = (node_t*)malloc(sizeof(*node));
 	memset (node, 0, sizeof(*node));
-	node->id = s_NodeCount;
+	node->id = ThreadInterlockedIncrement (&s_NodeCount) - 1;
 	node->diskId = -1;
 
-	s_NodeCount++;
-
 	return node;
 }
 
 
+/*
+================
+Brush pool
+
+Brushes are pooled by the side count they were allocated with.  That can be
+more than numsides ends up as, so it's kept in a header in front of the brush.
+================
+*/
+#define	BRUSH_POOL_CLASSES	(MAX_BRUSH_SIDES*2)
+
+struct brushblock_t
+{
+	int		poolclass;		// -1 if the brush is bigger than the pool handles
+	int		pad[3];			// keep the brush 16 byte aligned
+};
+
+typedef CToolPool< bspbrush_t, BRUSH_POOL_CLASSES > CBrushPool;
+static CBrushPool s_BrushPool;
+static CTHREADLOCALPTR( CBrushPool::ThreadCache_t ) s_pBrushCache;
+
+static CBrushPool::ThreadCache_t *GetBrushCache (void)
+{
+	CBrushPool::ThreadCache_t *pCache = s_pBrushCache;
+	if (!pCache)
+	{
+		pCache = (CBrushPool::ThreadCache_t *)calloc (1, sizeof(*pCache));
+		s_pBrushCache = pCache;
+	}
+	return pCache;
+}
+
+static void FlushBrushCache (void)
+{
+	CBrushPool::ThreadCache_t *pCache = s_pBrushCache;
+	if (pCache)
+		s_BrushPool.Flush (pCache);
+}
+
+static class CBrushPoolInit
+{
+public:
+	CBrushPoolInit() { RunThreads_AddExitFn (FlushBrushCache); }
+} s_BrushPoolInit;
+
+void PrintBrushPoolStats (void)
+{
+	FlushBrushCache ();
+	s_BrushPool.PrintStats ("Brush");
+}
+
 /*
 ================
 AllocBrush
@@ -334,13 +390,28 @@ bspbrush_t *AllocBrush (int numsides)
 {
 	static int s_BrushId = 0;
 
-	bspbrush_t	*bb;
+	bspbrush_t	*bb = NULL;
 	int			c;
 
 	c = (int)&(((bspbrush_t *)0)->sides[numsides]);
-	bb = (bspbrush_t*)malloc(c);
+	if (numsides < BRUSH_POOL_CLASSES)
+		bb = s_BrushPool.Alloc (GetBrushCache(), numsides);
+	if (!bb)
+	{
+		brushblock_t *block = (brushblock_t *)malloc (sizeof(brushblock_t) + c);
+		if (numsides < BRUSH_POOL_CLASSES)
+		{
+			block->poolclass = numsides;
+			s_BrushPool.AddBlock (sizeof(brushblock_t) + c);
+		}
+		else
+		{
+			block->poolclass = -1;
+		}
+		bb = (bspbrush_t *)(block + 1);
+	}
 	memset (bb, 0, c);
-	bb->id = s_BrushId++;
+	bb->id = ThreadInterlockedIncrement (&s_BrushId) - 1;
 	if (numthreads == 1)
 		c_active_brushes++;
 	return bb;
@@ -358,7 +429,13 @@ void FreeBrush (bspbrush_t *brushes)
 	for (i=0 ; i<brushes->numsides ; i++)
 		if (brushes->sides[i].winding)
 			FreeWinding(brushes->sides[i].winding);
-	free (brushes);
+
+	brushblock_t *block = (brushblock_t *)brushes - 1;
+	if (block->poolclass < 0)
+		free (block);
+	else
+		s_BrushPool.Free (GetBrushCache(), brushes, block->poolclass);
+
 	if (numthreads == 1)
 		c_active_brushes--;
 }
@@ -495,6 +572,111 @@ int BrushBspBoxOnPlaneSide (const Vector& mins, const Vector& maxs, dplane_t *pl
 	return side;
 }
 
+/*
+==============
+BrushBspBoxesOnPlaneSide
+
+BrushBspBoxOnPlaneSide for a whole brush list, four boxes at a time.
+Gives exactly the same sides as the scalar version.
+==============
+*/
+struct brushbounds_t
+{
+	int					count;
+	CUtlVector<float>	mins[3];		// padded to a multiple of 4
+	CUtlVector<float>	maxs[3];
+};
+
+static void BuildBrushBounds (bspbrush_t *brushes, brushbounds_t &bounds)
+{
+	bounds.count = CountBrushList (brushes);
+	int padded = (bounds.count + 3) & ~3;
+	for (int i=0 ; i<3 ; i++)
+	{
+		bounds.mins[i].SetCount (padded);
+		bounds.maxs[i].SetCount (padded);
+	}
+
+	int n = 0;
+	for (bspbrush_t *b=brushes ; b ; b=b->next, n++)
+	{
+		for (int i=0 ; i<3 ; i++)
+		{
+			bounds.mins[i][n] = b->mins[i];
+			bounds.maxs[i][n] = b->maxs[i];
+		}
+	}
+	for ( ; n<padded ; n++)
+	{
+		for (int i=0 ; i<3 ; i++)
+		{
+			bounds.mins[i][n] = 0;
+			bounds.maxs[i][n] = 0;
+		}
+	}
+}
+
+static void BrushBspBoxesOnPlaneSide (const brushbounds_t &bounds, dplane_t *plane, int *sides)
+{
+	int		i, j;
+
+	// axial planes are easy
+	if (plane->type < 3)
+	{
+		for (j=0 ; j<bounds.count ; j++)
+		{
+			sides[j] = 0;
+			if (bounds.maxs[plane->type][j] > plane->dist+PLANESIDE_EPSILON)
+				sides[j] |= PSIDE_FRONT;
+			if (bounds.mins[plane->type][j] < plane->dist-PLANESIDE_EPSILON)
+				sides[j] |= PSIDE_BACK;
+		}
+		return;
+	}
+
+	// the leading and trailing corners pick the same axis bounds for every box
+	const float	*corners[2][3];
+	for (i=0 ; i<3 ; i++)
+	{
+		if (plane->normal[i] < 0)
+		{
+			corners[0][i] = bounds.mins[i].Base();
+			corners[1][i] = bounds.maxs[i].Base();
+		}
+		else
+		{
+			corners[1][i] = bounds.mins[i].Base();
+			corners[0][i] = bounds.maxs[i].Base();
+		}
+	}
+
+	fltx4 normalx = ReplicateX4 (plane->normal[0]);
+	fltx4 normaly = ReplicateX4 (plane->normal[1]);
+	fltx4 normalz = ReplicateX4 (plane->normal[2]);
+	fltx4 dist = ReplicateX4 (plane->dist);
+	// dists are floats, so comparing them against the float epsilon
+	// gives the same answers as comparing against the double one
+	fltx4 epsilon = ReplicateX4 ((float)PLANESIDE_EPSILON);
+
+	for (j=0 ; j<bounds.count ; j+=4)
+	{
+		// same operation order as DotProduct, so the results match bit for bit
+		fltx4 dist1 = SubSIMD (AddSIMD (AddSIMD (MulSIMD (normalx, LoadUnalignedSIMD (corners[0][0] + j)),
+			MulSIMD (normaly, LoadUnalignedSIMD (corners[0][1] + j))), MulSIMD (normalz, LoadUnalignedSIMD (corners[0][2] + j))), dist);
+		fltx4 dist2 = SubSIMD (AddSIMD (AddSIMD (MulSIMD (normalx, LoadUnalignedSIMD (corners[1][0] + j)),
+			MulSIMD (normaly, LoadUnalignedSIMD (corners[1][1] + j))), MulSIMD (normalz, LoadUnalignedSIMD (corners[1][2] + j))), dist);
+
+		int front = TestSignSIMD (CmpGeSIMD (dist1, epsilon));
+		int back = TestSignSIMD (CmpLtSIMD (dist2, epsilon));
+
+		int count = MIN (4, bounds.count - j);
+		for (i=0 ; i<count ; i++)
+		{
+			sides[j+i] = ((front & (1<<i)) ? PSIDE_FRONT : 0) | ((back & (1<<i)) ? PSIDE_BACK : 0);
+		}
+	}
+}
+
 /*
 ============
 QuickTestBrushToPlanenum
@@ -539,9 +721,10 @@ int	QuickTestBrushToPlanenum (bspbrush_t *brush, int planenum, int *numsplits)
 ============
 TestBrushToPlanenum
 
+boxside is the brush bounds against the plane
 ============
 */
-int	TestBrushToPlanenum (bspbrush_t *brush, int planenum,
+int	TestBrushToPlanenum (bspbrush_t *brush, int planenum, int boxside,
 						 int *numsplits, qboolean *hintsplit, int *epsilonbrush)
 {
 	int			i, j, num;
@@ -567,9 +750,9 @@ int	TestBrushToPlanenum (bspbrush_t *brush, int planenum,
 			return PSIDE_FRONT|PSIDE_FACING;
 	}
 
-	// box on plane side
+	// box on plane side, from BrushBspBoxesOnPlaneSide
 	plane = &g_MainMap->mapplanes[planenum];
-	s = BrushBspBoxOnPlaneSide (brush->mins, brush->maxs, plane);
+	s = boxside;
 
 	if (s != PSIDE_BOTH)
 		return s;
@@ -854,7 +1037,7 @@ side_t *SelectSplitSide (bspbrush_t *brushes, node_t *node)
 	int			value, bestvalue;
 	bspbrush_t	*brush, *test;
 	side_t		*side, *bestside;
-	int			i, j, pass, numpasses;
+	int			i, j, t, pass, numpasses;
 	int			pnum;
 	int			s;
 	int			front, back, both, facing, splits;
@@ -862,11 +1045,16 @@ side_t *SelectSplitSide (bspbrush_t *brushes, node_t *node)
 	int			bestsplits;
 	int			epsilonbrush;
 	qboolean	hintsplit = false;
+	brushbounds_t	bounds;
+	CUtlVector<int>	boxsides;
 
 	bestside = NULL;
 	bestvalue = -99999;
 	bestsplits = 0;
 
+	BuildBrushBounds (brushes, bounds);
+	boxsides.SetCount (bounds.mins[0].Count());
+
 	// the search order goes: visible-structural, nonvisible-structural
 	// If any valid plane is available in a pass, no further
 	// passes will be tried.
@@ -907,9 +1095,11 @@ side_t *SelectSplitSide (bspbrush_t *brushes, node_t *node)
 				splits = 0;
 				epsilonbrush = 0;
 
-				for (test = brushes ; test ; test=test->next)
+				BrushBspBoxesOnPlaneSide (bounds, &g_MainMap->mapplanes[pnum], boxsides.Base());
+
+				for (test = brushes, t = 0 ; test ; test=test->next, t++)
 				{
-					s = TestBrushToPlanenum (test, pnum, &bsplits, &hintsplit, &epsilonbrush);
+					s = TestBrushToPlanenum (test, pnum, boxsides[t], &bsplits, &hintsplit, &epsilonbrush);
 
 					splits += bsplits;
 					if (bsplits && (s&PSIDE_FACING) )
@@ -977,8 +1167,7 @@ side_t *SelectSplitSide (bspbrush_t *brushes, node_t *node)
 		{
 			if (pass > 0)
 			{
-				if (numthreads == 1)
-					c_nonvis++;
+				ThreadInterlockedIncrement (&c_nonvis);
 			}
 			break;
 		}
@@ -1326,20 +1515,19 @@ void SplitBrushList (bspbrush_t *brushes,
 
 /*
 ================
-BuildTree_r
+SplitTreeNode
+
+Picks the split plane for node and divides its brushes between two new
+children.  Returns false if node became a leaf instead.
 ================
 */
-
-
-node_t *BuildTree_r (node_t *node, bspbrush_t *brushes)
+static bool SplitTreeNode (node_t *node, bspbrush_t *brushes, bspbrush_t **children)
 {
 	node_t		*newnode;
 	side_t		*bestside;
 	int			i;
-	bspbrush_t	*children[2];
 
-	if (numthreads == 1)
-		c_nodes++;
+	ThreadInterlockedIncrement (&c_nodes);
 
 	// find the best plane to use as a splitter
 	bestside = SelectSplitSide (brushes, node);
@@ -1350,7 +1538,7 @@ node_t *BuildTree_r (node_t *node, bspbrush_t *brushes)
 		node->side = NULL;
 		node->planenum = -1;
 		LeafNode (node, brushes);
-		return node;
+		return false;
 	}
 			 
 	// this is a splitplane node
@@ -1371,6 +1559,23 @@ node_t *BuildTree_r (node_t *node, bspbrush_t *brushes)
 	SplitBrush (node->volume, node->planenum, &node->children[0]->volume,
 		&node->children[1]->volume);
 
+	return true;
+}
+
+
+/*
+================
+BuildTree_r
+================
+*/
+node_t *BuildTree_r (node_t *node, bspbrush_t *brushes)
+{
+	int			i;
+	bspbrush_t	*children[2];
+
+	if (!SplitTreeNode (node, brushes, children))
+		return node;
+
 	// recursively process children
 	for (i=0 ; i<2 ; i++)
 	{
@@ -1379,6 +1584,99 @@ node_t *BuildTree_r (node_t *node, bspbrush_t *brushes)
 
 	return node;
 }
+
+
+/*
+================
+BuildTree
+
+Every subtree only depends on its own brushes and volume, so once the top of
+the tree is split up the subtrees are built on separate threads.  The tree is
+the same as BuildTree_r builds, and the node ids are put back in the order
+BuildTree_r would have allocated them.
+================
+*/
+struct bsptreetask_t
+{
+	node_t		*node;
+	bspbrush_t	*brushes;
+	int			numbrushes;
+};
+
+static int CompareTreeTasks (const bsptreetask_t *a, const bsptreetask_t *b)
+{
+	return b->numbrushes - a->numbrushes;
+}
+
+static void BuildTreeTask (int iThread, int iWorkItem, void *pUserData)
+{
+	bsptreetask_t *task = &(*(CUtlVector<bsptreetask_t> *)pUserData)[iWorkItem];
+	BuildTree_r (task->node, task->brushes);
+}
+
+static void NumberTreeNodes_r (node_t *node)
+{
+	if (node->planenum == PLANENUM_LEAF)
+		return;
+
+	// BuildTree_r allocates both children before recursing into either
+	node->children[0]->id = s_NodeCount++;
+	node->children[1]->id = s_NodeCount++;
+	NumberTreeNodes_r (node->children[0]);
+	NumberTreeNodes_r (node->children[1]);
+}
+
+static node_t *BuildTree (node_t *headnode, bspbrush_t *brushes)
+{
+	int		i;
+
+	if (g_nTreeThreads <= 1)
+		return BuildTree_r (headnode, brushes);
+
+	CUtlVector<bsptreetask_t> tasks;
+	bsptreetask_t &head = tasks[tasks.AddToTail()];
+	head.node = headnode;
+	head.brushes = brushes;
+	head.numbrushes = CountBrushList (brushes);
+
+	// split the biggest subtree until there's enough to go around
+	int firstId = s_NodeCount;
+	while (tasks.Count() < g_nTreeThreads * BRUSHBSP_TASKS_PER_THREAD)
+	{
+		int largest = 0;
+		for (i=1 ; i<tasks.Count() ; i++)
+		{
+			if (tasks[i].numbrushes > tasks[largest].numbrushes)
+				largest = i;
+		}
+		if (tasks[largest].numbrushes < BRUSHBSP_MIN_TASK_BRUSHES)
+			break;
+
+		bsptreetask_t task = tasks[largest];
+		tasks.FastRemove (largest);
+
+		bspbrush_t *children[2];
+		if (!SplitTreeNode (task.node, task.brushes, children))
+			continue;
+
+		for (i=0 ; i<2 ; i++)
+		{
+			bsptreetask_t &child = tasks[tasks.AddToTail()];
+			child.node = task.node->children[i];
+			child.brushes = children[i];
+			child.numbrushes = CountBrushList (children[i]);
+		}
+	}
+
+	// biggest first so a big subtree doesn't start last
+	tasks.Sort (CompareTreeTasks);
+	RunThreadsOnPool (tasks.Count(), g_nTreeThreads, BuildTreeTask, &tasks);
+
+	s_NodeCount = firstId;
+	NumberTreeNodes_r (headnode);
+
+	return headnode;
+}
 	  
 
 //===========================================================
@@ -1447,7 +1745,7 @@ tree_t *BrushBSP (bspbrush_t *brushlist, Vector& mins, Vector& maxs)
 
 	tree->headnode = node;
 
-	node = BuildTree_r (node, brushlist);
+	node = BuildTree (node, brushlist);
 	qprintf ("%5i visible nodes\n", c_nodes/2 - c_nonvis);
 	qprintf ("%5i nonvis nodes\n", c_nonvis);
 	qprintf ("%5i leafs\n", (c_nodes+1)/2);
@@ -7,6 +7,7 @@
 //=============================================================================//
 
 #include "vbsp.h"
+#include "tier1/utlvector.h"
 
 /*
 
@@ -653,123 +654,477 @@ qboolean BrushGE (bspbrush_t *b1, bspbrush_t *b2)
 
 /*
 =================
-ChopBrushes
-
-Carves any intersecting solid brushes into the minimum number
-of non-intersecting brushes. 
+CBrushChopper
+
+ChopBrushes walks the list comparing each brush against every brush after it,
+and starts over from the far end of the remaining list (CullList reverses it)
+whenever a pair gets chopped.  The order that produces is part of the output,
+so the chopper replays exactly the same sequence of tests and only skips the
+ones that can't change anything:
+
+- brushes are bucketed in a grid over their bounds, so a brush is only tested
+  against the brushes whose boxes overlap it
+- list position is a sequence number that grows towards the tail, and
+  reversing the list just flips which way it is read
+- a pair that didn't chop is remembered, so restarts don't subtract it again
 =================
 */
-bspbrush_t *ChopBrushes (bspbrush_t *head)
+#define CHOP_GRID_MAX_DIM			64
+#define CHOP_GRID_CELLS_PER_BRUSH	4		// total cells is capped at this many per input brush
+#define CHOP_LARGE_BRUSH_CELLS		256		// brushes covering more cells than this are tested against everything
+
+struct chopnode_t
 {
-	bspbrush_t	*b1, *b2, *next;
-	bspbrush_t	*tail;
-	bspbrush_t	*keep;
-	bspbrush_t	*sub, *sub2;
-	int			c1, c2;
+	bspbrush_t		*brush;
+	int				seq;				// list order; the head has the lowest seq unless the list is reversed
+	int				lower, higher;		// list neighbours by seq
+	bool			inlist;
+	bool			large;
+	int				cellmins[3], cellmaxs[3];
+	CUtlVector<int>	nochop;				// brushes this one was tested against as b1 without chopping
+};
+
+struct chopcandidate_t
+{
+	int				seq;
+	int				node;
+};
 
-	qprintf ("---- ChopBrushes ----\n");
-	qprintf ("original brushes: %i\n", CountBrushList (head));
+class CBrushChopper
+{
+public:
+	CBrushChopper();
+	bspbrush_t *Chop( bspbrush_t *head );
+
+private:
+	void InitGrid( bspbrush_t *head );
+	void CellBounds( const Vector &mins, const Vector &maxs, int *cellmins, int *cellmaxs ) const;
+	int CellIndex( int x, int y, int z ) const { return ( z * m_nDims[1] + y ) * m_nDims[0] + x; }
+
+	int Head() const { return m_bReversed ? m_nHighest : m_nLowest; }
+	int Next( int node ) const { return m_bReversed ? m_Nodes[node].lower : m_Nodes[node].higher; }
+	bool IsAfter( int node, int other ) const;
+
+	void AddToTail( bspbrush_t *brush );
+	void AddListToTail( bspbrush_t *list );
+	void Remove( int node );
+
+	void AddCandidate( int b1, int b2 );
+	void GatherCandidates( int b1 );
+	bool TryChop( int b1, int b2 );
+
+	CUtlVector<chopnode_t>			m_Nodes;
+	int								m_nLowest, m_nHighest;
+	int								m_nLowSeq, m_nHighSeq;
+	bool							m_bReversed;
+
+	Vector							m_GridMins;
+	Vector							m_CellSize;
+	int								m_nDims[3];
+	CUtlVector< CUtlVector<int> >	m_Cells;			// can still hold nodes that have left the list
+	CUtlVector<int>					m_LargeNodes;
+
+	CUtlVector<int>					m_Visited;			// GatherCandidates stamp per node
+	int								m_nVisitStamp;
+	CUtlVector<chopcandidate_t>		m_Candidates;
+};
+
+CBrushChopper::CBrushChopper()
+{
+	m_nLowest = m_nHighest = -1;
+	m_nLowSeq = m_nHighSeq = 0;
+	m_bReversed = false;
+	m_nVisitStamp = 0;
+}
 
-#if DEBUG_BRUSHMODEL
-	if (entity_num == DEBUG_BRUSHMODEL)
-		WriteBrushList ("before.gl", head, false);
-#endif
-	keep = NULL;
+inline bool CBrushChopper::IsAfter( int node, int other ) const
+{
+	if ( m_bReversed )
+		return m_Nodes[node].seq < m_Nodes[other].seq;
+	return m_Nodes[node].seq > m_Nodes[other].seq;
+}
 
-newlist:
-	// find tail
-	if (!head)
-		return NULL;
-	for (tail=head ; tail->next ; tail=tail->next)
-	;
+static int CompareChopExtents( const float *a, const float *b )
+{
+	return ( *a < *b ) ? -1 : ( *a > *b ) ? 1 : 0;
+}
+
+static int CompareChopCandidates( const chopcandidate_t *a, const chopcandidate_t *b )
+{
+	return a->seq - b->seq;
+}
+
+void CBrushChopper::InitGrid( bspbrush_t *head )
+{
+	Vector mins, maxs;
+	ClearBounds( mins, maxs );
 
-	for (b1=head ; b1 ; b1=next)
+	CUtlVector<float> extents[3];
+	for ( bspbrush_t *b = head; b; b = b->next )
 	{
-		next = b1->next;
-		for (b2=b1->next ; b2 ; b2 = b2->next)
+		AddPointToBounds( b->mins, mins, maxs );
+		AddPointToBounds( b->maxs, mins, maxs );
+		for ( int i = 0; i < 3; i++ )
 		{
-			if (BrushesDisjoint (b1, b2))
-				continue;
+			extents[i].AddToTail( b->maxs[i] - b->mins[i] );
+		}
+	}
+
+	// Size cells after the median brush so a typical brush only touches a few of them
+	int nBrushes = extents[0].Count();
+	for ( int i = 0; i < 3; i++ )
+	{
+		extents[i].Sort( CompareChopExtents );
+		float flCell = MAX( extents[i][nBrushes / 2], 1.0f );
+		m_nDims[i] = clamp( (int)ceil( ( maxs[i] - mins[i] ) / flCell ), 1, CHOP_GRID_MAX_DIM );
+	}
 
-			sub = NULL;
-			sub2 = NULL;
-			c1 = 999999;
-			c2 = 999999;
+	while ( m_nDims[0] * m_nDims[1] * m_nDims[2] > nBrushes * CHOP_GRID_CELLS_PER_BRUSH )
+	{
+		int nLargest = ( m_nDims[0] >= m_nDims[1] ) ? 0 : 1;
+		if ( m_nDims[2] > m_nDims[nLargest] )
+			nLargest = 2;
+		m_nDims[nLargest] = ( m_nDims[nLargest] + 1 ) / 2;
+	}
 
-			if ( BrushGE (b2, b1) )
-			{
-//				printf( "b2 bites b1\n" );
-				sub = SubtractBrush (b1, b2);
-				if (sub == b1)
-					continue;		// didn't really intersect
-				if (!sub)
-				{	// b1 is swallowed by b2
-					head = CullList (b1, b1);
-					goto newlist;
-				}
-				c1 = CountBrushList (sub);
-			}
+	m_GridMins = mins;
+	for ( int i = 0; i < 3; i++ )
+	{
+		m_CellSize[i] = MAX( ( maxs[i] - mins[i] ) / m_nDims[i], 1.0f );
+	}
+	m_Cells.SetCount( m_nDims[0] * m_nDims[1] * m_nDims[2] );
+}
+
+// Fragments can poke out of the grid by an epsilon; clamping still puts overlapping boxes in a shared cell
+void CBrushChopper::CellBounds( const Vector &mins, const Vector &maxs, int *cellmins, int *cellmaxs ) const
+{
+	for ( int i = 0; i < 3; i++ )
+	{
+		cellmins[i] = clamp( (int)floor( ( mins[i] - m_GridMins[i] ) / m_CellSize[i] ), 0, m_nDims[i] - 1 );
+		cellmaxs[i] = clamp( (int)floor( ( maxs[i] - m_GridMins[i] ) / m_CellSize[i] ), 0, m_nDims[i] - 1 );
+	}
+}
+
+void CBrushChopper::AddToTail( bspbrush_t *brush )
+{
+	int node = m_Nodes.AddToTail();
+	chopnode_t &n = m_Nodes[node];
+	n.brush = brush;
+	n.inlist = true;
+	n.lower = n.higher = -1;
+	brush->next = NULL;
+
+	// The tail is the high end of the seq range unless the list is reversed
+	if ( m_nLowest == -1 )
+	{
+		n.seq = m_nHighSeq;
+		m_nLowest = m_nHighest = node;
+	}
+	else if ( !m_bReversed )
+	{
+		n.seq = ++m_nHighSeq;
+		n.lower = m_nHighest;
+		m_Nodes[m_nHighest].higher = node;
+		m_nHighest = node;
+	}
+	else
+	{
+		n.seq = --m_nLowSeq;
+		n.higher = m_nLowest;
+		m_Nodes[m_nLowest].lower = node;
+		m_nLowest = node;
+	}
 
-			if ( BrushGE (b1, b2) )
+	CellBounds( brush->mins, brush->maxs, n.cellmins, n.cellmaxs );
+	int nCells = ( n.cellmaxs[0] - n.cellmins[0] + 1 ) * ( n.cellmaxs[1] - n.cellmins[1] + 1 ) * ( n.cellmaxs[2] - n.cellmins[2] + 1 );
+	n.large = ( nCells > CHOP_LARGE_BRUSH_CELLS );
+	if ( n.large )
+	{
+		m_LargeNodes.AddToTail( node );
+	}
+	else
+	{
+		for ( int z = n.cellmins[2]; z <= n.cellmaxs[2]; z++ )
+		{
+			for ( int y = n.cellmins[1]; y <= n.cellmaxs[1]; y++ )
 			{
-//				printf( "b1 bites b2\n" );
-				sub2 = SubtractBrush (b2, b1);
-				if (sub2 == b2)
-					continue;		// didn't really intersect
-				if (!sub2)
-				{	// b2 is swallowed by b1
-					FreeBrushList (sub);
-					head = CullList (b1, b2);
-					goto newlist;
+				for ( int x = n.cellmins[0]; x <= n.cellmaxs[0]; x++ )
+				{
+					m_Cells[ CellIndex( x, y, z ) ].AddToTail( node );
 				}
-				c2 = CountBrushList (sub2);
 			}
+		}
+	}
+	m_Visited.AddToTail( 0 );
+}
 
-			if (!sub && !sub2)
-				continue;		// neither one can bite
+void CBrushChopper::AddListToTail( bspbrush_t *list )
+{
+	bspbrush_t *next;
+	for ( ; list; list = next )
+	{
+		next = list->next;
+		AddToTail( list );
+	}
+}
+
+// Doesn't free the brush, it's either been kept or freed by the caller
+void CBrushChopper::Remove( int node )
+{
+	chopnode_t &n = m_Nodes[node];
+	Assert( n.inlist );
+	if ( n.lower != -1 )
+		m_Nodes[n.lower].higher = n.higher;
+	else
+		m_nLowest = n.higher;
+	if ( n.higher != -1 )
+		m_Nodes[n.higher].lower = n.lower;
+	else
+		m_nHighest = n.lower;
+
+	n.inlist = false;
+	n.brush = NULL;
+	n.nochop.Purge();
+}
+
+void CBrushChopper::AddCandidate( int b1, int b2 )
+{
+	if ( m_Visited[b2] == m_nVisitStamp )
+		return;
+	m_Visited[b2] = m_nVisitStamp;
+
+	const chopnode_t &n2 = m_Nodes[b2];
+	if ( !n2.inlist || !IsAfter( b2, b1 ) )
+		return;
+
+	// Same bounds test as BrushesDisjoint
+	const bspbrush_t *a = m_Nodes[b1].brush;
+	const bspbrush_t *b = n2.brush;
+	for ( int i = 0; i < 3; i++ )
+	{
+		if ( a->mins[i] >= b->maxs[i] || a->maxs[i] <= b->mins[i] )
+			return;
+	}
+
+	chopcandidate_t &candidate = m_Candidates[ m_Candidates.AddToTail() ];
+	candidate.seq = n2.seq;
+	candidate.node = b2;
+}
 
-			// only accept if it didn't fragment
-			// (commening this out allows full fragmentation)
-			if (c1 > 1 && c2 > 1)
+//-----------------------------------------------------------------------------
+// Finds the brushes after b1 whose bounds overlap it, in list order
+//-----------------------------------------------------------------------------
+void CBrushChopper::GatherCandidates( int b1 )
+{
+	m_Candidates.RemoveAll();
+	++m_nVisitStamp;
+
+	const chopnode_t &n1 = m_Nodes[b1];
+	if ( n1.large )
+	{
+		// Walking the list is cheaper than walking all the cells, and already in order
+		for ( int b2 = Next( b1 ); b2 != -1; b2 = Next( b2 ) )
+		{
+			AddCandidate( b1, b2 );
+		}
+		return;
+	}
+
+	for ( int z = n1.cellmins[2]; z <= n1.cellmaxs[2]; z++ )
+	{
+		for ( int y = n1.cellmins[1]; y <= n1.cellmaxs[1]; y++ )
+		{
+			for ( int x = n1.cellmins[0]; x <= n1.cellmaxs[0]; x++ )
 			{
-				const int contents1 = b1->original->contents;
-				const int contents2 = b2->original->contents;
-				// if both detail, allow fragmentation
-				if ( !((contents1&contents2) & CONTENTS_DETAIL) && !((contents1|contents2) & CONTENTS_AREAPORTAL) )
+				const CUtlVector<int> &cell = m_Cells[ CellIndex( x, y, z ) ];
+				for ( int i = 0; i < cell.Count(); i++ )
 				{
-					if (sub2)
-						FreeBrushList (sub2);
-					if (sub)
-						FreeBrushList (sub);
-					continue;
+					AddCandidate( b1, cell[i] );
 				}
 			}
+		}
+	}
 
-			if (c1 < c2)
-			{
-				if (sub2)
-					FreeBrushList (sub2);
-				tail = AddBrushListToTail (sub, tail);
-				head = CullList (b1, b1);
-				goto newlist;
-			}
-			else
+	for ( int i = 0; i < m_LargeNodes.Count(); i++ )
+	{
+		AddCandidate( b1, m_LargeNodes[i] );
+	}
+
+	m_Candidates.Sort( CompareChopCandidates );
+	if ( m_bReversed )
+	{
+		for ( int i = 0, j = m_Candidates.Count() - 1; i < j; i++, j-- )
+		{
+			V_swap( m_Candidates[i], m_Candidates[j] );
+		}
+	}
+}
+
+/*
+=================
+TryChop
+
+The body of the original ChopBrushes pair loop.  Returns true if b1 or b2
+was replaced, which starts the scan over.
+=================
+*/
+bool CBrushChopper::TryChop( int b1, int b2 )
+{
+	bspbrush_t	*brush1 = m_Nodes[b1].brush;
+	bspbrush_t	*brush2 = m_Nodes[b2].brush;
+	bspbrush_t	*sub, *sub2;
+	int			c1, c2;
+
+	if (BrushesDisjoint (brush1, brush2))
+		return false;
+
+	sub = NULL;
+	sub2 = NULL;
+	c1 = 999999;
+	c2 = 999999;
+
+	if ( BrushGE (brush2, brush1) )
+	{
+		sub = SubtractBrush (brush1, brush2);
+		if (sub == brush1)
+			return false;		// didn't really intersect
+		if (!sub)
+		{	// b1 is swallowed by b2
+			Remove (b1);
+			FreeBrush (brush1);
+			return true;
+		}
+		c1 = CountBrushList (sub);
+	}
+
+	if ( BrushGE (brush1, brush2) )
+	{
+		sub2 = SubtractBrush (brush2, brush1);
+		if (sub2 == brush2)
+		{
+			FreeBrushList (sub);
+			return false;		// didn't really intersect
+		}
+		if (!sub2)
+		{	// b2 is swallowed by b1
+			FreeBrushList (sub);
+			Remove (b2);
+			FreeBrush (brush2);
+			return true;
+		}
+		c2 = CountBrushList (sub2);
+	}
+
+	if (!sub && !sub2)
+		return false;		// neither one can bite
+
+	// only accept if it didn't fragment
+	// (commening this out allows full fragmentation)
+	if (c1 > 1 && c2 > 1)
+	{
+		const int contents1 = brush1->original->contents;
+		const int contents2 = brush2->original->contents;
+		// if both detail, allow fragmentation
+		if ( !((contents1&contents2) & CONTENTS_DETAIL) && !((contents1|contents2) & CONTENTS_AREAPORTAL) )
+		{
+			if (sub2)
+				FreeBrushList (sub2);
+			if (sub)
+				FreeBrushList (sub);
+			return false;
+		}
+	}
+
+	if (c1 < c2)
+	{
+		if (sub2)
+			FreeBrushList (sub2);
+		AddListToTail (sub);
+		Remove (b1);
+		FreeBrush (brush1);
+	}
+	else
+	{
+		if (sub)
+			FreeBrushList (sub);
+		AddListToTail (sub2);
+		Remove (b2);
+		FreeBrush (brush2);
+	}
+	return true;
+}
+
+bspbrush_t *CBrushChopper::Chop( bspbrush_t *head )
+{
+	bspbrush_t	*keep = NULL;
+
+	if (!head)
+		return NULL;
+
+	InitGrid (head);
+	AddListToTail (head);
+
+	int b1 = Head();
+	while (b1 != -1)
+	{
+		GatherCandidates (b1);
+
+		bool bChopped = false;
+		for (int i = 0; i < m_Candidates.Count(); i++)
+		{
+			int b2 = m_Candidates[i].node;
+			if (m_Nodes[b1].nochop.Find (b2) != -1)
+				continue;
+
+			if (TryChop (b1, b2))
 			{
-				if (sub)
-					FreeBrushList (sub);
-				tail = AddBrushListToTail (sub2, tail);
-				head = CullList (b1, b2);
-				goto newlist;
+				bChopped = true;
+				break;
 			}
+			m_Nodes[b1].nochop.AddToTail (b2);
 		}
 
-		if (!b2)
-		{	// b1 is no longer intersecting anything, so keep it
-			b1->next = keep;
-			keep = b1;
+		if (bChopped)
+		{
+			// The original rebuilds what's left with CullList, which reverses it
+			m_bReversed = !m_bReversed;
+			b1 = Head();
+			continue;
 		}
+
+		// b1 is no longer intersecting anything, so keep it
+		int next = Next (b1);
+		bspbrush_t *brush1 = m_Nodes[b1].brush;
+		Remove (b1);
+		brush1->next = keep;
+		keep = brush1;
+		b1 = next;
 	}
 
+	return keep;
+}
+
+/*
+=================
+ChopBrushes
+
+Carves any intersecting solid brushes into the minimum number
+of non-intersecting brushes. 
+=================
+*/
+bspbrush_t *ChopBrushes (bspbrush_t *head)
+{
+	qprintf ("---- ChopBrushes ----\n");
+	qprintf ("original brushes: %i\n", CountBrushList (head));
+
+#if DEBUG_BRUSHMODEL
+	if (entity_num == DEBUG_BRUSHMODEL)
+		WriteBrushList ("before.gl", head, false);
+#endif
+
+	CBrushChopper chopper;
+	bspbrush_t *keep = chopper.Chop (head);
+
 	qprintf ("output brushes: %i\n", CountBrushList (keep));
 #if DEBUG_BRUSHMODEL
 	if ( entity_num == DEBUG_BRUSHMODEL )
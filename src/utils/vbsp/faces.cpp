@@ -14,6 +14,7 @@
 #include "mstristrip.h"
 #include "tier1/strtools.h"
 #include "materialpatch.h"
+#include "tier0/threadtools.h"
 /*
 
   some faces will be removed before saving, but still form nodes:
@@ -42,8 +43,30 @@ int	c_facecollapse;
 int	c_badstartverts;
 
 #define	MAX_SUPERVERTS	512
-int	superverts[MAX_SUPERVERTS];
-int	numsuperverts;
+
+// Scratch space for welding a face's vertexes and breaking its edges at
+// tjunctions.  The tjunction pass gives each thread its own.
+struct tjuncverts_t
+{
+	int		superverts[MAX_SUPERVERTS];
+	int		numsuperverts;
+
+	Vector	edge_dir;
+	Vector	edge_start;
+
+	int		num_edge_verts;
+	int		edge_verts[MAX_MAP_VERTS];
+};
+
+static tjuncverts_t	s_TJuncVerts;
+
+// A face that got retriangulated to sew cracks.  The primitives are added
+// once the tjunction pass is done so they come out in tree order.
+struct tjuncprim_t
+{
+	face_t			*face;
+	CUtlVector<int>	indices;
+};
 
 face_t		*edgefaces[MAX_MAP_EDGES][2];
 int		firstmodeledge = 1;
@@ -51,13 +74,6 @@ int		firstmodelface;
 
 int	c_tryedges;
 
-Vector	edge_dir;
-Vector	edge_start;
-vec_t	edge_len;
-
-int		num_edge_verts;
-int		edge_verts[MAX_MAP_VERTS];
-
 
 float	g_maxLightmapDimension = 32;
 
@@ -219,16 +235,18 @@ superverts[base] will become face->vertexnums[0], and the others
 will be circularly filled in.
 ==================
 */
-void FaceFromSuperverts (face_t **pListHead, face_t *f, int base)
+void FaceFromSuperverts (tjuncverts_t *v, face_t **pListHead, face_t *f, int base)
 {
 	face_t	*newf;
 	int		remaining;
 	int		i;
+	int		*superverts = v->superverts;
+	int		numsuperverts = v->numsuperverts;
 
 	remaining = numsuperverts;
 	while (remaining > MAXEDGES)
 	{	// must split into two faces, because of vertex overload
-		c_faceoverflows++;
+		ThreadInterlockedIncrement (&c_faceoverflows);
 
 		newf = NewFaceFromFace (f);
 		f->split[0] = newf;
@@ -277,19 +295,19 @@ void EmitFaceVertexes (face_t **pListHead, face_t *f)
 		{	// make every point unique
 			if (numvertexes == MAX_MAP_VERTS)
 				Error ("Too many unique verts, max = %d (map has too much brush geometry)\n", MAX_MAP_VERTS);
-			superverts[i] = numvertexes;
+			s_TJuncVerts.superverts[i] = numvertexes;
 			VectorCopy (w->p[i], dvertexes[numvertexes].point);
 			numvertexes++;
 			c_uniqueverts++;
 			c_totalverts++;
 		}
 		else
-			superverts[i] = GetVertexnum (w->p[i]);
+			s_TJuncVerts.superverts[i] = GetVertexnum (w->p[i]);
 	}
-	numsuperverts = w->numpoints;
+	s_TJuncVerts.numsuperverts = w->numpoints;
 
 	// this may fragment the face if > MAXEDGES
-	FaceFromSuperverts (pListHead, f, 0);
+	FaceFromSuperverts (&s_TJuncVerts, pListHead, f, 0);
 }
 
 /*
@@ -339,7 +357,7 @@ FindEdgeVerts
 Uses the hash tables to cut down to a small number
 ==========
 */
-void FindEdgeVerts (Vector& v1, Vector& v2)
+void FindEdgeVerts (tjuncverts_t *v, Vector& v1, Vector& v2)
 {
 	int		x1, x2, y1, y2, t;
 	int		x, y;
@@ -348,9 +366,9 @@ void FindEdgeVerts (Vector& v1, Vector& v2)
 #if 0
 {
 	int		i;
-	num_edge_verts = numvertexes-1;
+	v->num_edge_verts = numvertexes-1;
 	for (i=0 ; i<numvertexes-1 ; i++)
-		edge_verts[i] = i+1;
+		v->edge_verts[i] = i+1;
 }
 #endif
 
@@ -385,14 +403,14 @@ void FindEdgeVerts (Vector& v1, Vector& v2)
 	if (y2 >= HASH_SIZE)
 		y2 = HASH_SIZE;
 #endif
-	num_edge_verts = 0;
+	v->num_edge_verts = 0;
 	for (x=x1 ; x <= x2 ; x++)
 	{
 		for (y=y1 ; y <= y2 ; y++)
 		{
 			for (vnum=hashverts[y*HASH_SIZE+x] ; vnum ; vnum=vertexchain[vnum])
 			{
-				edge_verts[num_edge_verts++] = vnum;
+				v->edge_verts[v->num_edge_verts++] = vnum;
 			}
 		}
 	}
@@ -406,13 +424,13 @@ FindEdgeVerts
 Forced a dumb check of everything
 ==========
 */
-void FindEdgeVerts (Vector& v1, Vector& v2)
+void FindEdgeVerts (tjuncverts_t *v, Vector& v1, Vector& v2)
 {
 	int		i;
 
-	num_edge_verts = numvertexes-1;
-	for (i=0 ; i<num_edge_verts ; i++)
-		edge_verts[i] = i+1;
+	v->num_edge_verts = numvertexes-1;
+	for (i=0 ; i<v->num_edge_verts ; i++)
+		v->edge_verts[i] = i+1;
 }
 #endif
 
@@ -423,7 +441,7 @@ TestEdge
 Can be recursively reentered
 ==========
 */
-void TestEdge (vec_t start, vec_t end, int p1, int p2, int startvert)
+void TestEdge (tjuncverts_t *v, vec_t start, vec_t end, int p1, int p2, int startvert)
 {
 	int		j, k;
 	vec_t	dist;
@@ -435,23 +453,23 @@ void TestEdge (vec_t start, vec_t end, int p1, int p2, int startvert)
 
 	if (p1 == p2)
 	{
-		c_degenerate++;
+		ThreadInterlockedIncrement (&c_degenerate);
 		return;		// degenerate edge
 	}
 
-	for (k=startvert ; k<num_edge_verts ; k++)
+	for (k=startvert ; k<v->num_edge_verts ; k++)
 	{
-		j = edge_verts[k];
+		j = v->edge_verts[k];
 		if (j==p1 || j == p2)
 			continue;
 
 		VectorCopy (dvertexes[j].point, p);
 
-		VectorSubtract (p, edge_start, delta);
-		dist = DotProduct (delta, edge_dir);
+		VectorSubtract (p, v->edge_start, delta);
+		dist = DotProduct (delta, v->edge_dir);
 		if (dist <=start || dist >= end)
 			continue;		// off an end
-		VectorMA (edge_start, dist, edge_dir, exact);
+		VectorMA (v->edge_start, dist, v->edge_dir, exact);
 		VectorSubtract (p, exact, off);
 		error = off.Length();
 
@@ -459,17 +477,17 @@ void TestEdge (vec_t start, vec_t end, int p1, int p2, int startvert)
 			continue;		// not on the edge
 
 		// break the edge
-		c_tjunctions++;
-		TestEdge (start, dist, p1, j, k+1);
-		TestEdge (dist, end, j, p2, k+1);
+		ThreadInterlockedIncrement (&c_tjunctions);
+		TestEdge (v, start, dist, p1, j, k+1);
+		TestEdge (v, dist, end, j, p2, k+1);
 		return;
 	}
 
 	// the edge p1 to p2 is now free of tjunctions
-	if (numsuperverts >= MAX_SUPERVERTS)
+	if (v->numsuperverts >= MAX_SUPERVERTS)
 		Error ("Edge with too many vertices due to t-junctions.  Max %d verts along an edge!\n", MAX_SUPERVERTS);
-	superverts[numsuperverts] = p1;
-	numsuperverts++;
+	v->superverts[v->numsuperverts] = p1;
+	v->numsuperverts++;
 }
 
 
@@ -584,7 +602,7 @@ FixFaceEdges
 
 ==================
 */
-void FixFaceEdges (face_t **pList, face_t *f)
+void FixFaceEdges (tjuncverts_t *v, face_t **pList, face_t *f, CUtlVector<tjuncprim_t> &prims)
 {
 	int		p1, p2;
 	int		i;
@@ -596,7 +614,7 @@ void FixFaceEdges (face_t **pList, face_t *f)
 	if (f->merged || f->split[0] || f->split[1])
 		return;
 
-	numsuperverts = 0;
+	v->numsuperverts = 0;
 
 	int originalPoints = f->numpoints;
 	for (i=0 ; i<f->numpoints ; i++)
@@ -604,24 +622,25 @@ void FixFaceEdges (face_t **pList, face_t *f)
 		p1 = f->vertexnums[i];
 		p2 = f->vertexnums[(i+1)%f->numpoints];
 
-		VectorCopy (dvertexes[p1].point, edge_start);
+		VectorCopy (dvertexes[p1].point, v->edge_start);
 		VectorCopy (dvertexes[p2].point, e2);
 
-		FindEdgeVerts (edge_start, e2);
+		FindEdgeVerts (v, v->edge_start, e2);
 
-		VectorSubtract (e2, edge_start, edge_dir);
-		len = VectorNormalize (edge_dir);
+		VectorSubtract (e2, v->edge_start, v->edge_dir);
+		len = VectorNormalize (v->edge_dir);
 
-		start[i] = numsuperverts;
-		TestEdge (0, len, p1, p2, 0);
+		start[i] = v->numsuperverts;
+		TestEdge (v, 0, len, p1, p2, 0);
 
-		count[i] = numsuperverts - start[i];
+		count[i] = v->numsuperverts - start[i];
 	}
 
+	int numsuperverts = v->numsuperverts;
 	if (numsuperverts < 3)
 	{	// entire face collapsed
 		f->numpoints = 0;
-		c_facecollapse++;
+		ThreadInterlockedIncrement (&c_facecollapse);
 		return;
 	}
 
@@ -636,7 +655,7 @@ void FixFaceEdges (face_t **pList, face_t *f)
 	if (i == f->numpoints)
 	{
 		f->badstartvert = true;
-		c_badstartverts++;
+		ThreadInterlockedIncrement (&c_badstartverts);
 		base = 0;
 
 	}
@@ -646,14 +665,13 @@ void FixFaceEdges (face_t **pList, face_t *f)
 	}
 
 	// this may fragment the face if > MAXEDGES
-	FaceFromSuperverts (pList, f, base);
+	FaceFromSuperverts (v, pList, f, base);
 
 	// if this is the world, then re-triangulate to sew cracks
 	if ( f->badstartvert && entity_num == 0 )
 	{
 		CUtlVector<face_vert_table_t> poly;
 		CUtlVector<int> inIndices;
-		CUtlVector<int> outIndices;
 		poly.AddMultipleToTail( numsuperverts );
 		for ( i = 0; i < originalPoints; i++ )
 		{
@@ -672,7 +690,26 @@ void FixFaceEdges (face_t **pList, face_t *f)
 		{
 			inIndices.AddToTail( i );
 		}
-		Triangulate_r( outIndices, inIndices, poly );
+		tjuncprim_t &prim = prims[ prims.AddToTail() ];
+		prim.face = f;
+		Triangulate_r( prim.indices, inIndices, poly );
+	}
+}
+
+/*
+==================
+EmitTJuncPrims
+==================
+*/
+void EmitTJuncPrims (const CUtlVector<tjuncprim_t> &prims)
+{
+	int		i, j;
+
+	for (i=0 ; i<prims.Count() ; i++)
+	{
+		face_t *f = prims[i].face;
+		const CUtlVector<int> &outIndices = prims[i].indices;
+
 		dprimitive_t &newPrim = g_primitives[g_numprimitives];
 		f->firstPrimID = g_numprimitives;
 		g_numprimitives++;
@@ -687,9 +724,9 @@ void FixFaceEdges (face_t **pList, face_t *f)
 		{
 			Error("Too many t-junctions to fix up! (%d prims, max %d :: %d indices, max %d)\n", g_numprimitives, MAX_MAP_PRIMITIVES, g_numprimindices, MAX_MAP_PRIMINDICES );
 		}
-		for ( i = 0; i < outIndices.Count(); i++ )
+		for ( j = 0; j < outIndices.Count(); j++ )
 		{
-			g_primindices[newPrim.firstIndex + i] = outIndices[i];
+			g_primindices[newPrim.firstIndex + j] = outIndices[j];
 		}
 	}
 }
@@ -699,7 +736,7 @@ void FixFaceEdges (face_t **pList, face_t *f)
 FixEdges_r
 ==================
 */
-void FixEdges_r (node_t *node)
+void FixEdges_r (node_t *node, CUtlVector<tjuncprim_t> &prims)
 {
 	int		i;
 	face_t	*f;
@@ -710,10 +747,64 @@ void FixEdges_r (node_t *node)
 	}
 
 	for (f=node->faces ; f ; f=f->next)
-		FixFaceEdges (&node->faces, f);
+		FixFaceEdges (&s_TJuncVerts, &node->faces, f, prims);
 
 	for (i=0 ; i<2 ; i++)
-		FixEdges_r (node->children[i]);
+		FixEdges_r (node->children[i], prims);
+}
+
+/*
+==================
+FixTreeEdges
+
+The vertexes are all welded before the edges get broken, so the hash only
+gets read here and every node's faces can be fixed on their own.  The
+primitives for retriangulated faces are added afterwards in the order
+FixEdges_r would have added them.
+==================
+*/
+struct tjuncnodes_t
+{
+	CUtlVector<node_t *>					nodes;
+	CUtlVector< CUtlVector<tjuncprim_t> >	prims;		// one list per node
+	CUtlVector<tjuncverts_t *>				verts;		// one per thread
+};
+
+static void FixNodeEdgesTask (int iThread, int iWorkItem, void *pUserData)
+{
+	tjuncnodes_t	*work = (tjuncnodes_t *)pUserData;
+	node_t			*node = work->nodes[iWorkItem];
+	face_t			*f;
+
+	for (f=node->faces ; f ; f=f->next)
+		FixFaceEdges (work->verts[iThread], &node->faces, f, work->prims[iWorkItem]);
+}
+
+void FixTreeEdges (node_t *headnode)
+{
+	int		i;
+
+	if (g_nTreeThreads <= 1)
+	{
+		CUtlVector<tjuncprim_t> prims;
+		FixEdges_r (headnode, prims);
+		EmitTJuncPrims (prims);
+		return;
+	}
+
+	tjuncnodes_t work;
+	GetTreeNodes (headnode, work.nodes);
+	work.prims.SetCount (work.nodes.Count());
+	work.verts.SetCount (g_nTreeThreads);
+	for (i=0 ; i<g_nTreeThreads ; i++)
+		work.verts[i] = (tjuncverts_t *)malloc (sizeof(tjuncverts_t));
+
+	RunThreadsOnPool (work.nodes.Count(), g_nTreeThreads, FixNodeEdgesTask, &work);
+
+	for (i=0 ; i<g_nTreeThreads ; i++)
+		free (work.verts[i]);
+	for (i=0 ; i<work.nodes.Count() ; i++)
+		EmitTJuncPrims (work.prims[i]);
 }
 
 
@@ -723,11 +814,13 @@ void FixEdges_r (node_t *node)
 void FixLeafFaceEdges( face_t **ppLeafFaceList )
 {
 	face_t *f;
+	CUtlVector<tjuncprim_t> prims;
 
 	for ( f = *ppLeafFaceList; f; f = f->next )
 	{
-		FixFaceEdges( ppLeafFaceList, f );
+		FixFaceEdges( &s_TJuncVerts, ppLeafFaceList, f, prims );
 	}
+	EmitTJuncPrims( prims );
 }
 
 /*
@@ -759,7 +852,7 @@ face_t *FixTjuncs (node_t *headnode, face_t *pLeafFaceList)
 	
 	if ( g_bAllowDetailCracks )
 	{
-		FixEdges_r (headnode);
+		FixTreeEdges (headnode);
 		EmitLeafFaceVertexes( &pLeafFaceList );
 		FixLeafFaceEdges( &pLeafFaceList );
 	}
@@ -768,7 +861,7 @@ face_t *FixTjuncs (node_t *headnode, face_t *pLeafFaceList)
 		EmitLeafFaceVertexes( &pLeafFaceList );
 		if (!notjunc)
 		{
-			FixEdges_r (headnode);
+			FixTreeEdges (headnode);
 			FixLeafFaceEdges( &pLeafFaceList );
 		}
 	}
@@ -789,18 +882,17 @@ face_t *FixTjuncs (node_t *headnode, face_t *pLeafFaceList)
 
 int		c_faces;
 
+static int s_FaceId = 0;
+
 face_t	*AllocFace (void)
 {
-	static int s_FaceId = 0;
-
 	face_t	*f;
 
 	f = (face_t*)malloc(sizeof(*f));
 	memset (f, 0, sizeof(*f));
-	f->id = s_FaceId;
-	++s_FaceId;
+	f->id = ThreadInterlockedIncrement (&s_FaceId) - 1;
 
-	c_faces++;
+	ThreadInterlockedIncrement (&c_faces);
 
 	return f;
 }
@@ -822,7 +914,7 @@ void FreeFace (face_t *f)
 	if (f->w)
 		FreeWinding (f->w);
 	free (f);
-	c_faces--;
+	ThreadInterlockedDecrement (&c_faces);
 }
 
 
@@ -1107,7 +1199,7 @@ face_t *TryMerge (face_t *f1, face_t *f2, Vector& planenormal)
 	if (!nw)
 		return NULL;
 
-	c_merge++;
+	ThreadInterlockedIncrement (&c_merge);
 	newf = NewFaceFromFace (f1);
 	newf->w = nw;
 
@@ -1211,7 +1303,7 @@ void SubdivideFace (face_t **pFaceList, face_t *f)
 				break;
 			
 		// split it
-			c_subdivide++;
+			ThreadInterlockedIncrement (&c_subdivide);
 			
 			luxelsPerWorldUnit = VectorNormalize (temp);	
 
@@ -1412,7 +1504,16 @@ mark the side that originally created it
   water / water : none
 ===============
 */
-void MakeFaces_r (node_t *node)
+static void MergeNodeFaces (node_t *node)
+{
+	// merge together all visible faces on the node
+	if (!nomerge)
+		MergeFaceList(&node->faces);
+	if (!nosubdiv)
+		SubdivideFaceList(&node->faces);
+}
+
+void MakeFaces_r (node_t *node, bool bMergeNodes)
 {
 	portal_t	*p;
 	int			s;
@@ -1420,14 +1521,11 @@ void MakeFaces_r (node_t *node)
 	// recurse down to leafs
 	if (node->planenum != PLANENUM_LEAF)
 	{
-		MakeFaces_r (node->children[0]);
-		MakeFaces_r (node->children[1]);
+		MakeFaces_r (node->children[0], bMergeNodes);
+		MakeFaces_r (node->children[1], bMergeNodes);
 
-		// merge together all visible faces on the node
-		if (!nomerge)
-			MergeFaceList(&node->faces);
-		if (!nosubdiv)
-			SubdivideFaceList(&node->faces);
+		if (bMergeNodes)
+			MergeNodeFaces (node);
 
 		return;
 	}
@@ -1790,6 +1888,11 @@ void SplitSubdividedFaces( face_t *pLeafFaceList, node_t *headnode )
 
 #pragma optimize( "", on )
 
+static void MergeNodeFacesTask (int iThread, int iWorkItem, void *pUserData)
+{
+	MergeNodeFaces ((*(CUtlVector<node_t *> *)pUserData)[iWorkItem]);
+}
+
 /*
 ============
 MakeFaces
@@ -1802,7 +1905,21 @@ void MakeFaces (node_t *node)
 	c_subdivide = 0;
 	c_nodefaces = 0;
 
-	MakeFaces_r (node);
+	if (g_nTreeThreads <= 1)
+	{
+		MakeFaces_r (node, true);
+	}
+	else
+	{
+		// A node's faces all come from the leafs under it and merging
+		// only looks at the one node, so once the leafs are done every
+		// node can be merged and subdivided on its own
+		MakeFaces_r (node, false);
+
+		CUtlVector<node_t *> nodes;
+		GetTreeNodes (node, nodes);
+		RunThreadsOnPool (nodes.Count(), g_nTreeThreads, MergeNodeFacesTask, &nodes);
+	}
 
 	qprintf ("%5i makefaces\n", c_nodefaces);
 	qprintf ("%5i merged\n", c_merge);
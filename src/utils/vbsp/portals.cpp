@@ -389,16 +389,13 @@ create the new portal by taking the full plane winding for the cutting plane
 and clipping it by all of parents of this node
 ==================
 */
-void MakeNodePortal (node_t *node)
+static void MakeNodePortalFromWinding (node_t *node, winding_t *w)
 {
 	portal_t	*new_portal, *p;
-	winding_t	*w;
 	Vector		normal;
 	float		dist = 0.0f;
 	int			side = 0;
 
-	w = BaseWindingForNode (node);
-
 	// clip the portal by all the other portals in the node
 	for (p = node->portals ; p && w; p = p->next[side])	
 	{
@@ -443,6 +440,11 @@ void MakeNodePortal (node_t *node)
 	AddPortalToNodes (new_portal, node->children[0], node->children[1]);
 }
 
+void MakeNodePortal (node_t *node)
+{
+	MakeNodePortalFromWinding (node, BaseWindingForNode (node));
+}
+
 
 /*
 ==============
@@ -572,7 +574,14 @@ void CalcNodeBounds (node_t *node)
 MakeTreePortals_r
 ==================
 */
-void MakeTreePortals_r (node_t *node)
+struct basewindings_t
+{
+	CUtlVector<node_t *>	nodes;
+	CUtlVector<winding_t *>	windings;
+	int						next;
+};
+
+void MakeTreePortals_r (node_t *node, basewindings_t *base)
 {
 	int		i;
 
@@ -602,22 +611,54 @@ void MakeTreePortals_r (node_t *node)
 	if (node->planenum == PLANENUM_LEAF)
 		return;
 
-	MakeNodePortal (node);
+	if (base)
+	{
+		// the windings are in the order this walk reaches the nodes
+		Assert (base->nodes[base->next] == node);
+		MakeNodePortalFromWinding (node, base->windings[base->next++]);
+	}
+	else
+	{
+		MakeNodePortal (node);
+	}
 	SplitNodePortals (node);
 
-	MakeTreePortals_r (node->children[0]);
-	MakeTreePortals_r (node->children[1]);
+	MakeTreePortals_r (node->children[0], base);
+	MakeTreePortals_r (node->children[1], base);
 }
 
 /*
 ==================
 MakeTreePortals
+
+The base winding of a node only depends on the planes above it, so with
+more than one thread they're all clipped up front and the serial walk just
+cuts them down by the portals already on the node.
 ==================
 */
+static void BaseWindingTask (int iThread, int iWorkItem, void *pUserData)
+{
+	basewindings_t *base = (basewindings_t *)pUserData;
+	base->windings[iWorkItem] = BaseWindingForNode (base->nodes[iWorkItem]);
+}
+
 void MakeTreePortals (tree_t *tree)
 {
 	MakeHeadnodePortals (tree);
-	MakeTreePortals_r (tree->headnode);
+
+	if (g_nTreeThreads <= 1)
+	{
+		MakeTreePortals_r (tree->headnode, NULL);
+		return;
+	}
+
+	basewindings_t base;
+	GetTreeNodes (tree->headnode, base.nodes);
+	base.windings.SetCount (base.nodes.Count());
+	base.next = 0;
+	RunThreadsOnPool (base.nodes.Count(), g_nTreeThreads, BaseWindingTask, &base);
+
+	MakeTreePortals_r (tree->headnode, &base);
 }
 
 /*
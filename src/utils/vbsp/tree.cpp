@@ -111,6 +111,24 @@ void FreeTree (tree_t *tree)
 	free (tree);
 }
 
+/*
+=============
+GetTreeNodes
+
+Lists the non-leaf nodes in the order a depth first walk that handles
+a node before its children reaches them
+=============
+*/
+void GetTreeNodes (node_t *node, CUtlVector<node_t *> &nodes)
+{
+	while (node->planenum != PLANENUM_LEAF)
+	{
+		nodes.AddToTail (node);
+		GetTreeNodes (node->children[0], nodes);
+		node = node->children[1];
+	}
+}
+
 //===============================================================
 
 void PrintTree_r (node_t *node, int depth)
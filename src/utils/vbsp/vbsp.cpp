@@ -56,6 +56,8 @@ bool		g_bKeepStaleZip = false;
 bool		g_NodrawTriggers = false;
 bool		g_DisableWaterLighting = false;
 bool		g_bAllowDetailCracks = false;
+int			g_nTreeThreads = 1;			// BrushBSP, MakeTreePortals, MakeFaces and FixTjuncs split their work over this many threads
+bool		g_bTimings = false;
 bool		g_bAllowDynamicPropsAsStatic = false;
 bool		g_bNoVirtualMesh = false;
 
@@ -86,6 +88,60 @@ int			entity_num;
 
 node_t		*block_nodes[BLOCKS_SPACE+2][BLOCKS_SPACE+2];
 
+//-----------------------------------------------------------------------------
+// Wall clock time spent in each compile stage, printed by -timings
+//-----------------------------------------------------------------------------
+struct StageTime_t
+{
+	const char	*m_pName;
+	double		m_flTime;
+	int			m_nCount;
+};
+
+static CUtlVector<StageTime_t> s_StageTimes;
+
+void AddStageTime( const char *pStage, double flStartTime )
+{
+	double flTime = Plat_FloatTime() - flStartTime;
+	for ( int i = 0; i < s_StageTimes.Count(); i++ )
+	{
+		if ( !Q_strcmp( s_StageTimes[i].m_pName, pStage ) )
+		{
+			s_StageTimes[i].m_flTime += flTime;
+			s_StageTimes[i].m_nCount++;
+			return;
+		}
+	}
+
+	StageTime_t &stage = s_StageTimes[ s_StageTimes.AddToTail() ];
+	stage.m_pName = pStage;
+	stage.m_flTime = flTime;
+	stage.m_nCount = 1;
+}
+
+static void PrintStageTimes( double flTotalTime )
+{
+	if ( flTotalTime <= 0.0 )
+		return;
+
+	Msg( "\nStage timings (%d threads):\n", g_nTreeThreads );
+
+	double flStages = 0.0;
+	for ( int i = 0; i < s_StageTimes.Count(); i++ )
+	{
+		const StageTime_t &stage = s_StageTimes[i];
+		Msg( "  %-20s %9.2fs %5.1f%%", stage.m_pName, stage.m_flTime, 100.0 * stage.m_flTime / flTotalTime );
+		if ( stage.m_nCount > 1 )
+		{
+			Msg( "  (%d runs)", stage.m_nCount );
+		}
+		Msg( "\n" );
+		flStages += stage.m_flTime;
+	}
+
+	Msg( "  %-20s %9.2fs %5.1f%%\n", "other", flTotalTime - flStages, 100.0 * ( flTotalTime - flStages ) / flTotalTime );
+}
+
 //-----------------------------------------------------------------------------
 // Assign occluder areas (must happen *after* the world model is processed)
 //-----------------------------------------------------------------------------
@@ -210,6 +266,7 @@ void ProcessWorldModel (void)
 	qboolean	leaked;
 	int	optimize;
 	int			start;
+	double		flStage;
 
 	e = &entities[entity_num];
 
@@ -259,8 +316,10 @@ void ProcessWorldModel (void)
 	{
 		qprintf ("--------------------------------------------\n");
 
+		flStage = Plat_FloatTime();
 		RunThreadsOnIndividual ((block_xh-block_xl+1)*(block_yh-block_yl+1),
 			!verbose, ProcessBlock_Thread);
+		AddStageTime ("BrushBSP", flStage);
 
 		//
 		// build the division tree
@@ -286,12 +345,19 @@ void ProcessWorldModel (void)
 		//
 
 		// make the portals/faces by traversing down to each empty leaf
+		flStage = Plat_FloatTime();
 		MakeTreePortals (tree);
+		AddStageTime ("MakeTreePortals", flStage);
 
-		if (FloodEntities (tree))
+		flStage = Plat_FloatTime();
+		qboolean bFlooded = FloodEntities (tree);
+		AddStageTime ("FloodEntities", flStage);
+		if (bFlooded)
 		{
 			// turns everthing outside into solid
+			flStage = Plat_FloatTime();
 			FillOutside (tree->headnode);
+			AddStageTime ("FillOutside", flStage);
 		}
 		else
 		{
@@ -306,7 +372,9 @@ void ProcessWorldModel (void)
 		}
 
 		// mark the brush sides that actually turned into faces
+		flStage = Plat_FloatTime();
 		MarkVisibleSides (tree, brush_start, brush_end, NO_DETAIL);
+		AddStageTime ("MarkVisibleSides", flStage);
 		if (noopt || leaked)
 			break;
 		if (!optimize)
@@ -318,7 +386,9 @@ void ProcessWorldModel (void)
 		}
 	}
 
+	flStage = Plat_FloatTime();
 	FloodAreas (tree);
+	AddStageTime ("FloodAreas", flStage);
 
 	RemoveAreaPortalBrushes_R( tree->headnode );
 
@@ -326,7 +396,9 @@ void ProcessWorldModel (void)
 	Msg("Building Faces...");
 	// this turns portals with one solid side into faces
 	// it also subdivides each face if necessary to fit max lightmap dimensions
+	flStage = Plat_FloatTime();
 	MakeFaces (tree->headnode);
+	AddStageTime ("MakeFaces", flStage);
 	Msg("done (%d)\n", (int)(Plat_FloatTime() - start) );
 
 	if (glview)
@@ -339,7 +411,9 @@ void ProcessWorldModel (void)
 	face_t *pLeafFaceList = NULL;
 	if ( !nodetail )
 	{
+		flStage = Plat_FloatTime();
 		pLeafFaceList = MergeDetailTree( tree, brush_start, brush_end );
+		AddStageTime ("MergeDetailTree", flStage);
 	}
 
 	start = Plat_FloatTime();
@@ -348,25 +422,33 @@ void ProcessWorldModel (void)
 	
 	// This unifies the vertex list for all edges (splits collinear edges to remove t-junctions)
 	// It also welds the list of vertices out of each winding/portal and rounds nearly integer verts to integer
+	flStage = Plat_FloatTime();
 	pLeafFaceList = FixTjuncs (tree->headnode, pLeafFaceList);
+	AddStageTime ("FixTjuncs", flStage);
 
 	// this merges all of the solid nodes that have separating planes
 	if (!noprune)
 	{
 		Msg("PruneNodes...\n");
+		flStage = Plat_FloatTime();
 		PruneNodes (tree->headnode);
+		AddStageTime ("PruneNodes", flStage);
 	}
 
 //	Msg( "SplitSubdividedFaces...\n" );
 //	SplitSubdividedFaces( tree->headnode );
 
 	Msg("WriteBSP...\n");
+	flStage = Plat_FloatTime();
 	WriteBSP (tree->headnode, pLeafFaceList);
+	AddStageTime ("WriteBSP", flStage);
 	Msg("done (%d)\n", (int)(Plat_FloatTime() - start) );
 
 	if (!leaked)
 	{
+		flStage = Plat_FloatTime();
 		WritePortalFile (tree);
+		AddStageTime ("WritePortalFile", flStage);
 	}
 
 	FreeTree( tree );
@@ -386,6 +468,7 @@ void ProcessSubModel( )
 	tree_t		*tree;
 	bspbrush_t	*list;
 	Vector		mins, maxs;
+	double		flStage;
 
 	e = &entities[entity_num];
 
@@ -396,9 +479,11 @@ void ProcessSubModel( )
 	maxs[0] = maxs[1] = maxs[2] = MAX_COORD_INTEGER;
 	list = MakeBspBrushList (start, end, mins, maxs, FULL_DETAIL);
 
+	flStage = Plat_FloatTime();
 	if (!nocsg)
 		list = ChopBrushes (list);
 	tree = BrushBSP (list, mins, maxs);
+	AddStageTime ("BrushBSP", flStage);
 	
 	// This would wind up crashing the engine because we'd have a negative leaf index in dmodel_t::headnode.
 	if ( tree->headnode->planenum == PLANENUM_LEAF )
@@ -408,18 +493,30 @@ void ProcessSubModel( )
 		Error( "bmodel %d has no head node (class '%s', targetname '%s')", entity_num, pClassName, pTargetName );
 	}
 
+	flStage = Plat_FloatTime();
 	MakeTreePortals (tree);
+	AddStageTime ("MakeTreePortals", flStage);
 	
 #if DEBUG_BRUSHMODEL
 	if ( entity_num == DEBUG_BRUSHMODEL )
 		WriteGLView( tree, "tree_all" );
 #endif
 
+	flStage = Plat_FloatTime();
 	MarkVisibleSides (tree, start, end, FULL_DETAIL);
+	AddStageTime ("MarkVisibleSides", flStage);
+
+	flStage = Plat_FloatTime();
 	MakeFaces (tree->headnode);
+	AddStageTime ("MakeFaces", flStage);
 
+	flStage = Plat_FloatTime();
 	FixTjuncs( tree->headnode, NULL );
+	AddStageTime ("FixTjuncs", flStage);
+
+	flStage = Plat_FloatTime();
 	WriteBSP( tree->headnode, NULL );
+	AddStageTime ("WriteBSP", flStage);
 	
 #if DEBUG_BRUSHMODEL
 	if ( entity_num == DEBUG_BRUSHMODEL )
@@ -831,7 +928,9 @@ void ProcessModels (void)
 
 	// Clip occluder brushes against each other, 
 	// Remove them from the list of models to process below
+	double flStage = Plat_FloatTime();
 	EmitOccluderBrushes( );
+	AddStageTime( "EmitOccluderBrushes", flStage );
 
 	for ( entity_num=0; entity_num < num_entities; ++entity_num )
 	{
@@ -863,7 +962,10 @@ void ProcessModels (void)
 	// Turn the skybox into a cubemap in case we don't build env_cubemap textures.
 	if (!nodefaultcubemap)
 		Cubemap_CreateDefaultCubemaps();
+
+	flStage = Plat_FloatTime();
 	EndBSPFile ();
+	AddStageTime( "EndBSPFile", flStage );
 }
 
 
@@ -922,6 +1024,10 @@ int RunVBSP( int argc, char **argv )
 		{
 			glview = true;
 		}
+		else if (!Q_stricmp(argv[i],"-timings"))
+		{
+			g_bTimings = true;
+		}
 		else if ( !Q_stricmp(argv[i], "-v") || !Q_stricmp(argv[i], "-verbose") )
 		{
 			Msg("verbose = true\n");
@@ -1208,8 +1314,10 @@ int RunVBSP( int argc, char **argv )
 			Warning(
 				"Other options  :\n"
 				"  -novconfig   : Don't bring up graphical UI on vproject errors.\n"
-				"  -threads     : Control the number of threads vbsp uses (defaults to the # of\n"
-				"                 processors on your machine).\n"
+				"  -threads     : Control the number of threads vbsp uses to build the BSP tree,\n"
+				"                 portals and faces\n"
+				"                 (defaults to the # of processors on your machine).\n"
+				"  -timings     : Print how much wall clock time each compile stage took.\n"
 				"  -verboseentities: If -v is on, this disables verbose output for submodels.\n"
 				"  -noweld      : Don't join face vertices together.\n"
 				"  -nocsg       : Don't chop out intersecting brush areas.\n"
@@ -1293,6 +1401,7 @@ int RunVBSP( int argc, char **argv )
 	}
 
 	ThreadSetDefault ();
+	g_nTreeThreads = numthreads;
 	numthreads = 1;		// multiple threads aren't helping...
 
 	// Setup the logfile.
@@ -1408,7 +1517,9 @@ int RunVBSP( int argc, char **argv )
 			AddBufferToPak( GetPakFile(), "stale.txt", "stale", strlen( "stale" ) + 1, false );
 		}
 
+		double flStage = Plat_FloatTime();
 		LoadMapFile (name);
+		AddStageTime( "LoadMapFile", flStage );
 		WorldVertexTransitionFixup();
 		if( ( g_nDXLevel == 0 ) || ( g_nDXLevel >= 70 ) )
 		{
@@ -1430,6 +1541,13 @@ int RunVBSP( int argc, char **argv )
 	}
 
 	end = Plat_FloatTime();
+
+	PrintWindingPoolStats();
+	PrintBrushPoolStats();
+	if ( g_bTimings )
+	{
+		PrintStageTimes( end - start );
+	}
 	
 	char str[512];
 	GetHourMinuteSecondsString( (int)( end - start ), str, sizeof( str ) );
@@ -365,6 +365,8 @@ extern	bool		g_snapAxialPlanes;
 extern	bool		g_NodrawTriggers;
 extern	bool		g_DisableWaterLighting;
 extern	bool		g_bAllowDetailCracks;
+extern	int			g_nTreeThreads;
+extern	bool		g_bTimings;
 extern	bool		g_bAllowDynamicPropsAsStatic;
 extern	bool		g_bNoVirtualMesh;
 extern	char		outbase[32];
@@ -377,6 +379,9 @@ bool 	LoadMapFile( const char *pszFileName );
 int		GetVertexnum( Vector& v );
 bool Is3DSkyboxArea( int area );
 
+// Adds the time since flStartTime (from Plat_FloatTime) to a compile stage, -timings prints them
+void AddStageTime( const char *pStage, double flStartTime );
+
 //=============================================================================
 
 // textures.c
@@ -475,6 +480,7 @@ void SplitBrush (bspbrush_t *brush, int planenum,
 tree_t *AllocTree (void);
 node_t *AllocNode (void);
 bspbrush_t *AllocBrush (int numsides);
+void PrintBrushPoolStats (void);
 int	CountBrushList (bspbrush_t *brushes);
 void FreeBrush (bspbrush_t *brushes);
 vec_t BrushVolume (bspbrush_t *brush);
@@ -582,6 +588,7 @@ void PrintTree_r (node_t *node, int depth);
 void FreeTreePortals_r (node_t *node);
 void PruneNodes_r (node_t *node);
 void PruneNodes (node_t *node);
+void GetTreeNodes (node_t *node, CUtlVector<node_t *> &nodes);
 
 // Returns true if the entity is a func_occluder
 bool IsFuncOccluder( int entity_num );
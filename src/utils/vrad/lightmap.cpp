@@ -2796,11 +2796,19 @@ bool PointsInWinding ( FourVectors const & point, winding_t *w, int &invalidBits
 	return true;
 }
 
+// -quality: neighborhood deviation (in perceptual intensity) that gets a sample
+// refined at quality 1, and how many times a sample's grid can be doubled
+#define SUPERSAMPLE_DEVIATION_THRESHOLD		0.03125f
+#define MAX_SUPERSAMPLE_LEVEL				3
+
+// faces listed by PrintSupersampleReport
+#define SUPERSAMPLE_REPORT_FACES			20
+
 //-----------------------------------------------------------------------------
 // Perform supersampling at a particular point
 //-----------------------------------------------------------------------------
 static int SupersampleLightAtPoint( lightinfo_t& l, SSE_SampleInfo_t& info,
-									int sampleIndex, int lightStyleIndex, LightingValue_t *pLight, int flags )
+									int sampleIndex, int lightStyleIndex, LightingValue_t *pLight, int flags, int nGridScale = 1 )
 {
 	sample_t& sample = info.m_pFaceLight->sample[sampleIndex];
 
@@ -2809,8 +2817,8 @@ static int SupersampleLightAtPoint( lightinfo_t& l, SSE_SampleInfo_t& info,
 	WorldToLuxelSpace( &l, sample.pos, temp );
 	Vector sampleLightOrigin( temp[0], temp[1], 0.0f );
 
-	// Some parameters related to supersampling
-	float sampleWidth = ( flags & NON_AMBIENT_ONLY ) ? 4 : 2;
+	// Some parameters related to supersampling, the grid scale refines it further
+	int sampleWidth = ( ( flags & NON_AMBIENT_ONLY ) ? 4 : 2 ) * nGridScale;
 	float cscale = 1.0f / sampleWidth;
 	float csshift = -((sampleWidth - 1) * cscale) / 2.0;
 
@@ -2826,49 +2834,53 @@ static int SupersampleLightAtPoint( lightinfo_t& l, SSE_SampleInfo_t& info,
 	FourVectors superSampleLightCoord;
 	FourVectors superSamplePosition;
 
-	if ( flags & NON_AMBIENT_ONLY )
+	if ( sampleWidth >= 4 )
 	{
-		float aRow[4];
-		for ( int coord = 0; coord < 4; ++coord )
-			aRow[coord] = csshift + coord * cscale;
-		fltx4 sseRow = LoadUnalignedSIMD( aRow );
-
-		for (int s = 0; s < 4; ++s)
+		// the grid is a multiple of 4 wide, trace it 4 samples at a time
+		for ( int col = 0; col < sampleWidth; col += 4 )
 		{
-			// make sure the coordinate is inside of the sample's winding and when normalizing
-			// below use the number of samples used, not just numsamples and some of them
-			// will be skipped if they are not inside of the winding
-			superSampleLightCoord.DuplicateVector( sampleLightOrigin );
-			superSampleLightCoord.x = AddSIMD( superSampleLightCoord.x, ReplicateX4( aRow[s] ) );
-			superSampleLightCoord.y = AddSIMD( superSampleLightCoord.y, sseRow );
-
-			// Figure out where the supersample exists in the world, and make sure
-			// it lies within the sample winding
-			LuxelSpaceToWorld( &l, superSampleLightCoord[0], superSampleLightCoord[1], superSamplePosition );
+			float aRow[4];
+			for ( int coord = 0; coord < 4; ++coord )
+				aRow[coord] = csshift + ( col + coord ) * cscale;
+			fltx4 sseRow = LoadUnalignedSIMD( aRow );
 
-			// A winding should exist only if the sample wasn't a uniform luxel, or if g_bDumpPatches is true.
-			int invalidBits = 0;
-			if ( sample.w && !PointsInWinding( superSamplePosition, sample.w, invalidBits ) )
-				continue;
+			for (int s = 0; s < sampleWidth; ++s)
+			{
+				// make sure the coordinate is inside of the sample's winding and when normalizing
+				// below use the number of samples used, not just numsamples and some of them
+				// will be skipped if they are not inside of the winding
+				superSampleLightCoord.DuplicateVector( sampleLightOrigin );
+				superSampleLightCoord.x = AddSIMD( superSampleLightCoord.x, ReplicateX4( csshift + s * cscale ) );
+				superSampleLightCoord.y = AddSIMD( superSampleLightCoord.y, sseRow );
+
+				// Figure out where the supersample exists in the world, and make sure
+				// it lies within the sample winding
+				LuxelSpaceToWorld( &l, superSampleLightCoord[0], superSampleLightCoord[1], superSamplePosition );
+
+				// A winding should exist only if the sample wasn't a uniform luxel, or if g_bDumpPatches is true.
+				int invalidBits = 0;
+				if ( sample.w && !PointsInWinding( superSamplePosition, sample.w, invalidBits ) )
+					continue;
 
-			// Compute the super-sample illumination point and normal
-			// We're assuming the flat normal is the same for all supersamples
-			ComputeIlluminationPointAndNormalsSSE( l, superSamplePosition, superSampleNormal, &info, 4 );
+				// Compute the super-sample illumination point and normal
+				// We're assuming the flat normal is the same for all supersamples
+				ComputeIlluminationPointAndNormalsSSE( l, superSamplePosition, superSampleNormal, &info, 4 );
 
-			// Resample the non-ambient light at this point...
-			LightingValue_t result[4][NUM_BUMP_VECTS+1];
-			ResampleLightAt4Points( info, lightStyleIndex, NON_AMBIENT_ONLY, result );
+				// Resample the light at this point...
+				LightingValue_t result[4][NUM_BUMP_VECTS+1];
+				ResampleLightAt4Points( info, lightStyleIndex, flags, result );
 
-			// Got more subsamples
-			for ( int i = 0; i < 4; i++ )
-			{
-				if ( !( ( invalidBits >> i ) & 0x1 ) )
+				// Got more subsamples
+				for ( int i = 0; i < 4; i++ )
 				{
-					for ( int n = 0; n < info.m_NormalCount; ++n )
+					if ( !( ( invalidBits >> i ) & 0x1 ) )
 					{
-						pLight[n].AddLight( result[i][n] );
+						for ( int n = 0; n < info.m_NormalCount; ++n )
+						{
+							pLight[n].AddLight( result[i][n] );
+						}
+						++subsampleCount;
 					}
-					++subsampleCount;
 				}
 			}
 		}
@@ -3058,6 +3070,7 @@ static void BuildSupersampleFaceLights( lightinfo_t& l, SSE_SampleInfo_t& info,
 
 			// Supersample the non-ambient light for each bump direction vector
 			int directSupersampleCount = SupersampleLightAtPoint( l, info, i, lightstyleIndex, pDirectLight, NON_AMBIENT_ONLY );
+			info.m_pFaceLight->numsupersamples += ambientSupersampleCount + directSupersampleCount;
 
 			// Because of sampling problems, small area triangles may have no samples.
 			// In this case, just use what we already have
@@ -3095,6 +3108,227 @@ static void BuildSupersampleFaceLights( lightinfo_t& l, SSE_SampleInfo_t& info,
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Compute the standard deviation of the intensity over each sample's 3x3
+// neighborhood, the maximum of all bumped lightmaps. Only luxels that have
+// a sample are looked at, the others have no intensity.
+//-----------------------------------------------------------------------------
+static void ComputeLightmapDeviations( SSE_SampleInfo_t& info, bool const* pHasLuxel, bool const* pConverged,
+									   float const* pIntensity, float* pDeviation )
+{
+	int w = info.m_LightmapWidth;
+	int h = info.m_LightmapHeight;
+	facelight_t* fl = info.m_pFaceLight;
+
+	for (int i=0 ; i<fl->numsamples ; i++)
+	{
+		if (pConverged[i])
+			continue;
+
+		pDeviation[i] = 0.0f;
+		sample_t& sample = fl->sample[i];
+
+		for ( int n = 0; n < info.m_NormalCount; ++n )
+		{
+			float const* pNormalIntensity = pIntensity + n * info.m_LightmapSize;
+			float flSum = 0.0f;
+			float flSumSq = 0.0f;
+			int nCount = 0;
+
+			for ( int t = max( sample.t - 1, 0 ); t <= min( sample.t + 1, h - 1 ); ++t )
+			{
+				for ( int s = max( sample.s - 1, 0 ); s <= min( sample.s + 1, w - 1 ); ++s )
+				{
+					int j = s + t * w;
+					if ( !pHasLuxel[j] )
+						continue;
+
+					flSum += pNormalIntensity[j];
+					flSumSq += pNormalIntensity[j] * pNormalIntensity[j];
+					++nCount;
+				}
+			}
+
+			if ( nCount < 2 )
+				continue;
+
+			float flMean = flSum / nCount;
+			float flVariance = max( flSumSq / nCount - flMean * flMean, 0.0f );
+			pDeviation[i] = max( pDeviation[i], sqrtf( flVariance ) );
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Error driven supersampling for -quality. Samples whose neighborhood varies
+// more than the threshold get supersampled on a grid that doubles every time
+// they're refined; a sample stops once another refinement barely changes it
+// or it reaches the finest grid. Uniform areas never get past the first test.
+//-----------------------------------------------------------------------------
+static void BuildAdaptiveSupersampleFaceLights( lightinfo_t& l, SSE_SampleInfo_t& info, int lightstyleIndex )
+{
+	LightingValue_t pAmbientLight[NUM_BUMP_VECTS+1];
+	LightingValue_t pDirectLight[NUM_BUMP_VECTS+1];
+
+	facelight_t* fl = info.m_pFaceLight;
+	float flThreshold = SUPERSAMPLE_DEVIATION_THRESHOLD / g_flSupersampleQuality;
+
+	// Which luxels have a sample, and therefore an intensity
+	int hasLuxelSize = info.m_LightmapSize * sizeof(bool);
+	bool* pHasLuxel = (bool*)stackalloc( hasLuxelSize );
+	memset( pHasLuxel, 0, hasLuxelSize );
+	for (int i=0 ; i<fl->numsamples ; ++i)
+	{
+		pHasLuxel[fl->sample[i].s + fl->sample[i].t * info.m_LightmapWidth] = true;
+	}
+
+	// How many times each sample has been refined, and whether it's done
+	int* pLevel = (int*)stackalloc( fl->numsamples * sizeof(int) );
+	memset( pLevel, 0, fl->numsamples * sizeof(int) );
+	bool* pConverged = (bool*)stackalloc( fl->numsamples * sizeof(bool) );
+	memset( pConverged, 0, fl->numsamples * sizeof(bool) );
+
+	float* pDeviation = (float*)stackalloc( fl->numsamples * sizeof(float) );
+	float* pSampleIntensity = (float*)stackalloc( info.m_NormalCount * info.m_LightmapSize * sizeof(float) );
+
+	LightingValue_t **ppLightSamples = fl->light[lightstyleIndex];
+	ComputeSampleIntensities( info, ppLightSamples, pSampleIntensity );
+
+	bool do_anotherpass = true;
+	int pass = 1;
+	while (do_anotherpass && pass <= extrapasses)
+	{
+		ComputeLightmapDeviations( info, pHasLuxel, pConverged, pSampleIntensity, pDeviation );
+
+		do_anotherpass = false;
+
+		for (int i=0 ; i<fl->numsamples; ++i)
+		{
+			if (pConverged[i])
+				continue;
+
+			// Don't refine if the lighting is pretty uniform near the sample
+			if (pDeviation[i] < flThreshold)
+				continue;
+
+			do_anotherpass = true;
+			int nLevel = ++pLevel[i];
+			if ( nLevel >= MAX_SUPERSAMPLE_LEVEL )
+			{
+				pConverged[i] = true;
+			}
+
+			int ambientSupersampleCount = SupersampleLightAtPoint( l, info, i, lightstyleIndex, pAmbientLight, AMBIENT_ONLY, 1 << ( nLevel - 1 ) );
+			int directSupersampleCount = SupersampleLightAtPoint( l, info, i, lightstyleIndex, pDirectLight, NON_AMBIENT_ONLY, 1 << ( nLevel - 1 ) );
+			fl->numsupersamples += ambientSupersampleCount + directSupersampleCount;
+
+			// Small area triangles may have no samples, a finer grid won't find any either
+			if ( ambientSupersampleCount <= 0 || directSupersampleCount <= 0 )
+			{
+				pConverged[i] = true;
+				continue;
+			}
+
+			sample_t& sample = fl->sample[i];
+			int luxelIdx = sample.s + sample.t * info.m_LightmapWidth;
+			float flOldIntensity[NUM_BUMP_VECTS+1];
+			for (int n = 0; n < info.m_NormalCount; ++n)
+			{
+				flOldIntensity[n] = pSampleIntensity[n * info.m_LightmapSize + luxelIdx];
+
+				ppLightSamples[n][i].Zero();
+				ppLightSamples[n][i].AddWeighted( pDirectLight[n], 1.0f / directSupersampleCount );
+				ppLightSamples[n][i].AddWeighted( pAmbientLight[n], 1.0f / ambientSupersampleCount );
+			}
+
+			ComputeLuxelIntensity( info, i, ppLightSamples, pSampleIntensity );
+
+			// Done once the estimate has stopped moving
+			float flChange = 0.0f;
+			for (int n = 0; n < info.m_NormalCount; ++n)
+			{
+				flChange = max( flChange, fabsf( pSampleIntensity[n * info.m_LightmapSize + luxelIdx] - flOldIntensity[n] ) );
+			}
+			if ( flChange < flThreshold )
+			{
+				pConverged[i] = true;
+			}
+		}
+
+		pass++;
+	}
+
+	if (debug_extra)
+	{
+		// Color each sample by how far it was refined: none, red, green, blue
+		static const Vector s_LevelColors[MAX_SUPERSAMPLE_LEVEL + 1] =
+		{
+			Vector( 0, 0, 0 ), Vector( 255, 0, 0 ), Vector( 0, 255, 0 ), Vector( 0, 0, 255 )
+		};
+
+		for (int i=0 ; i<fl->numsamples ; ++i)
+		{
+			const Vector &vecLevel = s_LevelColors[ clamp( pLevel[i], 0, MAX_SUPERSAMPLE_LEVEL ) ];
+			for (int j = 0; j <info.m_NormalCount; ++j)
+			{
+				VectorCopy( vecLevel, ppLightSamples[j][i].m_vecLighting );
+			}
+		}
+	}
+}
+
+static int SupersampleReportSortFn( const int *pFace1, const int *pFace2 )
+{
+	return facelight[*pFace2].numsupersamples - facelight[*pFace1].numsupersamples;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Prints how many samples supersampling took and the faces that
+//			took the most of them, to find what's making -extra slow.
+//-----------------------------------------------------------------------------
+void PrintSupersampleReport( void )
+{
+	double flSamples = 0;
+	double flSupersamples = 0;
+	CUtlVector<int> faces;
+	for ( int i = 0; i < numfaces; ++i )
+	{
+		flSamples += facelight[i].numsamples;
+		flSupersamples += facelight[i].numsupersamples;
+		if ( facelight[i].numsupersamples > 0 )
+		{
+			faces.AddToTail( i );
+		}
+	}
+
+	Msg( "Supersampling: %.0f subsamples for %.0f samples on %d faces\n", flSupersamples, flSamples, faces.Count() );
+	if ( !faces.Count() )
+		return;
+
+	faces.Sort( SupersampleReportSortFn );
+
+	int nReport = min( faces.Count(), SUPERSAMPLE_REPORT_FACES );
+	for ( int i = 0; i < nReport; ++i )
+	{
+		int facenum = faces[i];
+		facelight_t *fl = &facelight[facenum];
+		texinfo_t *tex = &texinfo[g_pFaces[facenum].texinfo];
+		const char *pMaterial = TexDataStringTable_GetString( dtexdata[tex->texdata].nameStringTableID );
+
+		Vector vecCenter( 0, 0, 0 );
+		winding_t *w = WindingFromFace( &g_pFaces[facenum], face_offset[facenum] );
+		if ( w )
+		{
+			WindingCenter( w, vecCenter );
+			FreeWinding( w );
+		}
+
+		Msg( "  face %5d: %7d subsamples (%5.1f per sample) at (%g, %g, %g) material=%s\n",
+			facenum, fl->numsupersamples, fl->numsamples ? (float)fl->numsupersamples / fl->numsamples : 0.0f,
+			(double)vecCenter.x, (double)vecCenter.y, (double)vecCenter.z, pMaterial );
+	}
+}
+
 void InitLightinfo( lightinfo_t *pl, int facenum )
 {
 	dface_t		*f;
@@ -3217,6 +3451,7 @@ void BuildFacelights (int iThread, int facenum)
 		return;
 
 	fl = &facelight[facenum];
+	fl->numsupersamples = 0;
 
 	InitLightinfo( &l, facenum );
 	CalcPoints( &l, fl, facenum );
@@ -3286,7 +3521,14 @@ void BuildFacelights (int iThread, int facenum)
 			if (f->styles[i] == 255)
 				break;
 
-			BuildSupersampleFaceLights( l, sampleInfo, i );
+			if ( g_flSupersampleQuality > 0.0f )
+			{
+				BuildAdaptiveSupersampleFaceLights( l, sampleInfo, i );
+			}
+			else
+			{
+				BuildSupersampleFaceLights( l, sampleInfo, i );
+			}
 		}
 	}
 
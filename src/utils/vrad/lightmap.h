@@ -79,6 +79,8 @@ struct facelight_t
 	Vector		*luxel;				// world space position of luxel
 	Vector		*luxelNormals;		// world space normal of luxel
 	float		worldAreaPerLuxel;
+
+	int			numsupersamples;	// subsamples taken by the -extra pass
 };
 
 extern directlight_t	*activelights;
@@ -102,6 +102,7 @@ bool		debug_extra = false;
 qboolean	do_fast = false;
 qboolean	do_centersamples = false;
 int			extrapasses = 4;
+float		g_flSupersampleQuality = 0.0f;	// > 0 when -quality turns on adaptive supersampling
 float		smoothing_threshold = 0.7071067; // cos(45.0*(M_PI/180)) 
 // Cosine of smoothing angle(in radians)
 float		coring = 1.0;	// Light threshold to force to blackness(minimizes lightmaps)
@@ -1951,6 +1952,12 @@ bool RadWorld_Go()
 	else 
 	{
 		RunThreadsOnIndividual (numfaces, true, BuildFacelights);
+
+		// the worker's sample counts don't come back over MPI, so only report locally
+		if ( do_extra && !g_pIncremental && ( g_flSupersampleQuality > 0.0f || verbose ) )
+		{
+			PrintSupersampleReport();
+		}
 	}
 
 	// Was the process interrupted?
@@ -2263,6 +2270,8 @@ void VRAD_Finish()
 
 	StaticPropMgr()->Shutdown();
 
+	PrintWindingPoolStats();
+
 	double end = Plat_FloatTime();
 	
 	char str[512];
@@ -2417,6 +2426,18 @@ int ParseCommandLine( int argc, char **argv, bool *onlydetail )
 		{
 			debug_extra = true;
 		}
+		else if (!Q_stricmp(argv[i],"-quality"))
+		{
+			if ( ++i < argc && *argv[i] && Q_atof( argv[i] ) > 0.0f )
+			{
+				g_flSupersampleQuality = Q_atof( argv[i] );
+			}
+			else
+			{
+				Warning("Error: expected a positive quality after '-quality'\n" );
+				return -1;
+			}
+		}
 		else if ( !Q_stricmp(argv[i], "-fastambient") )
 		{
 			g_bFastAmbient = true;
@@ -2757,6 +2778,9 @@ void PrintUsage( int argc, char **argv )
 		"  -noextra        : Disable supersampling.\n"
 		"  -debugextra     : Places debugging data in lightmaps to visualize\n"
 		"                    supersampling.\n"
+		"  -quality #      : Supersample adaptively, refining luxels until they stop\n"
+		"                    changing. Higher is finer (1 is a good start), also\n"
+		"                    reports the faces that took the most samples.\n"
 		"  -smooth #       : Set the threshold for smoothing groups, in degrees\n"
 		"                    (default 45).\n"
 		"  -dlightmap      : Force direct lighting into different lightmap than\n"
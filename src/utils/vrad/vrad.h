@@ -324,6 +324,7 @@ extern  qboolean do_extra;
 extern  qboolean do_fast;
 extern  qboolean do_centersamples;
 extern  int extrapasses;
+extern  float g_flSupersampleQuality;
 extern	Vector ambient;
 extern  float maxlight;
 extern	unsigned numbounce;
@@ -364,6 +365,7 @@ qboolean IsIncremental(char *filename);
 int SaveIncremental(char *filename);
 int PartialHead (void);
 void BuildFacelights (int facenum, int threadnum);
+void PrintSupersampleReport( void );
 void PrecompLightmapOffsets();
 void FinalLightFace (int threadnum, int facenum);
 void PvsForOrigin (Vector& org, byte *pvs);
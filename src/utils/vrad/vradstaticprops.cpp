@@ -42,6 +42,9 @@
 
 #define ALIGN_TO_POW2(x,y) (((x)+(y-1))&~(y-1))
 
+// static prop vertexes are handed to the lighting threads in blocks this big
+#define STATIC_PROP_VERTEX_BLOCK_SIZE	64
+
 // identifies a vertex embedded in solid
 // lighting will be copied from nearest valid neighbor
 struct badVertex_t
@@ -266,8 +269,13 @@ class CVradStaticPropMgr : public IVradStaticPropMgr
 	void VMPI_ReceiveStaticPropResults( int iStaticProp, MessageBuffer *pBuf, int iWorker );
 
 	// local thread version
-	static void ThreadComputeStaticPropLighting( int iThread, void *pUserData );
-	void ComputeLightingForProp( int iThread, int iStaticProp );
+	static void ThreadComputeStaticPropVertexLighting( int iThread, void *pUserData );
+	static void ThreadFinishStaticPropLighting( int iThread, void *pUserData );
+	void FinishLightingForProp( int iThread, int iStaticProp );
+
+	// Props that would light identically
+	static int CompareStaticPropLighting( const int *pProp1, const int *pProp2 );
+	void FindSharedLighting();
 
 	// Methods associated with unserializing static props
 	void UnserializeModelDict( CUtlBuffer& buf );
@@ -342,13 +350,33 @@ class CVradStaticPropMgr : public IVradStaticPropMgr
 		Ray_t const* m_pRay;
 	};
 
+	// A run of one mesh's vertexes, the unit of work for the lighting threads
+	struct PropVertexBlock_t
+	{
+		int						m_nProp;
+		mstudiomesh_t			*m_pStudioMesh;
+		CUtlVector<colorVertex_t>	*m_pColorVerts;		// the model's vertex colors
+		int						m_nFirstVertex;			// in the mesh
+		int						m_nVertexCount;
+		int						m_nFirstColorVertex;	// in m_pColorVerts
+	};
+
 	// The list of all static props
 	CUtlVector <StaticPropDict_t>	m_StaticPropDict;
 	CUtlVector <CStaticProp>		m_StaticProps;
 
 	bool m_bIgnoreStaticPropTrace;
 
+	// Threaded lighting state, only valid inside ComputeLighting( int iThread )
+	CUtlVector <PropVertexBlock_t>	m_VertexBlocks;
+	CUtlVector <CComputeStaticPropLightingResults *>	m_LightingResults;
+	CUtlVector <int>				m_SharedLighting;	// prop whose lighting each prop uses
+	CUtlVector <int>				m_LightingCopies;	// copies still waiting on each prop's lighting
+
 	void ComputeLighting( CStaticProp &prop, int iThread, int prop_index, CComputeStaticPropLightingResults *pResults );
+	void SetupLighting( CStaticProp &prop, int prop_index, CComputeStaticPropLightingResults *pResults, CUtlVector<PropVertexBlock_t> &blocks );
+	void LightVertexBlock( int iThread, const PropVertexBlock_t &block );
+	void FinishLighting( CStaticProp &prop, int iThread, int prop_index, CComputeStaticPropLightingResults *pResults );
 	void ApplyLightingToStaticProp( int iStaticProp, CStaticProp &prop, const CComputeStaticPropLightingResults *pResults );
 
 	void SerializeLighting();
@@ -1185,17 +1213,39 @@ bool PositionInSolid( Vector &position )
 }
 
 //-----------------------------------------------------------------------------
-// Trace from a vertex to each direct light source, accumulating its contribution.
+// Trace from up to four vertexes to each direct light source, accumulating
+// their contributions. The vertexes share each light's trace, unused lanes
+// repeat the last vertex.
 //-----------------------------------------------------------------------------
-void ComputeDirectLightingAtPoint( Vector &position, Vector &normal, Vector &outColor, int iThread,
-								   int static_prop_id_to_skip=-1, int nLFlags = 0)
+static void ComputeDirectLightingAt4Points( const Vector *pPositions, const Vector *pNormals, int nPoints, Vector *pOutColors,
+											int iThread, int static_prop_id_to_skip=-1, int nLFlags = 0 )
 {
-	SSE_sampleLightOutput_t	sampleOutput;
+	Assert( nPoints > 0 && nPoints <= 4 );
 
-	outColor.Init();
+	Vector vecPositions[4];
+	Vector vecNormals[4];
+	int cluster[4];
+	for ( int i = 0; i < 4; ++i )
+	{
+		int nPoint = min( i, nPoints - 1 );
+		vecPositions[i] = pPositions[nPoint];
+		vecNormals[i] = pNormals[nPoint];
+		cluster[i] = ( i < nPoints ) ? ClusterFromPoint( vecPositions[i] ) : cluster[nPoints - 1];
+	}
+
+	for ( int i = 0; i < nPoints; ++i )
+	{
+		pOutColors[i].Init();
+	}
+
+	FourVectors position4;
+	FourVectors normal4;
+	position4.LoadAndSwizzle( vecPositions[0], vecPositions[1], vecPositions[2], vecPositions[3] );
+	normal4.LoadAndSwizzle( vecNormals[0], vecNormals[1], vecNormals[2], vecNormals[3] );
+
+	SSE_sampleLightOutput_t	sampleOutput;
 
 	// Iterate over all direct lights and accumulate their contribution
-	int cluster = ClusterFromPoint( position );
 	for ( directlight_t *dl = activelights; dl != NULL; dl = dl->next )
 	{
 		if ( dl->light.style )
@@ -1205,46 +1255,63 @@ void ComputeDirectLightingAtPoint( Vector &position, Vector &normal, Vector &out
 		}
 
 		// is this lights cluster visible?
-		if ( !PVSCheck( dl->pvs, cluster ) )
+		bool bVisible[4];
+		bool bAnyVisible = false;
+		for ( int i = 0; i < nPoints; ++i )
+		{
+			bVisible[i] = PVSCheck( dl->pvs, cluster[i] ) != 0;
+			bAnyVisible = bAnyVisible || bVisible[i];
+		}
+		if ( !bAnyVisible )
 			continue;
 
-		// push the vertex towards the light to avoid surface acne
-		Vector adjusted_pos = position;
-		float flEpsilon = 0.0;
+		// push the vertexes towards the light to avoid surface acne
+		FourVectors adjusted_pos4 = position4;
+		FourVectors fudge;
 
 		if  (dl->light.type != emit_skyambient)
 		{
 			// push towards the light
-			Vector fudge;
 			if ( dl->light.type == emit_skylight )
-				fudge = -( dl->light.normal);
+				fudge.DuplicateVector( -dl->light.normal );
 			else
 			{
-				fudge = dl->light.origin-position;
-				VectorNormalize( fudge );
+				fudge.DuplicateVector( dl->light.origin );
+				fudge -= position4;
+				fudge.VectorNormalize();
 			}
-			fudge *= 4.0;
-			adjusted_pos += fudge;
 		}
 		else
 		{
 			// push out along normal
-			adjusted_pos += 4.0 * normal;
-//			flEpsilon = 1.0;
+			fudge = normal4;
 		}
-
-		FourVectors adjusted_pos4;
-		FourVectors normal4;
-		adjusted_pos4.DuplicateVector( adjusted_pos );
-		normal4.DuplicateVector( normal );
+		fudge *= 4.0f;
+		adjusted_pos4 += fudge;
 
 		GatherSampleLightSSE( sampleOutput, dl, -1, adjusted_pos4, &normal4, 1, iThread, nLFlags | GATHERLFLAGS_FORCE_FAST,
-		                      static_prop_id_to_skip, flEpsilon );
+		                      static_prop_id_to_skip, 0.0f );
 
-		VectorMA( outColor, sampleOutput.m_flFalloff.m128_f32[0] * sampleOutput.m_flDot[0].m128_f32[0], dl->light.intensity, outColor );
+		fltx4 scale = MulSIMD( sampleOutput.m_flFalloff, sampleOutput.m_flDot[0] );
+		for ( int i = 0; i < nPoints; ++i )
+		{
+			if ( bVisible[i] )
+			{
+				VectorMA( pOutColors[i], SubFloat( scale, i ), dl->light.intensity, pOutColors[i] );
+			}
+		}
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Trace from a vertex to each direct light source, accumulating its contribution.
+//-----------------------------------------------------------------------------
+void ComputeDirectLightingAtPoint( Vector &position, Vector &normal, Vector &outColor, int iThread,
+								   int static_prop_id_to_skip=-1, int nLFlags = 0)
+{
+	ComputeDirectLightingAt4Points( &position, &normal, 1, &outColor, iThread, static_prop_id_to_skip, nLFlags );
+}
+
 //-----------------------------------------------------------------------------
 // Takes the results from a ComputeLighting call and applies it to the static prop in question.
 //-----------------------------------------------------------------------------
@@ -1342,14 +1409,11 @@ void CVradStaticPropMgr::ApplyLightingToStaticProp( int iStaticProp, CStaticProp
 }
 
 //-----------------------------------------------------------------------------
-// Trace rays from each unique vertex, accumulating direct and indirect
-// sources at each ray termination. Use the winding data to distribute the unique vertexes
-// into the rendering layout.
+// Allocates the vertex colors for each of the prop's models and splits its
+// vertexes into blocks for the worker threads to light.
 //-----------------------------------------------------------------------------
-void CVradStaticPropMgr::ComputeLighting( CStaticProp &prop, int iThread, int prop_index, CComputeStaticPropLightingResults *pResults )
+void CVradStaticPropMgr::SetupLighting( CStaticProp &prop, int prop_index, CComputeStaticPropLightingResults *pResults, CUtlVector<PropVertexBlock_t> &blocks )
 {
-	CUtlVector<badVertex_t>		badVerts;
-
 	StaticPropDict_t &dict = m_StaticPropDict[prop.m_ModelIdx];
 	studiohdr_t	*pStudioHdr = dict.m_pStudioHdr;
 	OptimizedModel::FileHeader_t *pVtxHdr = (OptimizedModel::FileHeader_t *)dict.m_VtxBuf.Base();
@@ -1366,15 +1430,148 @@ void CVradStaticPropMgr::ComputeLighting( CStaticProp &prop, int iThread, int pr
 	if (!withVertexLighting && !withTexelLighting)
 		return;
 
-	const int skip_prop = (g_bDisablePropSelfShadowing || (prop.m_Flags & STATIC_PROP_NO_SELF_SHADOWING)) ? prop_index : -1;
+	for ( int bodyID = 0; bodyID < pStudioHdr->numbodyparts; ++bodyID )
+	{
+		mstudiobodyparts_t *pBodyPart = pStudioHdr->pBodypart( bodyID );
+
+		for ( int modelID = 0; modelID < pBodyPart->nummodels; ++modelID )
+		{
+			mstudiomodel_t *pStudioModel = pBodyPart->pModel( modelID );
+
+			// light all unique vertexes
+			CUtlVector<colorVertex_t> *pColorVertsArray = new CUtlVector<colorVertex_t>;
+			pResults->m_ColorVertsArrays.AddToTail( pColorVertsArray );
+
+			CUtlVector<colorVertex_t> &colorVerts = *pColorVertsArray;
+			colorVerts.EnsureCount( pStudioModel->numvertices );
+			memset( colorVerts.Base(), 0, colorVerts.Count() * sizeof(colorVertex_t) );
+
+			// If we do lightmapping, we also do vertex lighting as a potential fallback. This may change.
+			int numVertexes = 0;
+			for ( int meshID = 0; meshID < pStudioModel->nummeshes; ++meshID )
+			{
+				mstudiomesh_t *pStudioMesh = pStudioModel->pMesh( meshID );
+
+				for ( int vertexID = 0; vertexID < pStudioMesh->numvertices; vertexID += STATIC_PROP_VERTEX_BLOCK_SIZE )
+				{
+					PropVertexBlock_t &block = blocks[blocks.AddToTail()];
+					block.m_nProp = prop_index;
+					block.m_pStudioMesh = pStudioMesh;
+					block.m_pColorVerts = pColorVertsArray;
+					block.m_nFirstVertex = vertexID;
+					block.m_nVertexCount = min( STATIC_PROP_VERTEX_BLOCK_SIZE, pStudioMesh->numvertices - vertexID );
+					block.m_nFirstColorVertex = numVertexes + vertexID;
+				}
+
+				numVertexes += pStudioMesh->numvertices;
+			}
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Trace rays from a block of vertexes four at a time, accumulating direct and
+// indirect sources at each ray termination. Vertexes in solid are left invalid
+// for FinishLighting to recover once the whole model is lit.
+//-----------------------------------------------------------------------------
+void CVradStaticPropMgr::LightVertexBlock( int iThread, const PropVertexBlock_t &block )
+{
+	CStaticProp &prop = m_StaticProps[block.m_nProp];
+	studiohdr_t	*pStudioHdr = m_StaticPropDict[prop.m_ModelIdx].m_pStudioHdr;
+	const mstudio_meshvertexdata_t *vertData = block.m_pStudioMesh->GetVertexData((void *)pStudioHdr);
+
+	Assert(vertData); // This can only return NULL on X360 for now
+
+	const int skip_prop = (g_bDisablePropSelfShadowing || (prop.m_Flags & STATIC_PROP_NO_SELF_SHADOWING)) ? block.m_nProp : -1;
 	const int nFlags = ( prop.m_Flags & STATIC_PROP_IGNORE_NORMALS ) ? GATHERLFLAGS_IGNORE_NORMALS : 0;
 
-	VMPI_SetCurrentStage( "ComputeLighting" );
+	matrix3x4_t	matPos, matNormal;
+	AngleMatrix(prop.m_Angles, prop.m_Origin, matPos);
+	AngleMatrix(prop.m_Angles, matNormal);
+
+	CUtlVector<colorVertex_t> &colorVerts = *block.m_pColorVerts;
+
+	for ( int nGroup = 0; nGroup < block.m_nVertexCount; nGroup += 4 )
+	{
+		Vector samplePositions[4];
+		Vector sampleNormals[4];
+		int colorVertexIDs[4];
+		int nPoints = 0;
+
+		int nGroupEnd = min( nGroup + 4, block.m_nVertexCount );
+		for ( int i = nGroup; i < nGroupEnd; ++i )
+		{
+			// transform position and normal into world coordinate system
+			VectorTransform(*vertData->Position(block.m_nFirstVertex + i), matPos, samplePositions[nPoints]);
+			VectorTransform(*vertData->Normal(block.m_nFirstVertex + i), matNormal, sampleNormals[nPoints]);
+
+			// vertex is in solid, leave it for the recovery pass
+			if ( PositionInSolid( samplePositions[nPoints] ) )
+				continue;
+
+			colorVertexIDs[nPoints++] = block.m_nFirstColorVertex + i;
+		}
+
+		if ( !nPoints )
+			continue;
+
+		Vector directColors[4];
+		ComputeDirectLightingAt4Points( samplePositions, sampleNormals, nPoints, directColors, iThread, skip_prop, nFlags );
+
+		for ( int i = 0; i < nPoints; ++i )
+		{
+			Vector indirectColor(0,0,0);
+
+			if (g_bShowStaticPropNormals)
+			{
+				directColors[i] = sampleNormals[i];
+				directColors[i] += Vector(1.0,1.0,1.0);
+				directColors[i] *= 50.0;
+			}
+			else
+			{
+				if (numbounce >= 1)
+					ComputeIndirectLightingAtPoint(
+						samplePositions[i], sampleNormals[i],
+						indirectColor, iThread, true,
+						( prop.m_Flags & STATIC_PROP_IGNORE_NORMALS) != 0 );
+			}
+
+			colorVertex_t &colorVert = colorVerts[colorVertexIDs[i]];
+			colorVert.m_bValid = true;
+			colorVert.m_Position = samplePositions[i];
+			VectorAdd( directColors[i], indirectColor, colorVert.m_Color );
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Once all of a prop's vertex blocks are lit: computes its lightmaps and
+// relights the vertexes that were in solid from a nearby valid position.
+//-----------------------------------------------------------------------------
+void CVradStaticPropMgr::FinishLighting( CStaticProp &prop, int iThread, int prop_index, CComputeStaticPropLightingResults *pResults )
+{
+	// SetupLighting bailed on this prop
+	if ( !pResults->m_ColorVertsArrays.Count() )
+		return;
+
+	CUtlVector<badVertex_t>		badVerts;
+
+	StaticPropDict_t &dict = m_StaticPropDict[prop.m_ModelIdx];
+	studiohdr_t	*pStudioHdr = dict.m_pStudioHdr;
+	OptimizedModel::FileHeader_t *pVtxHdr = (OptimizedModel::FileHeader_t *)dict.m_VtxBuf.Base();
+
+	const bool withTexelLighting = (prop.m_Flags & STATIC_PROP_NO_PER_TEXEL_LIGHTING) == 0;
+
+	const int skip_prop = (g_bDisablePropSelfShadowing || (prop.m_Flags & STATIC_PROP_NO_SELF_SHADOWING)) ? prop_index : -1;
+	const int nFlags = ( prop.m_Flags & STATIC_PROP_IGNORE_NORMALS ) ? GATHERLFLAGS_IGNORE_NORMALS : 0;
 
 	matrix3x4_t	matPos, matNormal;
 	AngleMatrix(prop.m_Angles, prop.m_Origin, matPos);
 	AngleMatrix(prop.m_Angles, matNormal);
 
+	int iCurColorVertsArray = 0;
+
 	for ( int bodyID = 0; bodyID < pStudioHdr->numbodyparts; ++bodyID )
 	{
 		OptimizedModel::BodyPartHeader_t* pVtxBodyPart = pVtxHdr->pBodyPart( bodyID );
@@ -1391,13 +1588,7 @@ void CVradStaticPropMgr::ComputeLighting( CStaticProp &prop, int iThread, int pr
 				pResults->m_ColorTexelsArrays.AddToTail(pColorTexelArray);
 			}
 
-			// light all unique vertexes
-			CUtlVector<colorVertex_t> *pColorVertsArray = new CUtlVector<colorVertex_t>;
-			pResults->m_ColorVertsArrays.AddToTail( pColorVertsArray );
-
-			CUtlVector<colorVertex_t> &colorVerts = *pColorVertsArray;
-			colorVerts.EnsureCount( pStudioModel->numvertices );
-			memset( colorVerts.Base(), 0, colorVerts.Count() * sizeof(colorVertex_t) );
+			CUtlVector<colorVertex_t> &colorVerts = *pResults->m_ColorVertsArrays[iCurColorVertsArray++];
 
 			int numVertexes = 0;
 			for ( int meshID = 0; meshID < pStudioModel->nummeshes; ++meshID )
@@ -1407,63 +1598,22 @@ void CVradStaticPropMgr::ComputeLighting( CStaticProp &prop, int iThread, int pr
 
 				Assert(vertData); // This can only return NULL on X360 for now
 
-				// TODO: Move this into its own function. In fact, refactor this whole function.
 				if (withTexelLighting)
 				{
 					GenerateLightmapSamplesForMesh( matPos, matNormal, iThread, skip_prop, nFlags, prop.m_LightmapImageWidth, prop.m_LightmapImageHeight, pStudioHdr, pStudioModel, pVtxModel, meshID, pResults );
 				}
 
-				// If we do lightmapping, we also do vertex lighting as a potential fallback. This may change.
-				for ( int vertexID = 0; vertexID < pStudioMesh->numvertices; ++vertexID )
+				// collect the vertexes the blocks found in solid
+				for ( int vertexID = 0; vertexID < pStudioMesh->numvertices; ++vertexID, ++numVertexes )
 				{
-					Vector sampleNormal;
-					Vector samplePosition;
-					// transform position and normal into world coordinate system
-					VectorTransform(*vertData->Position(vertexID), matPos, samplePosition);
-					VectorTransform(*vertData->Normal(vertexID), matNormal, sampleNormal);
-
-					if ( PositionInSolid( samplePosition ) )
-					{
-						// vertex is in solid, add to the bad list, and recover later
-						badVertex_t badVertex;
-						badVertex.m_ColorVertex = numVertexes;
-						badVertex.m_Position = samplePosition;
-						badVertex.m_Normal = sampleNormal;
-						badVerts.AddToTail( badVertex );
-					}
-					else
-					{
-						Vector direct_pos=samplePosition;
-
-
-
-						Vector directColor(0,0,0);
-						ComputeDirectLightingAtPoint( direct_pos,
-														sampleNormal, directColor, iThread,
-														skip_prop, nFlags );
-						Vector indirectColor(0,0,0);
-
-						if (g_bShowStaticPropNormals)
-						{
-							directColor= sampleNormal;
-							directColor += Vector(1.0,1.0,1.0);
-							directColor *= 50.0;
-						}
-						else
-						{
-							if (numbounce >= 1)
-								ComputeIndirectLightingAtPoint(
-									samplePosition, sampleNormal,
-									indirectColor, iThread, true,
-									( prop.m_Flags & STATIC_PROP_IGNORE_NORMALS) != 0 );
-						}
-
-						colorVerts[numVertexes].m_bValid = true;
-						colorVerts[numVertexes].m_Position = samplePosition;
-						VectorAdd( directColor, indirectColor, colorVerts[numVertexes].m_Color );
-					}
+					if ( colorVerts[numVertexes].m_bValid )
+						continue;
 
-					numVertexes++;
+					badVertex_t badVertex;
+					badVertex.m_ColorVertex = numVertexes;
+					VectorTransform(*vertData->Position(vertexID), matPos, badVertex.m_Position);
+					VectorTransform(*vertData->Normal(vertexID), matNormal, badVertex.m_Normal);
+					badVerts.AddToTail( badVertex );
 				}
 			}
 
@@ -1540,6 +1690,26 @@ void CVradStaticPropMgr::ComputeLighting( CStaticProp &prop, int iThread, int pr
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Trace rays from each unique vertex, accumulating direct and indirect
+// sources at each ray termination. Use the winding data to distribute the unique vertexes
+// into the rendering layout.
+//-----------------------------------------------------------------------------
+void CVradStaticPropMgr::ComputeLighting( CStaticProp &prop, int iThread, int prop_index, CComputeStaticPropLightingResults *pResults )
+{
+	VMPI_SetCurrentStage( "ComputeLighting" );
+
+	CUtlVector<PropVertexBlock_t> blocks;
+	SetupLighting( prop, prop_index, pResults, blocks );
+
+	for ( int i = 0; i < blocks.Count(); ++i )
+	{
+		LightVertexBlock( iThread, blocks[i] );
+	}
+
+	FinishLighting( prop, iThread, prop_index, pResults );
+}
+
 //-----------------------------------------------------------------------------
 // Write the lighitng to bsp pak lump
 //-----------------------------------------------------------------------------
@@ -1781,23 +1951,127 @@ void CVradStaticPropMgr::VMPI_ReceiveStaticPropResults( int iStaticProp, Message
 }
 
 
-void CVradStaticPropMgr::ComputeLightingForProp( int iThread, int iStaticProp )
+void CVradStaticPropMgr::FinishLightingForProp( int iThread, int iStaticProp )
 {
-	// Compute the lighting.
-	CComputeStaticPropLightingResults results;
-	ComputeLighting( m_StaticProps[iStaticProp], iThread, iStaticProp, &results );
-	ApplyLightingToStaticProp( iStaticProp, m_StaticProps[iStaticProp], &results );
+	// Copies are done once their original is
+	if ( m_SharedLighting[iStaticProp] != iStaticProp )
+		return;
+
+	FinishLighting( m_StaticProps[iStaticProp], iThread, iStaticProp, m_LightingResults[iStaticProp] );
+	ApplyLightingToStaticProp( iStaticProp, m_StaticProps[iStaticProp], m_LightingResults[iStaticProp] );
+
+	// Nobody else needs them, don't hold every prop's results until the end of the pass
+	if ( !m_LightingCopies[iStaticProp] )
+	{
+		delete m_LightingResults[iStaticProp];
+		m_LightingResults[iStaticProp] = NULL;
+	}
 }
 
-void CVradStaticPropMgr::ThreadComputeStaticPropLighting( int iThread, void *pUserData )
+void CVradStaticPropMgr::ThreadComputeStaticPropVertexLighting( int iThread, void *pUserData )
 {
 	while (1)
 	{
 		int j = GetThreadWork ();
 		if (j == -1)
 			break;
-		CComputeStaticPropLightingResults results;
-		g_StaticPropMgr.ComputeLightingForProp( iThread, j );
+		g_StaticPropMgr.LightVertexBlock( iThread, g_StaticPropMgr.m_VertexBlocks[j] );
+	}
+}
+
+void CVradStaticPropMgr::ThreadFinishStaticPropLighting( int iThread, void *pUserData )
+{
+	while (1)
+	{
+		int j = GetThreadWork ();
+		if (j == -1)
+			break;
+		g_StaticPropMgr.FinishLightingForProp( iThread, j );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Orders props so the ones that would light identically (same model, placement,
+// flags and lighting origin) end up next to each other.
+//-----------------------------------------------------------------------------
+int CVradStaticPropMgr::CompareStaticPropLighting( const int *pProp1, const int *pProp2 )
+{
+	const CStaticProp &prop1 = g_StaticPropMgr.m_StaticProps[*pProp1];
+	const CStaticProp &prop2 = g_StaticPropMgr.m_StaticProps[*pProp2];
+
+	if ( prop1.m_ModelIdx != prop2.m_ModelIdx )
+		return ( prop1.m_ModelIdx < prop2.m_ModelIdx ) ? -1 : 1;
+	if ( prop1.m_Flags != prop2.m_Flags )
+		return ( prop1.m_Flags < prop2.m_Flags ) ? -1 : 1;
+
+	int nCompare = memcmp( &prop1.m_Origin, &prop2.m_Origin, sizeof( Vector ) );
+	if ( nCompare )
+		return nCompare;
+	nCompare = memcmp( &prop1.m_Angles, &prop2.m_Angles, sizeof( QAngle ) );
+	if ( nCompare )
+		return nCompare;
+
+	if ( prop1.m_bLightingOriginValid != prop2.m_bLightingOriginValid )
+		return prop1.m_bLightingOriginValid ? 1 : -1;
+	if ( prop1.m_bLightingOriginValid )
+	{
+		nCompare = memcmp( &prop1.m_LightingOrigin, &prop2.m_LightingOrigin, sizeof( Vector ) );
+		if ( nCompare )
+			return nCompare;
+	}
+
+	if ( prop1.m_LightmapImageFormat != prop2.m_LightmapImageFormat )
+		return ( prop1.m_LightmapImageFormat < prop2.m_LightmapImageFormat ) ? -1 : 1;
+	if ( prop1.m_LightmapImageWidth != prop2.m_LightmapImageWidth )
+		return ( prop1.m_LightmapImageWidth < prop2.m_LightmapImageWidth ) ? -1 : 1;
+	if ( prop1.m_LightmapImageHeight != prop2.m_LightmapImageHeight )
+		return ( prop1.m_LightmapImageHeight < prop2.m_LightmapImageHeight ) ? -1 : 1;
+
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+// Props placed exactly on top of a copy of themselves see the same lights and
+// shadow each other the same way, so only the first of them gets lit.
+//-----------------------------------------------------------------------------
+void CVradStaticPropMgr::FindSharedLighting()
+{
+	int count = m_StaticProps.Count();
+	m_SharedLighting.SetCount( count );
+	m_LightingCopies.SetCount( count );
+
+	CUtlVector<int> sorted;
+	sorted.SetCount( count );
+	for ( int i = 0; i < count; ++i )
+	{
+		sorted[i] = i;
+	}
+	sorted.Sort( CompareStaticPropLighting );
+
+	int nShared = 0;
+	for ( int nFirst = 0; nFirst < count; )
+	{
+		int nEnd = nFirst + 1;
+		int nOriginal = sorted[nFirst];
+		while ( nEnd < count && !CompareStaticPropLighting( &sorted[nFirst], &sorted[nEnd] ) )
+		{
+			nOriginal = min( nOriginal, sorted[nEnd] );
+			++nEnd;
+		}
+
+		for ( int i = nFirst; i < nEnd; ++i )
+		{
+			m_SharedLighting[sorted[i]] = nOriginal;
+			m_LightingCopies[sorted[i]] = 0;
+		}
+		m_LightingCopies[nOriginal] = nEnd - nFirst - 1;
+		nShared += nEnd - nFirst - 1;
+		nFirst = nEnd;
+	}
+
+	if ( nShared )
+	{
+		qprintf( "%d static props are copies of another prop, sharing its lighting\n", nShared );
 	}
 }
 
@@ -1833,7 +2107,41 @@ void CVradStaticPropMgr::ComputeLighting( int iThread )
 	}
 	else
 	{
-		RunThreadsOn(count, true, ThreadComputeStaticPropLighting);
+		FindSharedLighting();
+
+		// Split the props into vertex blocks so one big prop doesn't hold up the threads
+		m_LightingResults.SetCount( count );
+		for ( int i = 0; i < count; ++i )
+		{
+			m_LightingResults[i] = NULL;
+			if ( m_SharedLighting[i] == i )
+			{
+				m_LightingResults[i] = new CComputeStaticPropLightingResults;
+				SetupLighting( m_StaticProps[i], i, m_LightingResults[i], m_VertexBlocks );
+			}
+		}
+
+		RunThreadsOn(m_VertexBlocks.Count(), true, ThreadComputeStaticPropVertexLighting);
+		RunThreadsOn(count, true, ThreadFinishStaticPropLighting);
+
+		for ( int i = 0; i < count; ++i )
+		{
+			int nOriginal = m_SharedLighting[i];
+			if ( nOriginal != i )
+			{
+				ApplyLightingToStaticProp( i, m_StaticProps[i], m_LightingResults[nOriginal] );
+				if ( !--m_LightingCopies[nOriginal] )
+				{
+					delete m_LightingResults[nOriginal];
+					m_LightingResults[nOriginal] = NULL;
+				}
+			}
+		}
+
+		m_LightingResults.PurgeAndDeleteElements();
+		m_VertexBlocks.Purge();
+		m_SharedLighting.Purge();
+		m_LightingCopies.Purge();
 	}
 
 	// restore default